@@ -0,0 +1,83 @@
+// Time and hardware counters per element of the ways to reach the elements of a FlatValueMap, to tell the pointer chasing through the
+// sparse_to_dense hash nodes apart from reading the dense array. Without access to the counters (see bench::PerfCounters) only the time is shown.
+// Build: g++ -O2 -std=c++17 -Iinclude -Ibenchmarks benchmarks/access_pattern_benchmark.cpp -o access_pattern_benchmark
+// Usage: access_pattern_benchmark [element count]
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "flat_value_map.h"
+#include "perf_counters.h"
+
+
+using namespace cof;
+
+struct Particle { float position[3]; float velocity[3]; std::uint32_t flags; std::uint32_t owner; };
+struct ParticleTag;
+
+using ParticleHandle = FvmHandle<ParticleTag>;
+using ParticleMap = FlatValueMap<ParticleHandle, Particle>;
+
+template<typename Func>
+static void region(const char* name, std::size_t operations, Func&& f)
+{
+	bench::PerfCounters counters{};
+	auto start = std::chrono::steady_clock::now();
+	counters.start();
+	std::uint64_t checksum = f();
+	counters.stop();
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(operations);
+	std::printf("%-26s %7.2f ns per element   (checksum %llu)\n", name, ns, static_cast<unsigned long long>(checksum % 1000));
+	counters.print("counters", operations);
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+	ParticleMap particles{};
+	std::vector<ParticleHandle> handles;
+	handles.reserve(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		handles.push_back(particles.push_back(Particle{ {}, {}, static_cast<std::uint32_t>(i), 0 }));
+	}
+	std::vector<ParticleHandle> shuffled = handles;
+	std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64{ 7 });
+
+	bench::PerfCounters probe{};
+	std::printf("%zu elements of %zu bytes, hardware counters %s\n", count, sizeof(Particle), probe.available() ? "available" : "not available");
+
+	region("iterate the dense array", count, [&]() {
+		std::uint64_t sum = 0;
+		for (const Particle& particle : particles) {
+			sum += particle.flags;
+		}
+		return sum;
+	});
+	region("operator[] in push order", count, [&]() {
+		std::uint64_t sum = 0;
+		for (ParticleHandle handle : handles) {
+			sum += particles[handle].flags;
+		}
+		return sum;
+	});
+	region("operator[] in random order", count, [&]() {
+		std::uint64_t sum = 0;
+		for (ParticleHandle handle : shuffled) {
+			sum += particles[handle].flags;
+		}
+		return sum;
+	});
+	region("contains() in random order", count, [&]() {
+		std::uint64_t sum = 0;
+		for (ParticleHandle handle : shuffled) {
+			sum += particles.contains(handle);
+		}
+		return sum;
+	});
+	return 0;
+}
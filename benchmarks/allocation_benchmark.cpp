@@ -0,0 +1,178 @@
+// Allocations and allocated bytes per operation of every container configuration, counted with cof::CountingAllocator.
+// Exits with 1 when a configuration allocates more then it's budget below, so a allocation regression fails the run.
+// Build: g++ -O2 -std=c++17 -Iinclude benchmarks/allocation_benchmark.cpp -o allocation_benchmark
+// Usage: allocation_benchmark [element count] [churn operations]
+#include <cstddef>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <unordered_map>
+
+#include "flat_value_map.h"
+#include "light_flat_value_map.h"
+#include "utils/counting_allocator.h"
+
+
+using namespace cof;
+
+struct Order { std::uint64_t id; std::uint64_t customer; double price; std::uint32_t quantity; std::uint32_t flags; };
+
+struct VectorTag;
+struct UnorderedMapTag;
+struct FlatTag;
+struct ReservedTag;
+struct PooledTag;
+struct LightTag;
+
+/// The most a configuration may allocate
+struct Budget
+{
+	// While filling a empty map, on top of one node per element
+	double fill_extra_allocations;
+	// Erasing and pushing at a constant size
+	double churn_erase_allocations;
+	double churn_insert_allocations;
+	double churn_insert_bytes;
+};
+
+// A push_back allocates one sparse_to_dense node (32 bytes with libstdc++ and MSVC), a erase nothing.
+// Filling without reserve() adds the reallocations of the three arrays and the rehashes, a few for every doubling of the size.
+static const Budget node_only{ 0.0, 0.0, 1.0, 48.0 };
+static const Budget with_growth{ 3.0 * 64, 0.0, 1.0, 48.0 };
+
+struct Result
+{
+	AllocationCounts fill;
+	AllocationCounts churn_erase;
+	AllocationCounts churn_insert;
+};
+
+static void add(AllocationCounts& total, const AllocationCounts& counts)
+{
+	total.allocations += counts.allocations;
+	total.allocated_bytes += counts.allocated_bytes;
+}
+
+template<typename Tag, typename Map>
+static Result measure_map(Map& map, std::size_t count, std::size_t churn_operations)
+{
+	Result result{};
+	std::vector<typename Map::HandleType> handles;
+	handles.reserve(count);
+	AllocationCounts before = allocation_counts<Tag>();
+	for (std::size_t i = 0; i < count; ++i) {
+		handles.push_back(map.push_back(Order{ i, i % 97, 1.0, 1, 0 }));
+	}
+	result.fill = allocation_counts<Tag>() - before;
+
+	for (std::size_t i = 0; i < churn_operations; ++i) {
+		std::size_t oldest = i % count;
+		AllocationCounts start = allocation_counts<Tag>();
+		map.erase(handles[oldest]);
+		AllocationCounts between = allocation_counts<Tag>();
+		handles[oldest] = map.push_back(Order{ i, i % 97, 1.0, 1, 0 });
+		add(result.churn_erase, between - start);
+		add(result.churn_insert, allocation_counts<Tag>() - between);
+	}
+	return result;
+}
+
+static Result measure_unordered_map(std::size_t count, std::size_t churn_operations)
+{
+	using Allocator = CountingAllocator<std::pair<const std::uint64_t, Order>, UnorderedMapTag>;
+	std::unordered_map<std::uint64_t, Order, std::hash<std::uint64_t>, std::equal_to<std::uint64_t>, Allocator> map{};
+	Result result{};
+	AllocationCounts before = allocation_counts<UnorderedMapTag>();
+	for (std::size_t i = 0; i < count; ++i) {
+		map.emplace(i, Order{ i, i % 97, 1.0, 1, 0 });
+	}
+	result.fill = allocation_counts<UnorderedMapTag>() - before;
+
+	for (std::size_t i = 0; i < churn_operations; ++i) {
+		AllocationCounts start = allocation_counts<UnorderedMapTag>();
+		map.erase(i);
+		AllocationCounts between = allocation_counts<UnorderedMapTag>();
+		map.emplace(count + i, Order{ count + i, i % 97, 1.0, 1, 0 });
+		add(result.churn_erase, between - start);
+		add(result.churn_insert, allocation_counts<UnorderedMapTag>() - between);
+	}
+	return result;
+}
+
+static double per_operation(std::uint64_t value, std::size_t operations)
+{
+	return static_cast<double>(value) / static_cast<double>(operations == 0 ? 1 : operations);
+}
+
+// Print the result, \returns false if it is over `budget`
+static bool report(const char* name, const Result& result, std::size_t count, std::size_t churn_operations, const Budget* budget)
+{
+	double fill = per_operation(result.fill.allocations, count);
+	double erase = per_operation(result.churn_erase.allocations, churn_operations);
+	double insert = per_operation(result.churn_insert.allocations, churn_operations);
+	double insert_bytes = per_operation(result.churn_insert.allocated_bytes, churn_operations);
+	std::printf("%-30s fill: %6.3f allocs %7.1f B   churn erase: %6.3f allocs   churn insert: %6.3f allocs %7.1f B",
+		name, fill, per_operation(result.fill.allocated_bytes, count), erase, insert, insert_bytes);
+
+	if (budget == nullptr) {
+		std::printf("\n");
+		return true;
+	}
+	bool within = static_cast<double>(result.fill.allocations) <= static_cast<double>(count) + budget->fill_extra_allocations && erase <= budget->churn_erase_allocations
+		&& insert <= budget->churn_insert_allocations && insert_bytes <= budget->churn_insert_bytes;
+	std::printf("   %s\n", within ? "ok" : "OVER BUDGET");
+	return within;
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+	std::size_t churn_operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+	if (count == 0) {
+		std::fprintf(stderr, "The element count must be at least 1\n");
+		return 1;
+	}
+	std::printf("%zu elements of %zu bytes, %zu erases and push_backs at that size\n", count, sizeof(Order), churn_operations);
+	bool within_budget = true;
+
+	{
+		std::vector<Order, CountingAllocator<Order, VectorTag>> orders{};
+		AllocationCounts before = allocation_counts<VectorTag>();
+		for (std::size_t i = 0; i < count; ++i) {
+			orders.push_back(Order{ i, i % 97, 1.0, 1, 0 });
+		}
+		Result result{};
+		result.fill = allocation_counts<VectorTag>() - before;
+		report("std::vector (fill only)", result, count, 0, nullptr);
+	}
+	report("std::unordered_map", measure_unordered_map(count, churn_operations), count, churn_operations, nullptr);
+
+	{
+		FlatValueMap<FvmHandle<FlatTag>, Order, CountingAllocator<Order, FlatTag>> orders{};
+		within_budget &= report("FlatValueMap", measure_map<FlatTag>(orders, count, churn_operations), count, churn_operations, &with_growth);
+	}
+	{
+		FlatValueMap<FvmHandle<ReservedTag>, Order, CountingAllocator<Order, ReservedTag>> orders{};
+		orders.reserve(count);
+		within_budget &= report("FlatValueMap after reserve()", measure_map<ReservedTag>(orders, count, churn_operations), count, churn_operations, &node_only);
+	}
+	{
+		FlatValueMap<FvmHandle<PooledTag>, Order, CountingAllocator<Order, PooledTag>> orders{};
+		orders.enable_value_pool();
+		within_budget &= report("FlatValueMap with value pool", measure_map<PooledTag>(orders, count, churn_operations), count, churn_operations, &with_growth);
+	}
+	{
+		LightFlatValueMap<LfvmHandle<LightTag>, Order, CountingAllocator<Order, LightTag>> orders{};
+		// The erases search the whole hash map, keep them to a reasonable amount
+		std::size_t light_churn = churn_operations < 10000 ? churn_operations : 10000;
+		within_budget &= report("LightFlatValueMap", measure_map<LightTag>(orders, count, light_churn), count, light_churn, &with_growth);
+	}
+
+	if (!within_budget) {
+		std::printf("A configuration is over it's allocation budget\n");
+		return 1;
+	}
+	return 0;
+}
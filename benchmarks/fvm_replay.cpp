@@ -0,0 +1,135 @@
+// Replays a trace recorded with cof::TraceRecorder against several container configurations, and reports the throughput and the latency percentiles per operation.
+// Build: g++ -O2 -std=c++17 -Iinclude -Ibenchmarks benchmarks/fvm_replay.cpp -o fvm_replay
+// Usage: fvm_replay <trace>
+//        fvm_replay --record-sample <trace> [operations]   records a synthetic trace, to try the replay without a production trace
+#include <cstddef>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "flat_value_map.h"
+#include "light_flat_value_map.h"
+#include "flat_value_map_trace.h"
+#include "utils/huge_page_allocator.h"
+#include "benchmark_utils.h"
+
+
+using namespace cof;
+
+// A element with the size of the traced elements
+template<std::size_t Size>
+struct Payload
+{
+	unsigned char bytes[Size];
+};
+
+template<typename Map>
+static void replay(const char* name, const std::vector<TraceEvent>& events)
+{
+	Map map{};
+	TraceReplayer<Map> replayer{ events };
+	replayer.prepare(map);
+
+	bench::LatencyHistogram latencies[5];
+	std::uint64_t start = bench::now_ns();
+	for (const TraceEvent& event : events) {
+		std::uint64_t event_start = bench::now_ns();
+		replayer.replay(map, event);
+		latencies[static_cast<int>(event.op) - 1].record(bench::now_ns() - event_start);
+	}
+	double seconds = static_cast<double>(bench::now_ns() - start) / 1e9;
+
+	std::printf("%s: %.2f M events/s (checksum %u)\n", name, static_cast<double>(events.size()) / seconds / 1e6, replayer.checksum());
+	const char* op_names[5] = { "push_back", "erase", "access", "iterate", "clear" };
+	for (int op = 0; op < 5; ++op) {
+		if (latencies[op].count() != 0) {
+			latencies[op].print(op_names[op], "ns");
+		}
+	}
+}
+
+template<std::size_t Size>
+static void replay_all(const std::vector<TraceEvent>& events)
+{
+	struct Tag;
+	using Value = Payload<Size>;
+	using Handle = FvmHandle<Tag>;
+	replay<FlatValueMap<Handle, Value>>("FlatValueMap", events);
+	replay<LightFlatValueMap<LfvmHandle<Tag>, Value>>("LightFlatValueMap", events);
+	replay<FlatValueMap<Handle, Value, HugePageAllocator<Value>>>("FlatValueMap + HugePageAllocator", events);
+}
+
+// A mix of inserts, erases, skewed lookups and a few full scans through a TracedMap
+static int record_sample(const char* path, std::size_t operations)
+{
+	struct SampleTag;
+	using Value = Payload<64>;
+	TraceRecorder recorder{ path, sizeof(Value) };
+	if (!recorder.is_open()) {
+		std::fprintf(stderr, "Can not create %s\n", path);
+		return 1;
+	}
+	TracedMap<FlatValueMap<FvmHandle<SampleTag>, Value>> map{ &recorder };
+	std::vector<FvmHandle<SampleTag>> handles;
+	std::mt19937_64 rng{ 1 };
+	for (std::size_t i = 0; i < operations; ++i) {
+		std::uint64_t dice = rng() % 1000;
+		if (handles.size() < 1000 || dice < 200) {
+			handles.push_back(map.push_back(Value{}));
+		} else if (dice < 350) {
+			std::size_t index = rng() % handles.size();
+			map.erase(handles[index]);
+			handles[index] = handles.back();
+			handles.pop_back();
+		} else if (dice < 999) {
+			// Most lookups go to the newest elements
+			std::size_t recent = handles.size() < 4096 ? handles.size() : 4096;
+			std::size_t index = rng() % 4 == 0 ? rng() % handles.size() : handles.size() - 1 - rng() % recent;
+			map[handles[index]].bytes[0]++;
+		} else {
+			for (Value& value : map) {
+				value.bytes[1]++;
+			}
+		}
+	}
+	std::printf("Recorded %llu events to %s\n", static_cast<unsigned long long>(recorder.event_count()), path);
+	return recorder.close() ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc >= 3 && std::strcmp(argv[1], "--record-sample") == 0) {
+		return record_sample(argv[2], argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 5000000);
+	}
+	if (argc != 2) {
+		std::fprintf(stderr, "Usage: %s <trace>\n       %s --record-sample <trace> [operations]\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	std::vector<TraceEvent> events;
+	std::uint32_t value_size = 0;
+	if (!read_trace(argv[1], events, &value_size)) {
+		std::fprintf(stderr, "%s is not a trace\n", argv[1]);
+		return 1;
+	}
+	std::printf("%zu events, elements of %u bytes\n", events.size(), value_size);
+
+	if (value_size <= 8) {
+		replay_all<8>(events);
+	} else if (value_size <= 16) {
+		replay_all<16>(events);
+	} else if (value_size <= 32) {
+		replay_all<32>(events);
+	} else if (value_size <= 64) {
+		replay_all<64>(events);
+	} else if (value_size <= 128) {
+		replay_all<128>(events);
+	} else {
+		replay_all<256>(events);
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+// Random lookup latency of a large FlatValueMap with normal pages and with a HugePageAllocator.
+// Build: g++ -O2 -std=c++17 -Iinclude -Ibenchmarks benchmarks/huge_page_benchmark.cpp -o huge_page_benchmark
+// Usage: huge_page_benchmark [element count] [lookup count]
+#include <cstddef>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "flat_value_map.h"
+#include "utils/huge_page_allocator.h"
+#include "perf_counters.h"
+
+
+using namespace cof;
+
+struct Row { std::uint64_t key; std::uint64_t payload[7]; };
+struct NormalTag;
+struct HugeTag;
+
+// Sum of the AnonHugePages lines of /proc/self/smaps_rollup in kB, -1 if it can not be read
+static long anon_huge_pages_kb()
+{
+	std::ifstream rollup{ "/proc/self/smaps_rollup" };
+	std::string line;
+	while (std::getline(rollup, line)) {
+		if (line.compare(0, 14, "AnonHugePages:") == 0) {
+			return std::strtol(line.c_str() + 14, nullptr, 10);
+		}
+	}
+	return -1;
+}
+
+template<typename Map>
+static void run(const char* name, std::size_t element_count, std::size_t lookup_count)
+{
+	long huge_pages_before = anon_huge_pages_kb();
+	Map map{};
+	std::vector<typename Map::HandleType> handles;
+	handles.reserve(element_count);
+	for (std::size_t i = 0; i < element_count; ++i) {
+		handles.push_back(map.push_back(Row{ i, {} }));
+	}
+	long huge_pages_after = anon_huge_pages_kb();
+
+	std::mt19937_64 rng{ 42 };
+	std::vector<std::uint32_t> indices(lookup_count);
+	for (std::uint32_t& index : indices) {
+		index = static_cast<std::uint32_t>(rng() % element_count);
+	}
+
+	// Only the dense array, this is where the page size matters most
+	bench::PerfCounters dense_counters{};
+	std::uint64_t sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	dense_counters.start();
+	const Row* rows = map.data();
+	for (std::uint32_t index : indices) {
+		sum += rows[index].key;
+	}
+	dense_counters.stop();
+	double dense_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookup_count;
+
+	// Through the handle, this also walks sparse_to_dense. It's bucket array is allocated by the rebound HugePageAllocator and is above the threshold, so it is in huge pages too.
+	// The hash nodes are allocated one by one below the threshold and stay on normal pages, their TLB misses are what is left of the difference
+	bench::PerfCounters handle_counters{};
+	start = std::chrono::steady_clock::now();
+	handle_counters.start();
+	for (std::uint32_t index : indices) {
+		sum += map[handles[index]].key;
+	}
+	handle_counters.stop();
+	double handle_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookup_count;
+
+	std::printf("%-22s dense index: %6.1f ns   operator[]: %6.1f ns   AnonHugePages: %ld MB   (checksum %llu)\n",
+		name, dense_ns, handle_ns, (huge_pages_after - huge_pages_before) / 1024, static_cast<unsigned long long>(sum % 1000));
+	dense_counters.print("dense index", lookup_count);
+	handle_counters.print("operator[]", lookup_count);
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t element_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+	std::size_t lookup_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000000;
+	std::printf("%zu elements of %zu bytes (%zu MB dense array), %zu random lookups\n",
+		element_count, sizeof(Row), element_count * sizeof(Row) / (1024 * 1024), lookup_count);
+
+	run<FlatValueMap<FvmHandle<NormalTag>, Row>>("std::allocator", element_count, lookup_count);
+	run<FlatValueMap<FvmHandle<HugeTag>, Row, HugePageAllocator<Row>>>("HugePageAllocator", element_count, lookup_count);
+	return 0;
+}
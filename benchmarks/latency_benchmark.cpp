@@ -0,0 +1,134 @@
+// The latency of every single insert and erase, as p50/p99/p999/max per container, to show the tail that a average hides:
+// rehashes of the unordered_map, reallocations of the dense vector and the O(n) handle search in LightFlatValueMap::erase().
+// Build: g++ -O2 -std=c++17 -Iinclude -Ibenchmarks benchmarks/latency_benchmark.cpp -o latency_benchmark
+// Usage: latency_benchmark [element count] [repetitions]
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+
+#include "flat_value_map.h"
+#include "light_flat_value_map.h"
+#include "benchmark_utils.h"
+
+
+using namespace cof;
+
+struct Body { float position[3]; float velocity[3]; std::uint32_t flags; std::uint32_t owner; };
+struct BodyTag;
+
+struct Latencies
+{
+	bench::LatencyHistogram insert;
+	bench::LatencyHistogram erase;
+};
+
+// A random order to erase a tenth of the elements in, erasing them all from a LightFlatValueMap takes quadratic time
+static std::vector<std::size_t> erase_order(std::size_t count, std::uint64_t seed)
+{
+	std::vector<std::size_t> order(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		order[i] = i;
+	}
+	std::shuffle(order.begin(), order.end(), std::mt19937_64{ seed });
+	order.resize(count / 10);
+	return order;
+}
+
+template<typename Map>
+static void measure_inserts_and_erases(Map& map, Latencies& latencies, std::size_t count, std::size_t repetition)
+{
+	std::vector<typename Map::HandleType> handles;
+	handles.reserve(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		std::uint64_t start = bench::ticks();
+		handles.push_back(map.push_back(Body{}));
+		latencies.insert.record(bench::ticks_to_ns(bench::ticks() - start));
+	}
+	for (std::size_t index : erase_order(count, repetition)) {
+		std::uint64_t start = bench::ticks();
+		map.erase(handles[index]);
+		latencies.erase.record(bench::ticks_to_ns(bench::ticks() - start));
+	}
+}
+
+template<typename Map>
+static void measure_map(Latencies& latencies, std::size_t count, std::size_t repetition)
+{
+	Map map{};
+	measure_inserts_and_erases(map, latencies, count, repetition);
+}
+
+// No reallocations and rehashes while inserting
+template<typename Map>
+static void measure_reserved_map(Latencies& latencies, std::size_t count, std::size_t repetition)
+{
+	Map map{};
+	map.reserve(count);
+	measure_inserts_and_erases(map, latencies, count, repetition);
+}
+
+static void measure_unordered_map(Latencies& latencies, std::size_t count, std::size_t repetition)
+{
+	std::unordered_map<std::uint64_t, Body> map{};
+	for (std::size_t i = 0; i < count; ++i) {
+		std::uint64_t start = bench::ticks();
+		map.emplace(i, Body{});
+		latencies.insert.record(bench::ticks_to_ns(bench::ticks() - start));
+	}
+	for (std::size_t index : erase_order(count, repetition)) {
+		std::uint64_t start = bench::ticks();
+		map.erase(index);
+		latencies.erase.record(bench::ticks_to_ns(bench::ticks() - start));
+	}
+}
+
+// Erase is a swap with the back and a pop_back, the same as the dense vector of the maps but without a index to fix up
+static void measure_vector(Latencies& latencies, std::size_t count, std::size_t repetition)
+{
+	std::vector<Body> bodies{};
+	for (std::size_t i = 0; i < count; ++i) {
+		std::uint64_t start = bench::ticks();
+		bodies.push_back(Body{});
+		latencies.insert.record(bench::ticks_to_ns(bench::ticks() - start));
+	}
+	for (std::size_t index : erase_order(count, repetition)) {
+		std::uint64_t start = bench::ticks();
+		std::size_t position = index < bodies.size() ? index : index % bodies.size();
+		bodies[position] = bodies.back();
+		bodies.pop_back();
+		latencies.erase.record(bench::ticks_to_ns(bench::ticks() - start));
+	}
+}
+
+template<typename Measure>
+static void run(const char* name, Measure measure, std::size_t count, std::size_t repetitions)
+{
+	Latencies latencies{};
+	for (std::size_t repetition = 0; repetition < repetitions; ++repetition) {
+		measure(latencies, count, repetition);
+	}
+	std::printf("%s\n", name);
+	latencies.insert.print("insert", "ns");
+	latencies.erase.print("erase", "ns");
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+	std::size_t repetitions = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 5;
+	std::printf("%zu inserts and %zu erases, %zu times, %.3f ns per tick\n", count, count / 10, repetitions, bench::ns_per_tick());
+
+	using BodyMap = FlatValueMap<FvmHandle<BodyTag>, Body>;
+	using LightBodyMap = LightFlatValueMap<LfvmHandle<BodyTag>, Body>;
+	run("std::vector", measure_vector, count, repetitions);
+	run("std::unordered_map", measure_unordered_map, count, repetitions);
+	run("FlatValueMap", measure_map<BodyMap>, count, repetitions);
+	run("FlatValueMap after reserve()", measure_reserved_map<BodyMap>, count, repetitions);
+	run("LightFlatValueMap", measure_map<LightBodyMap>, count, repetitions);
+	return 0;
+}
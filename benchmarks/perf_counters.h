@@ -0,0 +1,192 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace bench
+{
+	/// The hardware events PerfCounters counts
+	enum class PerfEvent
+	{
+		instructions = 0,
+		cycles = 1,
+		cache_misses = 2,
+		branch_misses = 3,
+		// Data TLB misses of loads
+		dtlb_misses = 4,
+	};
+
+	/** \brief Counts hardware events of the calling thread with `perf_event_open()` around a region of a benchmark, to show where the time of a operation goes.
+	 *
+	 * \class PerfCounters
+	 *
+	 * Every event is opened on it's own, so a CPU or VM without a TLB miss counter still reports the other events. Events that can not be opened
+	 * (no PMU in the VM, `perf_event_paranoid` above 2, or not Linux) are reported as "n/a", the benchmark itself still runs.
+	 * When the kernel has more events then hardware counters it multiplexes them, the counts are scaled up to the full region.
+	*/
+	class PerfCounters
+	{
+	public:
+		static constexpr std::size_t event_count = 5;
+
+		PerfCounters();
+		PerfCounters(const PerfCounters&) = delete;
+		PerfCounters& operator=(const PerfCounters&) = delete;
+		~PerfCounters();
+
+		// \returns false if none of the events could be opened
+		bool available() const;
+		bool available(PerfEvent event) const;
+
+		// Reset the counts and start counting
+		void start();
+		// Stop counting, the counts stay readable until the next start()
+		void stop();
+		// The count of the last region, 0 if the event is not available
+		std::uint64_t value(PerfEvent event) const;
+
+		// Print "<name> instructions cycles cache misses branch misses dTLB misses", every count divided by `operations`. Prints nothing when available() is false
+		void print(const char* name, std::size_t operations) const;
+
+	private:
+		int descriptors[event_count];
+		std::uint64_t counts[event_count];
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace bench
+{
+	namespace detail
+	{
+#if defined(__linux__)
+		inline int open_perf_event(std::uint32_t type, std::uint64_t config)
+		{
+			perf_event_attr attributes;
+			std::memset(&attributes, 0, sizeof(attributes));
+			attributes.size = sizeof(attributes);
+			attributes.type = type;
+			attributes.config = config;
+			attributes.disabled = 1;
+			// Only the benchmark, this is also what perf_event_paranoid 2 allows without privileges
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+		}
+#endif // END: __linux__
+	}
+
+	inline PerfCounters::PerfCounters()
+	{
+		for (std::size_t i = 0; i < event_count; ++i) {
+			descriptors[i] = -1;
+			counts[i] = 0;
+		}
+#if defined(__linux__)
+		descriptors[static_cast<int>(PerfEvent::instructions)] = detail::open_perf_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		descriptors[static_cast<int>(PerfEvent::cycles)] = detail::open_perf_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		descriptors[static_cast<int>(PerfEvent::cache_misses)] = detail::open_perf_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		descriptors[static_cast<int>(PerfEvent::branch_misses)] = detail::open_perf_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+		descriptors[static_cast<int>(PerfEvent::dtlb_misses)] = detail::open_perf_event(PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif // END: __linux__
+	}
+
+	inline PerfCounters::~PerfCounters()
+	{
+#if defined(__linux__)
+		for (int descriptor : descriptors) {
+			if (descriptor >= 0) {
+				close(descriptor);
+			}
+		}
+#endif // END: __linux__
+	}
+
+	inline bool PerfCounters::available() const
+	{
+		for (int descriptor : descriptors) {
+			if (descriptor >= 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline bool PerfCounters::available(PerfEvent event) const
+	{
+		return descriptors[static_cast<int>(event)] >= 0;
+	}
+
+	inline void PerfCounters::start()
+	{
+#if defined(__linux__)
+		for (int descriptor : descriptors) {
+			if (descriptor >= 0) {
+				ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+				ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif // END: __linux__
+	}
+
+	inline void PerfCounters::stop()
+	{
+#if defined(__linux__)
+		for (int descriptor : descriptors) {
+			if (descriptor >= 0) {
+				ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+		for (std::size_t i = 0; i < event_count; ++i) {
+			counts[i] = 0;
+			// The count, the time the event was enabled and the time it was on a hardware counter
+			std::uint64_t values[3] = {};
+			if (descriptors[i] < 0 || read(descriptors[i], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+				continue;
+			}
+			if (values[2] != 0 && values[2] < values[1]) {
+				counts[i] = static_cast<std::uint64_t>(static_cast<double>(values[0]) * static_cast<double>(values[1]) / static_cast<double>(values[2]));
+			} else {
+				counts[i] = values[0];
+			}
+		}
+#endif // END: __linux__
+	}
+
+	inline std::uint64_t PerfCounters::value(PerfEvent event) const
+	{
+		return counts[static_cast<int>(event)];
+	}
+
+	inline void PerfCounters::print(const char* name, std::size_t operations) const
+	{
+		if (!available()) {
+			return;
+		}
+		const char* labels[event_count] = { "instructions", "cycles", "cache misses", "branch misses", "dTLB misses" };
+		std::printf("  %-12s per op:", name);
+		for (std::size_t i = 0; i < event_count; ++i) {
+			if (descriptors[i] >= 0) {
+				std::printf("  %s %.2f", labels[i], static_cast<double>(counts[i]) / static_cast<double>(operations == 0 ? 1 : operations));
+			} else {
+				std::printf("  %s n/a", labels[i]);
+			}
+		}
+		std::printf("\n");
+	}
+}
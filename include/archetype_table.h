@@ -0,0 +1,477 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flat_value_map_handle.h"
+#include "utils/component_column.h"
+#include "utils/tmp_compatibility.h"
+
+
+namespace cof
+{
+	namespace detail
+	{
+		// If `T` is one of `Ts`
+		template<typename T, typename... Ts>
+		struct is_one_of : std::false_type {};
+		template<typename T, typename U, typename... Ts>
+		struct is_one_of<T, U, Ts...> : std::conditional<std::is_same<T, U>::value, std::true_type, is_one_of<T, Ts...>>::type {};
+
+		// If every type in `Ts` is used only once
+		template<typename... Ts>
+		struct are_distinct : std::true_type {};
+		template<typename T, typename... Ts>
+		struct are_distinct<T, Ts...> : std::integral_constant<bool, !is_one_of<T, Ts...>::value && are_distinct<Ts...>::value> {};
+	}
+
+	/** \brief Storage for entities with different sets of components, without a FlatValueMap per component type.
+	 *
+	 * \class ArchetypeTable
+	 *
+	 * Every distinct set of component types (a archetype) gets it's own table, with one contiguous column per component type and one row per entity.
+	 * A single sparse_to_dense map maps every handle to it's (archetype, row). Inside a archetype rows are erased with the swap erase idiom, like FlatValueMap.
+	 * Adding or removing a component moves the whole row to the archetype of the new component set, the archetype transitions are cached per archetype so that is one lookup.
+	 * for_each() and for_each_chunk() only visit the archetypes that have all requested components, and walk their columns linearly.
+	*/
+	template<typename SparseHandle>
+	class ArchetypeTable
+	{
+	public:
+		using HandleType = SparseHandle;
+
+	private:
+		struct Archetype
+		{
+			// The component ids of this archetype, sorted
+			std::vector<ComponentId> signature;
+			// The column of every component, in the same order as the signature
+			std::vector<ComponentColumn> columns;
+			// The handle of every row
+			std::vector<HandleType> handles;
+			// Cached archetype index after adding or removing a component
+			std::unordered_map<ComponentId, std::size_t> add_transitions;
+			std::unordered_map<ComponentId, std::size_t> remove_transitions;
+
+			// \returns the index of the column of this component, or `columns.size()` if this archetype does not have it
+			std::size_t column_index(ComponentId component) const;
+		};
+
+		struct EntityLocation
+		{
+			std::uint32_t archetype;
+			std::uint32_t row;
+		};
+
+		using SparseToDenseMap = std::unordered_map<HandleType, EntityLocation>;
+
+		// The archetype at index 0 has no components
+		std::vector<Archetype> archetypes;
+		// The sparse_to_dense map is used for finding the archetype and row from a sparse handle
+		SparseToDenseMap sparse_to_dense{};
+
+		static uint32_t internalIdCounter;
+
+	public:
+		ArchetypeTable();
+
+		/// \Category Element access
+
+		// Check if this table contains a entity with this handle
+		bool contains(HandleType handle) const;
+		// Check if the entity with this handle has a `T` component
+		template<typename T>
+		bool has(HandleType handle) const;
+		// Get the `T` component of the entity with this handle, the entity has to have one
+		template<typename T>
+		auto get(HandleType handle)->T&;
+		// Get the const `T` component of the entity with this handle, the entity has to have one
+		template<typename T>
+		auto get(HandleType handle) const->const T&;
+		// \returns the `T` component of the entity with this handle, or nullptr if it has none
+		template<typename T>
+		auto try_get(HandleType handle)->T*;
+
+
+		/// \Category Capacity
+
+		// The amount of entities in this table
+		std::size_t size() const;
+		// \returns if there are no entities in this table
+		bool empty() const;
+		// The amount of distinct component sets that were used so far
+		std::size_t archetype_count() const;
+
+
+		/// \Category Modifiers
+
+		// Create a entity with the given components, the component types have to be distinct (checked at compile time)
+		template<typename... Components>
+		auto create(Components&&... components)->HandleType;
+		// Give the entity with this handle a `T` component constructed from `args`. If it already has one, it is assigned.
+		// Moves the entity to the archetype with `T` added.
+		template<typename T, typename... Args>
+		auto add(HandleType handle, Args&&... args)->T&;
+		// Remove the `T` component of the entity with this handle, moving the entity to the archetype without `T`
+		template<typename T>
+		void remove(HandleType handle);
+		// Destroy the entity with this handle and all of it's components
+		void destroy(HandleType handle);
+		// Destroy all entities, the archetypes are kept
+		void clear();
+
+
+		/// \Category Queries
+
+		// Call `function(HandleType, Components&...)` for every entity that has all `Components`, a component can be queried as `const T` to only read it
+		// The table should not be modified from inside `function`.
+		template<typename... Components, typename Function>
+		void for_each(Function&& function);
+		// Call `function(std::size_t count, const HandleType* handles, Components*... columns)` once for every archetype that has all `Components` and at least one entity.
+		// The columns are contiguous arrays of `count` elements, useful for vectorized loops. The table should not be modified from inside `function`.
+		template<typename... Components, typename Function>
+		void for_each_chunk(Function&& function);
+
+	private:
+		// Get the archetype with `component` added to (or removed from) the signature of `archetype_index`, creating it if needed
+		std::size_t archetype_with(std::size_t archetype_index, const ComponentInfo& component);
+		std::size_t archetype_without(std::size_t archetype_index, ComponentId component);
+		std::size_t find_or_create_archetype(std::vector<const ComponentInfo*> components);
+
+		// Move the components the target archetype also has, then swap erase the row from it's old archetype
+		void move_row(HandleType handle, std::size_t target_archetype);
+		void erase_row(std::size_t archetype_index, std::size_t row);
+
+		template<typename... Components, typename Function, std::size_t... Indices>
+		void for_each_chunk_impl(Function&& function, std::index_sequence<Indices...>);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle>
+	uint32_t ArchetypeTable<SparseHandle>::internalIdCounter = 0;
+
+
+	template<typename SparseHandle>
+	std::size_t ArchetypeTable<SparseHandle>::Archetype::column_index(ComponentId component) const
+	{
+		auto it = std::lower_bound(signature.begin(), signature.end(), component);
+		if (it == signature.end() || *it != component) {
+			return columns.size();
+		}
+		return static_cast<std::size_t>(it - signature.begin());
+	}
+
+	template<typename SparseHandle>
+	ArchetypeTable<SparseHandle>::ArchetypeTable()
+	{
+		archetypes.emplace_back();
+	}
+
+	template<typename SparseHandle>
+	bool ArchetypeTable<SparseHandle>::contains(HandleType handle) const
+	{
+		return sparse_to_dense.find(handle) != sparse_to_dense.end();
+	}
+
+	template<typename SparseHandle>
+	template<typename T>
+	bool ArchetypeTable<SparseHandle>::has(HandleType handle) const
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		assert(sparse_to_dense_it != sparse_to_dense.end());
+		const Archetype& archetype = archetypes[sparse_to_dense_it->second.archetype];
+		return archetype.column_index(component_info<T>().id) != archetype.columns.size();
+	}
+
+	template<typename SparseHandle>
+	template<typename T>
+	auto ArchetypeTable<SparseHandle>::get(HandleType handle) -> T&
+	{
+		T* component = try_get<T>(handle);
+		assert(component != nullptr);
+		return *component;
+	}
+
+	template<typename SparseHandle>
+	template<typename T>
+	auto ArchetypeTable<SparseHandle>::get(HandleType handle) const -> const T&
+	{
+		return const_cast<ArchetypeTable*>(this)->get<T>(handle);
+	}
+
+	template<typename SparseHandle>
+	template<typename T>
+	auto ArchetypeTable<SparseHandle>::try_get(HandleType handle) -> T*
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		assert(sparse_to_dense_it != sparse_to_dense.end());
+		EntityLocation location = sparse_to_dense_it->second;
+		Archetype& archetype = archetypes[location.archetype];
+		std::size_t column = archetype.column_index(component_info<T>().id);
+		if (column == archetype.columns.size()) {
+			return nullptr;
+		}
+		return archetype.columns[column].template data<T>() + location.row;
+	}
+
+	template<typename SparseHandle>
+	std::size_t ArchetypeTable<SparseHandle>::size() const
+	{
+		return sparse_to_dense.size();
+	}
+
+	template<typename SparseHandle>
+	bool ArchetypeTable<SparseHandle>::empty() const
+	{
+		return sparse_to_dense.empty();
+	}
+
+	template<typename SparseHandle>
+	std::size_t ArchetypeTable<SparseHandle>::archetype_count() const
+	{
+		return archetypes.size();
+	}
+
+	template<typename SparseHandle>
+	template<typename ... Components>
+	auto ArchetypeTable<SparseHandle>::create(Components&&... components) -> HandleType
+	{
+		static_assert(detail::are_distinct<typename std::decay<Components>::type...>::value, "Every component type can only be used once per entity");
+		std::size_t archetype_index = find_or_create_archetype({ &component_info<typename std::decay<Components>::type>()... });
+		Archetype& archetype = archetypes[archetype_index];
+
+		uint32_t element_id = ++internalIdCounter;
+		std::size_t row = archetype.handles.size();
+		archetype.handles.push_back(HandleType{ element_id });
+		// Every column gets the component of it's type, in the order of the signature
+		int expand[] = { 0, (archetype.columns[archetype.column_index(component_info<typename std::decay<Components>::type>().id)]
+			.template emplace_back<typename std::decay<Components>::type>(std::forward<Components>(components)), 0)... };
+		(void)expand;
+
+		sparse_to_dense.emplace(HandleType{ element_id }, EntityLocation{ static_cast<std::uint32_t>(archetype_index), static_cast<std::uint32_t>(row) });
+		return HandleType{ element_id };
+	}
+
+	template<typename SparseHandle>
+	template<typename T, typename ... Args>
+	auto ArchetypeTable<SparseHandle>::add(HandleType handle, Args&&... args) -> T&
+	{
+		if (T* existing = try_get<T>(handle)) {
+			*existing = T(std::forward<Args>(args)...);
+			return *existing;
+		}
+
+		const ComponentInfo& component = component_info<T>();
+		std::size_t target_archetype = archetype_with(sparse_to_dense.find(handle)->second.archetype, component);
+
+		// Construct the new component first, if that throws the entity stays in it's old archetype.
+		// move_row() does not touch this column, the component ends up in the row the entity is moved to
+		Archetype& archetype = archetypes[target_archetype];
+		ComponentColumn& column = archetype.columns[archetype.column_index(component.id)];
+		T& added = column.template emplace_back<T>(std::forward<Args>(args)...);
+		try {
+			move_row(handle, target_archetype);
+		} catch (...) {
+			column.swap_erase(column.size() - 1);
+			throw;
+		}
+		return added;
+	}
+
+	template<typename SparseHandle>
+	template<typename T>
+	void ArchetypeTable<SparseHandle>::remove(HandleType handle)
+	{
+		if (try_get<T>(handle) == nullptr) {
+			return;
+		}
+		std::size_t target_archetype = archetype_without(sparse_to_dense.find(handle)->second.archetype, component_info<T>().id);
+		move_row(handle, target_archetype);
+	}
+
+	template<typename SparseHandle>
+	void ArchetypeTable<SparseHandle>::destroy(HandleType handle)
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		assert(sparse_to_dense_it != sparse_to_dense.end());
+		EntityLocation location = sparse_to_dense_it->second;
+		sparse_to_dense.erase(sparse_to_dense_it);
+
+		Archetype& archetype = archetypes[location.archetype];
+		for (ComponentColumn& column : archetype.columns) {
+			column.swap_erase(location.row);
+		}
+		erase_row(location.archetype, location.row);
+	}
+
+	template<typename SparseHandle>
+	void ArchetypeTable<SparseHandle>::clear()
+	{
+		for (Archetype& archetype : archetypes) {
+			for (ComponentColumn& column : archetype.columns) {
+				column.clear();
+			}
+			archetype.handles.clear();
+		}
+		sparse_to_dense.clear();
+	}
+
+	template<typename SparseHandle>
+	template<typename ... Components, typename Function>
+	void ArchetypeTable<SparseHandle>::for_each(Function&& function)
+	{
+		for_each_chunk<Components...>([&function](std::size_t count, const HandleType* handles, Components*... columns) {
+			for (std::size_t row = 0; row < count; ++row) {
+				function(handles[row], columns[row]...);
+			}
+		});
+	}
+
+	template<typename SparseHandle>
+	template<typename ... Components, typename Function>
+	void ArchetypeTable<SparseHandle>::for_each_chunk(Function&& function)
+	{
+		for_each_chunk_impl<Components...>(std::forward<Function>(function), std::index_sequence_for<Components...>{});
+	}
+
+	template<typename SparseHandle>
+	template<typename ... Components, typename Function, std::size_t ... Indices>
+	void ArchetypeTable<SparseHandle>::for_each_chunk_impl(Function&& function, std::index_sequence<Indices...>)
+	{
+		// A query for `const T` uses the column of `T`, component_info<const T> would be a different component
+		const std::array<ComponentId, sizeof...(Components)> component_ids{ { component_info<typename std::remove_cv<Components>::type>().id... } };
+		for (Archetype& archetype : archetypes) {
+			if (archetype.handles.empty()) {
+				continue;
+			}
+
+			std::array<std::size_t, sizeof...(Components)> columns{};
+			bool has_all_components = true;
+			for (std::size_t i = 0; i < component_ids.size(); ++i) {
+				columns[i] = archetype.column_index(component_ids[i]);
+				has_all_components = has_all_components && columns[i] != archetype.columns.size();
+			}
+			if (has_all_components) {
+				function(archetype.handles.size(), archetype.handles.data(), archetype.columns[columns[Indices]].template data<typename std::remove_cv<Components>::type>()...);
+			}
+		}
+	}
+
+	template<typename SparseHandle>
+	std::size_t ArchetypeTable<SparseHandle>::archetype_with(std::size_t archetype_index, const ComponentInfo& component)
+	{
+		auto transition_it = archetypes[archetype_index].add_transitions.find(component.id);
+		if (transition_it != archetypes[archetype_index].add_transitions.end()) {
+			return transition_it->second;
+		}
+
+		std::vector<const ComponentInfo*> components;
+		for (const ComponentColumn& column : archetypes[archetype_index].columns) {
+			components.push_back(&column.info());
+		}
+		components.push_back(&component);
+		std::size_t target_archetype = find_or_create_archetype(std::move(components));
+
+		// find_or_create_archetype() can grow `archetypes`, so index again
+		archetypes[archetype_index].add_transitions.emplace(component.id, target_archetype);
+		archetypes[target_archetype].remove_transitions.emplace(component.id, archetype_index);
+		return target_archetype;
+	}
+
+	template<typename SparseHandle>
+	std::size_t ArchetypeTable<SparseHandle>::archetype_without(std::size_t archetype_index, ComponentId component)
+	{
+		auto transition_it = archetypes[archetype_index].remove_transitions.find(component);
+		if (transition_it != archetypes[archetype_index].remove_transitions.end()) {
+			return transition_it->second;
+		}
+
+		std::vector<const ComponentInfo*> components;
+		for (const ComponentColumn& column : archetypes[archetype_index].columns) {
+			if (column.info().id != component) {
+				components.push_back(&column.info());
+			}
+		}
+		std::size_t target_archetype = find_or_create_archetype(std::move(components));
+
+		archetypes[archetype_index].remove_transitions.emplace(component, target_archetype);
+		archetypes[target_archetype].add_transitions.emplace(component, archetype_index);
+		return target_archetype;
+	}
+
+	template<typename SparseHandle>
+	std::size_t ArchetypeTable<SparseHandle>::find_or_create_archetype(std::vector<const ComponentInfo*> components)
+	{
+		std::sort(components.begin(), components.end(), [](const ComponentInfo* lhs, const ComponentInfo* rhs) { return lhs->id < rhs->id; });
+		components.erase(std::unique(components.begin(), components.end()), components.end());
+
+		std::vector<ComponentId> signature;
+		for (const ComponentInfo* component : components) {
+			signature.push_back(component->id);
+		}
+
+		// Only runs when a transition is not cached yet, so a linear search is fine
+		for (std::size_t i = 0; i < archetypes.size(); ++i) {
+			if (archetypes[i].signature == signature) {
+				return i;
+			}
+		}
+
+		Archetype archetype;
+		archetype.signature = std::move(signature);
+		for (const ComponentInfo* component : components) {
+			archetype.columns.emplace_back(*component);
+		}
+		archetypes.push_back(std::move(archetype));
+		return archetypes.size() - 1;
+	}
+
+	template<typename SparseHandle>
+	void ArchetypeTable<SparseHandle>::move_row(HandleType handle, std::size_t target_archetype)
+	{
+		EntityLocation& location = sparse_to_dense.find(handle)->second;
+		EntityLocation source_location = location;
+		Archetype& source = archetypes[source_location.archetype];
+		Archetype& target = archetypes[target_archetype];
+
+		std::size_t target_row = target.handles.size();
+		target.handles.push_back(handle);
+		for (ComponentColumn& source_column : source.columns) {
+			std::size_t target_column = target.column_index(source_column.info().id);
+			if (target_column != target.columns.size()) {
+				target.columns[target_column].push_back_moved(source_column.at(source_location.row));
+			}
+			// The moved-from (or removed) component is destroyed here
+			source_column.swap_erase(source_location.row);
+		}
+		location = EntityLocation{ static_cast<std::uint32_t>(target_archetype), static_cast<std::uint32_t>(target_row) };
+
+		erase_row(source_location.archetype, source_location.row);
+	}
+
+	template<typename SparseHandle>
+	void ArchetypeTable<SparseHandle>::erase_row(std::size_t archetype_index, std::size_t row)
+	{
+		// The columns are already swap erased, do the same with the handles and fix up the location of the moved entity
+		Archetype& archetype = archetypes[archetype_index];
+		std::size_t last_row = archetype.handles.size() - 1;
+		if (row != last_row) {
+			archetype.handles[row] = archetype.handles[last_row];
+			sparse_to_dense.find(archetype.handles[row])->second.row = static_cast<std::uint32_t>(row);
+		}
+		archetype.handles.pop_back();
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "flat_value_map_snapshot.h"
+
+
+namespace cof
+{
+	/** \brief Saves snapshots of a map on a background thread, the owner of the map only waits while the elements are copied.
+	 *
+	 * \class AsyncSnapshotWriter
+	 *
+	 * start() copies the dense array and the handle array with memcpy, after that the map can be changed again while the copy is encoded and written.
+	 * The copy buffers are kept for the next start(), so taking snapshots regularly does not allocate (and page fault) new memory every time.
+	 * The sorting for the delta encodings, the compression and the disk writes all happen on the background thread.
+	*/
+	template<typename HandleType, typename Value>
+	class AsyncSnapshotWriter
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "The elements are captured with memcpy");
+
+	public:
+		AsyncSnapshotWriter() = default;
+		AsyncSnapshotWriter(const AsyncSnapshotWriter&) = delete;
+		AsyncSnapshotWriter& operator=(const AsyncSnapshotWriter&) = delete;
+		// Waits for the snapshot that is still being written
+		~AsyncSnapshotWriter();
+
+		// Copy the elements of `map` and save them to `path` on a background thread.
+		// When the previous snapshot of this writer is still being written, this waits for it first because the buffers are reused
+		template<typename Map>
+		void start(const std::string& path, const Map& map, std::uint64_t generation = 0, SnapshotEncoding encoding = SnapshotEncoding::delta_varint);
+		// \returns if the last started snapshot is still being written
+		bool busy() const;
+		// Wait until the last started snapshot is written
+		// \returns if it was saved, false if it failed or if there is no snapshot to wait for (none was started, or wait() already returned it's result)
+		bool wait();
+		// The time the last start() spent copying the elements, which is the time the owner of the map was blocked for
+		auto last_capture_time() const->std::chrono::nanoseconds;
+
+	private:
+		using ValueStorage = typename std::aligned_storage<sizeof(Value), alignof(Value)>::type;
+
+		std::vector<HandleType> captured_handles{};
+		// Not a std::vector, resizing a vector would zero the memory before it is overwritten by the copy
+		std::unique_ptr<ValueStorage[]> captured_values{};
+		std::size_t captured_capacity = 0;
+
+		std::future<bool> pending{};
+		std::chrono::nanoseconds capture_time{ 0 };
+	};
+
+	// Copy the elements of `map` and save them to `path` on a new background thread
+	// \returns a future with the result of save_snapshot()
+	template<typename Map>
+	auto async_snapshot(const std::string& path, const Map& map, std::uint64_t generation = 0, SnapshotEncoding encoding = SnapshotEncoding::delta_varint)->std::future<bool>;
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename HandleType, typename Value>
+	AsyncSnapshotWriter<HandleType, Value>::~AsyncSnapshotWriter()
+	{
+		if (pending.valid()) {
+			pending.wait();
+		}
+	}
+
+	template<typename HandleType, typename Value>
+	template<typename Map>
+	void AsyncSnapshotWriter<HandleType, Value>::start(const std::string& path, const Map& map, std::uint64_t generation, SnapshotEncoding encoding)
+	{
+		static_assert(std::is_same<typename Map::HandleType, HandleType>::value && std::is_same<typename Map::ValueType, Value>::value,
+			"The map has to have the handle and value type of this writer");
+		wait();
+
+		auto capture_start = std::chrono::steady_clock::now();
+		std::size_t count = map.size();
+		if (captured_capacity < count) {
+			captured_values.reset(new ValueStorage[count]);
+			captured_capacity = count;
+		}
+		captured_handles.assign(map.handle_data(), map.handle_data() + count);
+		if (count != 0) {
+			std::memcpy(captured_values.get(), map.data(), count * sizeof(Value));
+		}
+		std::uint32_t last_id = Map::last_handle_id();
+		capture_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - capture_start);
+
+		pending = std::async(std::launch::async, [this, path, count, last_id, generation, encoding]() {
+			return save_snapshot(path, captured_handles.data(), reinterpret_cast<const Value*>(captured_values.get()), count, last_id, generation, encoding);
+		});
+	}
+
+	template<typename HandleType, typename Value>
+	bool AsyncSnapshotWriter<HandleType, Value>::busy() const
+	{
+		return pending.valid() && pending.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
+	}
+
+	template<typename HandleType, typename Value>
+	bool AsyncSnapshotWriter<HandleType, Value>::wait()
+	{
+		// get() leaves the future without a state, so the result is only returned once
+		return pending.valid() && pending.get();
+	}
+
+	template<typename HandleType, typename Value>
+	auto AsyncSnapshotWriter<HandleType, Value>::last_capture_time() const -> std::chrono::nanoseconds
+	{
+		return capture_time;
+	}
+
+	template<typename Map>
+	auto async_snapshot(const std::string& path, const Map& map, std::uint64_t generation, SnapshotEncoding encoding) -> std::future<bool>
+	{
+		using HandleType = typename Map::HandleType;
+		using Value = typename Map::ValueType;
+		static_assert(std::is_trivially_copyable<Value>::value, "The elements are captured with memcpy");
+
+		std::size_t count = map.size();
+		std::vector<HandleType> handles(map.handle_data(), map.handle_data() + count);
+		std::unique_ptr<typename std::aligned_storage<sizeof(Value), alignof(Value)>::type[]> values{
+			new typename std::aligned_storage<sizeof(Value), alignof(Value)>::type[count]
+		};
+		if (count != 0) {
+			std::memcpy(values.get(), map.data(), count * sizeof(Value));
+		}
+		std::uint32_t last_id = Map::last_handle_id();
+
+		return std::async(std::launch::async, [path, handles = std::move(handles), values = std::move(values), count, last_id, generation, encoding]() {
+			return save_snapshot(path, handles.data(), reinterpret_cast<const Value*>(values.get()), count, last_id, generation, encoding);
+		});
+	}
+}
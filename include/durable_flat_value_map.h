@@ -0,0 +1,568 @@
+#pragma once
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "flat_value_map_snapshot.h"
+#include "utils/file_utils.h"
+
+
+namespace cof
+{
+	/// Settings for the write-ahead log of a DurableFlatValueMap
+	struct DurabilityOptions
+	{
+		// How long the log thread waits for more changes before it writes a group of them, sync() does not wait for this delay
+		std::chrono::microseconds group_commit_delay{ 2000 };
+		// A checkpoint is made by the next change after the log grew past this size, 0 makes checkpoints manual only
+		// That change writes the whole snapshot on the thread of the caller, so it stalls for as long as checkpoint() takes. Use 0 and call checkpoint() at a quiet moment to avoid the stall
+		std::size_t checkpoint_log_bytes = 64 * 1024 * 1024;
+		// Wait for the disk after every group (fsync), when false the log only survives a crash of the process, not of the machine
+		bool sync_to_disk = true;
+		// The encoding of the checkpoint snapshots, SnapshotEncoding::compressed makes them smaller for values with slowly changing fields
+		SnapshotEncoding snapshot_encoding = SnapshotEncoding::delta_varint;
+	};
+
+	/** \brief A FlatValueMap that survives crashes, every change is appended to a write-ahead log on disk.
+	 *
+	 * \class DurableFlatValueMap
+	 *
+	 * The map is stored in two files: `path.snapshot` with a full snapshot of the last checkpoint, and `path.wal` with the changes made after it.
+	 * The modifiers change the map in memory and add a small record to a buffer, a background thread writes the buffered records to the log as one group, so the caller does not wait for the disk.
+	 * sync() waits until all changes made before it are on disk. checkpoint() writes a new snapshot and starts a empty log.
+	 * The constructor recovers the map: it loads the snapshot and replays the log on top of it, a record that was only partly written before a crash is ignored.
+	 *
+	 * Value has to be trivially copyable, the records and snapshots store it as raw bytes.
+	 * The map itself is not thread safe, like FlatValueMap. Only the logging runs on a different thread.
+	*/
+	template<typename SparseHandle, typename Value>
+	class DurableFlatValueMap
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "The log stores the values as raw bytes");
+
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+		using Map = FlatValueMap<SparseHandle, Value>;
+		using value_type = Value;
+		using const_iterator = typename Map::const_iterator;
+		using const_reference = typename Map::const_reference;
+
+	private:
+		enum class RecordType : std::uint8_t
+		{
+			insert = 1,
+			update = 2,
+			erase = 3,
+			clear = 4,
+		};
+
+		struct LogHeader
+		{
+			static constexpr std::uint64_t expected_magic = 0x31304C4157464F43ull; // "COFWAL01"
+
+			std::uint64_t magic;
+			std::uint32_t value_size;
+			std::uint32_t reserved;
+			// The generation of the snapshot this log continues from
+			std::uint64_t generation;
+		};
+
+		struct RecordHeader
+		{
+			RecordType type;
+			std::uint8_t reserved[3];
+			std::uint32_t id;
+		};
+
+		Map values{};
+		std::string snapshot_path;
+		std::string log_path;
+		DurabilityOptions options;
+		std::uint64_t generation = 0;
+		bool opened = false;
+
+		// Held by whoever writes to or replaces the log file
+		std::mutex file_mutex;
+		std::FILE* log_file = nullptr;
+
+		// Guards the members below, which are shared with the log thread
+		std::mutex queue_mutex;
+		std::condition_variable queue_signal;
+		std::condition_variable durable_signal;
+		std::vector<unsigned char> pending_records;
+		std::uint64_t appended_record_count = 0;
+		std::uint64_t durable_record_count = 0;
+		std::size_t log_bytes = 0;
+		bool sync_requested = false;
+		bool stop_requested = false;
+		bool write_failed = false;
+
+		std::thread log_thread;
+
+	public:
+		// Open (or create) the map stored at `path`, and recover it from the snapshot and the log. Check is_open() to see if it succeeded
+		explicit DurableFlatValueMap(std::string path, DurabilityOptions options = {});
+		DurableFlatValueMap(const DurableFlatValueMap&) = delete;
+		DurableFlatValueMap& operator=(const DurableFlatValueMap&) = delete;
+		// Writes the remaining records to the log, it does not make a checkpoint
+		~DurableFlatValueMap();
+
+		/// \Category Element access
+
+		// Get the const element indexed by it's handle, changes have to go through the modifiers so they are logged
+		auto operator[](HandleType handle) const->const_reference;
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a const iterator to the element if found. Else returns end()
+		auto find(HandleType handle) const->const_iterator;
+		// Get the handle of the element at the raw index in the dense_vector
+		auto handle_at(std::size_t index) const->HandleType;
+		// Get the FlatValueMap in memory, for the functions that take a FlatValueMap (like the numeric queries)
+		auto map() const->const Map&;
+
+		auto begin() const->const_iterator;
+		auto end() const->const_iterator;
+
+
+		/// \Category Capacity
+
+		// \returns if the files could be read and the log could be opened
+		bool is_open() const;
+		// The amount of elements in this map
+		std::size_t size() const;
+		// \returns if the amount of elements in this map equal to zero
+		bool empty() const;
+
+
+		/// \Category Modifiers
+
+		// pushes back a copy of `value` and logs it
+		auto push_back(const Value& value)->HandleType;
+		// construct an element in place at the end and log it
+		template<typename... Args>
+		auto emplace_back(Args&&... args)->HandleType;
+		// Replace the value of a element and log it
+		void assign(HandleType handle, const Value& value);
+		// Change a element in place with `f(Value&)` and log it
+		template<typename Func>
+		void update(HandleType handle, Func&& f);
+		// Erase a element and log it
+		void erase(HandleType handle);
+		// Erase all elements and log it
+		void clear();
+
+
+		/// \Category Durability
+
+		// Wait until every change made before this call is in the log on disk
+		// \returns false if writing the log failed
+		bool sync();
+		// Write a snapshot of the map and start a empty log. Runs on the calling thread
+		// \returns false if the snapshot or the new log could not be written
+		bool checkpoint();
+		// The size of the log in bytes, including the records that are not written yet
+		std::size_t log_size();
+
+	private:
+		void append_record(RecordType type, std::uint32_t id, const Value* value);
+		void log_loop();
+		void replay_log();
+		bool write_checkpoint_files(std::uint64_t new_generation);
+		static std::size_t record_size(RecordType type);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value>
+	DurableFlatValueMap<SparseHandle, Value>::DurableFlatValueMap(std::string path, DurabilityOptions options)
+		: snapshot_path(path + ".snapshot")
+		, log_path(path + ".wal")
+		, options(options)
+	{
+		if (std::FILE* snapshot_file = open_file(snapshot_path, "rb")) {
+			SnapshotInfo info{};
+			bool loaded = read_snapshot(snapshot_file, values, &info);
+			std::fclose(snapshot_file);
+			if (!loaded) {
+				// Never replace a snapshot that can not be read
+				return;
+			}
+			generation = info.generation;
+		}
+		replay_log();
+
+		// Start from a clean checkpoint, this also drops a torn record at the end of the old log
+		if (!write_checkpoint_files(generation + 1)) {
+			return;
+		}
+		generation += 1;
+		log_bytes = sizeof(LogHeader);
+		opened = true;
+		log_thread = std::thread{ [this]() { log_loop(); } };
+	}
+
+	template<typename SparseHandle, typename Value>
+	DurableFlatValueMap<SparseHandle, Value>::~DurableFlatValueMap()
+	{
+		if (log_thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock{ queue_mutex };
+				stop_requested = true;
+			}
+			queue_signal.notify_one();
+			log_thread.join();
+		}
+		if (log_file != nullptr) {
+			std::fclose(log_file);
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto DurableFlatValueMap<SparseHandle, Value>::operator[](HandleType handle) const -> const_reference
+	{
+		return values[handle];
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool DurableFlatValueMap<SparseHandle, Value>::contains(HandleType handle) const
+	{
+		return values.contains(handle);
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto DurableFlatValueMap<SparseHandle, Value>::find(HandleType handle) const -> const_iterator
+	{
+		return values.find(handle);
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto DurableFlatValueMap<SparseHandle, Value>::handle_at(std::size_t index) const -> HandleType
+	{
+		return values.handle_at(index);
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto DurableFlatValueMap<SparseHandle, Value>::map() const -> const Map&
+	{
+		return values;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto DurableFlatValueMap<SparseHandle, Value>::begin() const -> const_iterator
+	{
+		return values.begin();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto DurableFlatValueMap<SparseHandle, Value>::end() const -> const_iterator
+	{
+		return values.end();
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool DurableFlatValueMap<SparseHandle, Value>::is_open() const
+	{
+		return opened;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t DurableFlatValueMap<SparseHandle, Value>::size() const
+	{
+		return values.size();
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool DurableFlatValueMap<SparseHandle, Value>::empty() const
+	{
+		return values.empty();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto DurableFlatValueMap<SparseHandle, Value>::push_back(const Value& value) -> HandleType
+	{
+		HandleType handle = values.push_back(value);
+		append_record(RecordType::insert, handle.id, &value);
+		return handle;
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename... Args>
+	auto DurableFlatValueMap<SparseHandle, Value>::emplace_back(Args&&... args) -> HandleType
+	{
+		HandleType handle = values.emplace_back(std::forward<Args>(args)...);
+		append_record(RecordType::insert, handle.id, &values.back());
+		return handle;
+	}
+
+	template<typename SparseHandle, typename Value>
+	void DurableFlatValueMap<SparseHandle, Value>::assign(HandleType handle, const Value& value)
+	{
+		update(handle, [&value](Value& element) { element = value; });
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	void DurableFlatValueMap<SparseHandle, Value>::update(HandleType handle, Func&& f)
+	{
+		Value& element = values[handle];
+		f(element);
+		append_record(RecordType::update, handle.id, &element);
+	}
+
+	template<typename SparseHandle, typename Value>
+	void DurableFlatValueMap<SparseHandle, Value>::erase(HandleType handle)
+	{
+		values.erase(handle);
+		append_record(RecordType::erase, handle.id, nullptr);
+	}
+
+	template<typename SparseHandle, typename Value>
+	void DurableFlatValueMap<SparseHandle, Value>::clear()
+	{
+		values.clear();
+		append_record(RecordType::clear, 0, nullptr);
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool DurableFlatValueMap<SparseHandle, Value>::sync()
+	{
+		assert(is_open());
+		std::unique_lock<std::mutex> lock{ queue_mutex };
+		std::uint64_t target_record_count = appended_record_count;
+		sync_requested = true;
+		queue_signal.notify_one();
+		durable_signal.wait(lock, [&]() { return durable_record_count >= target_record_count || write_failed; });
+		return !write_failed;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool DurableFlatValueMap<SparseHandle, Value>::checkpoint()
+	{
+		assert(is_open());
+		// Holding the file mutex keeps the log thread away from the log, only this thread adds records so the pending records stay the same
+		std::lock_guard<std::mutex> file_lock{ file_mutex };
+		bool ok = write_checkpoint_files(generation + 1);
+
+		std::lock_guard<std::mutex> lock{ queue_mutex };
+		if (ok) {
+			generation += 1;
+			// The snapshot has every change, the records that were not written yet are not needed anymore
+			pending_records.clear();
+			durable_record_count = appended_record_count;
+			log_bytes = sizeof(LogHeader);
+		} else if (log_file == nullptr) {
+			write_failed = true;
+		}
+		durable_signal.notify_all();
+		return ok;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t DurableFlatValueMap<SparseHandle, Value>::log_size()
+	{
+		std::lock_guard<std::mutex> lock{ queue_mutex };
+		return log_bytes;
+	}
+
+	template<typename SparseHandle, typename Value>
+	void DurableFlatValueMap<SparseHandle, Value>::append_record(RecordType type, std::uint32_t id, const Value* value)
+	{
+		assert(is_open());
+		RecordHeader header{ type, { 0, 0, 0 }, id };
+		Checksum checksum{};
+		checksum.update(&header, sizeof(header));
+		if (value != nullptr) {
+			checksum.update(value, sizeof(Value));
+		}
+		std::uint32_t checksum_value = checksum.value();
+
+		bool needs_checkpoint = false;
+		{
+			std::lock_guard<std::mutex> lock{ queue_mutex };
+			bool was_empty = pending_records.empty();
+			std::size_t offset = pending_records.size();
+			pending_records.resize(offset + record_size(type));
+			unsigned char* record = pending_records.data() + offset;
+			std::memcpy(record, &header, sizeof(header));
+			if (value != nullptr) {
+				std::memcpy(record + sizeof(header), value, sizeof(Value));
+			}
+			std::memcpy(record + record_size(type) - sizeof(checksum_value), &checksum_value, sizeof(checksum_value));
+
+			++appended_record_count;
+			log_bytes += record_size(type);
+			needs_checkpoint = options.checkpoint_log_bytes != 0 && log_bytes >= options.checkpoint_log_bytes;
+			// A waiting log thread only needs a wake up for the first record of a group
+			if (was_empty) {
+				queue_signal.notify_one();
+			}
+		}
+
+		if (needs_checkpoint) {
+			checkpoint();
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	void DurableFlatValueMap<SparseHandle, Value>::log_loop()
+	{
+		std::vector<unsigned char> group;
+		std::unique_lock<std::mutex> lock{ queue_mutex };
+		for (;;) {
+			queue_signal.wait(lock, [&]() { return stop_requested || sync_requested || !pending_records.empty(); });
+			if (pending_records.empty()) {
+				sync_requested = false;
+				durable_signal.notify_all();
+				if (stop_requested) {
+					return;
+				}
+				continue;
+			}
+
+			// Group commit: give more changes the chance to join this write
+			if (!stop_requested && !sync_requested && options.group_commit_delay.count() > 0) {
+				queue_signal.wait_for(lock, options.group_commit_delay, [&]() { return stop_requested || sync_requested; });
+			}
+
+			lock.unlock();
+			std::lock_guard<std::mutex> file_lock{ file_mutex };
+			lock.lock();
+			group.swap(pending_records);
+			std::uint64_t group_end = appended_record_count;
+			sync_requested = false;
+			lock.unlock();
+
+			bool ok = true;
+			if (!group.empty()) {
+				ok = log_file != nullptr
+					&& write_bytes(log_file, group.data(), group.size())
+					&& (options.sync_to_disk ? sync_file(log_file) : std::fflush(log_file) == 0);
+				group.clear();
+			}
+
+			lock.lock();
+			write_failed = write_failed || !ok;
+			if (durable_record_count < group_end) {
+				durable_record_count = group_end;
+			}
+			durable_signal.notify_all();
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	void DurableFlatValueMap<SparseHandle, Value>::replay_log()
+	{
+		std::FILE* file = open_file(log_path, "rb");
+		if (file == nullptr) {
+			return;
+		}
+
+		// A log of a older generation was made before the snapshot, and it's changes are already in the snapshot
+		LogHeader log_header{};
+		if (!read_bytes(file, &log_header, sizeof(log_header))
+			|| log_header.magic != LogHeader::expected_magic
+			|| log_header.value_size != sizeof(Value)
+			|| log_header.generation != generation)
+		{
+			std::fclose(file);
+			return;
+		}
+
+		typename std::aligned_storage<sizeof(Value), alignof(Value)>::type value_storage;
+		const Value& value = reinterpret_cast<const Value&>(value_storage);
+		for (;;) {
+			RecordHeader header{};
+			if (!read_bytes(file, &header, sizeof(header))) {
+				break;
+			}
+			bool has_value = header.type == RecordType::insert || header.type == RecordType::update;
+			if (!has_value && header.type != RecordType::erase && header.type != RecordType::clear) {
+				break;
+			}
+			std::uint32_t stored_checksum = 0;
+			if ((has_value && !read_bytes(file, &value_storage, sizeof(Value))) || !read_bytes(file, &stored_checksum, sizeof(stored_checksum))) {
+				break;
+			}
+			Checksum checksum{};
+			checksum.update(&header, sizeof(header));
+			if (has_value) {
+				checksum.update(&value_storage, sizeof(Value));
+			}
+			if (checksum.value() != stored_checksum) {
+				break;
+			}
+
+			HandleType handle{ header.id };
+			switch (header.type) {
+			case RecordType::insert:
+				if (!values.contains(handle)) {
+					values.emplace_with_handle(handle, value);
+				}
+				break;
+			case RecordType::update:
+				if (values.contains(handle)) {
+					values[handle] = value;
+				}
+				break;
+			case RecordType::erase:
+				if (values.contains(handle)) {
+					values.erase(handle);
+				}
+				break;
+			case RecordType::clear:
+				values.clear();
+				break;
+			}
+		}
+		std::fclose(file);
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool DurableFlatValueMap<SparseHandle, Value>::write_checkpoint_files(std::uint64_t new_generation)
+	{
+		if (!save_snapshot(snapshot_path, values, new_generation, options.snapshot_encoding)) {
+			return false;
+		}
+
+		// From here on the new snapshot is used, the old log does not match it's generation anymore
+		if (log_file != nullptr) {
+			std::fclose(log_file);
+		}
+		log_file = open_file(log_path, "wb");
+		if (log_file == nullptr) {
+			return false;
+		}
+		LogHeader log_header{ LogHeader::expected_magic, static_cast<std::uint32_t>(sizeof(Value)), 0, new_generation };
+		if (!write_bytes(log_file, &log_header, sizeof(log_header)) || !sync_file(log_file)) {
+			std::fclose(log_file);
+			log_file = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t DurableFlatValueMap<SparseHandle, Value>::record_size(RecordType type)
+	{
+		bool has_value = type == RecordType::insert || type == RecordType::update;
+		return sizeof(RecordHeader) + (has_value ? sizeof(Value) : 0) + sizeof(std::uint32_t);
+	}
+}
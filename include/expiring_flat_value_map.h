@@ -0,0 +1,365 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <utility>
+
+#include "flat_value_map.h"
+
+
+namespace cof
+{
+	/** \brief A FlatValueMap where every element can have a expiry timestamp, expired elements are removed in batches with expire_until().
+	 *
+	 * \class ExpiringFlatValueMap
+	 *
+	 * The expiry timestamps are stored in a column next to the dense_vector, in the same order as the elements. Timestamps are plain ticks of the callers clock (for example milliseconds).
+	 * Elements with a expiry are also put in a hashed timing wheel: bucket `(expires_at / ticks_per_bucket) % bucket_count`.
+	 * expire_until() only visits the buckets of the time slots since the previous call, so it does not scan the whole table every tick.
+	 * Those buckets can still hold entries for a later turn of the wheel, and entries for erased elements or changed expiries, these are skipped (and the stale ones dropped) while sweeping.
+	*/
+	template<typename SparseHandle, typename Value, typename Allocator = std::allocator<Value>>
+	class ExpiringFlatValueMap
+	{
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+		using Timestamp = std::uint64_t;
+
+		// Expiry of elements that never expire
+		static constexpr Timestamp never = UINT64_MAX;
+
+	private:
+		using ValueMap = FlatValueMap<SparseHandle, Value, Allocator>;
+
+		struct WheelEntry
+		{
+			HandleType handle;
+			Timestamp expires_at;
+		};
+
+		// The elements themselves
+		ValueMap values{};
+		// The expiry of every element, kept in the same order as the dense_vector of `values`
+		std::vector<Timestamp> expiry_column{};
+		// The timing wheel, the bucket count is a power of two
+		std::vector<std::vector<WheelEntry>> wheel;
+		Timestamp ticks_per_bucket;
+		// Everything that expired at or before this time is already removed
+		Timestamp last_expire_time;
+
+	public:
+		using value_type = ValueType;
+		using iterator = typename ValueMap::iterator;
+		using const_iterator = typename ValueMap::const_iterator;
+		using reference = typename ValueMap::reference;
+		using const_reference = typename ValueMap::const_reference;
+
+	public:
+		// `bucket_count` has to be a power of two. Pick `ticks_per_bucket` around the interval expire_until() is called with, and `bucket_count * ticks_per_bucket` around the common time to live.
+		explicit ExpiringFlatValueMap(Timestamp ticks_per_bucket = 1, std::size_t bucket_count = 256, Timestamp start_time = 0);
+
+		/// \Category Element access
+
+		// Get the element indexed by it's handle
+		auto operator[](HandleType handle)->reference;
+		// Get the const element indexed by it's handle
+		auto operator[](HandleType handle) const->const_reference;
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a iterator to the element if found. Else returns end()
+		auto find(HandleType handle)->iterator;
+		// \returns a const iterator to the element if found. Else returns end()
+		auto find(HandleType handle) const->const_iterator;
+		// Get the handle of the element at the raw index in the dense_vector
+		auto handle_at(std::size_t index) const->HandleType;
+		// The expiry of the element with this handle, or `never`
+		auto expiry(HandleType handle) const->Timestamp;
+		// Get the data pointer to the expiry timestamps, these are stored in the same order as the elements in begin()
+		auto expiry_data() const->const Timestamp*;
+
+
+		/// \Category Iterators
+
+		// Get a iterator to the first element in the dense_vector
+		auto begin()->iterator;
+		// Get a const iterator to the first element in the dense_vector
+		auto begin() const->const_iterator;
+		// Get a iterator past the last element in the dense_vector
+		auto end()->iterator;
+		// Get a const iterator past the last element in the dense_vector
+		auto end() const->const_iterator;
+
+
+		/// \Category Capacity
+
+		// The amount of elements in this map
+		std::size_t size() const;
+		// \returns if the amount of elements in this map equal to zero
+		bool empty() const;
+
+
+		/// \Category Modifiers
+
+		// pushes back a copy of element `t`, which expires at `expires_at`
+		auto push_back(const Value& t, Timestamp expires_at = never)->HandleType;
+		// pushes back the moved element `t`, which expires at `expires_at`
+		auto push_back(Value&& t, Timestamp expires_at = never)->HandleType;
+		// construct an element in place, which expires at `expires_at`
+		template<typename... Args>
+		auto emplace_back(Timestamp expires_at, Args&&... args)->HandleType;
+
+		// Change when the element with this handle expires, `never` removes the expiry
+		void set_expiry(HandleType handle, Timestamp expires_at);
+
+		// Erase all elements that expire at or before `now` and append their handles to `expired_handles`
+		// `now` should not go back in time between calls.
+		void expire_until(Timestamp now, std::vector<HandleType>& expired_handles);
+		// Erase all elements that expire at or before `now`
+		// \returns the handles of the erased elements
+		auto expire_until(Timestamp now)->std::vector<HandleType>;
+
+		// erase a element
+		void erase(HandleType handle);
+		// Erase all elements
+		void clear();
+
+	private:
+		void schedule(HandleType handle, Timestamp expires_at);
+		auto bucket_for(Timestamp expires_at)->std::vector<WheelEntry>&;
+		std::size_t index_of(HandleType handle) const;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value, typename Allocator>
+	ExpiringFlatValueMap<SparseHandle, Value, Allocator>::ExpiringFlatValueMap(Timestamp ticks_per_bucket, std::size_t bucket_count, Timestamp start_time)
+		: wheel(bucket_count)
+		, ticks_per_bucket(ticks_per_bucket)
+		, last_expire_time(start_time)
+	{
+		assert(ticks_per_bucket > 0);
+		assert(bucket_count > 0 && (bucket_count & (bucket_count - 1)) == 0);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::operator[](HandleType handle) -> reference
+	{
+		return values[handle];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::operator[](HandleType handle) const -> const_reference
+	{
+		return values[handle];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	bool ExpiringFlatValueMap<SparseHandle, Value, Allocator>::contains(HandleType handle) const
+	{
+		return values.contains(handle);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::find(HandleType handle) -> iterator
+	{
+		return values.find(handle);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::find(HandleType handle) const -> const_iterator
+	{
+		return values.find(handle);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::handle_at(std::size_t index) const -> HandleType
+	{
+		return values.handle_at(index);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::expiry(HandleType handle) const -> Timestamp
+	{
+		return expiry_column[index_of(handle)];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::expiry_data() const -> const Timestamp*
+	{
+		return expiry_column.data();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::begin() -> iterator
+	{
+		return values.begin();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::begin() const -> const_iterator
+	{
+		return values.begin();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::end() -> iterator
+	{
+		return values.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::end() const -> const_iterator
+	{
+		return values.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	std::size_t ExpiringFlatValueMap<SparseHandle, Value, Allocator>::size() const
+	{
+		return values.size();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	bool ExpiringFlatValueMap<SparseHandle, Value, Allocator>::empty() const
+	{
+		return values.empty();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::push_back(const Value& t, Timestamp expires_at) -> HandleType
+	{
+		HandleType handle = values.push_back(t);
+		expiry_column.push_back(expires_at);
+		schedule(handle, expires_at);
+		return handle;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::push_back(Value&& t, Timestamp expires_at) -> HandleType
+	{
+		HandleType handle = values.push_back(std::move(t));
+		expiry_column.push_back(expires_at);
+		schedule(handle, expires_at);
+		return handle;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	template<typename ... Args>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::emplace_back(Timestamp expires_at, Args&&... args) -> HandleType
+	{
+		HandleType handle = values.emplace_back(std::forward<Args>(args)...);
+		expiry_column.push_back(expires_at);
+		schedule(handle, expires_at);
+		return handle;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	void ExpiringFlatValueMap<SparseHandle, Value, Allocator>::set_expiry(HandleType handle, Timestamp expires_at)
+	{
+		Timestamp& current_expiry = expiry_column[index_of(handle)];
+		if (current_expiry == expires_at) {
+			return;
+		}
+		// The old wheel entry no longer matches the column, it is dropped when it's bucket is swept
+		current_expiry = expires_at;
+		schedule(handle, expires_at);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	void ExpiringFlatValueMap<SparseHandle, Value, Allocator>::expire_until(Timestamp now, std::vector<HandleType>& expired_handles)
+	{
+		if (now < last_expire_time) {
+			return;
+		}
+
+		const Timestamp first_slot = last_expire_time / ticks_per_bucket;
+		const Timestamp last_slot = now / ticks_per_bucket;
+		// After a full turn every bucket has been visited, no need to go around again
+		const Timestamp slot_count = last_slot - first_slot + 1 < wheel.size() ? last_slot - first_slot + 1 : wheel.size();
+		const std::size_t first_expired = expired_handles.size();
+
+		for (Timestamp slot = first_slot; slot < first_slot + slot_count; ++slot) {
+			std::vector<WheelEntry>& bucket = wheel[static_cast<std::size_t>(slot & (wheel.size() - 1))];
+			for (std::size_t i = 0; i < bucket.size();) {
+				const WheelEntry entry = bucket[i];
+				auto element_it = values.find(entry.handle);
+				bool is_stale = element_it == values.end() || expiry_column[element_it - values.begin()] != entry.expires_at;
+				if (is_stale || entry.expires_at <= now) {
+					if (!is_stale) {
+						// Setting the expiry back and forth can leave a second matching entry, marking the element makes that one stale
+						expiry_column[element_it - values.begin()] = never;
+						expired_handles.push_back(entry.handle);
+					}
+					bucket[i] = bucket.back();
+					bucket.pop_back();
+				} else {
+					++i;
+				}
+			}
+		}
+		last_expire_time = now;
+
+		for (std::size_t i = first_expired; i < expired_handles.size(); ++i) {
+			erase(expired_handles[i]);
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::expire_until(Timestamp now) -> std::vector<HandleType>
+	{
+		std::vector<HandleType> expired_handles;
+		expire_until(now, expired_handles);
+		return expired_handles;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	void ExpiringFlatValueMap<SparseHandle, Value, Allocator>::erase(HandleType handle)
+	{
+		// FlatValueMap::erase moves the back element into the hole, do the same with the expiry column
+		std::size_t removed_element_index = index_of(handle);
+		expiry_column[removed_element_index] = expiry_column.back();
+		expiry_column.pop_back();
+		values.erase(handle);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	void ExpiringFlatValueMap<SparseHandle, Value, Allocator>::clear()
+	{
+		values.clear();
+		expiry_column.clear();
+		for (std::vector<WheelEntry>& bucket : wheel) {
+			bucket.clear();
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	void ExpiringFlatValueMap<SparseHandle, Value, Allocator>::schedule(HandleType handle, Timestamp expires_at)
+	{
+		if (expires_at != never) {
+			bucket_for(expires_at).push_back(WheelEntry{ handle, expires_at });
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	auto ExpiringFlatValueMap<SparseHandle, Value, Allocator>::bucket_for(Timestamp expires_at) -> std::vector<WheelEntry>&
+	{
+		// A expiry that is already in the past goes in the bucket that the next expire_until() visits first
+		Timestamp slot = (expires_at < last_expire_time ? last_expire_time : expires_at) / ticks_per_bucket;
+		return wheel[static_cast<std::size_t>(slot & (wheel.size() - 1))];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator>
+	std::size_t ExpiringFlatValueMap<SparseHandle, Value, Allocator>::index_of(HandleType handle) const
+	{
+		auto element_it = values.find(handle);
+		assert(element_it != values.end());
+		return static_cast<std::size_t>(element_it - values.begin());
+	}
+}
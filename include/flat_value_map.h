@@ -3,8 +3,11 @@
 #include <unordered_map>
 #include <cstdint>
 #include <cassert>
+#include <memory>
+#include <type_traits>
 
 #include "utils/container_utils.h"
+#include "utils/membership_filter.h"
 #include "flat_value_map_handle.h"
 #include "utils/tmp_compatibility.h"
 
@@ -21,8 +24,8 @@ namespace cof
 	 * 
 	 *  A FlatValueMap is a vector which uses a handle to access it's members instead of members directly. This level of indirection is useful if you need your indices to stay valid even if things get deleted etc. 
 	 * The way it works is when you call operator[] with the handle, it first goes through a `unordered_map<HandleType, index_t>`(sparse to dense map) to get the index in the internal vector. This means that the elements themselves are still stored contiguously.
-	 * For erase this means we can make use of the swap erase idiom to avoid moving all later elements. But to efficiently implement this, a second `unordered_map<index_t, HandleType>`(dense to sparse map) is used for getting the handle from an id.
-	 * This extra "dense to sparse map" costs more memory but will increase speed. If this tradeoff is not undesired take a look at cof::LightFlatValueMap .
+	 * For erase this means we can make use of the swap erase idiom to avoid moving all later elements. But to efficiently implement this, a second `vector<HandleType>`(dense to sparse array) is kept in the same order as the elements for getting the handle from an index.
+	 * This extra "dense to sparse array" costs more memory but will increase speed. If this tradeoff is not undesired take a look at cof::LightFlatValueMap .
 	*/
 	template<typename SparseHandle, typename Value,
 		typename Allocator = std::allocator<Value>,
@@ -38,21 +41,27 @@ namespace cof
 	private:
 		using SparseToDenseMap = std::unordered_map<HandleType, std::size_t, std::hash<HandleType>, std::equal_to<>, SparseToDenseAllocator>;
 		using SparseToDenseIterator = typename SparseToDenseMap::iterator;
-		using DenseToSparseMap = std::unordered_map<std::size_t, HandleType, std::hash<std::size_t>, std::equal_to<>, DenseToSparseAllocator>;
-		using DenseToSparseIterator = typename DenseToSparseMap::iterator;
+		// The dense_to_sparse map used to be a unordered_map<size_t, handle>, the allocator parameter keeps it's old default and is rebound to allocate handles
+		using DenseToSparseVector = std::vector<HandleType, typename std::allocator_traits<DenseToSparseAllocator>::template rebind_alloc<HandleType>>;
 		using DenseVector = std::vector<ValueType, Allocator>;
 
 		// The sparse_to_dense map is used for finding a the raw index of the dense_vector from a sparse handle
 		SparseToDenseMap sparse_to_dense{};
-		// The dense_to_sparse map is used for finding a sparse handle from a raw dense_vector index.
-		DenseToSparseMap dense_to_sparse{};
+		// The dense_to_sparse array is used for finding a sparse handle from a raw dense_vector index. It is kept in the same order as the dense_vector.
+		DenseToSparseVector dense_to_sparse{};
 		// The internal dense_vector, contains all elements contiguously. 
 		DenseVector dense_vector;
 
 		SparseToDenseIterator back_element_sparse_to_dense_iterator;
-		DenseToSparseIterator back_element_dense_to_sparse_iterator;
 		bool back_element_cached_iterator_valid = false;
 
+		// Optional filter in front of sparse_to_dense, so contains() and find() can reject most unknown handles without walking a bucket.
+		CountingBloomFilter membership_filter{};
+
+		// In value pool mode erased elements stay in the dense_vector after the live elements, the last `pooled_element_count` elements are not part of this container.
+		std::size_t pooled_element_count = 0;
+		bool retain_erased_elements = false;
+
 		static uint32_t internalIdCounter;
 
 	public:
@@ -73,6 +82,8 @@ namespace cof
 		using sparse_to_dense_iterator = typename SparseToDenseMap::iterator;
 		using const_sparse_to_dense_iterator = typename SparseToDenseMap::const_iterator;
 
+		class Cursor;
+
 	public:
 		FlatValueMap() = default;
 
@@ -101,6 +112,10 @@ namespace cof
 		auto find(HandleType handle)->iterator;
 		// \returns a const iterator to the element in the internal dense_vector if found. Else returns cend()
 		auto find(HandleType handle) const->const_iterator;
+		// Get the handle of the element at the raw index in the dense_vector
+		auto handle_at(std::size_t index) const->HandleType;
+		// Get the data pointer to the handles, these are stored in the same order as the elements in data()
+		auto handle_data() const->const HandleType*;
 
 
 		/// \Category Iterators
@@ -118,17 +133,17 @@ namespace cof
 		// Get a const iterator past the last element in the dense_vector
 		auto cend() const->const_iterator;
 		// Get a reverse iterator to the first element of the reversed container.
-		auto rbegin()->iterator;
+		auto rbegin()->reverse_iterator;
 		// Get a const reverse iterator to the first element of the reversed container.
-		auto rbegin() const->const_iterator;
+		auto rbegin() const->const_reverse_iterator;
 		// Get a const reverse iterator to the first element of the reversed container.
-		auto crbegin() const->const_iterator;
+		auto crbegin() const->const_reverse_iterator;
 		// Get a reverse iterator to the last element of the reversed container.
-		auto rend()->iterator;
+		auto rend()->reverse_iterator;
 		// Get a const reverse iterator to the last element of the reversed container.
-		auto rend() const->const_iterator;
+		auto rend() const->const_reverse_iterator;
 		// Get a const reverse iterator to the last element of the reversed container.
-		auto crend() const->const_iterator;
+		auto crend() const->const_reverse_iterator;
 
 		//TODO: Let the handles_begin & handles_end return a iterator which only exposes the handles, and not the indices.
 
@@ -145,6 +160,10 @@ namespace cof
 		// Get a const iterator to the end of the sparse handles map;
 		auto handles_cend() const->const_sparse_to_dense_iterator;
 
+		// Get a cursor to the first element, unlike a iterator the cursor can erase the element it points to and keep going.
+		// `for (auto c = fvm.cursor(); c; ) { if (should_erase(*c)) c.erase(); else ++c; }`
+		auto cursor()->Cursor;
+
 
 		/// \Category Capacity
 
@@ -152,6 +171,8 @@ namespace cof
 		std::size_t size() const;
 		// \returns if the amount of elements in this vector equal to zero
 		bool empty() const;
+		// Make room for `new_capacity` elements in the dense arrays and the buckets of the sparse_to_dense map. Adding that many elements (like a bulk load with emplace_with_handle()) then never reallocates or rehashes
+		void reserve(std::size_t new_capacity);
 
 		/// \Category Modifiers
 
@@ -162,18 +183,136 @@ namespace cof
 		// construct an element in place at the end of the internal dense_vector
 		template<typename... Args>
 		auto emplace_back(Args&&... args)->HandleType;
+		// pushes back a element by calling `assign(Value&)` on a pooled element, or on a default constructed element when the value pool is empty.
+		// Assigning the members of the pooled element reuses their allocations, which push_back(Value&&) and emplace_back() can not do.
+		template<typename Assign>
+		auto recycle_back(Assign&& assign)->HandleType;
+		// construct an element at the end of the internal dense_vector with a handle that was made before, for example when loading a saved map.
+		// The handle can not be in this FlatValueMap yet, handles made after this get a higher id.
+		template<typename... Args>
+		auto emplace_with_handle(HandleType handle, Args&&... args)->reference;
 
 		// erase a element from the vector. This overload is the most efficient
 		void erase(HandleType handleToDelete);
 		// erase a element from the vector. This overload is NOT the most efficient
-		// This overload does one dense_to_sparse unordered_map lookup and then calls erase() with the sparse handle
+		// This overload does one dense_to_sparse array lookup and then calls erase() with the sparse handle
 		void erase(const_iterator position);
 		// erase a element from the vector. This overload is NOT the most efficient
-		// This overload does a dense_to_sparse unordered_map lookup for every element in the range and then calls erase() with each sparse handle
+		// This overload does a dense_to_sparse array lookup for every element in the range and then calls erase() with each sparse handle
 		void erase(const_iterator first, const_iterator last);
+		// erase every element for which `predicate(const Value&)` returns true. \returns the amount of erased elements
+		// The erased elements in front of the survivors are filled with the survivors from the back, so only as many elements move as there are holes
+		template<typename Predicate>
+		std::size_t erase_if(Predicate predicate);
+		// erase_if() on the threads of `pool`, a WorkStealingPool from utils/work_stealing_pool.h. The elements end up in the same order as with erase_if().
+		// `predicate` is called from many threads at once. Only erasing the handles from the sparse_to_dense map happens on the calling thread, because it is a node based hash map
+		// When `predicate` throws, the map is left unchanged and the exception is rethrown on the calling thread
+		template<typename Predicate, typename Pool>
+		std::size_t parallel_erase_if(Predicate predicate, Pool& pool, std::size_t grain = 16384);
 
 		// Erase all elements(and thus deconstruct all elements)
 		void clear();
+
+
+		/// \Category Handle ids
+
+		// The id of the last handle made by a FlatValueMap of this type
+		static uint32_t last_handle_id();
+		// Make sure handles made after this get a id higher then `last_id`, for example after loading handles that were saved by a earlier run
+		static void reserve_handle_ids(uint32_t last_id);
+
+
+		/// \Category Membership filter
+
+		// Put a counting bloom filter in front of the sparse_to_dense map, sized for at least `expected_elements` (or the current size if that is bigger).
+		// Useful when contains() and find() are mostly called with handles that are not in this FlatValueMap, those are then rejected with one cache line probe.
+		// The filter is kept up to date by every modifier and grows when the size goes past twice the capacity it was made for.
+		void enable_membership_filter(std::size_t expected_elements = 0);
+		// Remove the membership filter and free it's memory
+		void disable_membership_filter();
+		// \returns if enable_membership_filter() was called
+		bool membership_filter_enabled() const;
+
+
+		/// \Category Value pool
+
+		// Keep erased elements alive after the last element, instead of destroying them.
+		// push_back(), recycle_back() and emplace_back() with one argument that Value can be assigned from assign into those elements again,
+		// so allocations inside the elements (like the buffer of a std::string) are reused instead of freed and allocated again.
+		void enable_value_pool();
+		// Destroy the pooled elements and destroy erased elements directly again
+		void disable_value_pool();
+		// \returns if enable_value_pool() was called
+		bool value_pool_enabled() const;
+		// The amount of erased elements that are kept for reuse
+		std::size_t pooled_count() const;
+		// Destroy the pooled elements, the value pool stays enabled
+		void release_pool();
+
+	private:
+		// How a pooled element is given the arguments of a new element
+		using AssignDirectly = std::integral_constant<int, 0>;
+		using AssignTemporary = std::integral_constant<int, 1>;
+		using NotAssignable = std::integral_constant<int, 2>;
+		template<typename... Args>
+		struct PooledAssignKind : std::conditional<std::is_move_assignable<Value>::value, AssignTemporary, NotAssignable>::type {};
+		template<typename Arg>
+		struct PooledAssignKind<Arg> : std::conditional<std::is_assignable<Value&, Arg&&>::value, AssignDirectly,
+			typename std::conditional<std::is_move_assignable<Value>::value, AssignTemporary, NotAssignable>::type>::type {};
+
+		// Put a new element at index size(), in the first pooled element if there is one
+		template<typename... Args>
+		void construct_back(Args&&... args);
+		// Assigning the argument straight to the pooled element lets it keep it's allocations, like the buffer of a std::string
+		template<typename Arg>
+		void construct_pooled(AssignDirectly, Arg&& arg);
+		template<typename... Args>
+		void construct_pooled(AssignTemporary, Args&&... args);
+		// Elements that can not be assigned to are not reused, the pool is emptied instead
+		template<typename... Args>
+		void construct_pooled(NotAssignable, Args&&... args);
+
+		template<typename Predicate, typename Pool>
+		std::size_t erase_if_in_chunks(Predicate& predicate, Pool& pool, std::size_t grain);
+		void membership_filter_insert(HandleType handle);
+		void membership_filter_erase(HandleType handle);
+		bool membership_filter_rejects(HandleType handle) const;
+	};
+
+	/** \brief A position in a FlatValueMap that stays valid when the element it points to is erased.
+	 *
+	 * \class FlatValueMap::Cursor
+	 *
+	 * erase() moves the back element into the erased slot. The cursor does not advance after erase(), so the moved element is visited next and every element is still visited exactly once.
+	 * Elements pushed back while iterating are visited as well.
+	*/
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	class FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor
+	{
+	public:
+		// \returns if the cursor points to a element, false once it went past the last element
+		explicit operator bool() const;
+		// Get the element the cursor points to
+		auto operator*() const->reference;
+		// Get a pointer to the element the cursor points to
+		auto operator->() const->pointer;
+		// Go to the next element
+		auto operator++()->Cursor&;
+
+		// The handle of the element the cursor points to
+		auto handle() const->HandleType;
+		// The raw index in the dense_vector of the element the cursor points to
+		std::size_t index() const;
+
+		// Erase the element the cursor points to, after this the cursor points to the element that was at the back
+		void erase();
+
+	private:
+		friend class FlatValueMap;
+		Cursor(FlatValueMap& container, std::size_t index);
+
+		FlatValueMap* container;
+		std::size_t element_index;
 	};
 
 #if __cplusplus >= 201703L
@@ -234,14 +373,16 @@ namespace cof
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::back() -> reference
 	{
-		return dense_vector.back();
+		assert(!empty());
+		return dense_vector[size() - 1];
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::
 		back() const -> const_reference
 	{
-		return dense_vector.back();
+		assert(!empty());
+		return dense_vector[size() - 1];
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
@@ -261,6 +402,9 @@ namespace cof
 	bool FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::contains(
 		HandleType handle) const
 	{
+		if (membership_filter_rejects(handle)) {
+			return false;
+		}
 		return sparse_to_dense.find(handle) != sparse_to_dense.end();
 	}
 
@@ -268,6 +412,9 @@ namespace cof
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::find(
 		HandleType handle) -> iterator
 	{
+		if (membership_filter_rejects(handle)) {
+			return end();
+		}
 		auto sparse_to_dense_it = sparse_to_dense.find(handle);
 		if (sparse_to_dense_it != sparse_to_dense.end()) {
 			std::size_t element_index = sparse_to_dense_it->second;
@@ -278,13 +425,16 @@ namespace cof
 			return dense_it;
 		}
 
-		return dense_vector.end();
+		return end();
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::find(
 		HandleType handle) const -> const_iterator
 	{
+		if (membership_filter_rejects(handle)) {
+			return end();
+		}
 		auto sparse_to_dense_it = sparse_to_dense.find(handle);
 		if (sparse_to_dense_it != sparse_to_dense.end()) {
 			std::size_t element_index = sparse_to_dense_it->second;
@@ -295,7 +445,22 @@ namespace cof
 			return dense_it;
 		}
 
-		return dense_vector.end();
+		return end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::handle_at(
+		std::size_t index) const -> HandleType
+	{
+		assert(vector_in_range(dense_to_sparse, index));
+		return dense_to_sparse[index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::
+		handle_data() const -> const HandleType*
+	{
+		return dense_to_sparse.data();
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
@@ -320,60 +485,61 @@ namespace cof
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::end() -> iterator
 	{
-		return dense_vector.end();
+		return dense_vector.begin() + static_cast<difference_type>(size());
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::end() const -> const_iterator
 	{
-		return dense_vector.end();
+		return dense_vector.begin() + static_cast<difference_type>(size());
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::
 		cend() const -> const_iterator
 	{
-		return dense_vector.cend();
+		return dense_vector.cbegin() + static_cast<difference_type>(size());
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
-	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::rbegin() -> iterator
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::rbegin() -> reverse_iterator
 	{
-		return dense_vector.rbegin();
+		// Starts at end(), the pooled elements after it are not part of this container
+		return reverse_iterator{ end() };
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::
-		rbegin() const -> const_iterator
+		rbegin() const -> const_reverse_iterator
 	{
-		return dense_vector.rbegin();
+		return const_reverse_iterator{ end() };
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::
-		crbegin() const -> const_iterator
+		crbegin() const -> const_reverse_iterator
 	{
-		return dense_vector.crbegin();
+		return const_reverse_iterator{ cend() };
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
-	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::rend() -> iterator
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::rend() -> reverse_iterator
 	{
 		return dense_vector.rend();
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::
-		rend() const -> const_iterator
+		rend() const -> const_reverse_iterator
 	{
 		return dense_vector.rend();
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::
-		crend() const -> const_iterator
+		crend() const -> const_reverse_iterator
 	{
-		return dense_vector.crbegin();
+		return dense_vector.crend();
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
@@ -418,31 +584,45 @@ namespace cof
 		return sparse_to_dense.cend();
 	}
 
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::cursor() -> Cursor
+	{
+		return Cursor{ *this, 0 };
+	}
+
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	std::size_t FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::size() const
 	{
-		return dense_vector.size();
+		return dense_vector.size() - pooled_element_count;
 	}
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	bool FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::empty() const
 	{
-		return dense_vector.empty();
+		return size() == 0;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::reserve(std::size_t new_capacity)
+	{
+		dense_vector.reserve(new_capacity + pooled_element_count);
+		dense_to_sparse.reserve(new_capacity);
+		sparse_to_dense.reserve(new_capacity);
 	}
 
 
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::push_back(const Value& t) -> HandleType
 	{
-		std::size_t element_index = dense_vector.size();
+		std::size_t element_index = size();
 		uint32_t element_id = ++internalIdCounter; 
-		dense_vector.push_back(t);
+		construct_back(t);
 		auto sparse_to_dense_it = unordered_map_emplace_and_return_iterator(sparse_to_dense, HandleType{ element_id }, element_index);
-		auto dense_to_sparse_it = unordered_map_emplace_and_return_iterator(dense_to_sparse, element_index, HandleType{element_id});
+		dense_to_sparse.push_back(HandleType{ element_id });
 		back_element_sparse_to_dense_iterator = sparse_to_dense_it;
-		back_element_dense_to_sparse_iterator = dense_to_sparse_it;
 		back_element_cached_iterator_valid = true;
+		membership_filter_insert(HandleType{ element_id });
 
 		return HandleType{ element_id };
 	}
@@ -450,14 +630,14 @@ namespace cof
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::push_back(Value&& t) -> HandleType
 	{
-		std::size_t element_index = dense_vector.size();
+		std::size_t element_index = size();
 		uint32_t element_id = ++internalIdCounter;
-		dense_vector.push_back(std::move(t));
-		auto sparse_to_dense_it = unordered_map_emplace_and_return_iterator(sparse_to_dense, HandleType{element_id}, element_index);
-		auto dense_to_sparse_it = unordered_map_emplace_and_return_iterator(dense_to_sparse, element_index, HandleType{ element_id });
+		construct_back(std::move(t));
+		auto sparse_to_dense_it = unordered_map_emplace_and_return_iterator(sparse_to_dense, HandleType{ element_id }, element_index);
+		dense_to_sparse.push_back(HandleType{ element_id });
 		back_element_sparse_to_dense_iterator = sparse_to_dense_it;
-		back_element_dense_to_sparse_iterator = dense_to_sparse_it;
 		back_element_cached_iterator_valid = true;
+		membership_filter_insert(HandleType{ element_id });
 
 		return HandleType{ element_id };
 	}
@@ -467,18 +647,93 @@ namespace cof
 	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::emplace_back(
 		Args&&... args) -> HandleType
 	{
-		std::size_t element_index = dense_vector.size();
+		std::size_t element_index = size();
 		uint32_t element_id = ++internalIdCounter;
-		dense_vector.emplace_back(std::forward<Args>(args)...);
-		auto sparse_to_dense_it = unordered_map_emplace_and_return_iterator(sparse_to_dense, HandleType{element_id}, element_index);
-		auto dense_to_sparse_it = unordered_map_emplace_and_return_iterator(dense_to_sparse, element_index, HandleType{element_id});
+		construct_back(std::forward<Args>(args)...);
+		auto sparse_to_dense_it = unordered_map_emplace_and_return_iterator(sparse_to_dense, HandleType{ element_id }, element_index);
+		dense_to_sparse.push_back(HandleType{ element_id });
 		back_element_sparse_to_dense_iterator = sparse_to_dense_it;
-		back_element_dense_to_sparse_iterator = dense_to_sparse_it;
 		back_element_cached_iterator_valid = true;
+		membership_filter_insert(HandleType{ element_id });
 
 		return HandleType{ element_id };
 	}
 
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template <typename Assign>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::recycle_back(
+		Assign&& assign) -> HandleType
+	{
+		std::size_t element_index = size();
+		uint32_t element_id = ++internalIdCounter;
+		if (pooled_element_count != 0) {
+			--pooled_element_count;
+		} else {
+			dense_vector.emplace_back();
+		}
+		assign(dense_vector[element_index]);
+		auto sparse_to_dense_it = unordered_map_emplace_and_return_iterator(sparse_to_dense, HandleType{ element_id }, element_index);
+		dense_to_sparse.push_back(HandleType{ element_id });
+		back_element_sparse_to_dense_iterator = sparse_to_dense_it;
+		back_element_cached_iterator_valid = true;
+		membership_filter_insert(HandleType{ element_id });
+
+		return HandleType{ element_id };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template <typename ... Args>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::emplace_with_handle(
+		HandleType handle, Args&&... args) -> reference
+	{
+		assert(!contains(handle));
+		reserve_handle_ids(handle.id);
+		std::size_t element_index = size();
+		construct_back(std::forward<Args>(args)...);
+		auto sparse_to_dense_it = unordered_map_emplace_and_return_iterator(sparse_to_dense, handle, element_index);
+		dense_to_sparse.push_back(handle);
+		back_element_sparse_to_dense_iterator = sparse_to_dense_it;
+		back_element_cached_iterator_valid = true;
+		membership_filter_insert(handle);
+
+		return dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template<typename... Args>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::construct_back(Args&&... args)
+	{
+		if (pooled_element_count != 0) {
+			construct_pooled(PooledAssignKind<Args...>{}, std::forward<Args>(args)...);
+		} else {
+			dense_vector.emplace_back(std::forward<Args>(args)...);
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template<typename Arg>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::construct_pooled(AssignDirectly, Arg&& arg)
+	{
+		dense_vector[size()] = std::forward<Arg>(arg);
+		--pooled_element_count;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template<typename... Args>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::construct_pooled(AssignTemporary, Args&&... args)
+	{
+		dense_vector[size()] = Value(std::forward<Args>(args)...);
+		--pooled_element_count;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template<typename... Args>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::construct_pooled(NotAssignable, Args&&... args)
+	{
+		release_pool();
+		dense_vector.emplace_back(std::forward<Args>(args)...);
+	}
+
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::erase(HandleType handleToDelete)
 	{
@@ -486,37 +741,35 @@ namespace cof
 		assert(removing_sparse_to_dense_it != sparse_to_dense.end());
 		std::size_t removed_element_index = removing_sparse_to_dense_it->second;
 
-		DenseToSparseIterator back_dts_it;
-		if (removed_element_index != dense_vector.size() - 1) {
-			//Get the iterators for the back element where we are going to swap to 
+		std::size_t last_element_index = size() - 1;
+		if (removed_element_index != last_element_index) {
+			//Get the iterator for the back element where we are going to swap to 
 			SparseToDenseIterator back_std_it;
 
 			if (back_element_cached_iterator_valid) {
-				back_dts_it = back_element_dense_to_sparse_iterator;
 				back_std_it = back_element_sparse_to_dense_iterator;
 			} else {
-				back_dts_it = dense_to_sparse.find(dense_vector.size() - 1);
-				back_std_it = sparse_to_dense.find(back_dts_it->second);
+				back_std_it = sparse_to_dense.find(dense_to_sparse.back());
 			}
 
 			assert(vector_in_range(dense_vector, removed_element_index));
 			auto& removed_element = dense_vector[removed_element_index];
-			auto& last_element = dense_vector.back();
+			auto& last_element = dense_vector[last_element_index];
 			std::swap(removed_element, last_element);
 
 			//After the swap, we want to fixup the swapped elements indices and ids in the lookup maps
 			back_std_it->second = removed_element_index;
-			dense_to_sparse.at(removed_element_index) = back_std_it->first;
-		} else {
-			if (back_element_cached_iterator_valid) {
-				back_dts_it = back_element_dense_to_sparse_iterator;
-			} else {
-				back_dts_it = dense_to_sparse.find(dense_vector.size() - 1);
-			}
+			dense_to_sparse[removed_element_index] = back_std_it->first;
 		}
+		membership_filter_erase(handleToDelete);
 		sparse_to_dense.erase(removing_sparse_to_dense_it);
-		dense_to_sparse.erase(back_dts_it);
-		dense_vector.pop_back();
+		dense_to_sparse.pop_back();
+		if (retain_erased_elements) {
+			// The erased element was swapped to the back, it becomes the first pooled element
+			++pooled_element_count;
+		} else {
+			dense_vector.pop_back();
+		}
 
 		back_element_cached_iterator_valid = false;
 	}
@@ -526,9 +779,8 @@ namespace cof
 		const_iterator position)
 	{
 		std::size_t element_index = position - dense_vector.begin();
-		//TODO: Optimize this with custom function
-		assert(dense_to_sparse.find(element_index) != dense_to_sparse.end());
-		HandleType handle = dense_to_sparse.at(element_index);
+		assert(vector_in_range(dense_to_sparse, element_index));
+		HandleType handle = dense_to_sparse[element_index];
 		
 		erase(handle);
 	}
@@ -544,9 +796,8 @@ namespace cof
 
 		auto offset = first - begin();
 		for (int i = 0; i < count; ++i) {
-			auto dense_to_sparse_it = dense_to_sparse.find(offset + i);
-			assert(dense_to_sparse_it != dense_to_sparse.end());
-			handles[i] = dense_to_sparse_it->second;
+			assert(vector_in_range(dense_to_sparse, offset + i));
+			handles[i] = dense_to_sparse[offset + i];
 		}
 
 		for (HandleType handle : handles) {
@@ -554,12 +805,283 @@ namespace cof
 		}
 	}
 
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template<typename Predicate>
+	std::size_t FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::erase_if(Predicate predicate)
+	{
+		detail::SequentialFor sequential{};
+		return erase_if_in_chunks(predicate, sequential, 16384);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template<typename Predicate, typename Pool>
+	std::size_t FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::parallel_erase_if(
+		Predicate predicate, Pool& pool, std::size_t grain)
+	{
+		return erase_if_in_chunks(predicate, pool, grain);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	template<typename Predicate, typename Pool>
+	std::size_t FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::erase_if_in_chunks(
+		Predicate& predicate, Pool& pool, std::size_t grain)
+	{
+		std::size_t element_count = size();
+		if (element_count == 0) {
+			return 0;
+		}
+		grain = grain == 0 ? 1 : grain;
+		std::size_t chunk_count = (element_count + grain - 1) / grain;
+
+		// Mark the elements to erase, and count the survivors of every chunk
+		std::vector<std::uint8_t> doomed(element_count);
+		std::vector<std::size_t> chunk_survivors(chunk_count);
+		pool.parallel_for(element_count, grain, [&](std::size_t begin, std::size_t end) {
+			std::size_t survivors = 0;
+			for (std::size_t i = begin; i < end; ++i) {
+				bool erase_element = predicate(static_cast<const Value&>(dense_vector[i]));
+				doomed[i] = erase_element ? 1 : 0;
+				survivors += erase_element ? 0 : 1;
+			}
+			chunk_survivors[begin / grain] = survivors;
+		});
+		std::size_t survivor_count = 0;
+		for (std::size_t survivors : chunk_survivors) {
+			survivor_count += survivors;
+		}
+		if (survivor_count == element_count) {
+			return 0;
+		}
+
+		// The holes before `survivor_count` are filled by the survivors after it, the n-th hole gets the n-th of those survivors.
+		// The prefix sums of both per chunk give every chunk the rank of it's first hole and survivor
+		std::vector<std::size_t> hole_ranks(chunk_count);
+		std::vector<std::size_t> moved_ranks(chunk_count);
+		pool.parallel_for(element_count, grain, [&](std::size_t begin, std::size_t end) {
+			std::size_t holes = 0;
+			std::size_t moved = 0;
+			for (std::size_t i = begin; i < end; ++i) {
+				holes += (i < survivor_count && doomed[i]) ? 1 : 0;
+				moved += (i >= survivor_count && !doomed[i]) ? 1 : 0;
+			}
+			hole_ranks[begin / grain] = holes;
+			moved_ranks[begin / grain] = moved;
+		});
+		std::size_t hole_total = 0;
+		std::size_t moved_total = 0;
+		for (std::size_t c = 0; c < chunk_count; ++c) {
+			std::size_t holes = hole_ranks[c];
+			std::size_t moved = moved_ranks[c];
+			hole_ranks[c] = hole_total;
+			moved_ranks[c] = moved_total;
+			hole_total += holes;
+			moved_total += moved;
+		}
+		assert(hole_total == moved_total);
+
+		std::vector<std::size_t> moved_indices(moved_total);
+		pool.parallel_for(element_count, grain, [&](std::size_t begin, std::size_t end) {
+			std::size_t rank = moved_ranks[begin / grain];
+			for (std::size_t i = begin < survivor_count ? survivor_count : begin; i < end; ++i) {
+				if (!doomed[i]) {
+					moved_indices[rank++] = i;
+				}
+			}
+		});
+
+		// Every (hole, survivor) pair is swapped by one thread. Finding a handle does not change the sparse_to_dense map, so the indices can be fixed up in parallel
+		pool.parallel_for(survivor_count, grain, [&](std::size_t begin, std::size_t end) {
+			std::size_t rank = hole_ranks[begin / grain];
+			for (std::size_t i = begin; i < end; ++i) {
+				if (doomed[i]) {
+					std::size_t from = moved_indices[rank++];
+					std::swap(dense_vector[i], dense_vector[from]);
+					std::swap(dense_to_sparse[i], dense_to_sparse[from]);
+					sparse_to_dense.find(dense_to_sparse[i])->second = i;
+				}
+			}
+		});
+
+		// All erased elements are after the survivors now
+		for (std::size_t i = survivor_count; i < element_count; ++i) {
+			membership_filter_erase(dense_to_sparse[i]);
+			sparse_to_dense.erase(dense_to_sparse[i]);
+		}
+		dense_to_sparse.erase(dense_to_sparse.begin() + survivor_count, dense_to_sparse.end());
+		if (retain_erased_elements) {
+			pooled_element_count += element_count - survivor_count;
+		} else {
+			dense_vector.erase(dense_vector.begin() + survivor_count, dense_vector.end());
+		}
+		back_element_cached_iterator_valid = false;
+
+		return element_count - survivor_count;
+	}
+
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
 	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::clear()
 	{
-		dense_vector.clear();
+		if (retain_erased_elements) {
+			pooled_element_count = dense_vector.size();
+		} else {
+			dense_vector.clear();
+		}
 		sparse_to_dense.clear();
 		dense_to_sparse.clear();
+		membership_filter.clear();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	uint32_t FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::last_handle_id()
+	{
+		return internalIdCounter;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::reserve_handle_ids(uint32_t last_id)
+	{
+		if (internalIdCounter < last_id) {
+			internalIdCounter = last_id;
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::enable_membership_filter(
+		std::size_t expected_elements)
+	{
+		membership_filter = CountingBloomFilter{ expected_elements > size() ? expected_elements : size() };
+		for (HandleType handle : dense_to_sparse) {
+			membership_filter.insert(std::hash<HandleType>{}(handle));
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::disable_membership_filter()
+	{
+		membership_filter = CountingBloomFilter{};
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	bool FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::membership_filter_enabled() const
+	{
+		return membership_filter.enabled();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::enable_value_pool()
+	{
+		retain_erased_elements = true;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::disable_value_pool()
+	{
+		release_pool();
+		retain_erased_elements = false;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	bool FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::value_pool_enabled() const
+	{
+		return retain_erased_elements;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	std::size_t FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::pooled_count() const
+	{
+		return pooled_element_count;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::release_pool()
+	{
+		for (; pooled_element_count != 0; --pooled_element_count) {
+			dense_vector.pop_back();
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::membership_filter_insert(
+		HandleType handle)
+	{
+		if (membership_filter.enabled()) {
+			if (size() > membership_filter.capacity() * 2) {
+				// The handle is already in dense_to_sparse, so the rebuild includes it
+				enable_membership_filter(size() * 2);
+			} else {
+				membership_filter.insert(std::hash<HandleType>{}(handle));
+			}
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::membership_filter_erase(
+		HandleType handle)
+	{
+		if (membership_filter.enabled()) {
+			membership_filter.erase(std::hash<HandleType>{}(handle));
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	bool FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::membership_filter_rejects(
+		HandleType handle) const
+	{
+		return membership_filter.enabled() && !membership_filter.may_contain(std::hash<HandleType>{}(handle));
+	}
+
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::Cursor(FlatValueMap& container, std::size_t index)
+		: container(&container)
+		, element_index(index)
+	{
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::operator bool() const
+	{
+		return element_index < container->size();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::operator*() const -> reference
+	{
+		assert(element_index < container->size());
+		return container->dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::operator->() const -> pointer
+	{
+		assert(element_index < container->size());
+		return &container->dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::operator++() -> Cursor&
+	{
+		++element_index;
+		return *this;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::handle() const -> HandleType
+	{
+		return container->handle_at(element_index);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	std::size_t FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::index() const
+	{
+		return element_index;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	void FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>::Cursor::erase()
+	{
+		// Erasing by handle swaps the back element into element_index, so staying at the same index visits it next
+		container->erase(handle());
 	}
 
 
@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "utils/sorted_intersection.h"
+
+
+namespace cof
+{
+	/// A handle that is in both containers of an intersect() call, as the dense index in each container
+	struct MatchedIndices
+	{
+		std::size_t first_index;
+		std::size_t second_index;
+	};
+
+	/** \brief The handle ids of a FlatValueMap or LightFlatValueMap in sorted order, next to the dense index of every handle.
+	 *
+	 * \class SortedHandleIndex
+	 *
+	 * Build this on demand before intersecting, it does not track changes to the container. Calling rebuild() reuses the memory of the previous build.
+	 * The ids and dense indices are stored in two separate arrays, so the intersection kernels can load the ids with SIMD.
+	*/
+	class SortedHandleIndex
+	{
+	public:
+		SortedHandleIndex() = default;
+		// Build the index for the handles in `container`
+		template<typename Container>
+		explicit SortedHandleIndex(const Container& container);
+
+		// Throw away the old index and build it again for the handles in `container`
+		template<typename Container>
+		void rebuild(const Container& container);
+
+		// The amount of handles in the index
+		std::size_t size() const;
+		// The sorted handle ids
+		auto ids() const->const std::uint32_t*;
+		// The dense index of every handle in ids()
+		auto dense_indices() const->const std::uint32_t*;
+
+	private:
+		std::vector<std::uint32_t> sorted_ids;
+		std::vector<std::uint32_t> sorted_dense_indices;
+		// Handle id and dense index packed as (id << 32 | index), so sorting does not have to move two arrays
+		std::vector<std::uint64_t> packed_scratch;
+	};
+
+	// Handles are matched by id, so intersecting only makes sense when both containers hold handles of the same entities.
+	// The id counter is static, so it is shared by the containers of one FlatValueMap instantiation. Containers of different instantiations (e.g. a different Value) count separately,
+	// two of those that both push_back() give out the same ids for unrelated elements.
+	// Fill the second container with emplace_with_handle() and the handles of the first (or of one other container that owns the ids), never with push_back().
+
+	// Find the handles that are in both indices, and append their dense index pairs to `out` (in ascending handle order).
+	void intersect(const SortedHandleIndex& first, const SortedHandleIndex& second, std::vector<MatchedIndices>& out);
+
+	// Find the handles that are in both containers, see above for where the handles have to come from. Builds a SortedHandleIndex for both containers, keep the indices around and use the other overload when intersecting more then once.
+	// \returns the dense index pairs of the matching handles (in ascending handle order)
+	template<typename FirstContainer, typename SecondContainer>
+	auto intersect(const FirstContainer& first, const SecondContainer& second)->std::vector<MatchedIndices>;
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename Container>
+	SortedHandleIndex::SortedHandleIndex(const Container& container)
+	{
+		rebuild(container);
+	}
+
+	template<typename Container>
+	void SortedHandleIndex::rebuild(const Container& container)
+	{
+		assert(container.size() <= UINT32_MAX);
+
+		packed_scratch.clear();
+		packed_scratch.reserve(container.size());
+		for (auto it = container.handles_begin(); it != container.handles_end(); ++it) {
+			packed_scratch.push_back((static_cast<std::uint64_t>(it->first.id) << 32) | static_cast<std::uint64_t>(it->second));
+		}
+		std::sort(packed_scratch.begin(), packed_scratch.end());
+
+		sorted_ids.resize(packed_scratch.size());
+		sorted_dense_indices.resize(packed_scratch.size());
+		for (std::size_t i = 0; i < packed_scratch.size(); ++i) {
+			sorted_ids[i] = static_cast<std::uint32_t>(packed_scratch[i] >> 32);
+			sorted_dense_indices[i] = static_cast<std::uint32_t>(packed_scratch[i]);
+		}
+	}
+
+	inline std::size_t SortedHandleIndex::size() const
+	{
+		return sorted_ids.size();
+	}
+
+	inline auto SortedHandleIndex::ids() const -> const std::uint32_t*
+	{
+		return sorted_ids.data();
+	}
+
+	inline auto SortedHandleIndex::dense_indices() const -> const std::uint32_t*
+	{
+		return sorted_dense_indices.data();
+	}
+
+	inline void intersect(const SortedHandleIndex& first, const SortedHandleIndex& second, std::vector<MatchedIndices>& out)
+	{
+		std::size_t max_matches = first.size() < second.size() ? first.size() : second.size();
+		std::vector<std::uint32_t> first_positions(max_matches);
+		std::vector<std::uint32_t> second_positions(max_matches);
+
+		std::size_t matches = simd::intersect_sorted(first.ids(), first.size(), second.ids(), second.size(), first_positions.data(), second_positions.data());
+
+		out.reserve(out.size() + matches);
+		for (std::size_t i = 0; i < matches; ++i) {
+			out.push_back(MatchedIndices{ first.dense_indices()[first_positions[i]], second.dense_indices()[second_positions[i]] });
+		}
+	}
+
+	template<typename FirstContainer, typename SecondContainer>
+	auto intersect(const FirstContainer& first, const SecondContainer& second) -> std::vector<MatchedIndices>
+	{
+		static_assert(std::is_same<typename FirstContainer::HandleType, typename SecondContainer::HandleType>::value,
+			"Only containers with the same handle type can be intersected");
+
+		std::vector<MatchedIndices> matches;
+		intersect(SortedHandleIndex{ first }, SortedHandleIndex{ second }, matches);
+		return matches;
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+#include "flat_value_map.h"
+#include "utils/simd_kernels.h"
+
+
+namespace cof
+{
+	/** \brief Query functions over FlatValueMaps that contain numbers.
+	 *
+	 * Because a FlatValueMap keeps it's elements and their handles in two contiguous arrays in the same order, queries can scan the elements directly and read the handle of a match from the same index.
+	 * For float, double and int32_t values the scans use AVX2 when the CPU supports it (see utils/simd_kernels.h), every other arithmetic type uses a scalar loop.
+	 * The elements are scanned in dense order, which is not the insertion order after an erase(). So which handle is returned for equal extremes depends on that order.
+	 */
+
+	// A range predicate for count_if() and select_if(), matches the values in the inclusive range [low, high]
+	template<typename T>
+	struct InRange
+	{
+		T low;
+		T high;
+
+		bool operator()(const T& value) const { return value >= low && value <= high; }
+	};
+
+	// The handle and value of the smallest or biggest element
+	template<typename HandleType, typename T>
+	struct Extremum
+	{
+		HandleType handle;
+		T value;
+	};
+
+	// Create a InRange predicate matching [low, high]
+	template<typename T>
+	auto in_range(T low, T high)->InRange<T>;
+
+	// Add up all elements
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto sum(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm)->simd::sum_t<Value>;
+
+	// Get the handle and value of the smallest element, `fvm` cannot be empty.
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto find_min(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm)->Extremum<SparseHandle, Value>;
+	// Get the handle and value of the biggest element, `fvm` cannot be empty.
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto find_max(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm)->Extremum<SparseHandle, Value>;
+
+	// Count the elements in the range of the predicate. This overload is vectorized
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	std::size_t count_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, InRange<Value> predicate);
+	// Count the elements for which `predicate` returns true. This overload is NOT vectorized
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator, typename Predicate>
+	std::size_t count_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, Predicate predicate);
+
+	// Write the handles of the elements in the range of the predicate to `out`, which needs room for fvm.size() handles. This overload is vectorized
+	// \returns the amount of handles written
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	std::size_t select_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, InRange<Value> predicate, SparseHandle* out);
+	// Write the handles of the elements for which `predicate` returns true to `out`, which needs room for fvm.size() handles. This overload is NOT vectorized
+	// \returns the amount of handles written
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator, typename Predicate>
+	std::size_t select_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, Predicate predicate, SparseHandle* out);
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename T>
+	auto in_range(T low, T high) -> InRange<T>
+	{
+		return InRange<T>{ low, high };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto sum(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm) -> simd::sum_t<Value>
+	{
+		static_assert(std::is_arithmetic<Value>::value, "sum() is only available for FlatValueMaps with arithmetic values");
+		return simd::sum(fvm.data(), fvm.size());
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto find_min(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm) -> Extremum<SparseHandle, Value>
+	{
+		static_assert(std::is_arithmetic<Value>::value, "find_min() is only available for FlatValueMaps with arithmetic values");
+		assert(!fvm.empty());
+		std::size_t index = simd::min_index(fvm.data(), fvm.size());
+		return Extremum<SparseHandle, Value>{ fvm.handle_at(index), fvm.data()[index] };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	auto find_max(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm) -> Extremum<SparseHandle, Value>
+	{
+		static_assert(std::is_arithmetic<Value>::value, "find_max() is only available for FlatValueMaps with arithmetic values");
+		assert(!fvm.empty());
+		std::size_t index = simd::max_index(fvm.data(), fvm.size());
+		return Extremum<SparseHandle, Value>{ fvm.handle_at(index), fvm.data()[index] };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	std::size_t count_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, InRange<Value> predicate)
+	{
+		return simd::count_in_range(fvm.data(), fvm.size(), predicate.low, predicate.high);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator, typename Predicate>
+	std::size_t count_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, Predicate predicate)
+	{
+		std::size_t matches = 0;
+		for (const Value& value : fvm) {
+			if (predicate(value)) {
+				++matches;
+			}
+		}
+		return matches;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator>
+	std::size_t select_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, InRange<Value> predicate, SparseHandle* out)
+	{
+		return simd::select_in_range(fvm.data(), fvm.handle_data(), fvm.size(), predicate.low, predicate.high, out);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator, typename DenseToSparseAllocator, typename Predicate>
+	std::size_t select_if(const FlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator, DenseToSparseAllocator>& fvm, Predicate predicate, SparseHandle* out)
+	{
+		const Value* values = fvm.data();
+		const SparseHandle* handles = fvm.handle_data();
+		std::size_t written = 0;
+		for (std::size_t i = 0; i < fvm.size(); ++i) {
+			if (predicate(values[i])) {
+				out[written++] = handles[i];
+			}
+		}
+		return written;
+	}
+}
@@ -0,0 +1,496 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "utils/column_codec.h"
+#include "utils/file_utils.h"
+
+
+namespace cof
+{
+	/// How the handles and values are stored in a snapshot
+	enum class SnapshotEncoding : std::uint32_t
+	{
+		// The handle ids and values as raw bytes, in dense order. Loading keeps the dense order
+		raw = 0,
+		// Sorted by handle, the ids as delta varints and the values as raw bytes. Loading puts the elements in handle order
+		delta_varint = 1,
+		// Like delta_varint, and the values are compressed per byte plane (see utils/column_codec.h)
+		compressed = 2,
+	};
+
+	/// The header of a snapshot, which stores all elements of a map with their handles
+	struct SnapshotInfo
+	{
+		static constexpr std::uint64_t expected_magic = 0x31504E5346464F43ull; // "COFFSNP1"
+		static constexpr std::uint32_t expected_format_version = 2;
+
+		std::uint64_t magic = expected_magic;
+		std::uint32_t format_version = expected_format_version;
+		std::uint32_t value_size = 0;
+		// The last handle id that was made when the snapshot was written, loading the snapshot makes sure new handles get a higher id
+		std::uint32_t last_id = 0;
+		SnapshotEncoding encoding = SnapshotEncoding::raw;
+		// A number chosen by the writer, for example to match the snapshot with a log
+		std::uint64_t generation = 0;
+		std::uint64_t element_count = 0;
+	};
+
+	// The amount of elements in one block of a snapshot, the decoder only keeps one block in memory
+	constexpr std::size_t snapshot_block_elements = 4096;
+
+	/** Encode a snapshot of `count` elements and pass the bytes to `write(const void* data, std::size_t size)->bool`.
+	 *
+	 * The snapshot is the header and a sequence of blocks, every block has a checksum. The values are stored as raw bytes,
+	 * so `Value` has to be trivially copyable and the snapshot can only be read on a machine with the same byte order.
+	*/
+	template<typename HandleType, typename Value, typename Write>
+	bool encode_snapshot(Write&& write, const HandleType* handles, const Value* values, std::size_t count, std::uint32_t last_id,
+		std::uint64_t generation = 0, SnapshotEncoding encoding = SnapshotEncoding::delta_varint);
+	// Encode a snapshot of all elements in `map` into `out`, for example to send it to a replica
+	template<typename Map>
+	void encode_snapshot(const Map& map, std::vector<unsigned char>& out, SnapshotEncoding encoding = SnapshotEncoding::delta_varint, std::uint64_t generation = 0);
+
+	/** \brief Decodes a snapshot one block at a time, so a map can be rebuilt in one pass without holding the whole snapshot in memory.
+	 *
+	 * \class SnapshotDecoder
+	 *
+	 * `for (SnapshotDecoder<Handle, Value> decoder{ read }; decoder.next_block(); ) { use decoder.block_handles() and decoder.block_values() }`, then check finished().
+	*/
+	template<typename HandleType, typename Value>
+	class SnapshotDecoder
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "Snapshots store the values as raw bytes");
+
+	public:
+		// Reads exactly `size` bytes into the buffer, \returns false if there are not enough bytes
+		using ReadFunction = std::function<bool(void*, std::size_t)>;
+
+		// Reads the header, check is_valid() to see if it is a snapshot for this value type
+		explicit SnapshotDecoder(ReadFunction read);
+
+		// \returns false if the header did not match or a block was corrupted
+		bool is_valid() const;
+		// \returns if every block was read and the element count matched the header
+		bool finished() const;
+		auto info() const->const SnapshotInfo&;
+
+		// Decode the next block
+		// \returns false after the last block or after a error
+		bool next_block();
+		// The amount of elements in the current block
+		std::size_t block_size() const;
+		auto block_handles() const->const HandleType*;
+		auto block_values() const->const Value*;
+
+	private:
+		using ValueStorage = typename std::aligned_storage<sizeof(Value), alignof(Value)>::type;
+
+		bool fail();
+
+		ReadFunction read;
+		SnapshotInfo header{};
+		bool valid = false;
+		bool reached_end = false;
+		std::uint64_t decoded_count = 0;
+		std::uint32_t previous_id = 0;
+
+		std::vector<unsigned char> payload{};
+		std::vector<HandleType> handles{};
+		std::vector<ValueStorage> values{};
+	};
+
+	// Write a snapshot of `count` elements to `file`
+	template<typename HandleType, typename Value>
+	bool write_snapshot(std::FILE* file, const HandleType* handles, const Value* values, std::size_t count, std::uint32_t last_id,
+		std::uint64_t generation = 0, SnapshotEncoding encoding = SnapshotEncoding::delta_varint);
+	// Write a snapshot of all elements in `map`
+	template<typename Map>
+	bool write_snapshot(std::FILE* file, const Map& map, std::uint64_t generation = 0, SnapshotEncoding encoding = SnapshotEncoding::delta_varint);
+	// Replace the elements of `map` by the elements in the snapshot, in one pass over the file
+	// \returns false if the file is not a valid snapshot for this value type, `map` is empty in that case
+	template<typename Map>
+	bool read_snapshot(std::FILE* file, Map& map, SnapshotInfo* info = nullptr);
+	// Replace the elements of `map` by the elements in a snapshot made with encode_snapshot()
+	template<typename Map>
+	bool decode_snapshot(const unsigned char* data, std::size_t size, Map& map, SnapshotInfo* info = nullptr);
+
+	// Write a snapshot of `map` to a temporary file and replace `path` with it, so `path` always has a complete snapshot, even after a crash
+	template<typename Map>
+	bool save_snapshot(const std::string& path, const Map& map, std::uint64_t generation = 0, SnapshotEncoding encoding = SnapshotEncoding::delta_varint);
+	// Save a snapshot of `count` elements to `path` in the same way
+	template<typename HandleType, typename Value>
+	bool save_snapshot(const std::string& path, const HandleType* handles, const Value* values, std::size_t count, std::uint32_t last_id,
+		std::uint64_t generation = 0, SnapshotEncoding encoding = SnapshotEncoding::delta_varint);
+	// Replace the elements of `map` by the elements in the snapshot file at `path`
+	template<typename Map>
+	bool load_snapshot(const std::string& path, Map& map, SnapshotInfo* info = nullptr);
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	namespace detail
+	{
+		// Every block starts with this, followed by `payload_size` bytes and a checksum of the block header and payload. A block with 0 elements ends the snapshot
+		struct SnapshotBlockHeader
+		{
+			std::uint32_t element_count;
+			std::uint32_t payload_size;
+		};
+
+		// The biggest payload a block of `element_count` elements can have in any encoding, a block header that claims more is corrupted
+		constexpr std::size_t max_block_payload_size(std::size_t element_count, std::size_t value_size)
+		{
+			return element_count * max_varint_size + byte_plane_max_size(element_count, value_size);
+		}
+
+		template<typename Map, typename Decoder>
+		bool rebuild_from_snapshot(Decoder& decoder, Map& map, SnapshotInfo* info)
+		{
+			map.clear();
+			if (!decoder.is_valid()) {
+				return false;
+			}
+			bool duplicate = false;
+			while (!duplicate && decoder.next_block()) {
+				const auto* handles = decoder.block_handles();
+				const auto* values = decoder.block_values();
+				for (std::size_t i = 0; i < decoder.block_size() && !duplicate; ++i) {
+					// The decoder only sees one block, a raw snapshot can repeat a handle of a earlier block
+					duplicate = map.contains(handles[i]);
+					if (!duplicate) {
+						map.emplace_with_handle(handles[i], values[i]);
+					}
+				}
+			}
+			if (duplicate || !decoder.finished()) {
+				map.clear();
+				return false;
+			}
+
+			Map::reserve_handle_ids(decoder.info().last_id);
+			if (info != nullptr) {
+				*info = decoder.info();
+			}
+			return true;
+		}
+	}
+
+	template<typename HandleType, typename Value, typename Write>
+	bool encode_snapshot(Write&& write, const HandleType* handles, const Value* values, std::size_t count, std::uint32_t last_id,
+		std::uint64_t generation, SnapshotEncoding encoding)
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "Snapshots store the values as raw bytes");
+
+		SnapshotInfo info{};
+		info.value_size = static_cast<std::uint32_t>(sizeof(Value));
+		info.last_id = last_id;
+		info.encoding = encoding;
+		info.generation = generation;
+		info.element_count = count;
+		Checksum header_checksum{};
+		header_checksum.update(&info, sizeof(info));
+		std::uint32_t header_checksum_value = header_checksum.value();
+		if (!write(&info, sizeof(info)) || !write(&header_checksum_value, sizeof(header_checksum_value))) {
+			return false;
+		}
+
+		// The delta encodings visit the elements in handle order, sorted as (id << 32 | dense index)
+		std::vector<std::uint64_t> order;
+		if (encoding != SnapshotEncoding::raw) {
+			order.resize(count);
+			for (std::size_t i = 0; i < count; ++i) {
+				order[i] = (static_cast<std::uint64_t>(handles[i].id) << 32) | static_cast<std::uint64_t>(i);
+			}
+			std::sort(order.begin(), order.end());
+		}
+
+		std::vector<unsigned char> payload;
+		std::vector<unsigned char> gathered_values;
+		std::uint32_t previous_id = 0;
+		for (std::size_t first = 0;;) {
+			std::size_t block_count = count - first < snapshot_block_elements ? count - first : snapshot_block_elements;
+			payload.clear();
+			gathered_values.resize(block_count * sizeof(Value));
+
+			for (std::size_t i = 0; i < block_count; ++i) {
+				std::size_t index = encoding == SnapshotEncoding::raw ? first + i : static_cast<std::size_t>(order[first + i] & 0xFFFFFFFFu);
+				std::uint32_t id = handles[index].id;
+				if (encoding == SnapshotEncoding::raw) {
+					const auto* id_bytes = reinterpret_cast<const unsigned char*>(&id);
+					payload.insert(payload.end(), id_bytes, id_bytes + sizeof(id));
+				} else {
+					varint_encode(id - previous_id, payload);
+					previous_id = id;
+				}
+				std::memcpy(gathered_values.data() + i * sizeof(Value), values + index, sizeof(Value));
+			}
+			if (encoding == SnapshotEncoding::compressed) {
+				byte_plane_encode(gathered_values.data(), block_count, sizeof(Value), payload);
+			} else {
+				payload.insert(payload.end(), gathered_values.begin(), gathered_values.end());
+			}
+
+			detail::SnapshotBlockHeader block_header{ static_cast<std::uint32_t>(block_count), static_cast<std::uint32_t>(payload.size()) };
+			Checksum checksum{};
+			checksum.update(&block_header, sizeof(block_header));
+			checksum.update(payload.data(), payload.size());
+			std::uint32_t checksum_value = checksum.value();
+			if (!write(&block_header, sizeof(block_header)) || (!payload.empty() && !write(payload.data(), payload.size())) || !write(&checksum_value, sizeof(checksum_value))) {
+				return false;
+			}
+			// The empty block after the last element ends the snapshot
+			if (block_count == 0) {
+				break;
+			}
+			first += block_count;
+		}
+		return true;
+	}
+
+	template<typename Map>
+	void encode_snapshot(const Map& map, std::vector<unsigned char>& out, SnapshotEncoding encoding, std::uint64_t generation)
+	{
+		out.clear();
+		encode_snapshot([&out](const void* data, std::size_t size) {
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			out.insert(out.end(), bytes, bytes + size);
+			return true;
+		}, map.handle_data(), map.data(), map.size(), Map::last_handle_id(), generation, encoding);
+	}
+
+	template<typename HandleType, typename Value>
+	SnapshotDecoder<HandleType, Value>::SnapshotDecoder(ReadFunction read)
+		: read(std::move(read))
+	{
+		std::uint32_t stored_checksum = 0;
+		if (!this->read(&header, sizeof(header)) || !this->read(&stored_checksum, sizeof(stored_checksum))) {
+			return;
+		}
+		Checksum checksum{};
+		checksum.update(&header, sizeof(header));
+		valid = checksum.value() == stored_checksum
+			&& header.magic == SnapshotInfo::expected_magic
+			&& header.format_version == SnapshotInfo::expected_format_version
+			&& header.value_size == sizeof(Value)
+			&& static_cast<std::uint32_t>(header.encoding) <= static_cast<std::uint32_t>(SnapshotEncoding::compressed);
+	}
+
+	template<typename HandleType, typename Value>
+	bool SnapshotDecoder<HandleType, Value>::is_valid() const
+	{
+		return valid;
+	}
+
+	template<typename HandleType, typename Value>
+	bool SnapshotDecoder<HandleType, Value>::finished() const
+	{
+		return valid && reached_end && decoded_count == header.element_count;
+	}
+
+	template<typename HandleType, typename Value>
+	auto SnapshotDecoder<HandleType, Value>::info() const -> const SnapshotInfo&
+	{
+		return header;
+	}
+
+	template<typename HandleType, typename Value>
+	bool SnapshotDecoder<HandleType, Value>::next_block()
+	{
+		handles.clear();
+		if (!valid || reached_end) {
+			return false;
+		}
+
+		detail::SnapshotBlockHeader block_header{};
+		// Check the sizes before the checksum, the payload is only allocated for a block that could be valid
+		if (!read(&block_header, sizeof(block_header)) || block_header.element_count > snapshot_block_elements
+			|| block_header.payload_size > detail::max_block_payload_size(block_header.element_count, sizeof(Value))) {
+			return fail();
+		}
+		payload.resize(block_header.payload_size);
+		std::uint32_t stored_checksum = 0;
+		if (!read(payload.data(), payload.size()) || !read(&stored_checksum, sizeof(stored_checksum))) {
+			return fail();
+		}
+		Checksum checksum{};
+		checksum.update(&block_header, sizeof(block_header));
+		checksum.update(payload.data(), payload.size());
+		if (checksum.value() != stored_checksum) {
+			return fail();
+		}
+
+		std::size_t count = block_header.element_count;
+		if (count == 0) {
+			reached_end = true;
+			return false;
+		}
+
+		const unsigned char* position = payload.data();
+		const unsigned char* end = payload.data() + payload.size();
+		handles.resize(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			std::uint32_t id = 0;
+			if (header.encoding == SnapshotEncoding::raw) {
+				if (end - position < static_cast<std::ptrdiff_t>(sizeof(id))) {
+					return fail();
+				}
+				std::memcpy(&id, position, sizeof(id));
+				position += sizeof(id);
+				if (id == 0) {
+					return fail();
+				}
+			} else {
+				// The ids are sorted, a delta of 0 is a repeated id (or id 0) and a id can not wrap around
+				std::uint32_t delta = 0;
+				if (!varint_decode(&position, end, delta) || delta == 0 || delta > UINT32_MAX - previous_id) {
+					return fail();
+				}
+				id = previous_id + delta;
+				previous_id = id;
+			}
+			handles[i] = HandleType{ id };
+		}
+
+		values.resize(count);
+		auto* value_bytes = reinterpret_cast<unsigned char*>(values.data());
+		std::size_t remaining = static_cast<std::size_t>(end - position);
+		if (header.encoding == SnapshotEncoding::compressed) {
+			if (!byte_plane_decode(position, remaining, count, sizeof(Value), value_bytes)) {
+				return fail();
+			}
+		} else {
+			if (remaining != count * sizeof(Value)) {
+				return fail();
+			}
+			std::memcpy(value_bytes, position, remaining);
+		}
+
+		decoded_count += count;
+		return true;
+	}
+
+	template<typename HandleType, typename Value>
+	std::size_t SnapshotDecoder<HandleType, Value>::block_size() const
+	{
+		return handles.size();
+	}
+
+	template<typename HandleType, typename Value>
+	auto SnapshotDecoder<HandleType, Value>::block_handles() const -> const HandleType*
+	{
+		return handles.data();
+	}
+
+	template<typename HandleType, typename Value>
+	auto SnapshotDecoder<HandleType, Value>::block_values() const -> const Value*
+	{
+		return reinterpret_cast<const Value*>(values.data());
+	}
+
+	template<typename HandleType, typename Value>
+	bool SnapshotDecoder<HandleType, Value>::fail()
+	{
+		valid = false;
+		handles.clear();
+		return false;
+	}
+
+	template<typename HandleType, typename Value>
+	bool write_snapshot(std::FILE* file, const HandleType* handles, const Value* values, std::size_t count, std::uint32_t last_id,
+		std::uint64_t generation, SnapshotEncoding encoding)
+	{
+		return encode_snapshot([file](const void* data, std::size_t size) { return write_bytes(file, data, size); },
+			handles, values, count, last_id, generation, encoding);
+	}
+
+	template<typename Map>
+	bool write_snapshot(std::FILE* file, const Map& map, std::uint64_t generation, SnapshotEncoding encoding)
+	{
+		return write_snapshot(file, map.handle_data(), map.data(), map.size(), Map::last_handle_id(), generation, encoding);
+	}
+
+	template<typename Map>
+	bool read_snapshot(std::FILE* file, Map& map, SnapshotInfo* info)
+	{
+		SnapshotDecoder<typename Map::HandleType, typename Map::ValueType> decoder{
+			[file](void* out, std::size_t size) { return read_bytes(file, out, size); }
+		};
+		return detail::rebuild_from_snapshot(decoder, map, info);
+	}
+
+	template<typename Map>
+	bool decode_snapshot(const unsigned char* data, std::size_t size, Map& map, SnapshotInfo* info)
+	{
+		std::size_t offset = 0;
+		SnapshotDecoder<typename Map::HandleType, typename Map::ValueType> decoder{
+			[data, size, &offset](void* out, std::size_t read_size) {
+				if (size - offset < read_size) {
+					return false;
+				}
+				if (read_size != 0) {
+					std::memcpy(out, data + offset, read_size);
+				}
+				offset += read_size;
+				return true;
+			}
+		};
+		if (!detail::rebuild_from_snapshot(decoder, map, info)) {
+			return false;
+		}
+		if (offset != size) {
+			map.clear();
+			return false;
+		}
+		return true;
+	}
+
+	template<typename Map>
+	bool save_snapshot(const std::string& path, const Map& map, std::uint64_t generation, SnapshotEncoding encoding)
+	{
+		return save_snapshot(path, map.handle_data(), map.data(), map.size(), Map::last_handle_id(), generation, encoding);
+	}
+
+	template<typename HandleType, typename Value>
+	bool save_snapshot(const std::string& path, const HandleType* handles, const Value* values, std::size_t count, std::uint32_t last_id,
+		std::uint64_t generation, SnapshotEncoding encoding)
+	{
+		std::string temporary_path = path + ".tmp";
+		std::FILE* file = open_file(temporary_path, "wb");
+		if (file == nullptr) {
+			return false;
+		}
+		bool ok = write_snapshot(file, handles, values, count, last_id, generation, encoding) && sync_file(file);
+		ok = std::fclose(file) == 0 && ok;
+		if (!ok) {
+			std::remove(temporary_path.c_str());
+			return false;
+		}
+		return replace_file(temporary_path, path);
+	}
+
+	template<typename Map>
+	bool load_snapshot(const std::string& path, Map& map, SnapshotInfo* info)
+	{
+		std::FILE* file = open_file(path, "rb");
+		if (file == nullptr) {
+			map.clear();
+			return false;
+		}
+		bool ok = read_snapshot(file, map, info);
+		std::fclose(file);
+		return ok;
+	}
+}
@@ -0,0 +1,564 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils/column_codec.h"
+#include "utils/file_utils.h"
+
+
+namespace cof
+{
+	/// The kinds of events in a trace
+	enum class TraceOp : std::uint8_t
+	{
+		// A element was added, the id is the id of it's new handle
+		push_back = 1,
+		// The element with the id was erased
+		erase = 2,
+		// The element with the id was looked up, with operator[], find() or contains()
+		access = 3,
+		// All elements were iterated, the id is the size of the map at that moment
+		iterate = 4,
+		// All elements were erased
+		clear = 5,
+	};
+
+	struct TraceEvent
+	{
+		TraceOp op;
+		std::uint32_t id;
+	};
+
+	/** \brief Writes the events of a map to a compact binary trace file, for replaying production access patterns in a benchmark.
+	 *
+	 * \class TraceRecorder
+	 *
+	 * A trace is a 16 byte header (magic, version, value size) followed by one byte with the TraceOp and the id as a varint for every event, mostly 3 to 4 bytes per event.
+	 * record() only appends to a 64 KiB buffer, which is written to the file when it is full, so recording costs a few nanoseconds per event.
+	 * A recorder is not thread safe, use one recorder per map.
+	*/
+	class TraceRecorder
+	{
+	public:
+		static constexpr std::uint64_t magic = 0x3143525446464F43ull; // "COFFTRC1"
+		static constexpr std::uint32_t version = 1;
+		// A event is at most 6 bytes: the op and a 5 byte varint
+		static constexpr std::size_t max_event_size = 1 + max_varint_size;
+
+		TraceRecorder() = default;
+		// Create (or truncate) the trace file at `path`. `value_size` is stored so a replay can use elements of the same size
+		explicit TraceRecorder(const std::string& path, std::uint32_t value_size = 0);
+		TraceRecorder(const TraceRecorder&) = delete;
+		TraceRecorder& operator=(const TraceRecorder&) = delete;
+		// Writes the buffered events
+		~TraceRecorder();
+
+		bool is_open() const;
+		// Add a event to the trace
+		void record(TraceOp op, std::uint32_t id);
+		// Write the buffered events to the file
+		bool flush();
+		// Write the buffered events and close the file
+		bool close();
+		// The amount of events recorded so far
+		std::uint64_t event_count() const;
+
+	private:
+		static constexpr std::size_t buffer_size = 64 * 1024;
+
+		std::FILE* file = nullptr;
+		std::vector<unsigned char> buffer{};
+		std::size_t buffered = 0;
+		std::uint64_t events = 0;
+		bool write_failed = false;
+	};
+
+	// Read all events of the trace at `path`. `value_size` gets the value size the trace was recorded with
+	// The file is decoded in 64 KiB chunks, only the events are kept in memory
+	// \returns false if the file can not be read or is not a trace, a trace that ends in the middle of a event (because the recorder was not closed) keeps the complete events
+	bool read_trace(const std::string& path, std::vector<TraceEvent>& events, std::uint32_t* value_size = nullptr);
+
+	/** \brief A map that records every push_back, erase, lookup and iteration to a TraceRecorder, and otherwise behaves like the map it wraps.
+	 *
+	 * \class TracedMap
+	 *
+	 * Works with FlatValueMap, LightFlatValueMap and the other maps with the same interface. Pass nullptr as recorder to stop recording without changing the type.
+	 * Only the functions below are recorded, inner() gives the wrapped map for everything else (without recording it).
+	*/
+	template<typename Map>
+	class TracedMap
+	{
+	public:
+		using HandleType = typename Map::HandleType;
+		using ValueType = typename Map::ValueType;
+		using iterator = typename Map::iterator;
+		using const_iterator = typename Map::const_iterator;
+		using reference = typename Map::reference;
+		using const_reference = typename Map::const_reference;
+
+		explicit TracedMap(TraceRecorder* recorder = nullptr);
+
+		auto operator[](HandleType handle)->reference;
+		auto operator[](HandleType handle) const->const_reference;
+		bool contains(HandleType handle) const;
+		auto find(HandleType handle)->iterator;
+		auto find(HandleType handle) const->const_iterator;
+
+		// Records a iteration of all elements
+		auto begin()->iterator;
+		// Records a iteration of all elements
+		auto begin() const->const_iterator;
+		auto end()->iterator;
+		auto end() const->const_iterator;
+
+		std::size_t size() const;
+		bool empty() const;
+
+		auto push_back(const ValueType& value)->HandleType;
+		auto push_back(ValueType&& value)->HandleType;
+		template<typename... Args>
+		auto emplace_back(Args&&... args)->HandleType;
+		void erase(HandleType handle);
+		void clear();
+
+		// The wrapped map, changes through it are not recorded
+		auto inner()->Map&;
+		auto inner() const->const Map&;
+		// Change the recorder, nullptr stops recording
+		void set_recorder(TraceRecorder* new_recorder);
+
+	private:
+		void record(TraceOp op, std::uint32_t id) const;
+
+		Map map{};
+		TraceRecorder* recorder;
+	};
+
+	/** \brief Replays the events of a trace on a map.
+	 *
+	 * \class TraceReplayer
+	 *
+	 * prepare() gives every traced id a dense slot, and the slots hold the handles the map gives out while replaying.
+	 * The traced ids come from a process wide counter and can be large, the slots keep the memory at the amount of distinct ids in the trace.
+	 * A trace that was started on a map that already had elements refers to elements it never pushed, prepare() adds those first.
+	 * Lookups and iterations read the first byte of the elements, checksum() returns them combined so the compiler can not skip the reads.
+	*/
+	template<typename Map>
+	class TraceReplayer
+	{
+	public:
+		using HandleType = typename Map::HandleType;
+
+		// Keeps a reference to `events`, they have to outlive the replayer. Replaying many maps from one trace does not copy it
+		explicit TraceReplayer(const std::vector<TraceEvent>& events);
+		TraceReplayer(std::vector<TraceEvent>&& events) = delete;
+
+		// Give every id in the trace a slot, and push the elements the trace uses before it pushed them
+		void prepare(Map& map);
+		// Replay one event on `map`
+		void replay(Map& map, const TraceEvent& event);
+		std::uint32_t checksum() const;
+
+	private:
+		// The slot of `traced_id`, a new one if it has none yet
+		std::uint32_t slot_of(std::uint32_t traced_id);
+		static std::uint32_t first_byte(const typename Map::ValueType& value);
+
+		const std::vector<TraceEvent>& events;
+		// The slot of every traced id, the handles and alive flags are indexed by slot
+		std::unordered_map<std::uint32_t, std::uint32_t> slots{};
+		std::vector<HandleType> handles{};
+		std::vector<std::uint8_t> alive{};
+		std::uint32_t sum = 0;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline TraceRecorder::TraceRecorder(const std::string& path, std::uint32_t value_size)
+		: file(open_file(path, "wb"))
+		, buffer(buffer_size)
+	{
+		if (file == nullptr) {
+			return;
+		}
+		unsigned char header[16];
+		std::uint64_t header_magic = magic;
+		std::uint32_t header_version = version;
+		std::memcpy(header, &header_magic, 8);
+		std::memcpy(header + 8, &header_version, 4);
+		std::memcpy(header + 12, &value_size, 4);
+		if (!write_bytes(file, header, sizeof(header))) {
+			std::fclose(file);
+			file = nullptr;
+		}
+	}
+
+	inline TraceRecorder::~TraceRecorder()
+	{
+		close();
+	}
+
+	inline bool TraceRecorder::is_open() const
+	{
+		return file != nullptr;
+	}
+
+	inline void TraceRecorder::record(TraceOp op, std::uint32_t id)
+	{
+		if (file == nullptr) {
+			return;
+		}
+		if (buffered + max_event_size > buffer_size) {
+			flush();
+		}
+		unsigned char* out = buffer.data() + buffered;
+		*out++ = static_cast<unsigned char>(op);
+		out = varint_encode(id, out);
+		buffered = static_cast<std::size_t>(out - buffer.data());
+		++events;
+	}
+
+	inline bool TraceRecorder::flush()
+	{
+		if (file == nullptr) {
+			return false;
+		}
+		if (!write_bytes(file, buffer.data(), buffered)) {
+			write_failed = true;
+		}
+		buffered = 0;
+		return !write_failed && std::fflush(file) == 0;
+	}
+
+	inline bool TraceRecorder::close()
+	{
+		if (file == nullptr) {
+			return false;
+		}
+		bool flushed = flush();
+		bool closed = std::fclose(file) == 0;
+		file = nullptr;
+		return flushed && closed;
+	}
+
+	inline std::uint64_t TraceRecorder::event_count() const
+	{
+		return events;
+	}
+
+	inline bool read_trace(const std::string& path, std::vector<TraceEvent>& events, std::uint32_t* value_size)
+	{
+		events.clear();
+		std::FILE* file = open_file(path, "rb");
+		if (file == nullptr) {
+			return false;
+		}
+
+		unsigned char header[16];
+		if (std::fread(header, 1, sizeof(header), file) != sizeof(header)) {
+			std::fclose(file);
+			return false;
+		}
+		std::uint64_t header_magic = 0;
+		std::uint32_t header_version = 0;
+		std::uint32_t header_value_size = 0;
+		std::memcpy(&header_magic, header, 8);
+		std::memcpy(&header_version, header + 8, 4);
+		std::memcpy(&header_value_size, header + 12, 4);
+		if (header_magic != TraceRecorder::magic || header_version != TraceRecorder::version) {
+			std::fclose(file);
+			return false;
+		}
+		if (value_size != nullptr) {
+			*value_size = header_value_size;
+		}
+
+		// The bytes of a event that was cut off at the end of a chunk are moved to the front of the next one
+		std::vector<unsigned char> chunk(64 * 1024);
+		std::size_t carried = 0;
+		bool valid = true;
+		bool complete = false;
+		while (valid && !complete) {
+			std::size_t read = std::fread(chunk.data() + carried, 1, chunk.size() - carried, file);
+			if (read == 0) {
+				break;
+			}
+			const unsigned char* position = chunk.data();
+			const unsigned char* end = chunk.data() + carried + read;
+			while (position < end) {
+				const unsigned char* event_start = position;
+				TraceEvent event{};
+				event.op = static_cast<TraceOp>(*position++);
+				if (event.op < TraceOp::push_back || event.op > TraceOp::clear) {
+					valid = false;
+					break;
+				}
+				if (!varint_decode(&position, end, event.id)) {
+					// Cut off by the end of the chunk, or the varint is too long
+					position = event_start;
+					break;
+				}
+				events.push_back(event);
+			}
+			carried = static_cast<std::size_t>(end - position);
+			// A varint that does not end within a whole event is broken, keep the events before it
+			complete = carried >= TraceRecorder::max_event_size;
+			std::memmove(chunk.data(), position, carried);
+		}
+		std::fclose(file);
+		// A last event without it's complete varint is dropped, like the recorder was closed before it
+		return valid;
+	}
+
+	template<typename Map>
+	TracedMap<Map>::TracedMap(TraceRecorder* recorder)
+		: recorder(recorder)
+	{
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::operator[](HandleType handle) -> reference
+	{
+		record(TraceOp::access, handle.id);
+		return map[handle];
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::operator[](HandleType handle) const -> const_reference
+	{
+		record(TraceOp::access, handle.id);
+		return map[handle];
+	}
+
+	template<typename Map>
+	bool TracedMap<Map>::contains(HandleType handle) const
+	{
+		record(TraceOp::access, handle.id);
+		return map.contains(handle);
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::find(HandleType handle) -> iterator
+	{
+		record(TraceOp::access, handle.id);
+		return map.find(handle);
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::find(HandleType handle) const -> const_iterator
+	{
+		record(TraceOp::access, handle.id);
+		return map.find(handle);
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::begin() -> iterator
+	{
+		record(TraceOp::iterate, static_cast<std::uint32_t>(map.size()));
+		return map.begin();
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::begin() const -> const_iterator
+	{
+		record(TraceOp::iterate, static_cast<std::uint32_t>(map.size()));
+		return map.begin();
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::end() -> iterator
+	{
+		return map.end();
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::end() const -> const_iterator
+	{
+		return map.end();
+	}
+
+	template<typename Map>
+	std::size_t TracedMap<Map>::size() const
+	{
+		return map.size();
+	}
+
+	template<typename Map>
+	bool TracedMap<Map>::empty() const
+	{
+		return map.empty();
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::push_back(const ValueType& value) -> HandleType
+	{
+		HandleType handle = map.push_back(value);
+		record(TraceOp::push_back, handle.id);
+		return handle;
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::push_back(ValueType&& value) -> HandleType
+	{
+		HandleType handle = map.push_back(std::move(value));
+		record(TraceOp::push_back, handle.id);
+		return handle;
+	}
+
+	template<typename Map>
+	template<typename... Args>
+	auto TracedMap<Map>::emplace_back(Args&&... args) -> HandleType
+	{
+		HandleType handle = map.emplace_back(std::forward<Args>(args)...);
+		record(TraceOp::push_back, handle.id);
+		return handle;
+	}
+
+	template<typename Map>
+	void TracedMap<Map>::erase(HandleType handle)
+	{
+		record(TraceOp::erase, handle.id);
+		map.erase(handle);
+	}
+
+	template<typename Map>
+	void TracedMap<Map>::clear()
+	{
+		record(TraceOp::clear, 0);
+		map.clear();
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::inner() -> Map&
+	{
+		return map;
+	}
+
+	template<typename Map>
+	auto TracedMap<Map>::inner() const -> const Map&
+	{
+		return map;
+	}
+
+	template<typename Map>
+	void TracedMap<Map>::set_recorder(TraceRecorder* new_recorder)
+	{
+		recorder = new_recorder;
+	}
+
+	template<typename Map>
+	void TracedMap<Map>::record(TraceOp op, std::uint32_t id) const
+	{
+		if (recorder != nullptr) {
+			recorder->record(op, id);
+		}
+	}
+
+	template<typename Map>
+	TraceReplayer<Map>::TraceReplayer(const std::vector<TraceEvent>& events)
+		: events(events)
+	{
+	}
+
+	template<typename Map>
+	void TraceReplayer<Map>::prepare(Map& map)
+	{
+		for (const TraceEvent& event : events) {
+			if (event.op != TraceOp::iterate && event.op != TraceOp::clear) {
+				slot_of(event.id);
+			}
+		}
+
+		// The elements that are erased or looked up while they were not pushed (or after a clear) existed before the trace started
+		std::vector<std::uint8_t> pushed(handles.size(), 0);
+		for (const TraceEvent& event : events) {
+			if (event.op == TraceOp::clear) {
+				break;
+			}
+			if (event.op == TraceOp::iterate) {
+				continue;
+			}
+			std::uint32_t slot = slots.find(event.id)->second;
+			if (event.op == TraceOp::push_back) {
+				pushed[slot] = 1;
+			} else if (!pushed[slot]) {
+				pushed[slot] = 1;
+				handles[slot] = map.push_back(typename Map::ValueType{});
+				alive[slot] = 1;
+			}
+		}
+	}
+
+	template<typename Map>
+	void TraceReplayer<Map>::replay(Map& map, const TraceEvent& event)
+	{
+		switch (event.op) {
+		case TraceOp::push_back: {
+			std::uint32_t slot = slot_of(event.id);
+			handles[slot] = map.push_back(typename Map::ValueType{});
+			alive[slot] = 1;
+			break;
+		}
+		case TraceOp::erase: {
+			auto slot_it = slots.find(event.id);
+			if (slot_it != slots.end() && alive[slot_it->second]) {
+				map.erase(handles[slot_it->second]);
+				alive[slot_it->second] = 0;
+			}
+			break;
+		}
+		case TraceOp::access: {
+			auto slot_it = slots.find(event.id);
+			if (slot_it != slots.end() && alive[slot_it->second]) {
+				sum += first_byte(map[handles[slot_it->second]]);
+			}
+			break;
+		}
+		case TraceOp::iterate:
+			for (const auto& value : map) {
+				sum += first_byte(value);
+			}
+			break;
+		case TraceOp::clear:
+			map.clear();
+			std::fill(alive.begin(), alive.end(), static_cast<std::uint8_t>(0));
+			break;
+		}
+	}
+
+	template<typename Map>
+	std::uint32_t TraceReplayer<Map>::checksum() const
+	{
+		return sum;
+	}
+
+	template<typename Map>
+	std::uint32_t TraceReplayer<Map>::slot_of(std::uint32_t traced_id)
+	{
+		auto inserted = slots.emplace(traced_id, static_cast<std::uint32_t>(handles.size()));
+		if (inserted.second) {
+			handles.push_back(HandleType{ 0 });
+			alive.push_back(0);
+		}
+		return inserted.first->second;
+	}
+
+	template<typename Map>
+	std::uint32_t TraceReplayer<Map>::first_byte(const typename Map::ValueType& value)
+	{
+		return *reinterpret_cast<const unsigned char*>(&value);
+	}
+}
@@ -0,0 +1,493 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include <utility>
+
+#include "utils/container_utils.h"
+#include "flat_value_map_handle.h"
+#include "utils/tmp_compatibility.h"
+
+
+namespace cof
+{
+	/** \brief A FlatValueMap for trees (like a scene graph), which keeps the elements in depth first order.
+	 *
+	 * \class HierarchyFlatValueMap
+	 *
+	 * Every element is stored directly before it's subtree, so a parent always comes before it's children in the dense_vector.
+	 * Next to the elements the dense index of the parent and the size of the subtree are stored, so a parent to child propagation (like world transforms) is one forward pass with propagate(), without handle lookups.
+	 * The price is paid by the structural changes: adding a child, erasing and reparenting move the elements after them in bulk and fix up the indices, which is O(n).
+	*/
+	template<typename SparseHandle, typename Value,
+		typename Allocator = std::allocator<Value>,
+		typename SparseToDenseAllocator = typename cof::rebind<Allocator, std::pair<const SparseHandle, std::size_t> >::other
+	>
+	class HierarchyFlatValueMap
+	{
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+
+		// The parent index of a root element
+		static constexpr std::uint32_t no_parent = UINT32_MAX;
+
+	private:
+		using SparseToDenseMap = std::unordered_map<HandleType, std::size_t, std::hash<HandleType>, std::equal_to<>, SparseToDenseAllocator>;
+		using DenseToSparseVector = std::vector<HandleType, typename cof::rebind<Allocator, HandleType>::other>;
+		using IndexVector = std::vector<std::uint32_t, typename cof::rebind<Allocator, std::uint32_t>::other>;
+		using DenseVector = std::vector<ValueType, Allocator>;
+
+		// The sparse_to_dense map is used for finding a the raw index of the dense_vector from a sparse handle
+		SparseToDenseMap sparse_to_dense{};
+		// The dense_to_sparse array is used for finding a sparse handle from a raw dense_vector index. It is kept in the same order as the dense_vector.
+		DenseToSparseVector dense_to_sparse{};
+		// The dense index of the parent of every element, or no_parent
+		IndexVector parent_indices{};
+		// The amount of elements in the subtree of every element, including the element itself
+		IndexVector subtree_sizes{};
+		// The internal dense_vector, contains all elements contiguously in depth first order.
+		DenseVector dense_vector;
+
+		static uint32_t internalIdCounter;
+
+	public:
+		using value_type = ValueType;
+		using allocator_type = Allocator;
+		using size_type = typename DenseVector::size_type;
+		using iterator = typename DenseVector::iterator;
+		using const_iterator = typename DenseVector::const_iterator;
+		using reference = typename DenseVector::reference;
+		using const_reference = typename DenseVector::const_reference;
+		using pointer = typename DenseVector::pointer;
+		using const_pointer = typename DenseVector::const_pointer;
+
+	public:
+		HierarchyFlatValueMap() = default;
+
+		/// \Category Element access
+
+		// Get the element indexed by it's handle
+		auto operator[](HandleType handle)->reference;
+		// Get the const element indexed by it's handle
+		auto operator[](HandleType handle) const->const_reference;
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a iterator to the element if found. Else returns end()
+		auto find(HandleType handle)->iterator;
+		// \returns a const iterator to the element if found. Else returns end()
+		auto find(HandleType handle) const->const_iterator;
+		// Get the handle of the element at the raw index in the dense_vector
+		auto handle_at(std::size_t index) const->HandleType;
+		// Get the data pointer to the contiguous elements, in depth first order
+		auto data()->pointer;
+		// Get the const data pointer to the contiguous elements, in depth first order
+		auto data() const->const_pointer;
+
+		// \returns if the element with this handle has a parent
+		bool has_parent(HandleType handle) const;
+		// Get the handle of the parent of this element, the element has to have a parent
+		auto parent_of(HandleType handle) const->HandleType;
+		// The amount of elements in the subtree of this element, including the element itself. The subtree is stored directly after the element.
+		std::size_t subtree_size(HandleType handle) const;
+		// Get the parent index of every element, in the same order as data()
+		auto parent_index_data() const->const std::uint32_t*;
+
+
+		/// \Category Iterators
+
+		// Get a iterator to the first element in the dense_vector
+		auto begin()->iterator;
+		// Get a const iterator to the first element in the dense_vector
+		auto begin() const->const_iterator;
+		// Get a iterator past the last element in the dense_vector
+		auto end()->iterator;
+		// Get a const iterator past the last element in the dense_vector
+		auto end() const->const_iterator;
+
+
+		/// \Category Capacity
+
+		// The amount of elements in this map
+		std::size_t size() const;
+		// \returns if the amount of elements in this map equal to zero
+		bool empty() const;
+
+
+		/// \Category Modifiers
+
+		// pushes back a copy of `t` as a new root, after all existing trees
+		auto push_root(const Value& t)->HandleType;
+		// pushes back the moved `t` as a new root, after all existing trees
+		auto push_root(Value&& t)->HandleType;
+		// construct a new root in place, after all existing trees
+		template<typename... Args>
+		auto emplace_root(Args&&... args)->HandleType;
+		// insert a copy of `t` as the last child of `parent`
+		auto push_child(HandleType parent, const Value& t)->HandleType;
+		// insert the moved `t` as the last child of `parent`
+		auto push_child(HandleType parent, Value&& t)->HandleType;
+		// construct a element in place as the last child of `parent`
+		template<typename... Args>
+		auto emplace_child(HandleType parent, Args&&... args)->HandleType;
+
+		// Move the element with this handle and it's subtree to be the last child of `new_parent`. `new_parent` can not be in the subtree.
+		void reparent(HandleType handle, HandleType new_parent);
+		// Move the element with this handle and it's subtree to be the last root
+		void make_root(HandleType handle);
+		// Erase the element with this handle and it's whole subtree
+		// \returns the amount of erased elements
+		std::size_t erase(HandleType handle);
+		// Erase all elements
+		void clear();
+
+
+		/// \Category Traversal
+
+		// Call `function(Value& element, const Value* parent)` for every element in depth first order, `parent` is nullptr for roots.
+		// Every parent is visited before it's children, so values computed from the parent (like world transforms) are already up to date.
+		template<typename Function>
+		void propagate(Function&& function);
+
+	private:
+		std::size_t index_of(HandleType handle) const;
+		// Insert the bookkeeping of a element that was just inserted in the dense_vector at `index`
+		auto register_inserted_element(std::size_t index, std::uint32_t parent_index)->HandleType;
+		// The index where a new last child of `parent_index` goes, the end of it's subtree
+		std::size_t child_insert_index(std::uint32_t parent_index) const;
+		void add_to_ancestor_sizes(std::uint32_t parent_index, std::int64_t delta);
+		void move_subtree(std::size_t index, std::uint32_t new_parent_index);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	uint32_t HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::internalIdCounter = 0;
+
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::operator[](HandleType handle) -> reference
+	{
+		return dense_vector[index_of(handle)];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::operator[](HandleType handle) const -> const_reference
+	{
+		return dense_vector[index_of(handle)];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::contains(HandleType handle) const
+	{
+		return sparse_to_dense.find(handle) != sparse_to_dense.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::find(HandleType handle) -> iterator
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (sparse_to_dense_it == sparse_to_dense.end()) {
+			return dense_vector.end();
+		}
+		return dense_vector.begin() + sparse_to_dense_it->second;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::find(HandleType handle) const -> const_iterator
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (sparse_to_dense_it == sparse_to_dense.end()) {
+			return dense_vector.end();
+		}
+		return dense_vector.begin() + sparse_to_dense_it->second;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::handle_at(std::size_t index) const -> HandleType
+	{
+		assert(vector_in_range(dense_to_sparse, index));
+		return dense_to_sparse[index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::data() -> pointer
+	{
+		return dense_vector.data();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::data() const -> const_pointer
+	{
+		return dense_vector.data();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::has_parent(HandleType handle) const
+	{
+		return parent_indices[index_of(handle)] != no_parent;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::parent_of(HandleType handle) const -> HandleType
+	{
+		std::uint32_t parent_index = parent_indices[index_of(handle)];
+		assert(parent_index != no_parent);
+		return dense_to_sparse[parent_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::subtree_size(HandleType handle) const
+	{
+		return subtree_sizes[index_of(handle)];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::parent_index_data() const -> const std::uint32_t*
+	{
+		return parent_indices.data();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::begin() -> iterator
+	{
+		return dense_vector.begin();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::begin() const -> const_iterator
+	{
+		return dense_vector.begin();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::end() -> iterator
+	{
+		return dense_vector.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::end() const -> const_iterator
+	{
+		return dense_vector.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::size() const
+	{
+		return dense_vector.size();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::empty() const
+	{
+		return dense_vector.empty();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::push_root(const Value& t) -> HandleType
+	{
+		dense_vector.push_back(t);
+		return register_inserted_element(dense_vector.size() - 1, no_parent);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::push_root(Value&& t) -> HandleType
+	{
+		dense_vector.push_back(std::move(t));
+		return register_inserted_element(dense_vector.size() - 1, no_parent);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	template<typename ... Args>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::emplace_root(Args&&... args) -> HandleType
+	{
+		dense_vector.emplace_back(std::forward<Args>(args)...);
+		return register_inserted_element(dense_vector.size() - 1, no_parent);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::push_child(HandleType parent, const Value& t) -> HandleType
+	{
+		std::uint32_t parent_index = static_cast<std::uint32_t>(index_of(parent));
+		std::size_t element_index = child_insert_index(parent_index);
+		dense_vector.insert(dense_vector.begin() + element_index, t);
+		return register_inserted_element(element_index, parent_index);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::push_child(HandleType parent, Value&& t) -> HandleType
+	{
+		std::uint32_t parent_index = static_cast<std::uint32_t>(index_of(parent));
+		std::size_t element_index = child_insert_index(parent_index);
+		dense_vector.insert(dense_vector.begin() + element_index, std::move(t));
+		return register_inserted_element(element_index, parent_index);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	template<typename ... Args>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::emplace_child(HandleType parent, Args&&... args) -> HandleType
+	{
+		std::uint32_t parent_index = static_cast<std::uint32_t>(index_of(parent));
+		std::size_t element_index = child_insert_index(parent_index);
+		dense_vector.emplace(dense_vector.begin() + element_index, std::forward<Args>(args)...);
+		return register_inserted_element(element_index, parent_index);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::reparent(HandleType handle, HandleType new_parent)
+	{
+		move_subtree(index_of(handle), static_cast<std::uint32_t>(index_of(new_parent)));
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::make_root(HandleType handle)
+	{
+		move_subtree(index_of(handle), no_parent);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::erase(HandleType handle)
+	{
+		const std::size_t first = index_of(handle);
+		const std::size_t count = subtree_sizes[first];
+		const std::size_t last = first + count;
+		add_to_ancestor_sizes(parent_indices[first], -static_cast<std::int64_t>(count));
+
+		for (std::size_t i = first; i < last; ++i) {
+			sparse_to_dense.erase(dense_to_sparse[i]);
+		}
+		dense_vector.erase(dense_vector.begin() + first, dense_vector.begin() + last);
+		dense_to_sparse.erase(dense_to_sparse.begin() + first, dense_to_sparse.begin() + last);
+		parent_indices.erase(parent_indices.begin() + first, parent_indices.begin() + last);
+		subtree_sizes.erase(subtree_sizes.begin() + first, subtree_sizes.begin() + last);
+
+		// Everything after the subtree moved down by `count`
+		for (std::size_t i = first; i < dense_vector.size(); ++i) {
+			sparse_to_dense.find(dense_to_sparse[i])->second = i;
+			if (parent_indices[i] != no_parent && parent_indices[i] >= last) {
+				parent_indices[i] -= static_cast<std::uint32_t>(count);
+			}
+		}
+		return count;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::clear()
+	{
+		dense_vector.clear();
+		sparse_to_dense.clear();
+		dense_to_sparse.clear();
+		parent_indices.clear();
+		subtree_sizes.clear();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	template<typename Function>
+	void HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::propagate(Function&& function)
+	{
+		for (std::size_t i = 0; i < dense_vector.size(); ++i) {
+			std::uint32_t parent_index = parent_indices[i];
+			function(dense_vector[i], parent_index == no_parent ? nullptr : &dense_vector[parent_index]);
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::index_of(HandleType handle) const
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		assert(sparse_to_dense_it != sparse_to_dense.end());
+		return sparse_to_dense_it->second;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::register_inserted_element(
+		std::size_t index, std::uint32_t parent_index) -> HandleType
+	{
+		assert(dense_vector.size() < no_parent);
+		uint32_t element_id = ++internalIdCounter;
+		dense_to_sparse.insert(dense_to_sparse.begin() + index, HandleType{ element_id });
+		parent_indices.insert(parent_indices.begin() + index, parent_index);
+		subtree_sizes.insert(subtree_sizes.begin() + index, 1);
+		sparse_to_dense.emplace(HandleType{ element_id }, index);
+		add_to_ancestor_sizes(parent_index, 1);
+
+		// Everything after the new element moved up by one
+		for (std::size_t i = index + 1; i < dense_vector.size(); ++i) {
+			sparse_to_dense.find(dense_to_sparse[i])->second = i;
+			if (parent_indices[i] != no_parent && parent_indices[i] >= index) {
+				++parent_indices[i];
+			}
+		}
+		return HandleType{ element_id };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::child_insert_index(std::uint32_t parent_index) const
+	{
+		return static_cast<std::size_t>(parent_index) + subtree_sizes[parent_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::add_to_ancestor_sizes(std::uint32_t parent_index, std::int64_t delta)
+	{
+		for (std::uint32_t ancestor = parent_index; ancestor != no_parent; ancestor = parent_indices[ancestor]) {
+			subtree_sizes[ancestor] = static_cast<std::uint32_t>(static_cast<std::int64_t>(subtree_sizes[ancestor]) + delta);
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void HierarchyFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::move_subtree(std::size_t index, std::uint32_t new_parent_index)
+	{
+		const std::size_t count = subtree_sizes[index];
+		assert((new_parent_index == no_parent || new_parent_index < index || new_parent_index >= index + count) && "Can not move a element into it's own subtree");
+
+		// Where the subtree goes, before it is taken out
+		const std::size_t destination = new_parent_index == no_parent ? dense_vector.size() : child_insert_index(new_parent_index);
+		add_to_ancestor_sizes(parent_indices[index], -static_cast<std::int64_t>(count));
+		add_to_ancestor_sizes(new_parent_index, static_cast<std::int64_t>(count));
+		parent_indices[index] = new_parent_index;
+
+		// The range that changes, and the old index -> new index mapping of everything in it
+		std::size_t range_first, range_middle, range_last;
+		if (destination > index) {
+			range_first = index;
+			range_middle = index + count;
+			range_last = destination;
+		} else {
+			range_first = destination;
+			range_middle = index;
+			range_last = index + count;
+		}
+		if (range_middle == range_last || range_first == range_middle) {
+			return;
+		}
+		auto remap = [&](std::size_t old_index) -> std::size_t {
+			if (old_index < range_first || old_index >= range_last) {
+				return old_index;
+			}
+			return old_index < range_middle ? old_index + (range_last - range_middle) : old_index - (range_middle - range_first);
+		};
+
+		for (std::uint32_t& parent_index : parent_indices) {
+			if (parent_index != no_parent) {
+				parent_index = static_cast<std::uint32_t>(remap(parent_index));
+			}
+		}
+		std::rotate(dense_vector.begin() + range_first, dense_vector.begin() + range_middle, dense_vector.begin() + range_last);
+		std::rotate(dense_to_sparse.begin() + range_first, dense_to_sparse.begin() + range_middle, dense_to_sparse.begin() + range_last);
+		std::rotate(parent_indices.begin() + range_first, parent_indices.begin() + range_middle, parent_indices.begin() + range_last);
+		std::rotate(subtree_sizes.begin() + range_first, subtree_sizes.begin() + range_middle, subtree_sizes.begin() + range_last);
+		for (std::size_t i = range_first; i < range_last; ++i) {
+			sparse_to_dense.find(dense_to_sparse[i])->second = i;
+		}
+	}
+}
@@ -0,0 +1,287 @@
+#pragma once
+#include <vector>
+#include <cassert>
+#include <utility>
+
+#include "flat_value_map.h"
+
+
+namespace cof
+{
+	/** \brief A FlatValueMap that splits every element in a hot part, which is read often, and a cold part, which is read rarely.
+	 *
+	 * \class HotColdFlatValueMap
+	 *
+	 * The hot parts are stored in their own dense array, which begin() and end() iterate, so a loop over the hot fields does not stream the cold fields through the cache.
+	 * The cold parts are stored in a second dense array in the same order, erase() does the same swap and pop on both.
+	 * A type that mixes both can be split by moving it's rarely used fields into a separate struct, for example `struct Transform { Matrix world; }; struct TransformMeta { std::string name; ... };`
+	*/
+	template<typename SparseHandle, typename Hot, typename Cold,
+		typename HotAllocator = std::allocator<Hot>,
+		typename ColdAllocator = std::allocator<Cold>
+	>
+	class HotColdFlatValueMap
+	{
+	public:
+		using HandleType = SparseHandle;
+		using HotType = Hot;
+		using ColdType = Cold;
+		using HotMap = FlatValueMap<SparseHandle, Hot, HotAllocator>;
+
+	private:
+		using ColdVector = std::vector<Cold, ColdAllocator>;
+
+		// The hot parts, with the handle bookkeeping
+		HotMap hot_values{};
+		// The cold parts, kept in the same order as the dense_vector of `hot_values`
+		ColdVector cold_values{};
+
+	public:
+		using value_type = Hot;
+		using iterator = typename HotMap::iterator;
+		using const_iterator = typename HotMap::const_iterator;
+		using reference = typename HotMap::reference;
+		using const_reference = typename HotMap::const_reference;
+		using cold_iterator = typename ColdVector::iterator;
+		using const_cold_iterator = typename ColdVector::const_iterator;
+
+	public:
+		HotColdFlatValueMap() = default;
+
+		/// \Category Element access
+
+		// Get the hot part of the element indexed by it's handle
+		auto operator[](HandleType handle)->reference;
+		// Get the const hot part of the element indexed by it's handle
+		auto operator[](HandleType handle) const->const_reference;
+		// Get the cold part of the element indexed by it's handle
+		auto cold(HandleType handle)->Cold&;
+		// Get the const cold part of the element indexed by it's handle
+		auto cold(HandleType handle) const->const Cold&;
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a iterator to the hot part of the element if found. Else returns end()
+		auto find(HandleType handle)->iterator;
+		// \returns a const iterator to the hot part of the element if found. Else returns end()
+		auto find(HandleType handle) const->const_iterator;
+		// Get the handle of the element at the raw index in the dense arrays
+		auto handle_at(std::size_t index) const->HandleType;
+		// Get the FlatValueMap of the hot parts, for the functions that take a FlatValueMap (like the numeric queries)
+		auto hot_map() const->const HotMap&;
+
+
+		/// \Category Iterators
+
+		// Get a iterator to the first hot part
+		auto begin()->iterator;
+		// Get a const iterator to the first hot part
+		auto begin() const->const_iterator;
+		// Get a iterator past the last hot part
+		auto end()->iterator;
+		// Get a const iterator past the last hot part
+		auto end() const->const_iterator;
+		// Get a iterator to the first cold part, in the same order as begin()
+		auto cold_begin()->cold_iterator;
+		// Get a const iterator to the first cold part, in the same order as begin()
+		auto cold_begin() const->const_cold_iterator;
+		// Get a iterator past the last cold part
+		auto cold_end()->cold_iterator;
+		// Get a const iterator past the last cold part
+		auto cold_end() const->const_cold_iterator;
+
+
+		/// \Category Capacity
+
+		// The amount of elements in this map
+		std::size_t size() const;
+		// \returns if the amount of elements in this map equal to zero
+		bool empty() const;
+
+
+		/// \Category Modifiers
+
+		// pushes back copies of the hot and cold part of a new element
+		auto push_back(const Hot& hot, const Cold& cold)->HandleType;
+		// pushes back the moved hot and cold part of a new element
+		auto push_back(Hot&& hot, Cold&& cold)->HandleType;
+
+		// erase a element, both parts are swap and popped
+		void erase(HandleType handle);
+		// Erase all elements
+		void clear();
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::operator[](HandleType handle) -> reference
+	{
+		return hot_values[handle];
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::operator[](HandleType handle) const -> const_reference
+	{
+		return hot_values[handle];
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::cold(HandleType handle) -> Cold&
+	{
+		auto hot_it = hot_values.find(handle);
+		assert(hot_it != hot_values.end());
+		return cold_values[hot_it - hot_values.begin()];
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::cold(HandleType handle) const -> const Cold&
+	{
+		auto hot_it = hot_values.find(handle);
+		assert(hot_it != hot_values.end());
+		return cold_values[hot_it - hot_values.begin()];
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	bool HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::contains(HandleType handle) const
+	{
+		return hot_values.contains(handle);
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::find(HandleType handle) -> iterator
+	{
+		return hot_values.find(handle);
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::find(HandleType handle) const -> const_iterator
+	{
+		return hot_values.find(handle);
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::handle_at(std::size_t index) const -> HandleType
+	{
+		return hot_values.handle_at(index);
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::hot_map() const -> const HotMap&
+	{
+		return hot_values;
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::begin() -> iterator
+	{
+		return hot_values.begin();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::begin() const -> const_iterator
+	{
+		return hot_values.begin();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::end() -> iterator
+	{
+		return hot_values.end();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::end() const -> const_iterator
+	{
+		return hot_values.end();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::cold_begin() -> cold_iterator
+	{
+		return cold_values.begin();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::cold_begin() const -> const_cold_iterator
+	{
+		return cold_values.begin();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::cold_end() -> cold_iterator
+	{
+		return cold_values.end();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::cold_end() const -> const_cold_iterator
+	{
+		return cold_values.end();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	std::size_t HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::size() const
+	{
+		return hot_values.size();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	bool HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::empty() const
+	{
+		return hot_values.empty();
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::push_back(const Hot& hot, const Cold& cold) -> HandleType
+	{
+		HandleType handle = hot_values.push_back(hot);
+		try {
+			cold_values.push_back(cold);
+		} catch (...) {
+			// Take the hot part back out, so both arrays keep the same length and stay paired by index
+			hot_values.erase(handle);
+			throw;
+		}
+		return handle;
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	auto HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::push_back(Hot&& hot, Cold&& cold) -> HandleType
+	{
+		HandleType handle = hot_values.push_back(std::move(hot));
+		try {
+			cold_values.push_back(std::move(cold));
+		} catch (...) {
+			hot_values.erase(handle);
+			throw;
+		}
+		return handle;
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	void HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::erase(HandleType handle)
+	{
+		// FlatValueMap::erase moves the back element into the hole, do the same with the cold parts
+		auto hot_it = hot_values.find(handle);
+		assert(hot_it != hot_values.end());
+		std::size_t removed_element_index = static_cast<std::size_t>(hot_it - hot_values.begin());
+		if (removed_element_index != cold_values.size() - 1) {
+			std::swap(cold_values[removed_element_index], cold_values.back());
+		}
+		cold_values.pop_back();
+		hot_values.erase(handle);
+	}
+
+	template<typename SparseHandle, typename Hot, typename Cold, typename HotAllocator, typename ColdAllocator>
+	void HotColdFlatValueMap<SparseHandle, Hot, Cold, HotAllocator, ColdAllocator>::clear()
+	{
+		hot_values.clear();
+		cold_values.clear();
+	}
+}
@@ -4,6 +4,7 @@
 #include <cassert>
 
 #include "utils/container_utils.h"
+#include "utils/membership_filter.h"
 #include "flat_value_map_handle.h"
 #include "utils/tmp_compatibility.h"
 
@@ -38,6 +39,8 @@ namespace cof
 
 		SparseToDenseMap sparse_to_dense{};
 		DenseVector dense_vector;
+		// Optional filter in front of sparse_to_dense, so contains() and find() can reject most unknown handles without walking a bucket.
+		CountingBloomFilter membership_filter{};
 
 		static uint32_t internalIdCounter;
 
@@ -158,8 +161,24 @@ namespace cof
 
 		// Erase all elements(and thus deconstruct all elements)
 		void clear();
+
+
+		/// \Category Membership filter
+
+		// Put a counting bloom filter in front of the sparse_to_dense map, sized for at least `expected_elements` (or the current size if that is bigger).
+		// See FlatValueMap::enable_membership_filter()
+		void enable_membership_filter(std::size_t expected_elements = 0);
+		// Remove the membership filter and free it's memory
+		void disable_membership_filter();
+		// \returns if enable_membership_filter() was called
+		bool membership_filter_enabled() const;
 		
 	private:
+		void membership_filter_insert(HandleType handle);
+		void membership_filter_erase(HandleType handle);
+		bool membership_filter_rejects(HandleType handle) const;
+
+
 		// Do a dense to sparse lookup (raw index to sparse handle) by iterating over the sparse_to_dense map
 		auto dense_to_sparse(std::size_t denseIndex)->SparseToDenseIterator;
 	};
@@ -247,6 +266,9 @@ namespace cof
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
 	bool LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::contains(HandleType handle) const
 	{
+		if (membership_filter_rejects(handle)) {
+			return false;
+		}
 		return sparse_to_dense.find(handle) != sparse_to_dense.end();
 	}
 
@@ -254,6 +276,9 @@ namespace cof
 	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
 	auto LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::find(HandleType handle) -> iterator
 	{
+		if (membership_filter_rejects(handle)) {
+			return dense_vector.end();
+		}
 		auto sparse_to_dense_it = sparse_to_dense.find(handle);
 		if (sparse_to_dense_it != sparse_to_dense.end()) {
 			std::size_t element_index = sparse_to_dense_it->second;
@@ -271,6 +296,9 @@ namespace cof
 	auto LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::find(
 		HandleType handle) const -> const_iterator
 	{
+		if (membership_filter_rejects(handle)) {
+			return dense_vector.end();
+		}
 		auto sparse_to_dense_it = sparse_to_dense.find(handle);
 		if (sparse_to_dense_it != sparse_to_dense.end()) {
 			std::size_t element_index = sparse_to_dense_it->second;
@@ -421,6 +449,7 @@ namespace cof
 		uint32_t element_id = ++internalIdCounter;
 		dense_vector.push_back(t);
 		sparse_to_dense.emplace(HandleType{ element_id }, element_index);
+		membership_filter_insert(HandleType{ element_id });
 
 		return HandleType{ element_id };
 	}
@@ -432,6 +461,7 @@ namespace cof
 		uint32_t element_id = ++internalIdCounter;
 		dense_vector.push_back(std::move(t));
 		sparse_to_dense.emplace(HandleType{element_id}, element_index);
+		membership_filter_insert(HandleType{ element_id });
 
 		return HandleType{element_id};
 	}
@@ -444,6 +474,7 @@ namespace cof
 		uint32_t element_id = ++internalIdCounter;
 		dense_vector.emplace_back(std::forward<Args>(args)...);
 		sparse_to_dense.emplace(HandleType{ element_id }, element_index);
+		membership_filter_insert(HandleType{ element_id });
 
 		return HandleType{ element_id };
 	}
@@ -464,6 +495,7 @@ namespace cof
 				std_last_element_it->second = element_index;
 			}
 			dense_vector.pop_back();
+			membership_filter_erase(handleToRemove);
 			sparse_to_dense.erase(sparse_to_dense_it);
 		}
 	}
@@ -473,6 +505,55 @@ namespace cof
 	{
 		dense_vector.clear();
 		sparse_to_dense.clear();
+		membership_filter.clear();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::enable_membership_filter(std::size_t expected_elements)
+	{
+		membership_filter = CountingBloomFilter{ expected_elements > size() ? expected_elements : size() };
+		for (auto& handle_and_index : sparse_to_dense) {
+			membership_filter.insert(std::hash<HandleType>{}(handle_and_index.first));
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::disable_membership_filter()
+	{
+		membership_filter = CountingBloomFilter{};
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::membership_filter_enabled() const
+	{
+		return membership_filter.enabled();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::membership_filter_insert(HandleType handle)
+	{
+		if (membership_filter.enabled()) {
+			if (size() > membership_filter.capacity() * 2) {
+				// The handle is already in sparse_to_dense, so the rebuild includes it
+				enable_membership_filter(size() * 2);
+			} else {
+				membership_filter.insert(std::hash<HandleType>{}(handle));
+			}
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::membership_filter_erase(HandleType handle)
+	{
+		if (membership_filter.enabled()) {
+			membership_filter.erase(std::hash<HandleType>{}(handle));
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool LightFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::membership_filter_rejects(HandleType handle) const
+	{
+		return membership_filter.enabled() && !membership_filter.may_contain(std::hash<HandleType>{}(handle));
 	}
 
 
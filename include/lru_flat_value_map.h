@@ -0,0 +1,510 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cassert>
+#include <utility>
+
+#include "utils/container_utils.h"
+#include "flat_value_map_handle.h"
+#include "utils/tmp_compatibility.h"
+
+
+namespace cof
+{
+	/** \brief A capacity bounded cache keyed by handle, which evicts the least recently used element when a new element does not fit anymore.
+	 *
+	 * \class LruFlatValueMap
+	 *
+	 * The elements are stored contiguously like in a FlatValueMap, but the handles are chosen by the caller (the key of the cache).
+	 * The recency list is stored intrusively: every dense index has a pair of 32 bit links to the next newer and older element, in an array next to the dense_vector.
+	 * So get() and put() are O(1) and only relink indices, no list nodes are allocated per access.
+	 * When the cache is full put() reuses the slot of the evicted element, and in C++17 also it's sparse_to_dense node. After the constructor reserved the memory, a full cache does not allocate anymore.
+	 * erase() uses the swap erase idiom, the links of the element that got moved into the hole are fixed up.
+	*/
+	template<typename SparseHandle, typename Value,
+		typename Allocator = std::allocator<Value>,
+		typename SparseToDenseAllocator = typename cof::rebind<Allocator, std::pair<const SparseHandle, std::size_t> >::other
+	>
+	class LruFlatValueMap
+	{
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+
+		/// Hit and miss counters for tuning the capacity of the cache
+		struct CacheStats
+		{
+			std::uint64_t hits = 0;
+			std::uint64_t misses = 0;
+			std::uint64_t evictions = 0;
+
+			// \returns hits / (hits + misses), or 0 when get() was never called
+			double hit_rate() const;
+		};
+
+	private:
+		// Dense indices of the neighbours in the recency list
+		struct RecencyLinks
+		{
+			std::uint32_t newer;
+			std::uint32_t older;
+		};
+		static constexpr std::uint32_t no_element = UINT32_MAX;
+
+		using SparseToDenseMap = std::unordered_map<HandleType, std::size_t, std::hash<HandleType>, std::equal_to<>, SparseToDenseAllocator>;
+		using DenseToSparseVector = std::vector<HandleType, typename cof::rebind<Allocator, HandleType>::other>;
+		using RecencyVector = std::vector<RecencyLinks, typename cof::rebind<Allocator, RecencyLinks>::other>;
+		using DenseVector = std::vector<ValueType, Allocator>;
+
+		// The sparse_to_dense map is used for finding a the raw index of the dense_vector from a sparse handle
+		SparseToDenseMap sparse_to_dense{};
+		// The dense_to_sparse array is used for finding a sparse handle from a raw dense_vector index. It is kept in the same order as the dense_vector.
+		DenseToSparseVector dense_to_sparse{};
+		// The recency links of every element, kept in the same order as the dense_vector.
+		RecencyVector recency{};
+		// The internal dense_vector, contains all elements contiguously.
+		DenseVector dense_vector;
+
+		std::size_t max_size;
+		std::uint32_t most_recent = no_element;
+		std::uint32_t least_recent = no_element;
+		CacheStats cache_stats{};
+
+	public:
+		using value_type = ValueType;
+		using allocator_type = Allocator;
+		using size_type = typename DenseVector::size_type;
+		using iterator = typename DenseVector::iterator;
+		using const_iterator = typename DenseVector::const_iterator;
+		using reference = typename DenseVector::reference;
+		using const_reference = typename DenseVector::const_reference;
+		using pointer = typename DenseVector::pointer;
+		using const_pointer = typename DenseVector::const_pointer;
+
+	public:
+		// Create a cache that holds at most `capacity` elements, all memory for those elements is reserved up front.
+		explicit LruFlatValueMap(std::size_t capacity);
+
+		/// \Category Element access
+
+		// Get the element with this handle and mark it as the most recently used. Counts as a hit or a miss in stats().
+		// \returns nullptr if the element is not (or no longer) in the cache
+		auto get(HandleType handle)->pointer;
+		// Get the element with this handle without touching the recency order or the stats
+		// \returns nullptr if the element is not in the cache
+		auto peek(HandleType handle) const->const_pointer;
+		// Check if this cache contains a element with this handle, does not touch the recency order or the stats
+		bool contains(HandleType handle) const;
+		// The handle that will be evicted by the next put() of a new handle into a full cache
+		auto least_recent_handle() const->HandleType;
+		// The handle that was put or get last
+		auto most_recent_handle() const->HandleType;
+		// Get the handle of the element at the raw index in the dense_vector
+		auto handle_at(std::size_t index) const->HandleType;
+		// Get the data pointer to the contiguous elements, they are not in recency order
+		auto data()->pointer;
+		// Get the const data pointer to the contiguous elements, they are not in recency order
+		auto data() const->const_pointer;
+
+
+		/// \Category Iterators
+
+		// Get a iterator to the first element in the dense_vector
+		auto begin()->iterator;
+		// Get a const iterator to the first element in the dense_vector
+		auto begin() const->const_iterator;
+		// Get a iterator past the last element in the dense_vector
+		auto end()->iterator;
+		// Get a const iterator past the last element in the dense_vector
+		auto end() const->const_iterator;
+
+
+		/// \Category Capacity
+
+		// The amount of elements in this cache
+		std::size_t size() const;
+		// \returns if the amount of elements in this cache equal to zero
+		bool empty() const;
+		// The maximum amount of elements, put() evicts once size() reaches this
+		std::size_t capacity() const;
+
+
+		/// \Category Modifiers
+
+		// Insert or overwrite the element with this handle and mark it as the most recently used.
+		// If the handle is new and the cache is full, the least recently used element is evicted and it's slot is assigned to.
+		auto put(HandleType handle, const Value& value)->reference;
+		// Insert or overwrite the element with this handle by moving `value`, evicting like the copy overload
+		auto put(HandleType handle, Value&& value)->reference;
+		// Insert or overwrite the element with this handle with a Value constructed from `args`, evicting like put()
+		template<typename... Args>
+		auto emplace(HandleType handle, Args&&... args)->reference;
+
+		// Erase the element with this handle
+		// \returns false if there was no element with this handle
+		bool erase(HandleType handle);
+		// Erase all elements, the reserved memory and the stats are kept
+		void clear();
+
+
+		/// \Category Statistics
+
+		// The hit, miss and eviction counters since construction or the last reset_stats()
+		auto stats() const->const CacheStats&;
+		// Set all counters back to zero
+		void reset_stats();
+
+	private:
+		// Where the value of a put() goes
+		enum class SlotKind
+		{
+			existing,	// assign to the slot that already has this handle
+			evicted,	// assign to the slot of the least recently used element
+			appended	// push a new element to the dense_vector
+		};
+
+		// Find the slot for `handle`, without changing anything yet. So a throwing assignment or push leaves the cache as it was
+		auto find_slot(HandleType handle, std::size_t& index) const->SlotKind;
+		// Give the slot to `handle` and make it the most recent, after the value was stored in it
+		void link_slot(HandleType handle, std::size_t index, SlotKind kind);
+		void evict_into(HandleType handle, std::uint32_t index);
+		void unlink(std::uint32_t index);
+		void link_most_recent(std::uint32_t index);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	double LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::CacheStats::hit_rate() const
+	{
+		std::uint64_t lookups = hits + misses;
+		return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::LruFlatValueMap(std::size_t capacity)
+		: max_size(capacity)
+	{
+		assert(capacity > 0 && capacity < no_element);
+		sparse_to_dense.reserve(capacity);
+		dense_to_sparse.reserve(capacity);
+		recency.reserve(capacity);
+		dense_vector.reserve(capacity);
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::get(HandleType handle) -> pointer
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (sparse_to_dense_it == sparse_to_dense.end()) {
+			++cache_stats.misses;
+			return nullptr;
+		}
+
+		++cache_stats.hits;
+		std::uint32_t element_index = static_cast<std::uint32_t>(sparse_to_dense_it->second);
+		if (element_index != most_recent) {
+			unlink(element_index);
+			link_most_recent(element_index);
+		}
+		assert(vector_in_range(dense_vector, element_index));
+		return &dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::peek(HandleType handle) const -> const_pointer
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (sparse_to_dense_it == sparse_to_dense.end()) {
+			return nullptr;
+		}
+		assert(vector_in_range(dense_vector, sparse_to_dense_it->second));
+		return &dense_vector[sparse_to_dense_it->second];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::contains(HandleType handle) const
+	{
+		return sparse_to_dense.find(handle) != sparse_to_dense.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::least_recent_handle() const -> HandleType
+	{
+		assert(!empty());
+		return dense_to_sparse[least_recent];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::most_recent_handle() const -> HandleType
+	{
+		assert(!empty());
+		return dense_to_sparse[most_recent];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::handle_at(std::size_t index) const -> HandleType
+	{
+		assert(vector_in_range(dense_to_sparse, index));
+		return dense_to_sparse[index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::data() -> pointer
+	{
+		return dense_vector.data();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::data() const -> const_pointer
+	{
+		return dense_vector.data();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::begin() -> iterator
+	{
+		return dense_vector.begin();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::begin() const -> const_iterator
+	{
+		return dense_vector.begin();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::end() -> iterator
+	{
+		return dense_vector.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::end() const -> const_iterator
+	{
+		return dense_vector.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::size() const
+	{
+		return dense_vector.size();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::empty() const
+	{
+		return dense_vector.empty();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::capacity() const
+	{
+		return max_size;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::put(HandleType handle, const Value& value) -> reference
+	{
+		std::size_t element_index;
+		SlotKind kind = find_slot(handle, element_index);
+		if (kind == SlotKind::appended) {
+			dense_vector.push_back(value);
+		} else {
+			dense_vector[element_index] = value;
+		}
+		link_slot(handle, element_index, kind);
+		return dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::put(HandleType handle, Value&& value) -> reference
+	{
+		std::size_t element_index;
+		SlotKind kind = find_slot(handle, element_index);
+		if (kind == SlotKind::appended) {
+			dense_vector.push_back(std::move(value));
+		} else {
+			dense_vector[element_index] = std::move(value);
+		}
+		link_slot(handle, element_index, kind);
+		return dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	template<typename ... Args>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::emplace(HandleType handle, Args&&... args) -> reference
+	{
+		std::size_t element_index;
+		SlotKind kind = find_slot(handle, element_index);
+		if (kind == SlotKind::appended) {
+			dense_vector.emplace_back(std::forward<Args>(args)...);
+		} else {
+			dense_vector[element_index] = Value(std::forward<Args>(args)...);
+		}
+		link_slot(handle, element_index, kind);
+		return dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::erase(HandleType handle)
+	{
+		auto removing_sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (removing_sparse_to_dense_it == sparse_to_dense.end()) {
+			return false;
+		}
+		std::uint32_t removed_element_index = static_cast<std::uint32_t>(removing_sparse_to_dense_it->second);
+		std::uint32_t last_element_index = static_cast<std::uint32_t>(dense_vector.size() - 1);
+		unlink(removed_element_index);
+
+		if (removed_element_index != last_element_index) {
+			std::swap(dense_vector[removed_element_index], dense_vector[last_element_index]);
+			dense_to_sparse[removed_element_index] = dense_to_sparse[last_element_index];
+			sparse_to_dense.find(dense_to_sparse[removed_element_index])->second = removed_element_index;
+
+			//The moved element keeps it's place in the recency list, so point it's neighbours to the new index
+			RecencyLinks moved_links = recency[last_element_index];
+			recency[removed_element_index] = moved_links;
+			if (moved_links.newer != no_element) {
+				recency[moved_links.newer].older = removed_element_index;
+			} else {
+				most_recent = removed_element_index;
+			}
+			if (moved_links.older != no_element) {
+				recency[moved_links.older].newer = removed_element_index;
+			} else {
+				least_recent = removed_element_index;
+			}
+		}
+		sparse_to_dense.erase(removing_sparse_to_dense_it);
+		dense_to_sparse.pop_back();
+		recency.pop_back();
+		dense_vector.pop_back();
+		return true;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::clear()
+	{
+		sparse_to_dense.clear();
+		dense_to_sparse.clear();
+		recency.clear();
+		dense_vector.clear();
+		most_recent = no_element;
+		least_recent = no_element;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::stats() const -> const CacheStats&
+	{
+		return cache_stats;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::reset_stats()
+	{
+		cache_stats = CacheStats{};
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::find_slot(HandleType handle, std::size_t& index) const -> SlotKind
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (sparse_to_dense_it != sparse_to_dense.end()) {
+			index = sparse_to_dense_it->second;
+			return SlotKind::existing;
+		}
+		if (dense_vector.size() == max_size) {
+			index = least_recent;
+			return SlotKind::evicted;
+		}
+		index = dense_vector.size();
+		return SlotKind::appended;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::link_slot(HandleType handle, std::size_t index, SlotKind kind)
+	{
+		if (kind == SlotKind::existing) {
+			unlink(static_cast<std::uint32_t>(index));
+			link_most_recent(static_cast<std::uint32_t>(index));
+			return;
+		}
+		if (kind == SlotKind::evicted) {
+			evict_into(handle, static_cast<std::uint32_t>(index));
+			return;
+		}
+
+		try {
+			sparse_to_dense.emplace(handle, index);
+			dense_to_sparse.push_back(handle);
+			recency.push_back(RecencyLinks{ no_element, no_element });
+		} catch (...) {
+			// Take the new value back out, so the bookkeeping arrays keep the length of the dense_vector
+			sparse_to_dense.erase(handle);
+			dense_to_sparse.resize(index);
+			recency.resize(index);
+			dense_vector.pop_back();
+			throw;
+		}
+		link_most_recent(static_cast<std::uint32_t>(index));
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::evict_into(HandleType handle, std::uint32_t index)
+	{
+		assert(vector_in_range(dense_to_sparse, index));
+		HandleType evicted_handle = dense_to_sparse[index];
+
+#if __cplusplus >= 201703L || _MSVC_LANG >= 201703L
+		// Reuse the map node of the evicted handle, so a eviction does not free and allocate a node
+		auto node = sparse_to_dense.extract(evicted_handle);
+		assert(!node.empty());
+		node.key() = handle;
+		sparse_to_dense.insert(std::move(node));
+#else
+		sparse_to_dense.emplace(handle, index);
+		sparse_to_dense.erase(evicted_handle);
+#endif
+		dense_to_sparse[index] = handle;
+		unlink(index);
+		link_most_recent(index);
+		++cache_stats.evictions;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::unlink(std::uint32_t index)
+	{
+		RecencyLinks& links = recency[index];
+		if (links.newer != no_element) {
+			recency[links.newer].older = links.older;
+		} else {
+			most_recent = links.older;
+		}
+		if (links.older != no_element) {
+			recency[links.older].newer = links.newer;
+		} else {
+			least_recent = links.newer;
+		}
+		links = RecencyLinks{ no_element, no_element };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void LruFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::link_most_recent(std::uint32_t index)
+	{
+		recency[index] = RecencyLinks{ no_element, most_recent };
+		if (most_recent != no_element) {
+			recency[most_recent].newer = index;
+		} else {
+			least_recent = index;
+		}
+		most_recent = index;
+	}
+}
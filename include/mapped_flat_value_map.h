@@ -0,0 +1,542 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "utils/container_utils.h"
+#include "utils/memory_mapping.h"
+#include "utils/open_addressing_index.h"
+
+
+namespace cof
+{
+	/** \brief A FlatValueMap whose dense array, handle array and sparse index live in a memory mapped file, for tables that are larger then memory.
+	 *
+	 * \class MappedFlatValueMap
+	 *
+	 * The operating system pages the elements in when they are used and writes them back to the file, so the map can be larger then the physical memory.
+	 * Opening a existing file maps it, there is no load step. The sparse index is a open addressing table in the file (see utils/open_addressing_index.h).
+	 * When the file is full it grows to twice the capacity, which moves the mapping, so pointers into the map are invalidated by push_back() and emplace_back().
+	 *
+	 * Differences with FlatValueMap:
+	 * - Value has to be trivially copyable, the file stores it as raw bytes
+	 * - The handle ids come from a counter in the file, not from the shared internalIdCounter, so they stay unique across restarts
+	 * - flush() writes the changes to the disk. The file is not crash safe: after a crash the index is rebuilt from the handle array, but changes that were not flushed can be lost
+	 * - Only available when COF_POSIX_MAPPING is 1, on other targets is_open() is always false
+	*/
+	template<typename SparseHandle, typename Value>
+	class MappedFlatValueMap
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "The file stores the values as raw bytes");
+
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+		using value_type = Value;
+		using iterator = Value*;
+		using const_iterator = const Value*;
+		using reference = Value&;
+		using const_reference = const Value&;
+
+	private:
+		struct FileHeader
+		{
+			static constexpr std::uint64_t expected_magic = 0x31504D5646464F43ull; // "COFFVMP1"
+			static constexpr std::uint32_t expected_layout_version = 1;
+
+			std::uint64_t magic;
+			std::uint32_t layout_version;
+			std::uint32_t value_size;
+			std::uint64_t capacity;
+			std::uint64_t size;
+			std::uint32_t last_id;
+			// 0 while the map is open, a file that is opened while this is 0 was not closed properly
+			std::uint32_t closed_cleanly;
+			std::uint64_t handle_ids_offset;
+			std::uint64_t index_slots_offset;
+			std::uint64_t index_slot_count;
+		};
+
+		struct FileLayout
+		{
+			std::size_t handle_ids_offset;
+			std::size_t index_slots_offset;
+			std::size_t index_slot_count;
+			std::size_t total_size;
+		};
+
+		static constexpr std::size_t values_offset = (sizeof(FileHeader) + 63) / 64 * 64 > alignof(Value) ? (sizeof(FileHeader) + 63) / 64 * 64 : alignof(Value);
+
+		MappedFile file{};
+		OpenAddressingIndex index{};
+
+	public:
+		// Open the map in the file at `path`, or create it with room for `initial_capacity` elements. Check is_open() to see if it succeeded
+		explicit MappedFlatValueMap(const std::string& path, std::size_t initial_capacity = 1024);
+		MappedFlatValueMap(const MappedFlatValueMap&) = delete;
+		MappedFlatValueMap(MappedFlatValueMap&&) noexcept = default;
+		MappedFlatValueMap& operator=(const MappedFlatValueMap&) = delete;
+		MappedFlatValueMap& operator=(MappedFlatValueMap&&) = delete;
+		// Marks the file as closed cleanly, the operating system writes the remaining changes back
+		~MappedFlatValueMap();
+
+		/// \Category Element access
+
+		// Get the element indexed by it's handle
+		auto operator[](HandleType handle)->reference;
+		// Get the const element indexed by it's handle
+		auto operator[](HandleType handle) const->const_reference;
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a iterator to the element if found. Else returns end()
+		auto find(HandleType handle)->iterator;
+		// \returns a const iterator to the element if found. Else returns end()
+		auto find(HandleType handle) const->const_iterator;
+		// Get the handle of the element at the raw index in the dense array
+		auto handle_at(std::size_t index) const->HandleType;
+		// Get the data pointer to the contiguous elements
+		auto data()->Value*;
+		// Get the const data pointer to the contiguous elements
+		auto data() const->const Value*;
+
+
+		/// \Category Iterators
+
+		auto begin()->iterator;
+		auto begin() const->const_iterator;
+		auto end()->iterator;
+		auto end() const->const_iterator;
+
+
+		/// \Category Capacity
+
+		// \returns if the file could be opened or created
+		bool is_open() const;
+		// The amount of elements in this map
+		std::size_t size() const;
+		// \returns if the amount of elements in this map equal to zero
+		bool empty() const;
+		// The amount of elements that fit in the file before it grows
+		std::size_t capacity() const;
+		// Grow the file so it has room for at least `new_capacity` elements
+		// \returns false if the file could not grow, the map is then left as it was
+		bool reserve(std::size_t new_capacity);
+
+
+		/// \Category Modifiers
+
+		// pushes back a copy of `value`
+		// \returns the new handle, or a handle with id 0 if the file could not grow or every handle id is used
+		auto push_back(const Value& value)->HandleType;
+		// construct an element in place at the end
+		// \returns the new handle, or a handle with id 0 if the file could not grow or every handle id is used
+		template<typename... Args>
+		auto emplace_back(Args&&... args)->HandleType;
+		// Append `count` elements with handles that were made before, for example by a other map, and build the index once at the end on the threads of `pool`.
+		// `pool` is a WorkStealingPool (utils/work_stealing_pool.h) or a detail::SequentialFor. Handles made after this get a higher id
+		// \returns false if a handle has id 0, is in `handles` twice or is already in this map, or if the file could not grow. Nothing is loaded then,
+		// but the capacity can have grown: the handles are checked while the index is built, after the file grew to fit them
+		template<typename Pool>
+		bool bulk_load(const HandleType* handles, const Value* values, std::size_t count, Pool& pool);
+		// Erase a element, the back element is moved in it's place
+		void erase(HandleType handle);
+		// Erase all elements
+		void clear();
+
+
+		/// \Category File
+
+		// Write all changes to the disk and wait for it
+		bool flush();
+		// Tell the operating system how the elements will be accessed, AccessPattern::sequential before a scan over a table that does not fit in memory
+		void advise(AccessPattern pattern);
+
+	private:
+		auto header() const->FileHeader*;
+		auto value_data() const->Value*;
+		auto id_data() const->std::uint32_t*;
+		static FileLayout layout_for(std::size_t capacity);
+		void attach_index();
+		// \returns false if the ids in the file are not unique, see OpenAddressingIndex::build()
+		bool rebuild_index();
+		template<typename Pool>
+		bool rebuild_index(Pool& pool);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value>
+	MappedFlatValueMap<SparseHandle, Value>::MappedFlatValueMap(const std::string& path, std::size_t initial_capacity)
+	{
+		if (initial_capacity == 0) {
+			initial_capacity = 1;
+		}
+		if (!file.open(path.c_str(), sizeof(FileHeader))) {
+			return;
+		}
+
+		FileHeader* file_header = header();
+		if (file_header->magic == FileHeader::expected_magic) {
+			// A existing map, check that it was made for this value type and that the sections are where this layout puts them, inside the file.
+			// The capacity is checked against the file size first, so a corrupted capacity can not overflow layout_for()
+			bool valid = file_header->layout_version == FileHeader::expected_layout_version
+				&& file_header->value_size == sizeof(Value)
+				&& file_header->capacity <= file.size() / sizeof(Value)
+				&& file_header->size <= file_header->capacity;
+			if (valid) {
+				FileLayout layout = layout_for(static_cast<std::size_t>(file_header->capacity));
+				valid = layout.total_size <= file.size()
+					&& file_header->handle_ids_offset == layout.handle_ids_offset
+					&& file_header->index_slots_offset == layout.index_slots_offset
+					&& file_header->index_slot_count == layout.index_slot_count;
+			}
+			if (!valid) {
+				file.close();
+				return;
+			}
+			attach_index();
+			if (!file_header->closed_cleanly) {
+				rebuild_index();
+			}
+		} else {
+			// A new file reads as zeros, never overwrite a file that has something else in it
+			const auto* header_bytes = reinterpret_cast<const unsigned char*>(file_header);
+			for (std::size_t i = 0; i < sizeof(FileHeader); ++i) {
+				if (header_bytes[i] != 0) {
+					file.close();
+					return;
+				}
+			}
+			FileLayout layout = layout_for(initial_capacity);
+			if (!file.resize(layout.total_size)) {
+				file.close();
+				return;
+			}
+			file_header = header();
+			std::memset(file_header, 0, sizeof(FileHeader));
+			file_header->layout_version = FileHeader::expected_layout_version;
+			file_header->value_size = static_cast<std::uint32_t>(sizeof(Value));
+			file_header->capacity = initial_capacity;
+			file_header->handle_ids_offset = layout.handle_ids_offset;
+			file_header->index_slots_offset = layout.index_slots_offset;
+			file_header->index_slot_count = layout.index_slot_count;
+			attach_index();
+			OpenAddressingIndex::clear(reinterpret_cast<IndexSlot*>(static_cast<unsigned char*>(file.data()) + layout.index_slots_offset), layout.index_slot_count);
+			// The magic is written last, a file without it is created again
+			file_header->magic = FileHeader::expected_magic;
+		}
+		header()->closed_cleanly = 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	MappedFlatValueMap<SparseHandle, Value>::~MappedFlatValueMap()
+	{
+		if (file.is_open()) {
+			header()->closed_cleanly = 1;
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::operator[](HandleType handle) -> reference
+	{
+		std::uint32_t element_index = index.find(handle.id);
+		assert(element_index != OpenAddressingIndex::not_found);
+		return value_data()[element_index];
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::operator[](HandleType handle) const -> const_reference
+	{
+		std::uint32_t element_index = index.find(handle.id);
+		assert(element_index != OpenAddressingIndex::not_found);
+		return value_data()[element_index];
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool MappedFlatValueMap<SparseHandle, Value>::contains(HandleType handle) const
+	{
+		return index.find(handle.id) != OpenAddressingIndex::not_found;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::find(HandleType handle) -> iterator
+	{
+		std::uint32_t element_index = index.find(handle.id);
+		return element_index == OpenAddressingIndex::not_found ? end() : value_data() + element_index;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::find(HandleType handle) const -> const_iterator
+	{
+		std::uint32_t element_index = index.find(handle.id);
+		return element_index == OpenAddressingIndex::not_found ? end() : value_data() + element_index;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::handle_at(std::size_t index) const -> HandleType
+	{
+		assert(index < size());
+		return HandleType{ id_data()[index] };
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::data() -> Value*
+	{
+		return value_data();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::data() const -> const Value*
+	{
+		return value_data();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::begin() -> iterator
+	{
+		return value_data();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::begin() const -> const_iterator
+	{
+		return value_data();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::end() -> iterator
+	{
+		return value_data() + size();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::end() const -> const_iterator
+	{
+		return value_data() + size();
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool MappedFlatValueMap<SparseHandle, Value>::is_open() const
+	{
+		return file.is_open();
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t MappedFlatValueMap<SparseHandle, Value>::size() const
+	{
+		return is_open() ? static_cast<std::size_t>(header()->size) : 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool MappedFlatValueMap<SparseHandle, Value>::empty() const
+	{
+		return size() == 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t MappedFlatValueMap<SparseHandle, Value>::capacity() const
+	{
+		return is_open() ? static_cast<std::size_t>(header()->capacity) : 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool MappedFlatValueMap<SparseHandle, Value>::reserve(std::size_t new_capacity)
+	{
+		assert(is_open());
+		if (new_capacity <= capacity()) {
+			return true;
+		}
+
+		// A failed resize() keeps the file and the old mapping, so the map stays usable at it's old capacity
+		FileLayout layout = layout_for(new_capacity);
+		if (!file.resize(layout.total_size)) {
+			return false;
+		}
+		// The values stay where they are, the handle ids move behind the larger value array and the index is built again behind them
+		FileHeader* file_header = header();
+		auto* base = static_cast<unsigned char*>(file.data());
+		std::memmove(base + layout.handle_ids_offset, base + file_header->handle_ids_offset, static_cast<std::size_t>(file_header->size) * sizeof(std::uint32_t));
+		file_header->capacity = new_capacity;
+		file_header->handle_ids_offset = layout.handle_ids_offset;
+		file_header->index_slots_offset = layout.index_slots_offset;
+		file_header->index_slot_count = layout.index_slot_count;
+		attach_index();
+		rebuild_index();
+		return true;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::push_back(const Value& value) -> HandleType
+	{
+		return emplace_back(value);
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename... Args>
+	auto MappedFlatValueMap<SparseHandle, Value>::emplace_back(Args&&... args) -> HandleType
+	{
+		assert(is_open());
+		// The next id would wrap around to 0, which marks a empty index slot
+		if (header()->last_id == UINT32_MAX || (size() == capacity() && !reserve(capacity() * 2))) {
+			return HandleType{ 0 };
+		}
+
+		FileHeader* file_header = header();
+		std::uint32_t element_index = static_cast<std::uint32_t>(file_header->size);
+		std::uint32_t element_id = ++file_header->last_id;
+		new (value_data() + element_index) Value(std::forward<Args>(args)...);
+		id_data()[element_index] = element_id;
+		index.insert(element_id, element_index);
+		file_header->size = element_index + 1;
+		return HandleType{ element_id };
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Pool>
+	bool MappedFlatValueMap<SparseHandle, Value>::bulk_load(const HandleType* handles, const Value* values, std::size_t count, Pool& pool)
+	{
+		assert(is_open());
+		std::size_t first = size();
+		if (!reserve(first + count)) {
+			return false;
+		}
+
+		constexpr std::size_t grain = 65536;
+		std::vector<std::uint32_t> chunk_max_ids((count + grain - 1) / grain, 0);
+		Value* value_array = value_data();
+		std::uint32_t* id_array = id_data();
+		pool.parallel_for(count, grain, [&](std::size_t begin, std::size_t end) {
+			std::memcpy(static_cast<void*>(value_array + first + begin), values + begin, (end - begin) * sizeof(Value));
+			std::uint32_t max_id = 0;
+			for (std::size_t i = begin; i < end; ++i) {
+				id_array[first + i] = handles[i].id;
+				max_id = handles[i].id > max_id ? handles[i].id : max_id;
+			}
+			chunk_max_ids[begin / grain] = max_id;
+		});
+
+		// The index build finds the ids that are 0, in `handles` twice or already in the map while it probes, so the handles are not checked in a serial pass first
+		FileHeader* file_header = header();
+		file_header->size = first + count;
+		if (!rebuild_index(pool)) {
+			file_header->size = first;
+			rebuild_index(pool);
+			return false;
+		}
+		for (std::uint32_t max_id : chunk_max_ids) {
+			if (max_id > file_header->last_id) {
+				file_header->last_id = max_id;
+			}
+		}
+		return true;
+	}
+
+	template<typename SparseHandle, typename Value>
+	void MappedFlatValueMap<SparseHandle, Value>::erase(HandleType handle)
+	{
+		std::uint32_t removed_index = index.find(handle.id);
+		assert(removed_index != OpenAddressingIndex::not_found);
+
+		FileHeader* file_header = header();
+		std::uint32_t last_index = static_cast<std::uint32_t>(file_header->size - 1);
+		if (removed_index != last_index) {
+			value_data()[removed_index] = value_data()[last_index];
+			id_data()[removed_index] = id_data()[last_index];
+			index.update(id_data()[removed_index], removed_index);
+		}
+		index.erase(handle.id);
+		file_header->size = last_index;
+	}
+
+	template<typename SparseHandle, typename Value>
+	void MappedFlatValueMap<SparseHandle, Value>::clear()
+	{
+		assert(is_open());
+		header()->size = 0;
+		rebuild_index();
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool MappedFlatValueMap<SparseHandle, Value>::flush()
+	{
+		return is_open() && file.sync();
+	}
+
+	template<typename SparseHandle, typename Value>
+	void MappedFlatValueMap<SparseHandle, Value>::advise(AccessPattern pattern)
+	{
+		if (is_open()) {
+			file.advise(values_offset, size() * sizeof(Value), pattern);
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::header() const -> FileHeader*
+	{
+		return static_cast<FileHeader*>(file.data());
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::value_data() const -> Value*
+	{
+		return reinterpret_cast<Value*>(static_cast<unsigned char*>(file.data()) + values_offset);
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::id_data() const -> std::uint32_t*
+	{
+		return reinterpret_cast<std::uint32_t*>(static_cast<unsigned char*>(file.data()) + header()->handle_ids_offset);
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto MappedFlatValueMap<SparseHandle, Value>::layout_for(std::size_t capacity) -> FileLayout
+	{
+		constexpr std::size_t cache_line = 64;
+		FileLayout layout{};
+		layout.handle_ids_offset = (values_offset + capacity * sizeof(Value) + cache_line - 1) / cache_line * cache_line;
+		layout.index_slots_offset = (layout.handle_ids_offset + capacity * sizeof(std::uint32_t) + cache_line - 1) / cache_line * cache_line;
+		layout.index_slot_count = OpenAddressingIndex::slot_count_for(capacity);
+		layout.total_size = layout.index_slots_offset + layout.index_slot_count * sizeof(IndexSlot);
+		return layout;
+	}
+
+	template<typename SparseHandle, typename Value>
+	void MappedFlatValueMap<SparseHandle, Value>::attach_index()
+	{
+		FileHeader* file_header = header();
+		index = OpenAddressingIndex{
+			reinterpret_cast<IndexSlot*>(static_cast<unsigned char*>(file.data()) + file_header->index_slots_offset),
+			static_cast<std::size_t>(file_header->index_slot_count)
+		};
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool MappedFlatValueMap<SparseHandle, Value>::rebuild_index()
+	{
+		detail::SequentialFor sequential{};
+		return rebuild_index(sequential);
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Pool>
+	bool MappedFlatValueMap<SparseHandle, Value>::rebuild_index(Pool& pool)
+	{
+		FileHeader* file_header = header();
+		auto* slots = reinterpret_cast<IndexSlot*>(static_cast<unsigned char*>(file.data()) + file_header->index_slots_offset);
+		std::size_t slot_count = static_cast<std::size_t>(file_header->index_slot_count);
+		OpenAddressingIndex::clear(slots, slot_count);
+		return OpenAddressingIndex::build(slots, slot_count, id_data(), static_cast<std::size_t>(file_header->size), pool);
+	}
+}
@@ -0,0 +1,425 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "utils/numa_topology.h"
+
+
+namespace cof
+{
+	/** \brief A map split in shards that each live on one NUMA node, iterated by threads that run on the node of their shard.
+	 *
+	 * \class NumaShardedFlatValueMap
+	 *
+	 * Every shard is a FlatValueMap with a NumaNodeAllocator, and every change to a shard is made inside a NumaAllocationScope for the node of the shard,
+	 * so the dense array and the handle array of a shard are always allocated on it's node, whichever thread adds the elements.
+	 * The shards are spread round robin over the nodes that have CPUs. Memory-only nodes get no shards, no thread could be pinned next to them.
+	 *
+	 * The handles encode their shard in the lowest bits of the id, so a lookup goes straight to one shard. This leaves 32 - log2(shard_count) bits for the ids,
+	 * so a map with 16 shards can hand out 2^28 handles. After that the modifiers add nothing and return a handle with id 0.
+	 * parallel_for_each() starts threads pinned to the CPUs of every node, which only visit the shards of that node.
+	 * Like FlatValueMap, the modifiers are not thread safe.
+	*/
+	template<typename SparseHandle, typename Value>
+	class NumaShardedFlatValueMap
+	{
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+		using Shard = FlatValueMap<SparseHandle, Value, NumaNodeAllocator<Value>>;
+
+	private:
+		NumaTopology topology;
+		std::vector<Shard> shards{};
+		// The shards of every node, in increasing order
+		std::vector<std::vector<std::size_t>> node_shards{};
+		// The node of every shard
+		std::vector<std::size_t> shard_nodes{};
+		std::uint32_t shard_bits = 0;
+		// Spreads push_back() over the shards of the local node
+		std::size_t next_local_shard = 0;
+
+	public:
+		// Make `shards_per_node` shards on every node of `topology` that has CPUs (on every node if none of them has)
+		explicit NumaShardedFlatValueMap(std::size_t shards_per_node = 1, NumaTopology topology = NumaTopology::detect());
+
+		/// \Category Element access
+
+		// Get the element indexed by it's handle
+		auto operator[](HandleType handle)->Value&;
+		// Get the const element indexed by it's handle
+		auto operator[](HandleType handle) const->const Value&;
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a pointer to the element if found. Else returns nullptr
+		auto find(HandleType handle)->Value*;
+		// \returns a const pointer to the element if found. Else returns nullptr
+		auto find(HandleType handle) const->const Value*;
+
+
+		/// \Category Shards
+
+		std::size_t shard_count() const;
+		// The shard that has the element of `handle`
+		std::size_t shard_of(HandleType handle) const;
+		// The node the memory of `shard` is on
+		std::size_t node_of_shard(std::size_t shard) const;
+		// A shard on the node of the calling thread, push_back() adds to this shard
+		std::size_t local_shard();
+		// The FlatValueMap of `shard`, it's handles are not the handles of this map. Use handle_at() for the handle of a element
+		auto shard(std::size_t shard) const->const Shard&;
+		// Get the handle of the element at the raw index in the dense array of `shard`
+		auto handle_at(std::size_t shard, std::size_t index) const->HandleType;
+		auto get_topology() const->const NumaTopology&;
+
+
+		/// \Category Iterators
+
+		// Call `f(HandleType, Value&)` for every element, shard by shard on the calling thread
+		template<typename Func>
+		void for_each(Func&& f);
+		// Call `f(HandleType, Value&)` for every element. The shards of every node are visited by threads pinned to that node, `f` is called from many threads at once
+		// `threads_per_node` of 0 uses a thread per CPU of the node, but never more threads then the node has shards
+		template<typename Func>
+		void parallel_for_each(Func&& f, std::size_t threads_per_node = 0);
+		// Call `f(std::size_t shard, Shard&)` for every shard, on threads pinned to the node of the shard
+		// When `f` throws, the first exception is rethrown on the calling thread after all threads are joined
+		template<typename Func>
+		void parallel_for_each_shard(Func&& f, std::size_t threads_per_node = 0);
+
+
+		/// \Category Capacity
+
+		// The amount of elements in all shards
+		std::size_t size() const;
+		// \returns if all shards are empty
+		bool empty() const;
+
+
+		/// \Category Modifiers
+
+		// pushes back a new element to the local shard
+		// \returns the new handle, or a handle with id 0 if the ids do not fit next to the shard bits anymore
+		auto push_back(const Value& value)->HandleType;
+		// pushes back a new element to the local shard
+		// \returns the new handle, or a handle with id 0 if the ids do not fit next to the shard bits anymore
+		auto push_back(Value&& value)->HandleType;
+		// pushes back a new element to `shard`
+		// \returns the new handle, or a handle with id 0 if the ids do not fit next to the shard bits anymore
+		auto push_back_to(std::size_t shard, Value value)->HandleType;
+		// Construct a new element in place in `shard`
+		// \returns the new handle, or a handle with id 0 if the ids do not fit next to the shard bits anymore
+		template<typename... Args>
+		auto emplace_back_to(std::size_t shard, Args&&... args)->HandleType;
+		// erase the element of `handle`
+		void erase(HandleType handle);
+		// Erase all elements
+		void clear();
+
+	private:
+		// \returns if the next id of the shards does not fit next to the shard bits
+		bool ids_exhausted() const;
+		auto encode(std::size_t shard, HandleType shard_handle) const->HandleType;
+		auto shard_handle(HandleType handle) const->HandleType;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value>
+	NumaShardedFlatValueMap<SparseHandle, Value>::NumaShardedFlatValueMap(std::size_t shards_per_node, NumaTopology topology)
+		: topology(std::move(topology))
+	{
+		assert(shards_per_node != 0);
+		std::size_t node_count = this->topology.node_count();
+		std::vector<std::size_t> cpu_nodes;
+		for (std::size_t node = 0; node < node_count; ++node) {
+			if (!this->topology.cpus(node).empty()) {
+				cpu_nodes.push_back(node);
+			}
+		}
+		if (cpu_nodes.empty()) {
+			for (std::size_t node = 0; node < node_count; ++node) {
+				cpu_nodes.push_back(node);
+			}
+		}
+		std::size_t count = shards_per_node * cpu_nodes.size();
+		while ((std::size_t{ 1 } << shard_bits) < count) {
+			++shard_bits;
+		}
+		assert(shard_bits < 16 && "Too many shards, there would be almost no bits left for the ids");
+
+		node_shards.resize(node_count);
+		shards.reserve(count);
+		shard_nodes.reserve(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			std::size_t node = cpu_nodes[i % cpu_nodes.size()];
+			shards.emplace_back();
+			shard_nodes.push_back(node);
+			node_shards[node].push_back(i);
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::operator[](HandleType handle) -> Value&
+	{
+		return shards[shard_of(handle)][shard_handle(handle)];
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::operator[](HandleType handle) const -> const Value&
+	{
+		return shards[shard_of(handle)][shard_handle(handle)];
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool NumaShardedFlatValueMap<SparseHandle, Value>::contains(HandleType handle) const
+	{
+		std::size_t shard = shard_of(handle);
+		return shard < shards.size() && shards[shard].contains(shard_handle(handle));
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::find(HandleType handle) -> Value*
+	{
+		return const_cast<Value*>(static_cast<const NumaShardedFlatValueMap&>(*this).find(handle));
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::find(HandleType handle) const -> const Value*
+	{
+		std::size_t shard = shard_of(handle);
+		if (shard >= shards.size()) {
+			return nullptr;
+		}
+		auto it = shards[shard].find(shard_handle(handle));
+		return it == shards[shard].end() ? nullptr : &*it;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t NumaShardedFlatValueMap<SparseHandle, Value>::shard_count() const
+	{
+		return shards.size();
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t NumaShardedFlatValueMap<SparseHandle, Value>::shard_of(HandleType handle) const
+	{
+		return handle.id & ((std::uint32_t{ 1 } << shard_bits) - 1);
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t NumaShardedFlatValueMap<SparseHandle, Value>::node_of_shard(std::size_t shard) const
+	{
+		return shard_nodes[shard];
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t NumaShardedFlatValueMap<SparseHandle, Value>::local_shard()
+	{
+		const std::vector<std::size_t>& local = node_shards[topology.current_node()];
+		if (local.empty()) {
+			// The node of this CPU is not known, or a hand made topology has no shards on it
+			return next_local_shard++ % shards.size();
+		}
+		return local[next_local_shard++ % local.size()];
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::shard(std::size_t shard) const -> const Shard&
+	{
+		return shards[shard];
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::handle_at(std::size_t shard, std::size_t index) const -> HandleType
+	{
+		return encode(shard, shards[shard].handle_at(index));
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::get_topology() const -> const NumaTopology&
+	{
+		return topology;
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	void NumaShardedFlatValueMap<SparseHandle, Value>::for_each(Func&& f)
+	{
+		for (std::size_t shard = 0; shard < shards.size(); ++shard) {
+			Shard& shard_map = shards[shard];
+			for (std::size_t i = 0; i < shard_map.size(); ++i) {
+				f(encode(shard, shard_map.handle_at(i)), shard_map.data()[i]);
+			}
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	void NumaShardedFlatValueMap<SparseHandle, Value>::parallel_for_each(Func&& f, std::size_t threads_per_node)
+	{
+		parallel_for_each_shard([this, &f](std::size_t shard, Shard& shard_map) {
+			for (std::size_t i = 0; i < shard_map.size(); ++i) {
+				f(encode(shard, shard_map.handle_at(i)), shard_map.data()[i]);
+			}
+		}, threads_per_node);
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	void NumaShardedFlatValueMap<SparseHandle, Value>::parallel_for_each_shard(Func&& f, std::size_t threads_per_node)
+	{
+		// One shared counter per node, the threads of a node take the next shard of that node until there are none left
+		std::vector<std::atomic<std::size_t>> next_shard(node_shards.size());
+		std::vector<std::thread> threads;
+		std::mutex error_mutex;
+		std::exception_ptr error;
+		auto join_all = [&threads]() {
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+		};
+		try {
+			for (std::size_t node = 0; node < node_shards.size(); ++node) {
+				next_shard[node] = 0;
+				std::size_t thread_count = threads_per_node != 0 ? threads_per_node : topology.cpus(node).size();
+				if (thread_count > node_shards[node].size()) {
+					thread_count = node_shards[node].size();
+				}
+				// A hand made topology can put shards on a node without CPUs, they still need a thread
+				if (thread_count == 0 && !node_shards[node].empty()) {
+					thread_count = 1;
+				}
+				for (std::size_t t = 0; t < thread_count; ++t) {
+					threads.emplace_back([this, &f, &next_shard, &error_mutex, &error, node]() {
+						try {
+							// When pinning fails the shards are still visited, only from a CPU of a other node
+							pin_thread_to_node(topology, node);
+							NumaAllocationScope scope{ node };
+							const std::vector<std::size_t>& local = node_shards[node];
+							for (std::size_t i = next_shard[node]++; i < local.size(); i = next_shard[node]++) {
+								f(local[i], shards[local[i]]);
+							}
+						} catch (...) {
+							std::lock_guard<std::mutex> lock{ error_mutex };
+							if (!error) {
+								error = std::current_exception();
+							}
+						}
+					});
+				}
+			}
+		} catch (...) {
+			// Starting a thread failed, the threads that did start still have to be joined
+			join_all();
+			throw;
+		}
+		join_all();
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t NumaShardedFlatValueMap<SparseHandle, Value>::size() const
+	{
+		std::size_t total = 0;
+		for (const Shard& shard_map : shards) {
+			total += shard_map.size();
+		}
+		return total;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool NumaShardedFlatValueMap<SparseHandle, Value>::empty() const
+	{
+		return size() == 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::push_back(const Value& value) -> HandleType
+	{
+		return push_back_to(local_shard(), value);
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::push_back(Value&& value) -> HandleType
+	{
+		return push_back_to(local_shard(), std::move(value));
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::push_back_to(std::size_t shard, Value value) -> HandleType
+	{
+		assert(shard < shards.size());
+		if (ids_exhausted()) {
+			return HandleType{ 0 };
+		}
+		NumaAllocationScope scope{ node_of_shard(shard) };
+		return encode(shard, shards[shard].push_back(std::move(value)));
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename... Args>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::emplace_back_to(std::size_t shard, Args&&... args) -> HandleType
+	{
+		assert(shard < shards.size());
+		if (ids_exhausted()) {
+			return HandleType{ 0 };
+		}
+		NumaAllocationScope scope{ node_of_shard(shard) };
+		return encode(shard, shards[shard].emplace_back(std::forward<Args>(args)...));
+	}
+
+	template<typename SparseHandle, typename Value>
+	void NumaShardedFlatValueMap<SparseHandle, Value>::erase(HandleType handle)
+	{
+		std::size_t shard = shard_of(handle);
+		assert(shard < shards.size());
+		NumaAllocationScope scope{ node_of_shard(shard) };
+		shards[shard].erase(shard_handle(handle));
+	}
+
+	template<typename SparseHandle, typename Value>
+	void NumaShardedFlatValueMap<SparseHandle, Value>::clear()
+	{
+		for (Shard& shard_map : shards) {
+			shard_map.clear();
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool NumaShardedFlatValueMap<SparseHandle, Value>::ids_exhausted() const
+	{
+		// All shards share the id counter of the Shard type, a id that does not fit would alias the handle of a other shard
+		std::uint64_t next_id = static_cast<std::uint64_t>(Shard::last_handle_id()) + 1;
+		return (next_id >> (32 - shard_bits)) != 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::encode(std::size_t shard, HandleType shard_handle) const -> HandleType
+	{
+		assert((shard_bits == 0 || (shard_handle.id >> (32 - shard_bits)) == 0) && "The ids of the shards do not fit next to the shard bits anymore");
+		return HandleType{ static_cast<std::uint32_t>(shard_handle.id << shard_bits | shard) };
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto NumaShardedFlatValueMap<SparseHandle, Value>::shard_handle(HandleType handle) const -> HandleType
+	{
+		return HandleType{ handle.id >> shard_bits };
+	}
+}
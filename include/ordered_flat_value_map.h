@@ -0,0 +1,377 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cassert>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "utils/container_utils.h"
+#include "flat_value_map_handle.h"
+#include "utils/tmp_compatibility.h"
+
+
+namespace cof
+{
+	/** \brief A FlatValueMap variant that keeps it's elements in insertion order, for when iteration order has to be deterministic.
+	 *
+	 * \class OrderedFlatValueMap
+	 *
+	 * Instead of the swap erase idiom, erase() only marks the slot of the element as a tombstone and removes the handle from the sparse_to_dense map.
+	 * When more then half of the slots are tombstones, the live elements are moved down in order (one pass) and their indices in the sparse_to_dense map are fixed up.
+	 * Every compaction removes at least as many tombstones as there are live elements, so the fixups are amortized O(1) per erase.
+	 * The iterators skip tombstones. Erased elements are destroyed by the next compaction, call compact() to destroy them directly.
+	*/
+	template<typename SparseHandle, typename Value,
+		typename Allocator = std::allocator<Value>,
+		typename SparseToDenseAllocator = typename cof::rebind<Allocator, std::pair<const SparseHandle, std::size_t> >::other
+	>
+	class OrderedFlatValueMap
+	{
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+
+	private:
+		using SparseToDenseMap = std::unordered_map<HandleType, std::size_t, std::hash<HandleType>, std::equal_to<>, SparseToDenseAllocator>;
+		using DenseToSparseVector = std::vector<HandleType, typename cof::rebind<Allocator, HandleType>::other>;
+		using TombstoneVector = std::vector<std::uint8_t, typename cof::rebind<Allocator, std::uint8_t>::other>;
+		using DenseVector = std::vector<ValueType, Allocator>;
+
+		// Compaction does not run below this amount of slots, to not compact small maps on every erase
+		static constexpr std::size_t min_compaction_slots = 16;
+
+		// The sparse_to_dense map is used for finding a the raw index of the dense_vector from a sparse handle, erased handles are removed directly
+		SparseToDenseMap sparse_to_dense{};
+		// The dense_to_sparse array is used for finding a sparse handle from a raw dense_vector index. It is kept in the same order as the dense_vector.
+		DenseToSparseVector dense_to_sparse{};
+		// 1 for every slot in the dense_vector that holds a erased element
+		TombstoneVector tombstones{};
+		// The internal dense_vector, contains all elements and tombstones in insertion order.
+		DenseVector dense_vector;
+
+		std::size_t erased_slot_count = 0;
+
+		static uint32_t internalIdCounter;
+
+		template<bool IsConst>
+		class Iterator;
+
+	public:
+		using value_type = ValueType;
+		using allocator_type = Allocator;
+		using size_type = typename DenseVector::size_type;
+		using reference = typename DenseVector::reference;
+		using const_reference = typename DenseVector::const_reference;
+		using iterator = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+	public:
+		OrderedFlatValueMap() = default;
+
+		/// \Category Element access
+
+		// Get the element indexed by it's handle
+		auto operator[](HandleType handle)->reference;
+		// Get the const element indexed by it's handle
+		auto operator[](HandleType handle) const->const_reference;
+
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a iterator to the element if found. Else returns end()
+		auto find(HandleType handle)->iterator;
+		// \returns a const iterator to the element if found. Else returns end()
+		auto find(HandleType handle) const->const_iterator;
+
+
+		/// \Category Iterators
+
+		// Get a iterator to the oldest element
+		auto begin()->iterator;
+		// Get a const iterator to the oldest element
+		auto begin() const->const_iterator;
+		// Get a iterator past the newest element
+		auto end()->iterator;
+		// Get a const iterator past the newest element
+		auto end() const->const_iterator;
+
+
+		/// \Category Capacity
+
+		// The amount of elements in this map, tombstones not included
+		std::size_t size() const;
+		// \returns if the amount of elements in this map equal to zero
+		bool empty() const;
+		// The amount of erased elements that are waiting for the next compaction
+		std::size_t tombstone_count() const;
+
+
+		/// \Category Modifiers
+
+		// pushes back a copy of element `t` after all existing elements
+		auto push_back(const Value& t)->HandleType;
+		// pushes back the moved element `t` after all existing elements
+		auto push_back(Value&& t)->HandleType;
+		// construct an element in place after all existing elements
+		template<typename... Args>
+		auto emplace_back(Args&&... args)->HandleType;
+
+		// erase a element, the order of the other elements stays the same
+		void erase(HandleType handle);
+		// Erase all elements
+		void clear();
+		// Remove all tombstones now, moving the live elements down in order
+		void compact();
+
+	private:
+		auto register_back_element()->HandleType;
+		void compact_if_needed();
+		std::size_t first_live_index(std::size_t from) const;
+	};
+
+
+	/// \brief Forward iterator over the live elements of a OrderedFlatValueMap, in insertion order
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	template<bool IsConst>
+	class OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::Iterator
+	{
+		using MapType = typename std::conditional<IsConst, const OrderedFlatValueMap, OrderedFlatValueMap>::type;
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Value;
+		using difference_type = std::ptrdiff_t;
+		using pointer = typename std::conditional<IsConst, const Value*, Value*>::type;
+		using reference = typename std::conditional<IsConst, const Value&, Value&>::type;
+
+		Iterator() = default;
+		Iterator(MapType* map, std::size_t index) : map(map), element_index(index) {}
+		// A iterator converts to a const_iterator
+		template<bool OtherIsConst, typename = typename std::enable_if<IsConst && !OtherIsConst>::type>
+		Iterator(const Iterator<OtherIsConst>& other) : map(other.map), element_index(other.element_index) {}
+
+		reference operator*() const { return map->dense_vector[element_index]; }
+		pointer operator->() const { return &map->dense_vector[element_index]; }
+		Iterator& operator++() { element_index = map->first_live_index(element_index + 1); return *this; }
+		Iterator operator++(int) { Iterator copy = *this; ++*this; return copy; }
+
+		// The handle of the element this iterator points to
+		HandleType handle() const { return map->dense_to_sparse[element_index]; }
+
+		friend bool operator==(const Iterator& lhs, const Iterator& rhs) { return lhs.element_index == rhs.element_index; }
+		friend bool operator!=(const Iterator& lhs, const Iterator& rhs) { return lhs.element_index != rhs.element_index; }
+
+	private:
+		template<bool> friend class Iterator;
+
+		MapType* map = nullptr;
+		std::size_t element_index = 0;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	uint32_t OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::internalIdCounter = 0;
+
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::operator[](HandleType handle) -> reference
+	{
+		assert(sparse_to_dense.find(handle) != sparse_to_dense.end());
+		auto element_index = sparse_to_dense.at(handle);
+		assert(vector_in_range(dense_vector, element_index));
+		return dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::operator[](HandleType handle) const -> const_reference
+	{
+		assert(sparse_to_dense.find(handle) != sparse_to_dense.end());
+		auto element_index = sparse_to_dense.at(handle);
+		assert(vector_in_range(dense_vector, element_index));
+		return dense_vector[element_index];
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::contains(HandleType handle) const
+	{
+		return sparse_to_dense.find(handle) != sparse_to_dense.end();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::find(HandleType handle) -> iterator
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (sparse_to_dense_it == sparse_to_dense.end()) {
+			return end();
+		}
+		return iterator{ this, sparse_to_dense_it->second };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::find(HandleType handle) const -> const_iterator
+	{
+		auto sparse_to_dense_it = sparse_to_dense.find(handle);
+		if (sparse_to_dense_it == sparse_to_dense.end()) {
+			return end();
+		}
+		return const_iterator{ this, sparse_to_dense_it->second };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::begin() -> iterator
+	{
+		return iterator{ this, first_live_index(0) };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::begin() const -> const_iterator
+	{
+		return const_iterator{ this, first_live_index(0) };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::end() -> iterator
+	{
+		return iterator{ this, dense_vector.size() };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::end() const -> const_iterator
+	{
+		return const_iterator{ this, dense_vector.size() };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::size() const
+	{
+		return dense_vector.size() - erased_slot_count;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	bool OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::empty() const
+	{
+		return size() == 0;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::tombstone_count() const
+	{
+		return erased_slot_count;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::push_back(const Value& t) -> HandleType
+	{
+		dense_vector.push_back(t);
+		return register_back_element();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::push_back(Value&& t) -> HandleType
+	{
+		dense_vector.push_back(std::move(t));
+		return register_back_element();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	template<typename ... Args>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::emplace_back(Args&&... args) -> HandleType
+	{
+		dense_vector.emplace_back(std::forward<Args>(args)...);
+		return register_back_element();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::erase(HandleType handle)
+	{
+		auto removing_sparse_to_dense_it = sparse_to_dense.find(handle);
+		assert(removing_sparse_to_dense_it != sparse_to_dense.end());
+		std::size_t removed_element_index = removing_sparse_to_dense_it->second;
+		assert(tombstones[removed_element_index] == 0);
+
+		tombstones[removed_element_index] = 1;
+		++erased_slot_count;
+		sparse_to_dense.erase(removing_sparse_to_dense_it);
+
+		compact_if_needed();
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::clear()
+	{
+		dense_vector.clear();
+		sparse_to_dense.clear();
+		dense_to_sparse.clear();
+		tombstones.clear();
+		erased_slot_count = 0;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::compact()
+	{
+		if (erased_slot_count == 0) {
+			return;
+		}
+
+		// Skip the live prefix, nothing moves there
+		std::size_t write_index = 0;
+		while (write_index < dense_vector.size() && tombstones[write_index] == 0) {
+			++write_index;
+		}
+		for (std::size_t read_index = write_index + 1; read_index < dense_vector.size(); ++read_index) {
+			if (tombstones[read_index] != 0) {
+				continue;
+			}
+			dense_vector[write_index] = std::move(dense_vector[read_index]);
+			dense_to_sparse[write_index] = dense_to_sparse[read_index];
+			sparse_to_dense.find(dense_to_sparse[write_index])->second = write_index;
+			++write_index;
+		}
+
+		for (std::size_t i = dense_vector.size(); i > write_index; --i) {
+			dense_vector.pop_back();
+		}
+		dense_to_sparse.resize(write_index);
+		tombstones.assign(write_index, 0);
+		erased_slot_count = 0;
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	auto OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::register_back_element() -> HandleType
+	{
+		std::size_t element_index = dense_vector.size() - 1;
+		uint32_t element_id = ++internalIdCounter;
+		sparse_to_dense.emplace(HandleType{ element_id }, element_index);
+		dense_to_sparse.push_back(HandleType{ element_id });
+		tombstones.push_back(0);
+		return HandleType{ element_id };
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	void OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::compact_if_needed()
+	{
+		if (dense_vector.size() >= min_compaction_slots && erased_slot_count * 2 > dense_vector.size()) {
+			compact();
+		} else if (erased_slot_count == dense_vector.size()) {
+			// Everything is erased, no need to move anything
+			clear();
+		}
+	}
+
+	template<typename SparseHandle, typename Value, typename Allocator, typename SparseToDenseAllocator>
+	std::size_t OrderedFlatValueMap<SparseHandle, Value, Allocator, SparseToDenseAllocator>::first_live_index(std::size_t from) const
+	{
+		while (from < tombstones.size() && tombstones[from] != 0) {
+			++from;
+		}
+		return from;
+	}
+}
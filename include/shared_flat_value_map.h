@@ -0,0 +1,723 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "utils/defines.h"
+#include "utils/memory_mapping.h"
+#include "utils/offset_ptr.h"
+#include "utils/open_addressing_index.h"
+
+
+namespace cof
+{
+	namespace detail
+	{
+		// A hash of the name the compiler gives `Value`, with it's size and alignment.
+		// Processes built with the same compiler get the same tag for the same type, so a reader can tell two types of the same size apart
+		template<typename Value>
+		std::uint64_t shared_value_type_tag()
+		{
+#if defined(_MSC_VER) && !defined(__clang__)
+			const char* signature = __FUNCSIG__;
+#else
+			const char* signature = __PRETTY_FUNCTION__;
+#endif
+			// FNV-1a
+			std::uint64_t hash = 0xcbf29ce484222325ull;
+			for (const char* c = signature; *c != '\0'; ++c) {
+				hash = (hash ^ static_cast<unsigned char>(*c)) * 0x100000001b3ull;
+			}
+			hash = (hash ^ sizeof(Value)) * 0x100000001b3ull;
+			return (hash ^ alignof(Value)) * 0x100000001b3ull;
+		}
+
+		// The header at the start of a shared segment, the arrays follow it in the same segment
+		template<typename Value>
+		struct SharedSegmentHeader
+		{
+			static constexpr std::uint64_t expected_magic = 0x31564D465F464F43ull; // "COF_FMV1"
+			static constexpr std::uint32_t expected_layout_version = 3;
+
+			// Stored last when the segment is created, so a reader never sees a half initialized header
+			std::atomic<std::uint64_t> magic;
+			std::uint32_t layout_version;
+			std::uint32_t value_size;
+			std::uint32_t capacity;
+			// shared_value_type_tag<Value>() of the writer
+			std::uint64_t value_type_tag;
+			std::uint32_t last_id;
+			// 64 bits wide, the index of a capacity above 2^31 has 2^32 slots
+			std::uint64_t index_slot_count;
+			std::atomic<std::uint32_t> size;
+			// Odd while the writer changes the segment, bumped by 2 for every published change
+			std::atomic<std::uint64_t> sequence;
+
+			OffsetPtr<Value> values;
+			OffsetPtr<std::uint32_t> handle_ids;
+			OffsetPtr<IndexSlot> index_slots;
+		};
+
+		// Byte offsets of the arrays in a segment for `capacity` elements
+		struct SharedSegmentLayout
+		{
+			std::size_t values_offset;
+			std::size_t handle_ids_offset;
+			std::size_t index_slots_offset;
+			std::size_t index_slot_count;
+			std::size_t total_size;
+		};
+
+		inline std::size_t align_up(std::size_t offset, std::size_t alignment)
+		{
+			return (offset + alignment - 1) / alignment * alignment;
+		}
+
+		template<typename Value>
+		SharedSegmentLayout shared_segment_layout(std::size_t capacity)
+		{
+			constexpr std::size_t cache_line = 64;
+			SharedSegmentLayout layout{};
+			layout.values_offset = align_up(sizeof(SharedSegmentHeader<Value>), alignof(Value) > cache_line ? alignof(Value) : cache_line);
+			layout.handle_ids_offset = align_up(layout.values_offset + capacity * sizeof(Value), cache_line);
+			layout.index_slots_offset = align_up(layout.handle_ids_offset + capacity * sizeof(std::uint32_t), cache_line);
+			layout.index_slot_count = OpenAddressingIndex::slot_count_for(capacity);
+			layout.total_size = layout.index_slots_offset + layout.index_slot_count * sizeof(IndexSlot);
+			return layout;
+		}
+	}
+
+	/** \brief A FlatValueMap in a POSIX shared memory segment, written by one process and read zero-copy by other processes.
+	 *
+	 * \class SharedFlatValueMap
+	 *
+	 * The dense values, the dense handle ids and a open addressing sparse index are stored in one segment, the header points to them with OffsetPtr, so every process can map the segment at a different address.
+	 * Readers attach with SharedFlatValueMapReader. Every change is published with a seqlock: the sequence number in the header is odd while a change is in progress, readers retry when it changed during their read.
+	 *
+	 * Differences with FlatValueMap:
+	 * - The capacity is fixed when the segment is created, push_back() returns a handle with id 0 when it's full or when the 2^32 - 1 ids of the segment are used up
+	 * - Value has to be trivially copyable, readers copy it while the writer could change it. Readers only attach when they use the same Value type, built with the same compiler
+	 * - There can be only one writer per segment, handle ids continue from the `last_id` in the segment header
+	 * - Only available when COF_POSIX_MAPPING is 1, on other targets is_open() is always false
+	*/
+	template<typename SparseHandle, typename Value>
+	class SharedFlatValueMap
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "Values in shared memory are copied by other processes, so they have to be trivially copyable");
+		static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "The seqlock needs a address free atomic");
+
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+		using value_type = Value;
+		using const_iterator = const Value*;
+
+	private:
+		using Header = detail::SharedSegmentHeader<Value>;
+
+		MappedMemory segment{};
+		Header* header = nullptr;
+		OpenAddressingIndex index{};
+		// Nesting depth of the write sections, only the outer section changes the sequence
+		std::uint32_t write_depth = 0;
+
+	public:
+		// Create (or replace) the shared memory segment `name` with room for `capacity` elements. Check is_open() to see if it succeeded
+		// A capacity of 0 or of UINT32_MAX and up does not fit the 32 bit dense indices, the map stays closed
+		// Readers that are still attached to a replaced segment keep reading the old one
+		SharedFlatValueMap(const char* name, std::size_t capacity);
+		SharedFlatValueMap(const SharedFlatValueMap&) = delete;
+		// The moved from map is closed
+		SharedFlatValueMap(SharedFlatValueMap&& other) noexcept;
+		SharedFlatValueMap& operator=(const SharedFlatValueMap&) = delete;
+		SharedFlatValueMap& operator=(SharedFlatValueMap&& other) noexcept;
+
+		// Remove the name of a segment, processes that mapped it keep their mapping
+		static bool remove(const char* name);
+
+		/// \Category Element access
+
+		// Get the const element indexed by it's handle, the writer is the only one changing the segment so it does not need the seqlock
+		auto operator[](HandleType handle) const->const Value&;
+		// Check if this map contains a element with this handle.
+		bool contains(HandleType handle) const;
+		// \returns a pointer to the element, or nullptr if there is no element with this handle
+		auto find(HandleType handle) const->const Value*;
+		// Get the handle of the element at the raw index in the dense array
+		auto handle_at(std::size_t index) const->HandleType;
+		// Get the dense array of elements
+		auto data() const->const Value*;
+
+
+		/// \Category Iterators
+
+		auto begin() const->const_iterator;
+		auto end() const->const_iterator;
+
+
+		/// \Category Capacity
+
+		// \returns if the segment was created
+		bool is_open() const;
+		// The amount of elements in this map
+		std::size_t size() const;
+		// \returns if the amount of elements in this map equal to zero
+		bool empty() const;
+		// The fixed amount of elements the segment has room for
+		std::size_t capacity() const;
+		// The size of the segment in bytes
+		std::size_t segment_size() const;
+
+
+		/// \Category Modifiers
+
+		// Publish a copy of `value` as a new element
+		// \returns the new handle, or a handle with id 0 if the segment is full or out of ids
+		auto push_back(const Value& value)->HandleType;
+		// Construct a new element from `args` and publish it
+		// \returns the new handle, or a handle with id 0 if the segment is full or out of ids
+		template<typename... TArgs>
+		auto emplace_back(TArgs&&... args)->HandleType;
+		// Replace the value of a element
+		void assign(HandleType handle, const Value& value);
+		// Change a element in place with `f(Value&)`
+		template<typename Func>
+		void update(HandleType handle, Func&& f);
+		// Erase a element, the back element is moved in it's place
+		// \returns false if there was no element with this handle
+		bool erase(HandleType handle);
+		// Erase all elements
+		void clear();
+		// Run `f(*this)` as one change, readers see all modifiers in `f` or none of them
+		// When `f` throws, the changes it made up to then are published and the exception is passed on
+		template<typename Func>
+		void batch(Func&& f);
+
+	private:
+		void begin_write();
+		void end_write();
+
+		// Publishes the change when it goes out of scope, also when the change throws, so the sequence never stays odd
+		class WriteGuard
+		{
+		public:
+			explicit WriteGuard(SharedFlatValueMap& map) : map(map) { map.begin_write(); }
+			WriteGuard(const WriteGuard&) = delete;
+			WriteGuard& operator=(const WriteGuard&) = delete;
+			~WriteGuard() { map.end_write(); }
+
+		private:
+			SharedFlatValueMap& map;
+		};
+		auto value_data() const->Value*;
+	};
+
+	/** \brief A read only view of a SharedFlatValueMap segment, for other processes.
+	 *
+	 * \class SharedFlatValueMapReader
+	 *
+	 * The values are never copied out of the segment by the reader itself. read() calls `f(view)` on the live segment and calls it again when the writer changed the segment during the call.
+	 * So `f` has to copy what it needs, and only use those copies after read() returned. try_read() does a single attempt.
+	*/
+	template<typename SparseHandle, typename Value>
+	class SharedFlatValueMapReader
+	{
+		static_assert(std::is_trivially_copyable<Value>::value, "Values in shared memory are copied by other processes, so they have to be trivially copyable");
+
+	public:
+		using HandleType = SparseHandle;
+		using ValueType = Value;
+
+	private:
+		using Header = detail::SharedSegmentHeader<Value>;
+
+		MappedMemory segment{};
+		const Header* header = nullptr;
+
+	public:
+		/** \brief The segment as seen during one read attempt. It is only consistent if the attempt succeeds
+		 *
+		 * Every function checks the bounds, so a view of a segment that changes during the read never reads outside of the segment.
+		*/
+		class View
+		{
+		public:
+			explicit View(const Header* header);
+
+			// The amount of elements
+			std::size_t size() const;
+			bool empty() const;
+			// Get the dense array of elements, it has size() elements
+			auto data() const->const Value*;
+			auto begin() const->const Value*;
+			auto end() const->const Value*;
+			// Get the handle of the element at the raw index in the dense array
+			auto handle_at(std::size_t index) const->HandleType;
+			// \returns a pointer to the element, or nullptr if there is no element with this handle
+			auto find(HandleType handle) const->const Value*;
+			bool contains(HandleType handle) const;
+
+		private:
+			const Header* header;
+			std::size_t element_count;
+		};
+
+	public:
+		// Map the existing segment `name` read only. Check is_open() to see if it succeeded, it fails when the segment was made for a different Value type
+		explicit SharedFlatValueMapReader(const char* name);
+		SharedFlatValueMapReader(const SharedFlatValueMapReader&) = delete;
+		// The moved from reader is closed
+		SharedFlatValueMapReader(SharedFlatValueMapReader&& other) noexcept;
+		SharedFlatValueMapReader& operator=(const SharedFlatValueMapReader&) = delete;
+		SharedFlatValueMapReader& operator=(SharedFlatValueMapReader&& other) noexcept;
+
+		// \returns if the segment is mapped
+		bool is_open() const;
+		// The sequence number of the last published change, it changes every time the writer publishes
+		std::uint64_t version() const;
+
+		// Call `f(const View&)` until it ran without the writer changing the segment
+		template<typename Func>
+		void read(Func&& f) const;
+		// Call `f(const View&)` once
+		// \returns false if the writer changed the segment during the call, in that case everything `f` read has to be thrown away
+		template<typename Func>
+		bool try_read(Func&& f) const;
+		// Copy the element with this handle into `out`
+		// \returns false if there is no element with this handle
+		bool get(HandleType handle, Value& out) const;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename SparseHandle, typename Value>
+	SharedFlatValueMap<SparseHandle, Value>::SharedFlatValueMap(const char* name, std::size_t capacity)
+	{
+		if (capacity == 0 || capacity >= UINT32_MAX) {
+			return;
+		}
+		detail::SharedSegmentLayout layout = detail::shared_segment_layout<Value>(capacity);
+		segment = create_shared_memory(name, layout.total_size);
+		if (!segment.is_open()) {
+			return;
+		}
+
+		auto* base = static_cast<unsigned char*>(segment.data());
+		header = new (base) Header{};
+		header->layout_version = Header::expected_layout_version;
+		header->value_size = static_cast<std::uint32_t>(sizeof(Value));
+		header->value_type_tag = detail::shared_value_type_tag<Value>();
+		header->capacity = static_cast<std::uint32_t>(capacity);
+		header->index_slot_count = layout.index_slot_count;
+		header->last_id = 0;
+		header->size.store(0, std::memory_order_relaxed);
+		header->sequence.store(0, std::memory_order_relaxed);
+		header->values = reinterpret_cast<Value*>(base + layout.values_offset);
+		header->handle_ids = reinterpret_cast<std::uint32_t*>(base + layout.handle_ids_offset);
+		header->index_slots = reinterpret_cast<IndexSlot*>(base + layout.index_slots_offset);
+
+		OpenAddressingIndex::clear(header->index_slots.get(), layout.index_slot_count);
+		index = OpenAddressingIndex{ header->index_slots.get(), layout.index_slot_count };
+
+		header->magic.store(Header::expected_magic, std::memory_order_release);
+	}
+
+	template<typename SparseHandle, typename Value>
+	SharedFlatValueMap<SparseHandle, Value>::SharedFlatValueMap(SharedFlatValueMap&& other) noexcept
+		: segment(std::move(other.segment))
+		, header(std::exchange(other.header, nullptr))
+		, index(std::exchange(other.index, OpenAddressingIndex{}))
+		, write_depth(std::exchange(other.write_depth, 0u))
+	{
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::operator=(SharedFlatValueMap&& other) noexcept -> SharedFlatValueMap&
+	{
+		if (this != &other) {
+			segment = std::move(other.segment);
+			header = std::exchange(other.header, nullptr);
+			index = std::exchange(other.index, OpenAddressingIndex{});
+			write_depth = std::exchange(other.write_depth, 0u);
+		}
+		return *this;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMap<SparseHandle, Value>::remove(const char* name)
+	{
+		return unlink_shared_memory(name);
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::operator[](HandleType handle) const -> const Value&
+	{
+		const Value* value = find(handle);
+		assert(value != nullptr);
+		return *value;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMap<SparseHandle, Value>::contains(HandleType handle) const
+	{
+		return find(handle) != nullptr;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::find(HandleType handle) const -> const Value*
+	{
+		assert(is_open());
+		std::uint32_t element_index = index.find(handle.id);
+		return element_index == OpenAddressingIndex::not_found ? nullptr : value_data() + element_index;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::handle_at(std::size_t index) const -> HandleType
+	{
+		assert(index < size());
+		return HandleType{ header->handle_ids[index] };
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::data() const -> const Value*
+	{
+		return value_data();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::begin() const -> const_iterator
+	{
+		return value_data();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::end() const -> const_iterator
+	{
+		return value_data() + size();
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMap<SparseHandle, Value>::is_open() const
+	{
+		return header != nullptr;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t SharedFlatValueMap<SparseHandle, Value>::size() const
+	{
+		return is_open() ? header->size.load(std::memory_order_relaxed) : 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMap<SparseHandle, Value>::empty() const
+	{
+		return size() == 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t SharedFlatValueMap<SparseHandle, Value>::capacity() const
+	{
+		return is_open() ? header->capacity : 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t SharedFlatValueMap<SparseHandle, Value>::segment_size() const
+	{
+		return segment.size();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::push_back(const Value& value) -> HandleType
+	{
+		return emplace_back(value);
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename... TArgs>
+	auto SharedFlatValueMap<SparseHandle, Value>::emplace_back(TArgs&&... args) -> HandleType
+	{
+		assert(is_open());
+		std::uint32_t element_index = header->size.load(std::memory_order_relaxed);
+		// Id 0 marks a empty index slot, so the ids can not wrap around
+		if (element_index == header->capacity || header->last_id == UINT32_MAX) {
+			return HandleType{ 0 };
+		}
+
+		std::uint32_t element_id = ++header->last_id;
+		WriteGuard write{ *this };
+		new (value_data() + element_index) Value(std::forward<TArgs>(args)...);
+		header->handle_ids[element_index] = element_id;
+		index.insert(element_id, element_index);
+		header->size.store(element_index + 1, std::memory_order_relaxed);
+		return HandleType{ element_id };
+	}
+
+	template<typename SparseHandle, typename Value>
+	void SharedFlatValueMap<SparseHandle, Value>::assign(HandleType handle, const Value& value)
+	{
+		update(handle, [&value](Value& element) { element = value; });
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	void SharedFlatValueMap<SparseHandle, Value>::update(HandleType handle, Func&& f)
+	{
+		assert(is_open());
+		std::uint32_t element_index = index.find(handle.id);
+		assert(element_index != OpenAddressingIndex::not_found);
+		WriteGuard write{ *this };
+		f(value_data()[element_index]);
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMap<SparseHandle, Value>::erase(HandleType handle)
+	{
+		assert(is_open());
+		std::uint32_t removed_index = index.find(handle.id);
+		if (removed_index == OpenAddressingIndex::not_found) {
+			return false;
+		}
+
+		WriteGuard write{ *this };
+		std::uint32_t last_index = header->size.load(std::memory_order_relaxed) - 1;
+		if (removed_index != last_index) {
+			value_data()[removed_index] = value_data()[last_index];
+			header->handle_ids[removed_index] = header->handle_ids[last_index];
+			index.update(header->handle_ids[removed_index], removed_index);
+		}
+		index.erase(handle.id);
+		header->size.store(last_index, std::memory_order_relaxed);
+		return true;
+	}
+
+	template<typename SparseHandle, typename Value>
+	void SharedFlatValueMap<SparseHandle, Value>::clear()
+	{
+		assert(is_open());
+		WriteGuard write{ *this };
+		OpenAddressingIndex::clear(header->index_slots.get(), static_cast<std::size_t>(header->index_slot_count));
+		header->size.store(0, std::memory_order_relaxed);
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	void SharedFlatValueMap<SparseHandle, Value>::batch(Func&& f)
+	{
+		WriteGuard write{ *this };
+		f(*this);
+	}
+
+	template<typename SparseHandle, typename Value>
+	void SharedFlatValueMap<SparseHandle, Value>::begin_write()
+	{
+		if (write_depth++ == 0) {
+			std::uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+			header->sequence.store(sequence + 1, std::memory_order_relaxed);
+			// The odd sequence has to be visible before any of the writes that follow
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	void SharedFlatValueMap<SparseHandle, Value>::end_write()
+	{
+		assert(write_depth > 0);
+		if (--write_depth == 0) {
+			std::uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+			header->sequence.store(sequence + 1, std::memory_order_release);
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMap<SparseHandle, Value>::value_data() const -> Value*
+	{
+		return header->values.get();
+	}
+
+
+	template<typename SparseHandle, typename Value>
+	SharedFlatValueMapReader<SparseHandle, Value>::View::View(const Header* header)
+		: header(header)
+		, element_count(header->size.load(std::memory_order_relaxed))
+	{
+		// A size read during a change can be anything, never read past the arrays
+		if (element_count > header->capacity) {
+			element_count = header->capacity;
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::size_t SharedFlatValueMapReader<SparseHandle, Value>::View::size() const
+	{
+		return element_count;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMapReader<SparseHandle, Value>::View::empty() const
+	{
+		return element_count == 0;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMapReader<SparseHandle, Value>::View::data() const -> const Value*
+	{
+		return header->values.get();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMapReader<SparseHandle, Value>::View::begin() const -> const Value*
+	{
+		return data();
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMapReader<SparseHandle, Value>::View::end() const -> const Value*
+	{
+		return data() + element_count;
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMapReader<SparseHandle, Value>::View::handle_at(std::size_t index) const -> HandleType
+	{
+		assert(index < element_count);
+		return HandleType{ header->handle_ids[index] };
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMapReader<SparseHandle, Value>::View::find(HandleType handle) const -> const Value*
+	{
+		if (handle.id == 0) {
+			return nullptr;
+		}
+
+		// Probe the index by hand: the slots can change during the probe, so the probe length is bounded and the result is checked against the handle array
+		const IndexSlot* slots = header->index_slots.get();
+		std::size_t slot_mask = static_cast<std::size_t>(header->index_slot_count) - 1;
+		std::size_t slot = OpenAddressingIndex::home_slot(handle.id, slot_mask);
+		for (std::size_t probe = 0; probe <= slot_mask; ++probe, slot = (slot + 1) & slot_mask) {
+			IndexSlot entry = slots[slot];
+			if (entry.id == 0) {
+				return nullptr;
+			}
+			if (entry.id == handle.id) {
+				if (entry.index < element_count && header->handle_ids[entry.index] == handle.id) {
+					return data() + entry.index;
+				}
+				return nullptr;
+			}
+		}
+		return nullptr;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMapReader<SparseHandle, Value>::View::contains(HandleType handle) const
+	{
+		return find(handle) != nullptr;
+	}
+
+	template<typename SparseHandle, typename Value>
+	SharedFlatValueMapReader<SparseHandle, Value>::SharedFlatValueMapReader(const char* name)
+	{
+		segment = open_shared_memory(name, false);
+		if (!segment.is_open() || segment.size() < sizeof(Header)) {
+			segment.reset();
+			return;
+		}
+
+		const auto* mapped_header = static_cast<const Header*>(segment.data());
+		if (mapped_header->magic.load(std::memory_order_acquire) != Header::expected_magic
+			|| mapped_header->layout_version != Header::expected_layout_version
+			|| mapped_header->value_size != sizeof(Value)
+			|| mapped_header->value_type_tag != detail::shared_value_type_tag<Value>()
+			|| mapped_header->capacity == 0 || mapped_header->capacity == UINT32_MAX
+			|| mapped_header->index_slot_count != OpenAddressingIndex::slot_count_for(mapped_header->capacity)
+			|| detail::shared_segment_layout<Value>(mapped_header->capacity).total_size > segment.size())
+		{
+			segment.reset();
+			return;
+		}
+		header = mapped_header;
+	}
+
+	template<typename SparseHandle, typename Value>
+	SharedFlatValueMapReader<SparseHandle, Value>::SharedFlatValueMapReader(SharedFlatValueMapReader&& other) noexcept
+		: segment(std::move(other.segment))
+		, header(std::exchange(other.header, nullptr))
+	{
+	}
+
+	template<typename SparseHandle, typename Value>
+	auto SharedFlatValueMapReader<SparseHandle, Value>::operator=(SharedFlatValueMapReader&& other) noexcept -> SharedFlatValueMapReader&
+	{
+		if (this != &other) {
+			segment = std::move(other.segment);
+			header = std::exchange(other.header, nullptr);
+		}
+		return *this;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMapReader<SparseHandle, Value>::is_open() const
+	{
+		return header != nullptr;
+	}
+
+	template<typename SparseHandle, typename Value>
+	std::uint64_t SharedFlatValueMapReader<SparseHandle, Value>::version() const
+	{
+		assert(is_open());
+		return header->sequence.load(std::memory_order_acquire);
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	void SharedFlatValueMapReader<SparseHandle, Value>::read(Func&& f) const
+	{
+		while (!try_read(f)) {
+			std::this_thread::yield();
+		}
+	}
+
+	template<typename SparseHandle, typename Value>
+	template<typename Func>
+	bool SharedFlatValueMapReader<SparseHandle, Value>::try_read(Func&& f) const
+	{
+		assert(is_open());
+		std::uint64_t sequence_before = header->sequence.load(std::memory_order_acquire);
+		if (sequence_before & 1) {
+			return false;
+		}
+
+		View view{ header };
+		f(static_cast<const View&>(view));
+
+		// The reads in `f` have to be done before the sequence is read again
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return header->sequence.load(std::memory_order_relaxed) == sequence_before;
+	}
+
+	template<typename SparseHandle, typename Value>
+	bool SharedFlatValueMapReader<SparseHandle, Value>::get(HandleType handle, Value& out) const
+	{
+		bool found = false;
+		read([&](const View& view) {
+			const Value* value = view.find(handle);
+			found = value != nullptr;
+			if (found) {
+				out = *value;
+			}
+		});
+		return found;
+	}
+}
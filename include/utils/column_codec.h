@@ -0,0 +1,166 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace cof
+{
+	// Append `value` as a LEB128 varint: 7 bits per byte, small values take one byte
+	void varint_encode(std::uint32_t value, std::vector<unsigned char>& out);
+	// Write `value` as a varint at `out`, which needs room for max_varint_size bytes
+	// \returns the position after the varint
+	unsigned char* varint_encode(std::uint32_t value, unsigned char* out);
+	// The most bytes a 32 bit varint takes
+	constexpr std::size_t max_varint_size = 5;
+	// Decode a varint at `*in`, and move `*in` past it
+	// \returns false if the varint does not end before `end` or does not fit in 32 bits
+	bool varint_decode(const unsigned char** in, const unsigned char* end, std::uint32_t& value);
+
+	/** Append the compressed bytes of `count` elements of `element_size` bytes each.
+	 *
+	 * The elements are split in byte planes (all first bytes, then all second bytes, ...), every plane is delta encoded and then run length encoded.
+	 * Fields that change slowly between elements (counters, flags, small integers, the exponent bytes of floats) turn into long runs of zeros this way.
+	 * A plane that does not compress costs at most one extra byte per 128 bytes.
+	*/
+	void byte_plane_encode(const unsigned char* elements, std::size_t count, std::size_t element_size, std::vector<unsigned char>& out);
+	// Decode `count` elements of `element_size` bytes from `in` into `out`
+	// \returns false if `in` is not exactly the encoded form of `count` elements
+	bool byte_plane_decode(const unsigned char* in, std::size_t in_size, std::size_t count, std::size_t element_size, unsigned char* out);
+	// The most bytes byte_plane_encode() appends for `count` elements of `element_size` bytes
+	constexpr std::size_t byte_plane_max_size(std::size_t count, std::size_t element_size);
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline void varint_encode(std::uint32_t value, std::vector<unsigned char>& out)
+	{
+		unsigned char bytes[max_varint_size];
+		unsigned char* end = varint_encode(value, bytes);
+		out.insert(out.end(), bytes, end);
+	}
+
+	inline unsigned char* varint_encode(std::uint32_t value, unsigned char* out)
+	{
+		while (value >= 0x80) {
+			*out++ = static_cast<unsigned char>(value | 0x80);
+			value >>= 7;
+		}
+		*out++ = static_cast<unsigned char>(value);
+		return out;
+	}
+
+	inline bool varint_decode(const unsigned char** in, const unsigned char* end, std::uint32_t& value)
+	{
+		const unsigned char* position = *in;
+		std::uint32_t result = 0;
+		for (unsigned shift = 0; shift < 35; shift += 7) {
+			if (position == end) {
+				return false;
+			}
+			unsigned char byte = *position++;
+			if (shift == 28 && byte > 0x0F) {
+				return false;
+			}
+			result |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0) {
+				value = result;
+				*in = position;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Run length encoding of one delta encoded plane. A control byte below 128 is followed by (control + 1) literal bytes,
+	// a control byte of 128 or more is followed by one byte that repeats (control - 125) times.
+	inline void byte_plane_encode(const unsigned char* elements, std::size_t count, std::size_t element_size, std::vector<unsigned char>& out)
+	{
+		constexpr std::size_t min_run = 3;
+		constexpr std::size_t max_run = 130;
+		constexpr std::size_t max_literals = 128;
+
+		std::vector<unsigned char> plane(count);
+		for (std::size_t byte_index = 0; byte_index < element_size; ++byte_index) {
+			unsigned char previous = 0;
+			for (std::size_t i = 0; i < count; ++i) {
+				unsigned char byte = elements[i * element_size + byte_index];
+				plane[i] = static_cast<unsigned char>(byte - previous);
+				previous = byte;
+			}
+
+			std::size_t literal_start = 0;
+			std::size_t i = 0;
+			auto flush_literals = [&](std::size_t literal_end) {
+				while (literal_start < literal_end) {
+					std::size_t literal_count = literal_end - literal_start < max_literals ? literal_end - literal_start : max_literals;
+					out.push_back(static_cast<unsigned char>(literal_count - 1));
+					out.insert(out.end(), plane.begin() + literal_start, plane.begin() + literal_start + literal_count);
+					literal_start += literal_count;
+				}
+			};
+			while (i < count) {
+				std::size_t run_end = i + 1;
+				while (run_end < count && run_end - i < max_run && plane[run_end] == plane[i]) {
+					++run_end;
+				}
+				if (run_end - i >= min_run) {
+					flush_literals(i);
+					out.push_back(static_cast<unsigned char>(run_end - i + 125));
+					out.push_back(plane[i]);
+					literal_start = run_end;
+				}
+				i = run_end;
+			}
+			flush_literals(count);
+		}
+	}
+
+	inline bool byte_plane_decode(const unsigned char* in, std::size_t in_size, std::size_t count, std::size_t element_size, unsigned char* out)
+	{
+		const unsigned char* position = in;
+		const unsigned char* end = in + in_size;
+		for (std::size_t byte_index = 0; byte_index < element_size; ++byte_index) {
+			std::size_t i = 0;
+			unsigned char previous = 0;
+			while (i < count) {
+				if (position == end) {
+					return false;
+				}
+				unsigned char control = *position++;
+				if (control < 128) {
+					std::size_t literal_count = static_cast<std::size_t>(control) + 1;
+					if (literal_count > count - i || literal_count > static_cast<std::size_t>(end - position)) {
+						return false;
+					}
+					for (std::size_t j = 0; j < literal_count; ++j, ++i) {
+						previous = static_cast<unsigned char>(previous + *position++);
+						out[i * element_size + byte_index] = previous;
+					}
+				} else {
+					std::size_t run_length = static_cast<std::size_t>(control) - 125;
+					if (run_length > count - i || position == end) {
+						return false;
+					}
+					unsigned char delta = *position++;
+					for (std::size_t j = 0; j < run_length; ++j, ++i) {
+						previous = static_cast<unsigned char>(previous + delta);
+						out[i * element_size + byte_index] = previous;
+					}
+				}
+			}
+		}
+		return position == end;
+	}
+
+	constexpr std::size_t byte_plane_max_size(std::size_t count, std::size_t element_size)
+	{
+		// Runs never cost more bytes then they cover, so the worst case are literals: one control byte per 128, and one more for every literal sequence that a run cuts short
+		return element_size * (count + count / 128 + 1);
+	}
+}
@@ -0,0 +1,237 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+namespace cof
+{
+	using ComponentId = std::uint32_t;
+
+	/// The type erased operations of a component type, so a ComponentColumn can manage it's elements without knowing the type
+	struct ComponentInfo
+	{
+		ComponentId id;
+		std::size_t size;
+		std::size_t alignment;
+		// Move construct a element at `destination` from `source`, `source` stays a valid moved-from object
+		void(*move_construct)(void* destination, void* source);
+		void(*destroy)(void* element);
+	};
+
+	// Get the ComponentInfo of `T`, the id is unique per type in the program and assigned on the first call
+	template<typename T>
+	auto component_info()->const ComponentInfo&;
+
+	/** \brief A type erased contiguous array of one component type, one column of a archetype table.
+	 *
+	 * \class ComponentColumn
+	 *
+	 * Only supports what a archetype table needs: appending, and erasing with the swap erase idiom.
+	 * Components can not be over aligned (above alignof(std::max_align_t)).
+	*/
+	class ComponentColumn
+	{
+	public:
+		explicit ComponentColumn(const ComponentInfo& info);
+		~ComponentColumn();
+		ComponentColumn(const ComponentColumn&) = delete;
+		ComponentColumn& operator=(const ComponentColumn&) = delete;
+		ComponentColumn(ComponentColumn&& other) noexcept;
+		ComponentColumn& operator=(ComponentColumn&& other) noexcept;
+
+		// The type erased operations of the component type in this column
+		auto info() const->const ComponentInfo&;
+		// The amount of elements in this column
+		std::size_t size() const;
+		// Get the address of the element at `index`
+		void* at(std::size_t index);
+		// Get the const address of the element at `index`
+		const void* at(std::size_t index) const;
+		// Get the elements as a array of `T`, `T` has to be the component type of this column
+		template<typename T>
+		T* data();
+
+		// Append a element move constructed from `source`
+		void push_back_moved(void* source);
+		// Append a element constructed from `args`, `T` has to be the component type of this column
+		template<typename T, typename... Args>
+		T& emplace_back(Args&&... args);
+		// Destroy the element at `index` and move the last element into it's place
+		void swap_erase(std::size_t index);
+		// Destroy all elements, the memory is kept
+		void clear();
+
+	private:
+		void grow_for_push_back();
+
+		const ComponentInfo* component;
+		unsigned char* buffer = nullptr;
+		std::size_t element_count = 0;
+		std::size_t element_capacity = 0;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	namespace detail
+	{
+		inline ComponentId next_component_id()
+		{
+			static std::atomic<ComponentId> component_id_counter{ 0 };
+			return component_id_counter.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		template<typename T>
+		void move_construct_component(void* destination, void* source)
+		{
+			::new (destination) T(std::move(*static_cast<T*>(source)));
+		}
+
+		template<typename T>
+		void destroy_component(void* element)
+		{
+			static_cast<T*>(element)->~T();
+		}
+	}
+
+	template<typename T>
+	auto component_info() -> const ComponentInfo&
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Over aligned components are not supported");
+		static_assert(std::is_move_constructible<T>::value, "Components have to be move constructible");
+
+		static const ComponentInfo info{ detail::next_component_id(), sizeof(T), alignof(T), &detail::move_construct_component<T>, &detail::destroy_component<T> };
+		return info;
+	}
+
+	inline ComponentColumn::ComponentColumn(const ComponentInfo& info)
+		: component(&info)
+	{
+	}
+
+	inline ComponentColumn::~ComponentColumn()
+	{
+		clear();
+		::operator delete(buffer);
+	}
+
+	inline ComponentColumn::ComponentColumn(ComponentColumn&& other) noexcept
+		: component(other.component)
+		, buffer(other.buffer)
+		, element_count(other.element_count)
+		, element_capacity(other.element_capacity)
+	{
+		other.buffer = nullptr;
+		other.element_count = 0;
+		other.element_capacity = 0;
+	}
+
+	inline ComponentColumn& ComponentColumn::operator=(ComponentColumn&& other) noexcept
+	{
+		if (this != &other) {
+			clear();
+			::operator delete(buffer);
+			component = other.component;
+			buffer = other.buffer;
+			element_count = other.element_count;
+			element_capacity = other.element_capacity;
+			other.buffer = nullptr;
+			other.element_count = 0;
+			other.element_capacity = 0;
+		}
+		return *this;
+	}
+
+	inline auto ComponentColumn::info() const -> const ComponentInfo&
+	{
+		return *component;
+	}
+
+	inline std::size_t ComponentColumn::size() const
+	{
+		return element_count;
+	}
+
+	inline void* ComponentColumn::at(std::size_t index)
+	{
+		assert(index < element_count);
+		return buffer + index * component->size;
+	}
+
+	inline const void* ComponentColumn::at(std::size_t index) const
+	{
+		assert(index < element_count);
+		return buffer + index * component->size;
+	}
+
+	template<typename T>
+	T* ComponentColumn::data()
+	{
+		assert(component == &component_info<T>());
+		return reinterpret_cast<T*>(buffer);
+	}
+
+	inline void ComponentColumn::push_back_moved(void* source)
+	{
+		grow_for_push_back();
+		component->move_construct(buffer + element_count * component->size, source);
+		++element_count;
+	}
+
+	template<typename T, typename ... Args>
+	T& ComponentColumn::emplace_back(Args&&... args)
+	{
+		assert(component == &component_info<T>());
+		grow_for_push_back();
+		T* element = ::new (buffer + element_count * component->size) T(std::forward<Args>(args)...);
+		++element_count;
+		return *element;
+	}
+
+	inline void ComponentColumn::swap_erase(std::size_t index)
+	{
+		assert(index < element_count);
+		std::size_t last_index = element_count - 1;
+		component->destroy(at(index));
+		if (index != last_index) {
+			component->move_construct(at(index), at(last_index));
+			component->destroy(at(last_index));
+		}
+		--element_count;
+	}
+
+	inline void ComponentColumn::clear()
+	{
+		for (std::size_t i = 0; i < element_count; ++i) {
+			component->destroy(buffer + i * component->size);
+		}
+		element_count = 0;
+	}
+
+	inline void ComponentColumn::grow_for_push_back()
+	{
+		if (element_count < element_capacity) {
+			return;
+		}
+
+		std::size_t new_capacity = element_capacity == 0 ? 8 : element_capacity * 2;
+		unsigned char* new_buffer = static_cast<unsigned char*>(::operator new(new_capacity * component->size));
+		for (std::size_t i = 0; i < element_count; ++i) {
+			component->move_construct(new_buffer + i * component->size, buffer + i * component->size);
+			component->destroy(buffer + i * component->size);
+		}
+		::operator delete(buffer);
+		buffer = new_buffer;
+		element_capacity = new_capacity;
+	}
+}
@@ -71,4 +71,25 @@ namespace cof
 		auto iterator_and_success = map.emplace(std::forward<Args>(args)...);
 		return iterator_and_success.first;
 	}
+
+	namespace detail
+	{
+		// Has the parallel_for() of WorkStealingPool, but runs the chunks one after the other on the calling thread
+		struct SequentialFor
+		{
+			template<typename Func>
+			void parallel_for(std::size_t count, std::size_t grain, Func&& f) const
+			{
+				// A grain of 0 is treated as 1, like WorkStealingPool does
+				if (grain == 0) {
+					grain = 1;
+				}
+				for (std::size_t begin = 0; begin < count;) {
+					std::size_t end = count - begin > grain ? begin + grain : count;
+					f(begin, end);
+					begin = end;
+				}
+			}
+		};
 	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+
+namespace cof
+{
+	/// The allocations made through the CountingAllocators of one Tag
+	struct AllocationCounts
+	{
+		std::uint64_t allocations = 0;
+		std::uint64_t deallocations = 0;
+		std::uint64_t allocated_bytes = 0;
+		std::uint64_t deallocated_bytes = 0;
+
+		// The counts between two snapshots
+		friend AllocationCounts operator-(const AllocationCounts& lhs, const AllocationCounts& rhs)
+		{
+			return AllocationCounts{ lhs.allocations - rhs.allocations, lhs.deallocations - rhs.deallocations,
+				lhs.allocated_bytes - rhs.allocated_bytes, lhs.deallocated_bytes - rhs.deallocated_bytes };
+		}
+	};
+
+	// The counts of all CountingAllocators with this Tag, copy it to take a snapshot
+	template<typename Tag>
+	AllocationCounts& allocation_counts();
+
+	/** \brief Allocator that counts every allocation and it's size, to check that a code path does not allocate.
+	 *
+	 * \class CountingAllocator
+	 *
+	 * Allocates with std::allocator and adds to allocation_counts<Tag>(). Give every container configuration that is measured it's own Tag.
+	 * Rebinding keeps the Tag, so the sparse_to_dense nodes and the handle array of a FlatValueMap are counted together with the elements.
+	 * The counts are not atomic, only allocate from one thread at a time.
+	 * \code cof::FlatValueMap<Handle, Value, cof::CountingAllocator<Value, Tag>> \endcode
+	*/
+	template<typename T, typename Tag = void>
+	class CountingAllocator
+	{
+		using StdAllocator = std::allocator<T>;
+
+	public:
+		using value_type = T;
+#if _MSVC_LANG < 201703L
+		using pointer = T*;
+		using const_pointer = const T*;
+		using reference = T&;
+		using const_reference = const T&;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_move_assignment = std::true_type;
+		using is_always_equal = std::true_type;
+#endif
+		template<typename U>
+		struct rebind { typedef CountingAllocator<U, Tag> other; };
+
+		CountingAllocator() = default;
+		template<typename U>
+		CountingAllocator(const CountingAllocator<U, Tag>&) noexcept
+		{
+		}
+
+		T* allocate(std::size_t n);
+		void deallocate(T* p, std::size_t n);
+
+		friend bool operator==(const CountingAllocator&, const CountingAllocator&) { return true; }
+		friend bool operator!=(const CountingAllocator&, const CountingAllocator&) { return false; }
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename Tag>
+	AllocationCounts& allocation_counts()
+	{
+		static AllocationCounts counts{};
+		return counts;
+	}
+
+	template<typename T, typename Tag>
+	T* CountingAllocator<T, Tag>::allocate(std::size_t n)
+	{
+		T* p = StdAllocator{}.allocate(n);
+		AllocationCounts& counts = allocation_counts<Tag>();
+		++counts.allocations;
+		counts.allocated_bytes += n * sizeof(T);
+		return p;
+	}
+
+	template<typename T, typename Tag>
+	void CountingAllocator<T, Tag>::deallocate(T* p, std::size_t n)
+	{
+		AllocationCounts& counts = allocation_counts<Tag>();
+		++counts.deallocations;
+		counts.deallocated_bytes += n * sizeof(T);
+		StdAllocator{}.deallocate(p, n);
+	}
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+#include "utils/cpu_features.h"
+
+
+// The address of a kernel variant for a KernelVariants table, or nullptr on targets that do not compile that variant
+#ifndef COF_SIMD_VARIANT
+#if COF_SIMD_X86
+#define COF_SIMD_VARIANT(function) &function
+#else
+#define COF_SIMD_VARIANT(function) nullptr
+#endif
+#endif
+
+
+/* Runtime dispatch for the vectorized kernels.
+ * The kernels are compiled for every SimdLevel with per function target attributes, so one build runs on every x86 machine.
+ * On the first call the CPU is queried with cpuid and every kernel resolves to the best variant that is at most the active level.
+ * The active level can be lowered for benchmarking, either with force_simd_level() or with the COF_SIMD_LEVEL environment variable ("scalar", "sse4.2", "avx2" or "avx512").
+ */
+namespace cof
+{
+	// The highest level the running CPU supports, cpuid is only queried once.
+	SimdLevel supported_simd_level();
+	// The level the kernels currently dispatch to.
+	SimdLevel active_simd_level();
+	// Make the kernels dispatch to `level`. A level the CPU does not support is lowered to supported_simd_level().
+	// \returns the level that is active now
+	SimdLevel force_simd_level(SimdLevel level);
+	// Undo force_simd_level(), the kernels dispatch to the best supported level again (or the level from COF_SIMD_LEVEL)
+	void reset_simd_level();
+
+	/// \brief The variants of a kernel for every SimdLevel. A variant can be nullptr if there is no specialized version for that level, scalar is always required.
+	template<typename Function>
+	struct KernelVariants
+	{
+		Function scalar;
+		Function sse42;
+		Function avx2;
+		Function avx512;
+
+		// \returns the best variant that does not go above `level`
+		Function resolve(SimdLevel level) const;
+		// \returns the best variant for the active_simd_level()
+		Function resolve() const;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	namespace detail
+	{
+		inline SimdLevel clamp_simd_level(SimdLevel level)
+		{
+			return static_cast<int>(level) < static_cast<int>(supported_simd_level()) ? level : supported_simd_level();
+		}
+
+		// The level from the COF_SIMD_LEVEL environment variable, or the supported level if it is not set.
+		inline SimdLevel default_simd_level()
+		{
+			std::string name;
+#if defined(_MSC_VER)
+			char* buffer = nullptr;
+			std::size_t length = 0;
+			if (_dupenv_s(&buffer, &length, "COF_SIMD_LEVEL") == 0 && buffer != nullptr) {
+				name = buffer;
+				std::free(buffer);
+			}
+#else
+			if (const char* value = std::getenv("COF_SIMD_LEVEL")) {
+				name = value;
+			}
+#endif
+			SimdLevel level = supported_simd_level();
+			if (!name.empty() && parse_simd_level(name.c_str(), level)) {
+				return clamp_simd_level(level);
+			}
+			return supported_simd_level();
+		}
+
+		inline std::atomic<int>& active_simd_level_storage()
+		{
+			static std::atomic<int> active_level{ static_cast<int>(default_simd_level()) };
+			return active_level;
+		}
+	}
+
+	inline SimdLevel supported_simd_level()
+	{
+		static const SimdLevel supported_level = detect_simd_level();
+		return supported_level;
+	}
+
+	inline SimdLevel active_simd_level()
+	{
+		return static_cast<SimdLevel>(detail::active_simd_level_storage().load(std::memory_order_relaxed));
+	}
+
+	inline SimdLevel force_simd_level(SimdLevel level)
+	{
+		SimdLevel clamped_level = detail::clamp_simd_level(level);
+		detail::active_simd_level_storage().store(static_cast<int>(clamped_level), std::memory_order_relaxed);
+		return clamped_level;
+	}
+
+	inline void reset_simd_level()
+	{
+		detail::active_simd_level_storage().store(static_cast<int>(detail::default_simd_level()), std::memory_order_relaxed);
+	}
+
+	template<typename Function>
+	Function KernelVariants<Function>::resolve(SimdLevel level) const
+	{
+		assert(scalar != nullptr);
+		switch (level) {
+		case SimdLevel::AVX512:
+			if (avx512 != nullptr) { return avx512; }
+			// fallthrough
+		case SimdLevel::AVX2:
+			if (avx2 != nullptr) { return avx2; }
+			// fallthrough
+		case SimdLevel::SSE42:
+			if (sse42 != nullptr) { return sse42; }
+			// fallthrough
+		case SimdLevel::Scalar:
+			break;
+		}
+		return scalar;
+	}
+
+	template<typename Function>
+	Function KernelVariants<Function>::resolve() const
+	{
+		return resolve(active_simd_level());
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include "utils/defines.h"
+
+#if COF_SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+namespace cof
+{
+	/// The instruction set levels the vectorized kernels are compiled for, every level includes the ones before it.
+	enum class SimdLevel
+	{
+		Scalar = 0,
+		SSE42 = 1,
+		AVX2 = 2,
+		AVX512 = 3,
+	};
+
+	// Query the running CPU (and OS) for the highest SimdLevel it supports
+	SimdLevel detect_simd_level();
+	// \returns a readable name for the level, these are also the names accepted by parse_simd_level()
+	const char* simd_level_name(SimdLevel level);
+	// Parse "scalar", "sse4.2", "avx2" or "avx512" into `level`. \returns false if the name is unknown
+	bool parse_simd_level(const char* name, SimdLevel& level);
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	namespace detail
+	{
+#if COF_SIMD_X86
+		// Execute the cpuid instruction for the leaf and subleaf. registers is filled in the order eax, ebx, ecx, edx
+		inline void cpuid(unsigned leaf, unsigned subleaf, unsigned registers[4])
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+			for (int i = 0; i < 4; ++i) {
+				registers[i] = static_cast<unsigned>(info[i]);
+			}
+#else
+			__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+		}
+
+		// Read the extended control register, which tells which register states the OS saves on a context switch
+		inline unsigned long long xgetbv(unsigned index)
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(index);
+#else
+			unsigned eax, edx;
+			__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+			return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+		}
+#endif // END: COF_SIMD_X86
+
+		inline bool equals_ignore_case(const char* lhs, const char* rhs)
+		{
+			for (; *lhs != '\0' && *rhs != '\0'; ++lhs, ++rhs) {
+				char l = (*lhs >= 'A' && *lhs <= 'Z') ? static_cast<char>(*lhs - 'A' + 'a') : *lhs;
+				char r = (*rhs >= 'A' && *rhs <= 'Z') ? static_cast<char>(*rhs - 'A' + 'a') : *rhs;
+				if (l != r) {
+					return false;
+				}
+			}
+			return *lhs == *rhs;
+		}
+	}
+
+	inline SimdLevel detect_simd_level()
+	{
+#if COF_SIMD_X86
+		unsigned registers[4];
+		detail::cpuid(0, 0, registers);
+		const unsigned max_leaf = registers[0];
+		if (max_leaf < 1) {
+			return SimdLevel::Scalar;
+		}
+
+		detail::cpuid(1, 0, registers);
+		const unsigned leaf1_ecx = registers[2];
+		if ((leaf1_ecx & (1u << 20)) == 0) {
+			return SimdLevel::Scalar;
+		}
+
+		const bool osxsave = (leaf1_ecx & (1u << 27)) != 0;
+		const bool avx = (leaf1_ecx & (1u << 28)) != 0;
+		// The OS has to save the xmm and ymm registers, otherwise AVX instructions fault
+		const unsigned long long xcr0 = osxsave ? detail::xgetbv(0) : 0;
+		if (!avx || (xcr0 & 0x6) != 0x6 || max_leaf < 7) {
+			return SimdLevel::SSE42;
+		}
+
+		detail::cpuid(7, 0, registers);
+		const unsigned leaf7_ebx = registers[1];
+		if ((leaf7_ebx & (1u << 5)) == 0) {
+			return SimdLevel::SSE42;
+		}
+
+		// AVX-512F, and the OS has to save the opmask and zmm registers as well
+		if ((leaf7_ebx & (1u << 16)) == 0 || (xcr0 & 0xE6) != 0xE6) {
+			return SimdLevel::AVX2;
+		}
+		return SimdLevel::AVX512;
+#else
+		return SimdLevel::Scalar;
+#endif // END: COF_SIMD_X86
+	}
+
+	inline const char* simd_level_name(SimdLevel level)
+	{
+		switch (level) {
+		case SimdLevel::Scalar: return "scalar";
+		case SimdLevel::SSE42: return "sse4.2";
+		case SimdLevel::AVX2: return "avx2";
+		case SimdLevel::AVX512: return "avx512";
+		}
+		return "unknown";
+	}
+
+	inline bool parse_simd_level(const char* name, SimdLevel& level)
+	{
+		const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 };
+		for (SimdLevel candidate : levels) {
+			if (detail::equals_ignore_case(name, simd_level_name(candidate))) {
+				level = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+}
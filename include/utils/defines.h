@@ -8,3 +8,45 @@
 #define NO_DISCARD // If no compliance is found, we ignore this keyword
 #endif // END: __cplusplus >= 201703L
 #endif // END: ifndef NO_DISCARD
+
+// COF_SIMD_X86: Defined to 1 when compiling for a x86 or x64 target, where the SSE/AVX kernels are available
+#ifndef COF_SIMD_X86
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COF_SIMD_X86 1
+#else // ELSE: x86 target
+#define COF_SIMD_X86 0
+#endif // END: x86 target
+#endif // END: ifndef COF_SIMD_X86
+
+// COF_TARGET_SSE42, COF_TARGET_AVX2, COF_TARGET_AVX512: Allows a single function to use these instructions without compiling the whole program for them
+// The caller is responsible for checking that the CPU supports them, see utils/cpu_dispatch.h
+#ifndef COF_TARGET_AVX2
+#if defined(__GNUC__) || defined(__clang__)
+#define COF_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define COF_TARGET_AVX2 __attribute__((target("avx2")))
+#define COF_TARGET_AVX512 __attribute__((target("avx512f")))
+#else // ELSE: GCC or Clang
+// MSVC allows intrinsics for any instruction set without a target attribute
+#define COF_TARGET_SSE42
+#define COF_TARGET_AVX2
+#define COF_TARGET_AVX512
+#endif // END: GCC or Clang
+#endif // END: ifndef COF_TARGET_AVX2
+
+// COF_POSIX_MAPPING: Defined to 1 when the POSIX shared memory and mmap functions are available (utils/memory_mapping.h)
+#ifndef COF_POSIX_MAPPING
+#if defined(__unix__) || defined(__APPLE__)
+#define COF_POSIX_MAPPING 1
+#else // ELSE: POSIX target
+#define COF_POSIX_MAPPING 0
+#endif // END: POSIX target
+#endif // END: ifndef COF_POSIX_MAPPING
+
+// COF_LINUX_NUMA: Defined to 1 when the Linux scheduler affinity and mbind() system calls are available (utils/numa_topology.h)
+#ifndef COF_LINUX_NUMA
+#if defined(__linux__)
+#define COF_LINUX_NUMA 1
+#else // ELSE: Linux target
+#define COF_LINUX_NUMA 0
+#endif // END: Linux target
+#endif // END: ifndef COF_LINUX_NUMA
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#if defined(_WIN32)
+#include <io.h>
+
+// Declared here instead of including <windows.h>, which would give every includer the Win32 macros. Matches the declaration in <winbase.h>
+extern "C" __declspec(dllimport) int __stdcall MoveFileExA(const char* existing_file_name, const char* new_file_name, unsigned long flags);
+#else // ELSE: _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif // END: _WIN32
+
+
+namespace cof
+{
+	// Open a file with std::fopen modes
+	// \returns nullptr if the file could not be opened
+	auto open_file(const std::string& path, const char* mode)->std::FILE*;
+	// Flush the buffers of `file` and wait until the operating system wrote it to the disk
+	bool sync_file(std::FILE* file);
+	// Rename `from` to `to`, replacing `to` in one step when it exists, and wait until the rename is on the disk. A crash or power loss leaves either the old or the new `to`
+	bool replace_file(const std::string& from, const std::string& to);
+
+	/// A FNV-1a checksum, to find torn writes and corrupted records in files
+	class Checksum
+	{
+	public:
+		void update(const void* data, std::size_t size);
+		std::uint32_t value() const;
+
+	private:
+		std::uint32_t hash = 2166136261u;
+	};
+
+	// Read exactly `size` bytes
+	// \returns false if the file ended before that
+	bool read_bytes(std::FILE* file, void* out, std::size_t size);
+	// Write `size` bytes
+	bool write_bytes(std::FILE* file, const void* data, std::size_t size);
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline auto open_file(const std::string& path, const char* mode) -> std::FILE*
+	{
+#if defined(_MSC_VER)
+		std::FILE* file = nullptr;
+		return fopen_s(&file, path.c_str(), mode) == 0 ? file : nullptr;
+#else // ELSE: _MSC_VER
+		return std::fopen(path.c_str(), mode);
+#endif // END: _MSC_VER
+	}
+
+	inline bool sync_file(std::FILE* file)
+	{
+		if (std::fflush(file) != 0) {
+			return false;
+		}
+#if defined(_WIN32)
+		return _commit(_fileno(file)) == 0;
+#else // ELSE: _WIN32
+		return fsync(fileno(file)) == 0;
+#endif // END: _WIN32
+	}
+
+	inline bool replace_file(const std::string& from, const std::string& to)
+	{
+#if defined(_WIN32)
+		// MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+		const unsigned long replace_existing_write_through = 0x1 | 0x8;
+		return MoveFileExA(from.c_str(), to.c_str(), replace_existing_write_through) != 0;
+#else // ELSE: _WIN32
+		// rename() replaces `to` atomically on POSIX
+		if (std::rename(from.c_str(), to.c_str()) != 0) {
+			return false;
+		}
+		// The rename is a change to the directory, it is only durable after the directory itself is synced
+		std::string::size_type separator = to.find_last_of('/');
+		std::string directory = separator == std::string::npos ? std::string{ "." } : separator == 0 ? std::string{ "/" } : to.substr(0, separator);
+		int directory_descriptor = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+		if (directory_descriptor == -1) {
+			return false;
+		}
+		bool synced = fsync(directory_descriptor) == 0;
+		::close(directory_descriptor);
+		return synced;
+#endif // END: _WIN32
+	}
+
+	inline void Checksum::update(const void* data, std::size_t size)
+	{
+		const auto* bytes = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; ++i) {
+			hash = (hash ^ bytes[i]) * 16777619u;
+		}
+	}
+
+	inline std::uint32_t Checksum::value() const
+	{
+		return hash;
+	}
+
+	inline bool read_bytes(std::FILE* file, void* out, std::size_t size)
+	{
+		return size == 0 || std::fread(out, 1, size, file) == size;
+	}
+
+	inline bool write_bytes(std::FILE* file, const void* data, std::size_t size)
+	{
+		return size == 0 || std::fwrite(data, 1, size, file) == size;
+	}
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "defines.h"
+
+#if COF_POSIX_MAPPING
+#include <sys/mman.h>
+#endif // END: COF_POSIX_MAPPING
+
+
+namespace cof
+{
+	namespace detail
+	{
+		constexpr std::size_t huge_page_size = std::size_t{ 2 } * 1024 * 1024;
+
+		// Map `size` bytes (a multiple of huge_page_size) of anonymous memory at a 2 MiB aligned address, backed by huge pages if possible
+		// \returns nullptr if nothing could be mapped
+		void* map_huge_pages(std::size_t size);
+		void unmap_huge_pages(void* address, std::size_t size);
+	}
+
+	/** \brief Allocator that backs large allocations with 2 MiB huge pages, for dense arrays that are read at random indices.
+	 *
+	 * \class HugePageAllocator
+	 *
+	 * With 4 KiB pages a random lookup into a array of hundreds of MB misses the TLB almost every time, with 2 MiB pages the TLB covers 512 times more memory.
+	 * Allocations of at least `Threshold` bytes are rounded up to a multiple of 2 MiB and mapped with mmap: first with MAP_HUGETLB,
+	 * and when no huge pages are reserved with madvise(MADV_HUGEPAGE) so the kernel uses transparent huge pages.
+	 * Smaller allocations, and every allocation on targets without COF_POSIX_MAPPING, use operator new.
+	 *
+	 * The allocator has no state, all instances are equal. Pass it as the Allocator of a FlatValueMap:
+	 * \code cof::FlatValueMap<Handle, Value, cof::HugePageAllocator<Value>> \endcode
+	*/
+	template<typename T, std::size_t Threshold = detail::huge_page_size>
+	class HugePageAllocator
+	{
+		using StdAllocator = std::allocator<T>;
+
+	public:
+		using value_type = T;
+#if _MSVC_LANG < 201703L
+		using pointer = T*;
+		using const_pointer = const T*;
+		using reference = T&;
+		using const_reference = const T&;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_move_assignment = std::true_type;
+		using is_always_equal = std::true_type;
+#endif
+		template<typename U>
+		struct rebind { typedef HugePageAllocator<U, Threshold> other; };
+
+		HugePageAllocator() = default;
+		template<typename U>
+		HugePageAllocator(const HugePageAllocator<U, Threshold>&) noexcept
+		{
+		}
+
+		T* allocate(std::size_t n);
+		void deallocate(T* p, std::size_t n);
+
+		// \returns if a allocation of `n` elements is mapped instead of allocated with operator new
+		static bool is_mapped(std::size_t n);
+
+		friend bool operator==(const HugePageAllocator&, const HugePageAllocator&) { return true; }
+		friend bool operator!=(const HugePageAllocator&, const HugePageAllocator&) { return false; }
+
+	private:
+		static std::size_t mapped_size(std::size_t n);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	namespace detail
+	{
+		inline void* map_huge_pages(std::size_t size)
+		{
+#if COF_POSIX_MAPPING
+#ifdef MAP_HUGETLB
+			void* reserved = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (reserved != MAP_FAILED) {
+				return reserved;
+			}
+#endif // END: MAP_HUGETLB
+
+			// The kernel can only use a huge page for a 2 MiB aligned range, so map one huge page more and cut off the unaligned ends
+			std::size_t padded_size = size + huge_page_size;
+			void* padded = mmap(nullptr, padded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (padded == MAP_FAILED) {
+				return nullptr;
+			}
+			std::uintptr_t start = reinterpret_cast<std::uintptr_t>(padded);
+			std::uintptr_t aligned = (start + huge_page_size - 1) & ~(static_cast<std::uintptr_t>(huge_page_size) - 1);
+			std::size_t head = static_cast<std::size_t>(aligned - start);
+			std::size_t tail = padded_size - head - size;
+			if (head != 0) {
+				munmap(padded, head);
+			}
+			if (tail != 0) {
+				munmap(reinterpret_cast<void*>(aligned + size), tail);
+			}
+#ifdef MADV_HUGEPAGE
+			madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif // END: MADV_HUGEPAGE
+			return reinterpret_cast<void*>(aligned);
+#else // ELSE: COF_POSIX_MAPPING
+			(void)size;
+			return nullptr;
+#endif // END: COF_POSIX_MAPPING
+		}
+
+		inline void unmap_huge_pages(void* address, std::size_t size)
+		{
+#if COF_POSIX_MAPPING
+			munmap(address, size);
+#else // ELSE: COF_POSIX_MAPPING
+			(void)address;
+			(void)size;
+#endif // END: COF_POSIX_MAPPING
+		}
+	}
+
+	template<typename T, std::size_t Threshold>
+	T* HugePageAllocator<T, Threshold>::allocate(std::size_t n)
+	{
+		if (!is_mapped(n)) {
+			return StdAllocator{}.allocate(n);
+		}
+		void* address = detail::map_huge_pages(mapped_size(n));
+		if (address == nullptr) {
+			throw std::bad_alloc{};
+		}
+		return static_cast<T*>(address);
+	}
+
+	template<typename T, std::size_t Threshold>
+	void HugePageAllocator<T, Threshold>::deallocate(T* p, std::size_t n)
+	{
+		if (!is_mapped(n)) {
+			StdAllocator{}.deallocate(p, n);
+			return;
+		}
+		detail::unmap_huge_pages(p, mapped_size(n));
+	}
+
+	template<typename T, std::size_t Threshold>
+	bool HugePageAllocator<T, Threshold>::is_mapped(std::size_t n)
+	{
+		return COF_POSIX_MAPPING && n * sizeof(T) >= Threshold;
+	}
+
+	template<typename T, std::size_t Threshold>
+	std::size_t HugePageAllocator<T, Threshold>::mapped_size(std::size_t n)
+	{
+		std::size_t size = n * sizeof(T);
+		return (size + detail::huge_page_size - 1) / detail::huge_page_size * detail::huge_page_size;
+	}
+}
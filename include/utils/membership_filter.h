@@ -0,0 +1,172 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace cof
+{
+	/** \brief A blocked counting bloom filter, it answers "definitely not in the set" or "maybe in the set" for hashed keys.
+	 *
+	 * \class CountingBloomFilter
+	 *
+	 * Every key maps to a single 64 byte block (one cache line) of 128 4-bit counters, and increments 4 counters in that block.
+	 * So a lookup costs one cache line probe, and because the bits are counters instead of bits, keys can be erased again.
+	 * A counter that reaches 15 stays at 15, which can only cause more false positives, never false negatives.
+	 * With the block count picked by the constructor the false positive rate stays around 1-2% as long as the element count stays below capacity().
+	 * A default constructed filter is disabled and has no memory.
+	*/
+	class CountingBloomFilter
+	{
+	public:
+		CountingBloomFilter() = default;
+		// Create a filter sized for `expected_elements` keys
+		explicit CountingBloomFilter(std::size_t expected_elements);
+
+		// \returns if this filter has any blocks, a disabled filter should not be queried
+		bool enabled() const;
+		// The amount of keys this filter was sized for
+		std::size_t capacity() const;
+
+		// Add a key by it's hash. Adding the same key twice has to be matched with two erase() calls.
+		void insert(std::size_t hash);
+		// Remove a key that was added with insert()
+		void erase(std::size_t hash);
+		// \returns false if the key was definitely never inserted, true if it might have been
+		bool may_contain(std::size_t hash) const;
+
+		// Reset all counters without freeing the memory
+		void clear();
+
+	private:
+		struct alignas(64) Block
+		{
+			std::uint64_t words[8];
+		};
+
+		// Every block holds 128 counters, sizing for 12 keys per block gives about 10 counters per key
+		static constexpr std::size_t keys_per_block = 12;
+		static constexpr unsigned counters_per_key = 4;
+		static constexpr std::uint64_t counter_max = 0xF;
+
+		std::vector<Block> blocks;
+		std::size_t element_capacity = 0;
+
+		// Mix the bits, std::hash of a integer is the identity function on most implementations
+		static std::uint64_t mix(std::size_t hash);
+		auto block_for(std::uint64_t mixed_hash) const->const Block&;
+		auto block_for(std::uint64_t mixed_hash)->Block&;
+		// The counter index (0..127) for one of the `counters_per_key` counters of a key
+		static unsigned counter_index(std::uint64_t mixed_hash, unsigned counter);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline CountingBloomFilter::CountingBloomFilter(std::size_t expected_elements)
+		: blocks((expected_elements + keys_per_block - 1) / keys_per_block + 1, Block{})
+		, element_capacity(expected_elements)
+	{
+	}
+
+	inline bool CountingBloomFilter::enabled() const
+	{
+		return !blocks.empty();
+	}
+
+	inline std::size_t CountingBloomFilter::capacity() const
+	{
+		return element_capacity;
+	}
+
+	inline void CountingBloomFilter::insert(std::size_t hash)
+	{
+		assert(enabled());
+		std::uint64_t mixed_hash = mix(hash);
+		Block& block = block_for(mixed_hash);
+		for (unsigned i = 0; i < counters_per_key; ++i) {
+			unsigned index = counter_index(mixed_hash, i);
+			std::uint64_t& word = block.words[index / 16];
+			unsigned shift = (index % 16) * 4;
+			if (((word >> shift) & counter_max) != counter_max) {
+				word += std::uint64_t{ 1 } << shift;
+			}
+		}
+	}
+
+	inline void CountingBloomFilter::erase(std::size_t hash)
+	{
+		assert(enabled());
+		std::uint64_t mixed_hash = mix(hash);
+		Block& block = block_for(mixed_hash);
+		for (unsigned i = 0; i < counters_per_key; ++i) {
+			unsigned index = counter_index(mixed_hash, i);
+			std::uint64_t& word = block.words[index / 16];
+			unsigned shift = (index % 16) * 4;
+			std::uint64_t counter = (word >> shift) & counter_max;
+			assert(counter != 0);
+			// A saturated counter lost track of how many keys use it, so it can never go down again
+			if (counter != 0 && counter != counter_max) {
+				word -= std::uint64_t{ 1 } << shift;
+			}
+		}
+	}
+
+	inline bool CountingBloomFilter::may_contain(std::size_t hash) const
+	{
+		assert(enabled());
+		std::uint64_t mixed_hash = mix(hash);
+		const Block& block = block_for(mixed_hash);
+		for (unsigned i = 0; i < counters_per_key; ++i) {
+			unsigned index = counter_index(mixed_hash, i);
+			if (((block.words[index / 16] >> ((index % 16) * 4)) & counter_max) == 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	inline void CountingBloomFilter::clear()
+	{
+		for (Block& block : blocks) {
+			block = Block{};
+		}
+	}
+
+	inline std::uint64_t CountingBloomFilter::mix(std::size_t hash)
+	{
+		// splitmix64 finalizer
+		std::uint64_t x = static_cast<std::uint64_t>(hash);
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	inline auto CountingBloomFilter::block_for(std::uint64_t mixed_hash) const -> const Block&
+	{
+		// Map the high 32 bits onto [0, block count) with a multiply instead of a modulo
+		std::uint64_t index = ((mixed_hash >> 32) * static_cast<std::uint64_t>(blocks.size())) >> 32;
+		return blocks[static_cast<std::size_t>(index)];
+	}
+
+	inline auto CountingBloomFilter::block_for(std::uint64_t mixed_hash) -> Block&
+	{
+		std::uint64_t index = ((mixed_hash >> 32) * static_cast<std::uint64_t>(blocks.size())) >> 32;
+		return blocks[static_cast<std::size_t>(index)];
+	}
+
+	inline unsigned CountingBloomFilter::counter_index(std::uint64_t mixed_hash, unsigned counter)
+	{
+		// The low 28 bits give 4 counter indices of 7 bits
+		return static_cast<unsigned>((mixed_hash >> (counter * 7)) & 0x7F);
+	}
+}
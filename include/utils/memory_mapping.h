@@ -0,0 +1,362 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+
+#include "defines.h"
+
+#if COF_POSIX_MAPPING
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // END: COF_POSIX_MAPPING
+
+
+namespace cof
+{
+	/** \brief Owns a range of memory mapped with mmap, and unmaps it when destroyed.
+	 *
+	 * \class MappedMemory
+	 *
+	 * A default constructed (or failed) mapping is empty, check is_open() after creating one.
+	 * On targets without COF_POSIX_MAPPING the functions below always return a empty mapping.
+	*/
+	class MappedMemory
+	{
+	public:
+		MappedMemory() = default;
+		MappedMemory(void* address, std::size_t size);
+		MappedMemory(const MappedMemory&) = delete;
+		MappedMemory(MappedMemory&& other) noexcept;
+		MappedMemory& operator=(const MappedMemory&) = delete;
+		MappedMemory& operator=(MappedMemory&& other) noexcept;
+		~MappedMemory();
+
+		// The start of the mapped range, nullptr if nothing is mapped
+		void* data() const;
+		// The size of the mapped range in bytes
+		std::size_t size() const;
+		// \returns if this owns a mapping
+		bool is_open() const;
+		// Unmap the range
+		void reset();
+
+	private:
+		void* address = nullptr;
+		std::size_t mapped_size = 0;
+	};
+
+	/// How a mapped range will be accessed, passed to madvise()
+	enum class AccessPattern
+	{
+		normal,
+		// Read ahead aggressively and drop pages soon after they were read, for scans
+		sequential,
+		// Do not read ahead, for lookups
+		random,
+	};
+
+	/** \brief A file mapped read and write with mmap, which can grow.
+	 *
+	 * \class MappedFile
+	 *
+	 * Changes to the mapping are written back to the file by the operating system, sync() waits until that is done.
+	 * resize() can move the mapping, pointers into data() are invalid after it.
+	*/
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		~MappedFile();
+
+		// Open or create the file at `path` and map all of it, a file smaller then `min_size` is made larger first
+		bool open(const char* path, std::size_t min_size);
+		// Make the file at least `new_size` bytes and map `new_size` bytes of it again, the file never shrinks
+		// When it fails the file and the old mapping are left as they were
+		bool resize(std::size_t new_size);
+		// Write the changed pages to the file and wait for it
+		bool sync();
+		// Tell the operating system how the range [offset, offset + size) will be accessed
+		void advise(std::size_t offset, std::size_t size, AccessPattern pattern);
+		// Unmap and close the file
+		void close();
+
+		void* data() const;
+		std::size_t size() const;
+		bool is_open() const;
+
+	private:
+		MappedMemory mapping{};
+		int file_descriptor = -1;
+	};
+
+	// Create the POSIX shared memory object `name` with `size` bytes and map it read and write. `name` has to start with a '/'
+	// A existing object with that name is unlinked first, processes that still map it keep the old object instead of seeing it truncated
+	auto create_shared_memory(const char* name, std::size_t size)->MappedMemory;
+	// Map the whole existing POSIX shared memory object `name`
+	auto open_shared_memory(const char* name, bool writable)->MappedMemory;
+	// Remove the name of a shared memory object, mappings that still exist stay valid
+	// \returns false if there was no object with this name
+	bool unlink_shared_memory(const char* name);
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline MappedMemory::MappedMemory(void* address, std::size_t size)
+		: address(address)
+		, mapped_size(size)
+	{
+	}
+
+	inline MappedMemory::MappedMemory(MappedMemory&& other) noexcept
+		: address(std::exchange(other.address, nullptr))
+		, mapped_size(std::exchange(other.mapped_size, 0))
+	{
+	}
+
+	inline MappedMemory& MappedMemory::operator=(MappedMemory&& other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			address = std::exchange(other.address, nullptr);
+			mapped_size = std::exchange(other.mapped_size, 0);
+		}
+		return *this;
+	}
+
+	inline MappedMemory::~MappedMemory()
+	{
+		reset();
+	}
+
+	inline void* MappedMemory::data() const
+	{
+		return address;
+	}
+
+	inline std::size_t MappedMemory::size() const
+	{
+		return mapped_size;
+	}
+
+	inline bool MappedMemory::is_open() const
+	{
+		return address != nullptr;
+	}
+
+	inline void MappedMemory::reset()
+	{
+#if COF_POSIX_MAPPING
+		if (address != nullptr) {
+			munmap(address, mapped_size);
+		}
+#endif // END: COF_POSIX_MAPPING
+		address = nullptr;
+		mapped_size = 0;
+	}
+
+	inline MappedFile::MappedFile(MappedFile&& other) noexcept
+		: mapping(std::move(other.mapping))
+		, file_descriptor(std::exchange(other.file_descriptor, -1))
+	{
+	}
+
+	inline MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other) {
+			close();
+			mapping = std::move(other.mapping);
+			file_descriptor = std::exchange(other.file_descriptor, -1);
+		}
+		return *this;
+	}
+
+	inline MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	inline bool MappedFile::open(const char* path, std::size_t min_size)
+	{
+		close();
+#if COF_POSIX_MAPPING
+		file_descriptor = ::open(path, O_RDWR | O_CREAT, 0644);
+		if (file_descriptor == -1) {
+			return false;
+		}
+		struct stat file_status;
+		if (fstat(file_descriptor, &file_status) != 0) {
+			close();
+			return false;
+		}
+		std::size_t file_size = static_cast<std::size_t>(file_status.st_size);
+		if (!resize(file_size < min_size ? min_size : file_size)) {
+			close();
+			return false;
+		}
+		return true;
+#else // ELSE: COF_POSIX_MAPPING
+		(void)path;
+		(void)min_size;
+		return false;
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	inline bool MappedFile::resize(std::size_t new_size)
+	{
+#if COF_POSIX_MAPPING
+		if (file_descriptor == -1 || new_size == 0) {
+			return false;
+		}
+		struct stat file_status;
+		if (fstat(file_descriptor, &file_status) != 0) {
+			return false;
+		}
+		// The file only grows here, and the old mapping stays until the new one exists. On a failure nothing changed
+		off_t old_file_size = file_status.st_size;
+		bool grown = static_cast<off_t>(new_size) > old_file_size;
+		if (grown && ftruncate(file_descriptor, static_cast<off_t>(new_size)) != 0) {
+			return false;
+		}
+		void* address = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+		if (address == MAP_FAILED) {
+			if (grown) {
+				(void)ftruncate(file_descriptor, old_file_size);
+			}
+			return false;
+		}
+		mapping = MappedMemory{ address, new_size };
+		return true;
+#else // ELSE: COF_POSIX_MAPPING
+		(void)new_size;
+		return false;
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	inline bool MappedFile::sync()
+	{
+#if COF_POSIX_MAPPING
+		return mapping.is_open() && msync(mapping.data(), mapping.size(), MS_SYNC) == 0;
+#else // ELSE: COF_POSIX_MAPPING
+		return false;
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	inline void MappedFile::advise(std::size_t offset, std::size_t size, AccessPattern pattern)
+	{
+#if COF_POSIX_MAPPING
+		if (!mapping.is_open() || offset >= mapping.size()) {
+			return;
+		}
+		// madvise needs a page aligned start
+		std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		std::size_t aligned_offset = offset / page_size * page_size;
+		std::size_t end = offset + size < mapping.size() ? offset + size : mapping.size();
+		int advice = pattern == AccessPattern::sequential ? MADV_SEQUENTIAL : (pattern == AccessPattern::random ? MADV_RANDOM : MADV_NORMAL);
+		madvise(static_cast<char*>(mapping.data()) + aligned_offset, end - aligned_offset, advice);
+#else // ELSE: COF_POSIX_MAPPING
+		(void)offset;
+		(void)size;
+		(void)pattern;
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	inline void MappedFile::close()
+	{
+		mapping.reset();
+#if COF_POSIX_MAPPING
+		if (file_descriptor != -1) {
+			::close(file_descriptor);
+		}
+#endif // END: COF_POSIX_MAPPING
+		file_descriptor = -1;
+	}
+
+	inline void* MappedFile::data() const
+	{
+		return mapping.data();
+	}
+
+	inline std::size_t MappedFile::size() const
+	{
+		return mapping.size();
+	}
+
+	inline bool MappedFile::is_open() const
+	{
+		return mapping.is_open();
+	}
+
+	inline auto create_shared_memory(const char* name, std::size_t size) -> MappedMemory
+	{
+#if COF_POSIX_MAPPING
+		// A new object, truncating the old one would zero (or cut off) the memory attached readers are using
+		shm_unlink(name);
+		int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd == -1) {
+			return MappedMemory{};
+		}
+		if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+			close(fd);
+			shm_unlink(name);
+			return MappedMemory{};
+		}
+		void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (address == MAP_FAILED) {
+			shm_unlink(name);
+			return MappedMemory{};
+		}
+		return MappedMemory{ address, size };
+#else // ELSE: COF_POSIX_MAPPING
+		(void)name;
+		(void)size;
+		return MappedMemory{};
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	inline auto open_shared_memory(const char* name, bool writable) -> MappedMemory
+	{
+#if COF_POSIX_MAPPING
+		int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+		if (fd == -1) {
+			return MappedMemory{};
+		}
+		struct stat file_status;
+		if (fstat(fd, &file_status) != 0 || file_status.st_size <= 0) {
+			close(fd);
+			return MappedMemory{};
+		}
+		std::size_t size = static_cast<std::size_t>(file_status.st_size);
+		void* address = mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (address == MAP_FAILED) {
+			return MappedMemory{};
+		}
+		return MappedMemory{ address, size };
+#else // ELSE: COF_POSIX_MAPPING
+		(void)name;
+		(void)writable;
+		return MappedMemory{};
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	inline bool unlink_shared_memory(const char* name)
+	{
+#if COF_POSIX_MAPPING
+		return shm_unlink(name) == 0;
+#else // ELSE: COF_POSIX_MAPPING
+		(void)name;
+		return false;
+#endif // END: COF_POSIX_MAPPING
+	}
+}
@@ -0,0 +1,347 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "defines.h"
+
+#if COF_POSIX_MAPPING
+#include <sys/mman.h>
+#endif // END: COF_POSIX_MAPPING
+#if COF_LINUX_NUMA
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // END: COF_LINUX_NUMA
+
+
+namespace cof
+{
+	/** \brief The NUMA nodes of the machine and the CPUs that belong to them.
+	 *
+	 * \class NumaTopology
+	 *
+	 * detect() reads /sys/devices/system/node on Linux. Everywhere else, and when that fails, the machine is one node with every CPU.
+	 * Node i is the node with id i of the kernel, so the ids can be passed to mbind(). Ids that are not online, and memory-only nodes, have no CPUs.
+	 * A topology can also be made by hand, for example to try out a sharding on a machine with one node.
+	*/
+	class NumaTopology
+	{
+	public:
+		// One node with the CPUs 0 until std::thread::hardware_concurrency()
+		NumaTopology();
+		// The CPU numbers of every node, node i is `node_cpus[i]`
+		explicit NumaTopology(std::vector<std::vector<int>> node_cpus);
+
+		// The topology of this machine
+		static auto detect()->NumaTopology;
+
+		std::size_t node_count() const;
+		// The CPU numbers of `node`
+		auto cpus(std::size_t node) const->const std::vector<int>&;
+		// The node of `cpu`, 0 if the CPU is not part of any node
+		std::size_t node_of_cpu(int cpu) const;
+		// The node of the CPU the calling thread runs on right now, 0 if that is not known
+		std::size_t current_node() const;
+
+	private:
+		std::vector<std::vector<int>> node_cpus;
+	};
+
+	// Let the calling thread only run on the CPUs of `node`
+	// \returns false if the thread could not be pinned (or this is not Linux), the thread keeps running where it was allowed to before
+	bool pin_thread_to_node(const NumaTopology& topology, std::size_t node);
+	// Ask the kernel to put the pages of [address, address + size) on `node`, `address` has to be page aligned. Pages that are not touched yet are allocated there when they are touched
+	// \returns false if the kernel did not accept it (or this is not Linux)
+	bool bind_memory_to_node(void* address, std::size_t size, std::size_t node);
+
+	namespace detail
+	{
+		// Parse a CPU list like "0-3,8,10-11" from sysfs, node lists use the same format
+		auto parse_cpu_list(const std::string& list)->std::vector<int>;
+		// The contents of a small sysfs file, empty if it can not be read
+		auto read_sysfs_file(const char* path)->std::string;
+		// The node the NumaNodeAllocator allocates on for the calling thread, -1 for no preference
+		int& numa_allocation_node();
+	}
+
+	/// Makes every NumaNodeAllocator allocation of this thread prefer `node` while it exists
+	class NumaAllocationScope
+	{
+	public:
+		explicit NumaAllocationScope(std::size_t node);
+		NumaAllocationScope(const NumaAllocationScope&) = delete;
+		NumaAllocationScope& operator=(const NumaAllocationScope&) = delete;
+		~NumaAllocationScope();
+
+	private:
+		int previous_node;
+	};
+
+	/** \brief Allocator that places large allocations on the NUMA node of the current NumaAllocationScope.
+	 *
+	 * \class NumaNodeAllocator
+	 *
+	 * Allocations of at least `Threshold` bytes are mapped with mmap and bound to the node with mbind() before they are touched, so they end up on that node no matter which thread fills them.
+	 * Smaller allocations (like the nodes of a unordered_map) and every allocation on targets without COF_POSIX_MAPPING use operator new, they are placed by the first thread that touches them.
+	 * The allocator has no state, the node comes from the thread, so it fits the Allocator parameter of FlatValueMap without a constructor argument.
+	*/
+	template<typename T, std::size_t Threshold = 64 * 1024>
+	class NumaNodeAllocator
+	{
+		using StdAllocator = std::allocator<T>;
+
+	public:
+		using value_type = T;
+#if _MSVC_LANG < 201703L
+		using pointer = T*;
+		using const_pointer = const T*;
+		using reference = T&;
+		using const_reference = const T&;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_move_assignment = std::true_type;
+		using is_always_equal = std::true_type;
+#endif
+		template<typename U>
+		struct rebind { typedef NumaNodeAllocator<U, Threshold> other; };
+
+		NumaNodeAllocator() = default;
+		template<typename U>
+		NumaNodeAllocator(const NumaNodeAllocator<U, Threshold>&) noexcept
+		{
+		}
+
+		T* allocate(std::size_t n);
+		void deallocate(T* p, std::size_t n);
+
+		// \returns if a allocation of `n` elements is mapped (and bound to a node) instead of allocated with operator new
+		static bool is_mapped(std::size_t n);
+
+		friend bool operator==(const NumaNodeAllocator&, const NumaNodeAllocator&) { return true; }
+		friend bool operator!=(const NumaNodeAllocator&, const NumaNodeAllocator&) { return false; }
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline NumaTopology::NumaTopology()
+	{
+		unsigned cpu_count = std::thread::hardware_concurrency();
+		node_cpus.emplace_back();
+		for (unsigned cpu = 0; cpu < (cpu_count == 0 ? 1 : cpu_count); ++cpu) {
+			node_cpus.front().push_back(static_cast<int>(cpu));
+		}
+	}
+
+	inline NumaTopology::NumaTopology(std::vector<std::vector<int>> node_cpus)
+		: node_cpus(std::move(node_cpus))
+	{
+		if (this->node_cpus.empty()) {
+			*this = NumaTopology{};
+		}
+	}
+
+	inline auto NumaTopology::detect() -> NumaTopology
+	{
+#if COF_LINUX_NUMA
+		// The online node ids can have gaps, for example "0,2-3"
+		std::vector<int> online = detail::parse_cpu_list(detail::read_sysfs_file("/sys/devices/system/node/online"));
+		std::vector<std::vector<int>> detected;
+		for (int node : online) {
+			if (node < 0) {
+				continue;
+			}
+			if (static_cast<std::size_t>(node) >= detected.size()) {
+				detected.resize(static_cast<std::size_t>(node) + 1);
+			}
+			std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+			detected[static_cast<std::size_t>(node)] = detail::parse_cpu_list(detail::read_sysfs_file(path.c_str()));
+		}
+		if (!detected.empty()) {
+			return NumaTopology{ std::move(detected) };
+		}
+#endif // END: COF_LINUX_NUMA
+		return NumaTopology{};
+	}
+
+	inline std::size_t NumaTopology::node_count() const
+	{
+		return node_cpus.size();
+	}
+
+	inline auto NumaTopology::cpus(std::size_t node) const -> const std::vector<int>&
+	{
+		return node_cpus[node];
+	}
+
+	inline std::size_t NumaTopology::node_of_cpu(int cpu) const
+	{
+		for (std::size_t node = 0; node < node_cpus.size(); ++node) {
+			for (int node_cpu : node_cpus[node]) {
+				if (node_cpu == cpu) {
+					return node;
+				}
+			}
+		}
+		return 0;
+	}
+
+	inline std::size_t NumaTopology::current_node() const
+	{
+#if COF_LINUX_NUMA
+		int cpu = sched_getcpu();
+		return cpu < 0 ? 0 : node_of_cpu(cpu);
+#else // ELSE: COF_LINUX_NUMA
+		return 0;
+#endif // END: COF_LINUX_NUMA
+	}
+
+	inline bool pin_thread_to_node(const NumaTopology& topology, std::size_t node)
+	{
+#if COF_LINUX_NUMA
+		if (node >= topology.node_count() || topology.cpus(node).empty()) {
+			return false;
+		}
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		for (int cpu : topology.cpus(node)) {
+			if (cpu >= 0 && cpu < CPU_SETSIZE) {
+				CPU_SET(cpu, &cpu_set);
+			}
+		}
+		return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+#else // ELSE: COF_LINUX_NUMA
+		(void)topology;
+		(void)node;
+		return false;
+#endif // END: COF_LINUX_NUMA
+	}
+
+	inline bool bind_memory_to_node(void* address, std::size_t size, std::size_t node)
+	{
+#if COF_LINUX_NUMA && defined(SYS_mbind)
+		// MPOL_PREFERRED from <linux/mempolicy.h>: use the node while it has free memory instead of failing like MPOL_BIND
+		constexpr int mpol_preferred = 1;
+		constexpr std::size_t bits_per_word = sizeof(unsigned long) * 8;
+		std::vector<unsigned long> node_mask(node / bits_per_word + 1, 0);
+		node_mask[node / bits_per_word] |= 1UL << (node % bits_per_word);
+		return syscall(SYS_mbind, address, size, mpol_preferred, node_mask.data(), node_mask.size() * bits_per_word + 1, 0) == 0;
+#else // ELSE: COF_LINUX_NUMA
+		(void)address;
+		(void)size;
+		(void)node;
+		return false;
+#endif // END: COF_LINUX_NUMA
+	}
+
+	namespace detail
+	{
+		inline auto parse_cpu_list(const std::string& list) -> std::vector<int>
+		{
+			std::vector<int> cpus;
+			std::size_t position = 0;
+			while (position < list.size()) {
+				char* end = nullptr;
+				long first = std::strtol(list.c_str() + position, &end, 10);
+				if (end == list.c_str() + position) {
+					break;
+				}
+				long last = first;
+				if (*end == '-') {
+					last = std::strtol(end + 1, &end, 10);
+				}
+				for (long cpu = first; cpu <= last; ++cpu) {
+					cpus.push_back(static_cast<int>(cpu));
+				}
+				position = static_cast<std::size_t>(end - list.c_str());
+				if (position < list.size() && list[position] == ',') {
+					++position;
+				} else {
+					break;
+				}
+			}
+			return cpus;
+		}
+
+		inline auto read_sysfs_file(const char* path) -> std::string
+		{
+			std::FILE* file = std::fopen(path, "r");
+			if (file == nullptr) {
+				return std::string{};
+			}
+			char buffer[4096];
+			std::size_t length = std::fread(buffer, 1, sizeof(buffer) - 1, file);
+			std::fclose(file);
+			return std::string(buffer, length);
+		}
+
+		inline int& numa_allocation_node()
+		{
+			static thread_local int node = -1;
+			return node;
+		}
+	}
+
+	inline NumaAllocationScope::NumaAllocationScope(std::size_t node)
+		: previous_node(detail::numa_allocation_node())
+	{
+		detail::numa_allocation_node() = static_cast<int>(node);
+	}
+
+	inline NumaAllocationScope::~NumaAllocationScope()
+	{
+		detail::numa_allocation_node() = previous_node;
+	}
+
+	template<typename T, std::size_t Threshold>
+	T* NumaNodeAllocator<T, Threshold>::allocate(std::size_t n)
+	{
+		if (!is_mapped(n)) {
+			return StdAllocator{}.allocate(n);
+		}
+#if COF_POSIX_MAPPING
+		void* address = mmap(nullptr, n * sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (address == MAP_FAILED) {
+			throw std::bad_alloc{};
+		}
+		int node = detail::numa_allocation_node();
+		if (node >= 0) {
+			bind_memory_to_node(address, n * sizeof(T), static_cast<std::size_t>(node));
+		}
+		return static_cast<T*>(address);
+#else // ELSE: COF_POSIX_MAPPING
+		return nullptr;
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	template<typename T, std::size_t Threshold>
+	void NumaNodeAllocator<T, Threshold>::deallocate(T* p, std::size_t n)
+	{
+		if (!is_mapped(n)) {
+			StdAllocator{}.deallocate(p, n);
+			return;
+		}
+#if COF_POSIX_MAPPING
+		munmap(p, n * sizeof(T));
+#endif // END: COF_POSIX_MAPPING
+	}
+
+	template<typename T, std::size_t Threshold>
+	bool NumaNodeAllocator<T, Threshold>::is_mapped(std::size_t n)
+	{
+		return COF_POSIX_MAPPING && n * sizeof(T) >= Threshold;
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+
+namespace cof
+{
+	/** \brief A pointer that stores the distance to it's target instead of the address, so it stays valid when the memory it is in is mapped at a different address.
+	 *
+	 * \class OffsetPtr
+	 *
+	 * Used for data structures in shared memory or mapped files, where every process (or every run) can map the memory at a different address.
+	 * The pointer and it's target have to be in the same mapping. A offset of 0 is the null pointer, so a OffsetPtr can not point to itself.
+	 * Copying a OffsetPtr to a different address recalculates the offset.
+	*/
+	template<typename T>
+	class OffsetPtr
+	{
+	public:
+		OffsetPtr() = default;
+		OffsetPtr(T* target);
+		OffsetPtr(const OffsetPtr& other);
+		OffsetPtr& operator=(const OffsetPtr& other);
+		OffsetPtr& operator=(T* target);
+
+		// Get the raw pointer for this mapping
+		T* get() const;
+		T& operator*() const;
+		T* operator->() const;
+		T& operator[](std::size_t index) const;
+		explicit operator bool() const;
+
+	private:
+		void set(T* target);
+
+		std::ptrdiff_t offset = 0;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	template<typename T>
+	OffsetPtr<T>::OffsetPtr(T* target)
+	{
+		set(target);
+	}
+
+	template<typename T>
+	OffsetPtr<T>::OffsetPtr(const OffsetPtr& other)
+	{
+		set(other.get());
+	}
+
+	template<typename T>
+	OffsetPtr<T>& OffsetPtr<T>::operator=(const OffsetPtr& other)
+	{
+		set(other.get());
+		return *this;
+	}
+
+	template<typename T>
+	OffsetPtr<T>& OffsetPtr<T>::operator=(T* target)
+	{
+		set(target);
+		return *this;
+	}
+
+	template<typename T>
+	T* OffsetPtr<T>::get() const
+	{
+		if (offset == 0) {
+			return nullptr;
+		}
+		return reinterpret_cast<T*>(reinterpret_cast<std::uintptr_t>(this) + static_cast<std::uintptr_t>(offset));
+	}
+
+	template<typename T>
+	T& OffsetPtr<T>::operator*() const
+	{
+		return *get();
+	}
+
+	template<typename T>
+	T* OffsetPtr<T>::operator->() const
+	{
+		return get();
+	}
+
+	template<typename T>
+	T& OffsetPtr<T>::operator[](std::size_t index) const
+	{
+		return get()[index];
+	}
+
+	template<typename T>
+	OffsetPtr<T>::operator bool() const
+	{
+		return offset != 0;
+	}
+
+	template<typename T>
+	void OffsetPtr<T>::set(T* target)
+	{
+		offset = target == nullptr ? 0 : static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(target) - reinterpret_cast<std::uintptr_t>(this));
+	}
+}
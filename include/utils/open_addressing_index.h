@@ -0,0 +1,246 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace cof
+{
+	/// One slot of a open addressing index: a handle id and the dense index of it's element. A id of 0 marks a empty slot, so handle ids have to start at 1.
+	struct IndexSlot
+	{
+		std::uint32_t id;
+		std::uint32_t index;
+	};
+
+	/** \brief A sparse to dense index in a plain array of IndexSlot, for memory that can not hold a std::unordered_map (like shared memory or a mapped file).
+	 *
+	 * \class OpenAddressingIndex
+	 *
+	 * Uses linear probing, and erase() shifts the following slots back instead of leaving tombstones, so lookups never slow down over time.
+	 * This class only holds a pointer to the slots, the slots themselves are owned by the caller. The slot count has to be a power of two and more then the maximum element count.
+	*/
+	class OpenAddressingIndex
+	{
+	public:
+		static constexpr std::uint32_t not_found = UINT32_MAX;
+
+		OpenAddressingIndex() = default;
+		OpenAddressingIndex(IndexSlot* slots, std::size_t slot_count);
+
+		// The slot count for `max_elements` elements, at most half of the slots are used
+		static std::size_t slot_count_for(std::size_t max_elements);
+		// Mark all slots as empty
+		static void clear(IndexSlot* slots, std::size_t slot_count);
+
+		// \returns the dense index of `id`, or not_found
+		std::uint32_t find(std::uint32_t id) const;
+		// Add `id`, it can not be in the index yet
+		void insert(std::uint32_t id, std::uint32_t index);
+		// Change the dense index of `id`, it has to be in the index
+		void update(std::uint32_t id, std::uint32_t index);
+		// Remove `id`
+		// \returns false if `id` was not in the index
+		bool erase(std::uint32_t id);
+
+		// The first slot probed for `id`
+		static std::size_t home_slot(std::uint32_t id, std::size_t slot_mask);
+
+		// Fill empty `slots` with `ids[i]` -> i for all `count` ids. Runs on `pool`, a WorkStealingPool or a detail::SequentialFor.
+		// The ids are sorted by the range of slots (partition) their home slot is in, and every partition is filled by one thread. Inserts that would probe past the end
+		// of their partition are done afterwards on the calling thread, with the table at most half full these are a few per partition.
+		// Equal ids have the same home slot, so the probe of the second one always runs into the first one and duplicates are found without a extra pass.
+		// \returns false if a id is 0 or is in `ids` twice, the slots are only partly filled then
+		template<typename Pool>
+		static bool build(IndexSlot* slots, std::size_t slot_count, const std::uint32_t* ids, std::size_t count, Pool& pool);
+
+	private:
+		std::size_t find_slot(std::uint32_t id) const;
+
+		IndexSlot* slots = nullptr;
+		std::size_t slot_mask = 0;
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline OpenAddressingIndex::OpenAddressingIndex(IndexSlot* slots, std::size_t slot_count)
+		: slots(slots)
+		, slot_mask(slot_count - 1)
+	{
+		assert(slot_count > 0 && (slot_count & (slot_count - 1)) == 0);
+	}
+
+	inline std::size_t OpenAddressingIndex::slot_count_for(std::size_t max_elements)
+	{
+		std::size_t slot_count = 16;
+		while (slot_count < max_elements * 2) {
+			slot_count *= 2;
+		}
+		return slot_count;
+	}
+
+	inline void OpenAddressingIndex::clear(IndexSlot* slots, std::size_t slot_count)
+	{
+		for (std::size_t i = 0; i < slot_count; ++i) {
+			slots[i] = IndexSlot{ 0, 0 };
+		}
+	}
+
+	inline std::uint32_t OpenAddressingIndex::find(std::uint32_t id) const
+	{
+		std::size_t slot = find_slot(id);
+		return slots[slot].id == id && id != 0 ? slots[slot].index : not_found;
+	}
+
+	inline void OpenAddressingIndex::insert(std::uint32_t id, std::uint32_t index)
+	{
+		assert(id != 0);
+		std::size_t slot = find_slot(id);
+		assert(slots[slot].id == 0 && "The id is already in the index");
+		slots[slot] = IndexSlot{ id, index };
+	}
+
+	inline void OpenAddressingIndex::update(std::uint32_t id, std::uint32_t index)
+	{
+		std::size_t slot = find_slot(id);
+		assert(slots[slot].id == id);
+		slots[slot].index = index;
+	}
+
+	inline bool OpenAddressingIndex::erase(std::uint32_t id)
+	{
+		std::size_t hole = find_slot(id);
+		if (slots[hole].id != id) {
+			return false;
+		}
+
+		// Backward shift deletion: move every following slot of the probe sequence into the hole if it's home slot allows it
+		std::size_t slot = hole;
+		for (;;) {
+			slot = (slot + 1) & slot_mask;
+			if (slots[slot].id == 0) {
+				break;
+			}
+			std::size_t home = home_slot(slots[slot].id, slot_mask);
+			// The slot can move back if it's home slot is not in (hole, slot], cyclically
+			bool home_between = hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot);
+			if (!home_between) {
+				slots[hole] = slots[slot];
+				hole = slot;
+			}
+		}
+		slots[hole] = IndexSlot{ 0, 0 };
+		return true;
+	}
+
+	inline std::size_t OpenAddressingIndex::home_slot(std::uint32_t id, std::size_t slot_mask)
+	{
+		// Fibonacci hashing, consecutive ids spread over the slots
+		return static_cast<std::size_t>((static_cast<std::uint64_t>(id) * 0x9E3779B97F4A7C15ull) >> 32) & slot_mask;
+	}
+
+	template<typename Pool>
+	bool OpenAddressingIndex::build(IndexSlot* slots, std::size_t slot_count, const std::uint32_t* ids, std::size_t count, Pool& pool)
+	{
+		assert(slot_count > 0 && (slot_count & (slot_count - 1)) == 0);
+		std::size_t slot_mask = slot_count - 1;
+		// Partitions of 8192 slots (64 KiB), the ids of one partition fit in the cache together with it's slots
+		std::size_t slot_bits = 0;
+		while ((std::size_t{ 1 } << slot_bits) < slot_count) {
+			++slot_bits;
+		}
+		std::size_t partition_shift = slot_bits > 13 ? 13 : slot_bits;
+		std::size_t partition_count = slot_count >> partition_shift;
+		std::size_t slots_per_partition = std::size_t{ 1 } << partition_shift;
+
+		// Count the ids per partition in every chunk of ids, the prefix sum gives every chunk the place to write it's ids of every partition
+		constexpr std::size_t grain = 65536;
+		std::size_t chunk_count = (count + grain - 1) / grain;
+		std::vector<std::size_t> offsets(chunk_count * partition_count, 0);
+		pool.parallel_for(count, grain, [&](std::size_t begin, std::size_t end) {
+			std::size_t* chunk_offsets = offsets.data() + begin / grain * partition_count;
+			for (std::size_t i = begin; i < end; ++i) {
+				++chunk_offsets[home_slot(ids[i], slot_mask) >> partition_shift];
+			}
+		});
+		std::vector<std::size_t> partition_begin(partition_count + 1, 0);
+		std::size_t total = 0;
+		for (std::size_t partition = 0; partition < partition_count; ++partition) {
+			partition_begin[partition] = total;
+			for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+				std::size_t chunk_ids = offsets[chunk * partition_count + partition];
+				offsets[chunk * partition_count + partition] = total;
+				total += chunk_ids;
+			}
+		}
+		partition_begin[partition_count] = total;
+
+		std::vector<IndexSlot> sorted(count);
+		pool.parallel_for(count, grain, [&](std::size_t begin, std::size_t end) {
+			std::size_t* chunk_offsets = offsets.data() + begin / grain * partition_count;
+			for (std::size_t i = begin; i < end; ++i) {
+				sorted[chunk_offsets[home_slot(ids[i], slot_mask) >> partition_shift]++] = IndexSlot{ ids[i], static_cast<std::uint32_t>(i) };
+			}
+		});
+
+		// Fill every partition on it's own, a probe that runs into the next partition is left for later because that partition belongs to a other thread
+		std::vector<std::vector<IndexSlot>> overflow(partition_count);
+		std::atomic<bool> invalid_id{ false };
+		pool.parallel_for(partition_count, 1, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t partition = begin; partition < end; ++partition) {
+				std::size_t partition_end = (partition + 1) * slots_per_partition;
+				for (std::size_t i = partition_begin[partition]; i < partition_begin[partition + 1]; ++i) {
+					if (sorted[i].id == 0) {
+						invalid_id = true;
+						return;
+					}
+					std::size_t slot = home_slot(sorted[i].id, slot_mask);
+					while (slot < partition_end && slots[slot].id != 0) {
+						if (slots[slot].id == sorted[i].id) {
+							invalid_id = true;
+							return;
+						}
+						++slot;
+					}
+					if (slot < partition_end) {
+						slots[slot] = sorted[i];
+					} else {
+						overflow[partition].push_back(sorted[i]);
+					}
+				}
+			}
+		});
+
+		if (invalid_id) {
+			return false;
+		}
+
+		OpenAddressingIndex index{ slots, slot_count };
+		for (const std::vector<IndexSlot>& partition_overflow : overflow) {
+			for (IndexSlot slot : partition_overflow) {
+				if (index.find(slot.id) != not_found) {
+					return false;
+				}
+				index.insert(slot.id, slot.index);
+			}
+		}
+		return true;
+	}
+
+	inline std::size_t OpenAddressingIndex::find_slot(std::uint32_t id) const
+	{
+		std::size_t slot = home_slot(id, slot_mask);
+		while (slots[slot].id != 0 && slots[slot].id != id) {
+			slot = (slot + 1) & slot_mask;
+		}
+		return slot;
+	}
+}
@@ -0,0 +1,1009 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "utils/defines.h"
+#include "utils/cpu_dispatch.h"
+
+#if COF_SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+/* Scan kernels over contiguous arrays, these are the building blocks of the FlatValueMap query functions in flat_value_map_kernels.h
+ * Every kernel has a scalar version that works for every arithmetic type, float, double and int32_t also get SSE4.2 and AVX2 versions and float and int32_t get AVX-512 versions.
+ * Which version runs is decided at runtime by utils/cpu_dispatch.h, so the program does not need to be compiled with -mavx2 / /arch:AVX2.
+ */
+namespace cof
+{
+	namespace simd
+	{
+		// The type a sum is accumulated in, wide enough so adding up a big array does not overflow (or lose too much precision)
+		template<typename T>
+		using sum_t = typename std::conditional<std::is_floating_point<T>::value,
+			typename std::common_type<T, double>::type,
+			typename std::conditional<std::is_signed<T>::value, std::int64_t, std::uint64_t>::type
+		>::type;
+
+		/// \Category Scalar kernels
+
+		// Add up all `count` elements
+		template<typename T>
+		auto sum_scalar(const T* data, std::size_t count)->sum_t<T>;
+		// \returns the index of the first smallest element, `count` has to be bigger then zero
+		template<typename T>
+		std::size_t min_index_scalar(const T* data, std::size_t count);
+		// \returns the index of the first biggest element, `count` has to be bigger then zero
+		template<typename T>
+		std::size_t max_index_scalar(const T* data, std::size_t count);
+		// \returns the amount of elements that are in the inclusive range [low, high]
+		template<typename T>
+		std::size_t count_in_range_scalar(const T* data, std::size_t count, T low, T high);
+		// Write the handles of the elements that are in the inclusive range [low, high] to `out`. `handles` is in the same order as `data`.
+		// \returns the amount of handles written
+		template<typename T, typename Handle>
+		std::size_t select_in_range_scalar(const T* data, const Handle* handles, std::size_t count, T low, T high, Handle* out);
+
+
+		/// \Category Dispatching kernels, these pick the fastest version the CPU supports
+
+		template<typename T>
+		auto sum(const T* data, std::size_t count)->sum_t<T>;
+		double sum(const float* data, std::size_t count);
+		double sum(const double* data, std::size_t count);
+		std::int64_t sum(const std::int32_t* data, std::size_t count);
+
+		template<typename T>
+		std::size_t min_index(const T* data, std::size_t count);
+		std::size_t min_index(const float* data, std::size_t count);
+		std::size_t min_index(const double* data, std::size_t count);
+		std::size_t min_index(const std::int32_t* data, std::size_t count);
+
+		template<typename T>
+		std::size_t max_index(const T* data, std::size_t count);
+		std::size_t max_index(const float* data, std::size_t count);
+		std::size_t max_index(const double* data, std::size_t count);
+		std::size_t max_index(const std::int32_t* data, std::size_t count);
+
+		template<typename T>
+		std::size_t count_in_range(const T* data, std::size_t count, T low, T high);
+		std::size_t count_in_range(const float* data, std::size_t count, float low, float high);
+		std::size_t count_in_range(const double* data, std::size_t count, double low, double high);
+		std::size_t count_in_range(const std::int32_t* data, std::size_t count, std::int32_t low, std::int32_t high);
+
+		template<typename T, typename Handle>
+		std::size_t select_in_range(const T* data, const Handle* handles, std::size_t count, T low, T high, Handle* out);
+		template<typename Handle>
+		std::size_t select_in_range(const float* data, const Handle* handles, std::size_t count, float low, float high, Handle* out);
+		template<typename Handle>
+		std::size_t select_in_range(const double* data, const Handle* handles, std::size_t count, double low, double high, Handle* out);
+		template<typename Handle>
+		std::size_t select_in_range(const std::int32_t* data, const Handle* handles, std::size_t count, std::int32_t low, std::int32_t high, Handle* out);
+	}
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	namespace simd
+	{
+		namespace detail
+		{
+			inline unsigned count_trailing_zeros(unsigned bits)
+			{
+				assert(bits != 0);
+#if defined(_MSC_VER)
+				unsigned long index;
+				_BitScanForward(&index, bits);
+				return static_cast<unsigned>(index);
+#else
+				return static_cast<unsigned>(__builtin_ctz(bits));
+#endif
+			}
+
+			inline unsigned popcount(unsigned bits)
+			{
+#if defined(_MSC_VER)
+				return __popcnt(bits);
+#else
+				return static_cast<unsigned>(__builtin_popcount(bits));
+#endif
+			}
+
+			// Write the handles for every set bit in `mask`, bit 0 belongs to handles[0]
+			template<typename Handle>
+			std::size_t emit_selected(unsigned mask, const Handle* handles, Handle* out)
+			{
+				std::size_t written = 0;
+				while (mask != 0) {
+					out[written++] = handles[count_trailing_zeros(mask)];
+					mask &= mask - 1;
+				}
+				return written;
+			}
+
+			template<bool FindMax, typename T>
+			T pick_extreme(T lhs, T rhs)
+			{
+				return FindMax ? (rhs > lhs ? rhs : lhs) : (rhs < lhs ? rhs : lhs);
+			}
+
+			// Fold the lanes of the vertical min/max and the elements after the last full vector into the extreme value
+			template<bool FindMax, typename T>
+			T reduce_extreme(const T* lanes, std::size_t lane_count, const T* tail, std::size_t tail_count)
+			{
+				T extreme = lanes[0];
+				for (std::size_t i = 1; i < lane_count; ++i) {
+					extreme = pick_extreme<FindMax>(extreme, lanes[i]);
+				}
+				for (std::size_t i = 0; i < tail_count; ++i) {
+					extreme = pick_extreme<FindMax>(extreme, tail[i]);
+				}
+				return extreme;
+			}
+
+			template<bool FindMax, typename T>
+			std::size_t extremum_index_scalar(const T* data, std::size_t count)
+			{
+				return FindMax ? max_index_scalar(data, count) : min_index_scalar(data, count);
+			}
+
+			// The vectorized extremum kernels do two passes, first find the extreme value with vertical min/max and then find the first index that holds it.
+			// Both passes stream the array, which is cheaper then keeping track of an index per lane.
+			// When the value is not found in the vectorized part of the second pass, this function searches the tail.
+			// The scalar versions skip NaNs, unless data[0] is a NaN which then is the result. The float and double lanes start at data[0] to match that:
+			// min/max return their second operand (the lane) when either is a NaN, so a lane never becomes a NaN unless data[0] is one, and then the scalar version decides.
+			template<bool FindMax, typename T>
+			std::size_t find_extreme_in_tail(const T* data, std::size_t from, std::size_t count, T extreme)
+			{
+				for (std::size_t i = from; i < count; ++i) {
+					if (data[i] == extreme) {
+						return i;
+					}
+				}
+				// Only reachable with NaNs in the data, let the scalar version decide
+				return extremum_index_scalar<FindMax>(data, count);
+			}
+
+#if COF_SIMD_X86
+			namespace sse42
+			{
+				COF_TARGET_SSE42 inline double sum(const float* data, std::size_t count)
+				{
+					__m128d low_acc = _mm_setzero_pd();
+					__m128d high_acc = _mm_setzero_pd();
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						__m128 values = _mm_loadu_ps(data + i);
+						low_acc = _mm_add_pd(low_acc, _mm_cvtps_pd(values));
+						high_acc = _mm_add_pd(high_acc, _mm_cvtps_pd(_mm_movehl_ps(values, values)));
+					}
+
+					alignas(16) double lanes[2];
+					_mm_store_pd(lanes, _mm_add_pd(low_acc, high_acc));
+					return lanes[0] + lanes[1] + sum_scalar(data + i, count - i);
+				}
+
+				COF_TARGET_SSE42 inline double sum(const double* data, std::size_t count)
+				{
+					__m128d acc0 = _mm_setzero_pd();
+					__m128d acc1 = _mm_setzero_pd();
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						acc0 = _mm_add_pd(acc0, _mm_loadu_pd(data + i));
+						acc1 = _mm_add_pd(acc1, _mm_loadu_pd(data + i + 2));
+					}
+
+					alignas(16) double lanes[2];
+					_mm_store_pd(lanes, _mm_add_pd(acc0, acc1));
+					return lanes[0] + lanes[1] + sum_scalar(data + i, count - i);
+				}
+
+				COF_TARGET_SSE42 inline std::int64_t sum(const std::int32_t* data, std::size_t count)
+				{
+					__m128i acc = _mm_setzero_si128();
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+						acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(values));
+						acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(_mm_srli_si128(values, 8)));
+					}
+
+					alignas(16) std::int64_t lanes[2];
+					_mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+					return lanes[0] + lanes[1] + sum_scalar(data + i, count - i);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_SSE42 std::size_t extremum_index(const float* data, std::size_t count)
+				{
+					if (count < 4) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m128 best = _mm_set1_ps(data[0]);
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						__m128 values = _mm_loadu_ps(data + i);
+						best = FindMax ? _mm_max_ps(values, best) : _mm_min_ps(values, best);
+					}
+
+					alignas(16) float lanes[4];
+					_mm_store_ps(lanes, best);
+					const float extreme = reduce_extreme<FindMax>(lanes, 4, data + i, count - i);
+
+					const __m128 target = _mm_set1_ps(extreme);
+					for (i = 0; i + 4 <= count; i += 4) {
+						unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(data + i), target)));
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_SSE42 std::size_t extremum_index(const double* data, std::size_t count)
+				{
+					if (count < 2) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m128d best = _mm_set1_pd(data[0]);
+					std::size_t i = 0;
+					for (; i + 2 <= count; i += 2) {
+						__m128d values = _mm_loadu_pd(data + i);
+						best = FindMax ? _mm_max_pd(values, best) : _mm_min_pd(values, best);
+					}
+
+					alignas(16) double lanes[2];
+					_mm_store_pd(lanes, best);
+					const double extreme = reduce_extreme<FindMax>(lanes, 2, data + i, count - i);
+
+					const __m128d target = _mm_set1_pd(extreme);
+					for (i = 0; i + 2 <= count; i += 2) {
+						unsigned mask = static_cast<unsigned>(_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), target)));
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_SSE42 std::size_t extremum_index(const std::int32_t* data, std::size_t count)
+				{
+					if (count < 4) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m128i best = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+					std::size_t i = 4;
+					for (; i + 4 <= count; i += 4) {
+						__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+						best = FindMax ? _mm_max_epi32(values, best) : _mm_min_epi32(values, best);
+					}
+
+					alignas(16) std::int32_t lanes[4];
+					_mm_store_si128(reinterpret_cast<__m128i*>(lanes), best);
+					const std::int32_t extreme = reduce_extreme<FindMax>(lanes, 4, data + i, count - i);
+
+					const __m128i target = _mm_set1_epi32(extreme);
+					for (i = 0; i + 4 <= count; i += 4) {
+						__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), target);
+						unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(equal)));
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				COF_TARGET_SSE42 inline unsigned in_range_mask(const float* data, __m128 low, __m128 high)
+				{
+					__m128 values = _mm_loadu_ps(data);
+					return static_cast<unsigned>(_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(values, low), _mm_cmple_ps(values, high))));
+				}
+
+				COF_TARGET_SSE42 inline unsigned in_range_mask(const double* data, __m128d low, __m128d high)
+				{
+					__m128d values = _mm_loadu_pd(data);
+					return static_cast<unsigned>(_mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(values, low), _mm_cmple_pd(values, high))));
+				}
+
+				COF_TARGET_SSE42 inline unsigned in_range_mask(const std::int32_t* data, __m128i low, __m128i high)
+				{
+					__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+					__m128i outside = _mm_or_si128(_mm_cmplt_epi32(values, low), _mm_cmpgt_epi32(values, high));
+					return ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(outside))) & 0xFu;
+				}
+
+				COF_TARGET_SSE42 inline std::size_t count_in_range(const float* data, std::size_t count, float low, float high)
+				{
+					const __m128 low_v = _mm_set1_ps(low);
+					const __m128 high_v = _mm_set1_ps(high);
+					std::size_t total = 0;
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						total += popcount(in_range_mask(data + i, low_v, high_v));
+					}
+					return total + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				COF_TARGET_SSE42 inline std::size_t count_in_range(const double* data, std::size_t count, double low, double high)
+				{
+					const __m128d low_v = _mm_set1_pd(low);
+					const __m128d high_v = _mm_set1_pd(high);
+					std::size_t total = 0;
+					std::size_t i = 0;
+					for (; i + 2 <= count; i += 2) {
+						total += popcount(in_range_mask(data + i, low_v, high_v));
+					}
+					return total + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				COF_TARGET_SSE42 inline std::size_t count_in_range(const std::int32_t* data, std::size_t count, std::int32_t low, std::int32_t high)
+				{
+					const __m128i low_v = _mm_set1_epi32(low);
+					const __m128i high_v = _mm_set1_epi32(high);
+					std::size_t total = 0;
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						total += popcount(in_range_mask(data + i, low_v, high_v));
+					}
+					return total + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				template<typename Handle>
+				COF_TARGET_SSE42 std::size_t select_in_range(const float* data, const Handle* handles, std::size_t count, float low, float high, Handle* out)
+				{
+					const __m128 low_v = _mm_set1_ps(low);
+					const __m128 high_v = _mm_set1_ps(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						written += emit_selected(in_range_mask(data + i, low_v, high_v), handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+
+				template<typename Handle>
+				COF_TARGET_SSE42 std::size_t select_in_range(const double* data, const Handle* handles, std::size_t count, double low, double high, Handle* out)
+				{
+					const __m128d low_v = _mm_set1_pd(low);
+					const __m128d high_v = _mm_set1_pd(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 2 <= count; i += 2) {
+						written += emit_selected(in_range_mask(data + i, low_v, high_v), handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+
+				template<typename Handle>
+				COF_TARGET_SSE42 std::size_t select_in_range(const std::int32_t* data, const Handle* handles, std::size_t count, std::int32_t low, std::int32_t high, Handle* out)
+				{
+					const __m128i low_v = _mm_set1_epi32(low);
+					const __m128i high_v = _mm_set1_epi32(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						written += emit_selected(in_range_mask(data + i, low_v, high_v), handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+			}
+
+			namespace avx2
+			{
+				COF_TARGET_AVX2 inline double sum(const float* data, std::size_t count)
+				{
+					__m256d low_acc = _mm256_setzero_pd();
+					__m256d high_acc = _mm256_setzero_pd();
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						__m256 values = _mm256_loadu_ps(data + i);
+						low_acc = _mm256_add_pd(low_acc, _mm256_cvtps_pd(_mm256_castps256_ps128(values)));
+						high_acc = _mm256_add_pd(high_acc, _mm256_cvtps_pd(_mm256_extractf128_ps(values, 1)));
+					}
+
+					alignas(32) double lanes[4];
+					_mm256_store_pd(lanes, _mm256_add_pd(low_acc, high_acc));
+					return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sum_scalar(data + i, count - i);
+				}
+
+				COF_TARGET_AVX2 inline double sum(const double* data, std::size_t count)
+				{
+					__m256d acc0 = _mm256_setzero_pd();
+					__m256d acc1 = _mm256_setzero_pd();
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(data + i));
+						acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(data + i + 4));
+					}
+
+					alignas(32) double lanes[4];
+					_mm256_store_pd(lanes, _mm256_add_pd(acc0, acc1));
+					return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sum_scalar(data + i, count - i);
+				}
+
+				COF_TARGET_AVX2 inline std::int64_t sum(const std::int32_t* data, std::size_t count)
+				{
+					__m256i acc = _mm256_setzero_si256();
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+						acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(values)));
+						acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(values, 1)));
+					}
+
+					alignas(32) std::int64_t lanes[4];
+					_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+					return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(data + i, count - i);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_AVX2 std::size_t extremum_index(const float* data, std::size_t count)
+				{
+					if (count < 8) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m256 best = _mm256_set1_ps(data[0]);
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						__m256 values = _mm256_loadu_ps(data + i);
+						best = FindMax ? _mm256_max_ps(values, best) : _mm256_min_ps(values, best);
+					}
+
+					alignas(32) float lanes[8];
+					_mm256_store_ps(lanes, best);
+					const float extreme = reduce_extreme<FindMax>(lanes, 8, data + i, count - i);
+
+					const __m256 target = _mm256_set1_ps(extreme);
+					for (i = 0; i + 8 <= count; i += 8) {
+						unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + i), target, _CMP_EQ_OQ)));
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_AVX2 std::size_t extremum_index(const double* data, std::size_t count)
+				{
+					if (count < 4) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m256d best = _mm256_set1_pd(data[0]);
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						__m256d values = _mm256_loadu_pd(data + i);
+						best = FindMax ? _mm256_max_pd(values, best) : _mm256_min_pd(values, best);
+					}
+
+					alignas(32) double lanes[4];
+					_mm256_store_pd(lanes, best);
+					const double extreme = reduce_extreme<FindMax>(lanes, 4, data + i, count - i);
+
+					const __m256d target = _mm256_set1_pd(extreme);
+					for (i = 0; i + 4 <= count; i += 4) {
+						unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i), target, _CMP_EQ_OQ)));
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_AVX2 std::size_t extremum_index(const std::int32_t* data, std::size_t count)
+				{
+					if (count < 8) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m256i best = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+					std::size_t i = 8;
+					for (; i + 8 <= count; i += 8) {
+						__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+						best = FindMax ? _mm256_max_epi32(values, best) : _mm256_min_epi32(values, best);
+					}
+
+					alignas(32) std::int32_t lanes[8];
+					_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), best);
+					const std::int32_t extreme = reduce_extreme<FindMax>(lanes, 8, data + i, count - i);
+
+					const __m256i target = _mm256_set1_epi32(extreme);
+					for (i = 0; i + 8 <= count; i += 8) {
+						__m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), target);
+						unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				COF_TARGET_AVX2 inline __m256 in_range_mask(__m256 values, __m256 low, __m256 high)
+				{
+					return _mm256_and_ps(_mm256_cmp_ps(values, low, _CMP_GE_OQ), _mm256_cmp_ps(values, high, _CMP_LE_OQ));
+				}
+
+				COF_TARGET_AVX2 inline __m256d in_range_mask(__m256d values, __m256d low, __m256d high)
+				{
+					return _mm256_and_pd(_mm256_cmp_pd(values, low, _CMP_GE_OQ), _mm256_cmp_pd(values, high, _CMP_LE_OQ));
+				}
+
+				// Integers only have a greater than compare, so this returns the lanes that are OUTSIDE of the range
+				COF_TARGET_AVX2 inline __m256i out_of_range_mask(__m256i values, __m256i low, __m256i high)
+				{
+					return _mm256_or_si256(_mm256_cmpgt_epi32(low, values), _mm256_cmpgt_epi32(values, high));
+				}
+
+				COF_TARGET_AVX2 inline std::size_t count_in_range(const float* data, std::size_t count, float low, float high)
+				{
+					const __m256 low_v = _mm256_set1_ps(low);
+					const __m256 high_v = _mm256_set1_ps(high);
+					// A true compare lane is all ones (-1), so subtracting the mask counts up
+					__m256i acc = _mm256_setzero_si256();
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						__m256 mask = in_range_mask(_mm256_loadu_ps(data + i), low_v, high_v);
+						acc = _mm256_sub_epi32(acc, _mm256_castps_si256(mask));
+					}
+
+					alignas(32) std::uint32_t lanes[8];
+					_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+					std::size_t total = 0;
+					for (std::uint32_t lane : lanes) {
+						total += lane;
+					}
+					return total + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				COF_TARGET_AVX2 inline std::size_t count_in_range(const double* data, std::size_t count, double low, double high)
+				{
+					const __m256d low_v = _mm256_set1_pd(low);
+					const __m256d high_v = _mm256_set1_pd(high);
+					__m256i acc = _mm256_setzero_si256();
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						__m256d mask = in_range_mask(_mm256_loadu_pd(data + i), low_v, high_v);
+						acc = _mm256_sub_epi64(acc, _mm256_castpd_si256(mask));
+					}
+
+					alignas(32) std::uint64_t lanes[4];
+					_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+					std::size_t total = static_cast<std::size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+					return total + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				COF_TARGET_AVX2 inline std::size_t count_in_range(const std::int32_t* data, std::size_t count, std::int32_t low, std::int32_t high)
+				{
+					const __m256i low_v = _mm256_set1_epi32(low);
+					const __m256i high_v = _mm256_set1_epi32(high);
+					// Counts the elements outside of the range (as negative numbers)
+					__m256i acc = _mm256_setzero_si256();
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+						acc = _mm256_add_epi32(acc, out_of_range_mask(values, low_v, high_v));
+					}
+
+					alignas(32) std::int32_t lanes[8];
+					_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+					std::size_t outside = 0;
+					for (std::int32_t lane : lanes) {
+						outside += static_cast<std::size_t>(-static_cast<std::int64_t>(lane));
+					}
+					return (i - outside) + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				template<typename Handle>
+				COF_TARGET_AVX2 std::size_t select_in_range(const float* data, const Handle* handles, std::size_t count, float low, float high, Handle* out)
+				{
+					const __m256 low_v = _mm256_set1_ps(low);
+					const __m256 high_v = _mm256_set1_ps(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(in_range_mask(_mm256_loadu_ps(data + i), low_v, high_v)));
+						written += emit_selected(mask, handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+
+				template<typename Handle>
+				COF_TARGET_AVX2 std::size_t select_in_range(const double* data, const Handle* handles, std::size_t count, double low, double high, Handle* out)
+				{
+					const __m256d low_v = _mm256_set1_pd(low);
+					const __m256d high_v = _mm256_set1_pd(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 4 <= count; i += 4) {
+						unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(in_range_mask(_mm256_loadu_pd(data + i), low_v, high_v)));
+						written += emit_selected(mask, handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+
+				template<typename Handle>
+				COF_TARGET_AVX2 std::size_t select_in_range(const std::int32_t* data, const Handle* handles, std::size_t count, std::int32_t low, std::int32_t high, Handle* out)
+				{
+					const __m256i low_v = _mm256_set1_epi32(low);
+					const __m256i high_v = _mm256_set1_epi32(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 8 <= count; i += 8) {
+						__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+						unsigned outside = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(out_of_range_mask(values, low_v, high_v))));
+						written += emit_selected(~outside & 0xFFu, handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+			}
+
+			// AVX-512 compares write straight into a mask register, which removes the movemask step. Doubles are left to the AVX2 versions.
+			// The conversions and min/max use the zero masking forms with a full mask, and the sums are reduced through memory: GCC implements the plain forms and
+			// _mm512_reduce_add_* with a undefined source register, which -Wmaybe-uninitialized reports
+			namespace avx512
+			{
+				constexpr __mmask8 all_8_lanes = 0xFF;
+				constexpr __mmask16 all_16_lanes = 0xFFFF;
+
+				COF_TARGET_AVX512 inline double sum(const float* data, std::size_t count)
+				{
+					__m512d low_acc = _mm512_setzero_pd();
+					__m512d high_acc = _mm512_setzero_pd();
+					std::size_t i = 0;
+					for (; i + 16 <= count; i += 16) {
+						low_acc = _mm512_add_pd(low_acc, _mm512_maskz_cvtps_pd(all_8_lanes, _mm256_loadu_ps(data + i)));
+						high_acc = _mm512_add_pd(high_acc, _mm512_maskz_cvtps_pd(all_8_lanes, _mm256_loadu_ps(data + i + 8)));
+					}
+					alignas(64) double lanes[8];
+					_mm512_store_pd(lanes, _mm512_add_pd(low_acc, high_acc));
+					return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) + sum_scalar(data + i, count - i);
+				}
+
+				COF_TARGET_AVX512 inline std::int64_t sum(const std::int32_t* data, std::size_t count)
+				{
+					__m512i acc = _mm512_setzero_si512();
+					std::size_t i = 0;
+					for (; i + 16 <= count; i += 16) {
+						acc = _mm512_add_epi64(acc, _mm512_maskz_cvtepi32_epi64(all_8_lanes, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))));
+						acc = _mm512_add_epi64(acc, _mm512_maskz_cvtepi32_epi64(all_8_lanes, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 8))));
+					}
+					alignas(64) std::int64_t lanes[8];
+					_mm512_store_si512(lanes, acc);
+					return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7] + sum_scalar(data + i, count - i);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_AVX512 std::size_t extremum_index(const float* data, std::size_t count)
+				{
+					if (count < 16) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m512 best = _mm512_set1_ps(data[0]);
+					std::size_t i = 0;
+					for (; i + 16 <= count; i += 16) {
+						__m512 values = _mm512_loadu_ps(data + i);
+						best = FindMax ? _mm512_maskz_max_ps(all_16_lanes, values, best) : _mm512_maskz_min_ps(all_16_lanes, values, best);
+					}
+
+					alignas(64) float lanes[16];
+					_mm512_store_ps(lanes, best);
+					const float extreme = reduce_extreme<FindMax>(lanes, 16, data + i, count - i);
+
+					const __m512 target = _mm512_set1_ps(extreme);
+					for (i = 0; i + 16 <= count; i += 16) {
+						unsigned mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(data + i), target, _CMP_EQ_OQ);
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				template<bool FindMax>
+				COF_TARGET_AVX512 std::size_t extremum_index(const std::int32_t* data, std::size_t count)
+				{
+					if (count < 16) {
+						return extremum_index_scalar<FindMax>(data, count);
+					}
+
+					__m512i best = _mm512_loadu_si512(data);
+					std::size_t i = 16;
+					for (; i + 16 <= count; i += 16) {
+						__m512i values = _mm512_loadu_si512(data + i);
+						best = FindMax ? _mm512_maskz_max_epi32(all_16_lanes, values, best) : _mm512_maskz_min_epi32(all_16_lanes, values, best);
+					}
+
+					alignas(64) std::int32_t lanes[16];
+					_mm512_store_si512(lanes, best);
+					const std::int32_t extreme = reduce_extreme<FindMax>(lanes, 16, data + i, count - i);
+
+					const __m512i target = _mm512_set1_epi32(extreme);
+					for (i = 0; i + 16 <= count; i += 16) {
+						unsigned mask = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(data + i), target);
+						if (mask != 0) {
+							return i + count_trailing_zeros(mask);
+						}
+					}
+					return find_extreme_in_tail<FindMax>(data, i, count, extreme);
+				}
+
+				COF_TARGET_AVX512 inline unsigned in_range_mask(const float* data, __m512 low, __m512 high)
+				{
+					__m512 values = _mm512_loadu_ps(data);
+					return _mm512_cmp_ps_mask(values, low, _CMP_GE_OQ) & _mm512_cmp_ps_mask(values, high, _CMP_LE_OQ);
+				}
+
+				COF_TARGET_AVX512 inline unsigned in_range_mask(const std::int32_t* data, __m512i low, __m512i high)
+				{
+					__m512i values = _mm512_loadu_si512(data);
+					return _mm512_cmpge_epi32_mask(values, low) & _mm512_cmple_epi32_mask(values, high);
+				}
+
+				COF_TARGET_AVX512 inline std::size_t count_in_range(const float* data, std::size_t count, float low, float high)
+				{
+					const __m512 low_v = _mm512_set1_ps(low);
+					const __m512 high_v = _mm512_set1_ps(high);
+					std::size_t total = 0;
+					std::size_t i = 0;
+					for (; i + 16 <= count; i += 16) {
+						total += popcount(in_range_mask(data + i, low_v, high_v));
+					}
+					return total + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				COF_TARGET_AVX512 inline std::size_t count_in_range(const std::int32_t* data, std::size_t count, std::int32_t low, std::int32_t high)
+				{
+					const __m512i low_v = _mm512_set1_epi32(low);
+					const __m512i high_v = _mm512_set1_epi32(high);
+					std::size_t total = 0;
+					std::size_t i = 0;
+					for (; i + 16 <= count; i += 16) {
+						total += popcount(in_range_mask(data + i, low_v, high_v));
+					}
+					return total + count_in_range_scalar(data + i, count - i, low, high);
+				}
+
+				template<typename Handle>
+				COF_TARGET_AVX512 std::size_t select_in_range(const float* data, const Handle* handles, std::size_t count, float low, float high, Handle* out)
+				{
+					const __m512 low_v = _mm512_set1_ps(low);
+					const __m512 high_v = _mm512_set1_ps(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 16 <= count; i += 16) {
+						written += emit_selected(in_range_mask(data + i, low_v, high_v), handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+
+				template<typename Handle>
+				COF_TARGET_AVX512 std::size_t select_in_range(const std::int32_t* data, const Handle* handles, std::size_t count, std::int32_t low, std::int32_t high, Handle* out)
+				{
+					const __m512i low_v = _mm512_set1_epi32(low);
+					const __m512i high_v = _mm512_set1_epi32(high);
+					std::size_t written = 0;
+					std::size_t i = 0;
+					for (; i + 16 <= count; i += 16) {
+						written += emit_selected(in_range_mask(data + i, low_v, high_v), handles + i, out + written);
+					}
+					return written + select_in_range_scalar(data + i, handles + i, count - i, low, high, out + written);
+				}
+			}
+#endif // END: COF_SIMD_X86
+		}
+
+
+		template<typename T>
+		auto sum_scalar(const T* data, std::size_t count) -> sum_t<T>
+		{
+			sum_t<T> total{};
+			for (std::size_t i = 0; i < count; ++i) {
+				total += data[i];
+			}
+			return total;
+		}
+
+		template<typename T>
+		std::size_t min_index_scalar(const T* data, std::size_t count)
+		{
+			assert(count > 0);
+			std::size_t best = 0;
+			for (std::size_t i = 1; i < count; ++i) {
+				if (data[i] < data[best]) {
+					best = i;
+				}
+			}
+			return best;
+		}
+
+		template<typename T>
+		std::size_t max_index_scalar(const T* data, std::size_t count)
+		{
+			assert(count > 0);
+			std::size_t best = 0;
+			for (std::size_t i = 1; i < count; ++i) {
+				if (data[i] > data[best]) {
+					best = i;
+				}
+			}
+			return best;
+		}
+
+		template<typename T>
+		std::size_t count_in_range_scalar(const T* data, std::size_t count, T low, T high)
+		{
+			std::size_t in_range = 0;
+			for (std::size_t i = 0; i < count; ++i) {
+				in_range += (data[i] >= low && data[i] <= high) ? 1 : 0;
+			}
+			return in_range;
+		}
+
+		template<typename T, typename Handle>
+		std::size_t select_in_range_scalar(const T* data, const Handle* handles, std::size_t count, T low, T high, Handle* out)
+		{
+			std::size_t written = 0;
+			for (std::size_t i = 0; i < count; ++i) {
+				if (data[i] >= low && data[i] <= high) {
+					out[written++] = handles[i];
+				}
+			}
+			return written;
+		}
+
+
+		template<typename T>
+		auto sum(const T* data, std::size_t count) -> sum_t<T>
+		{
+			return sum_scalar(data, count);
+		}
+
+		inline double sum(const float* data, std::size_t count)
+		{
+			static const KernelVariants<double(*)(const float*, std::size_t)> variants{
+				&sum_scalar<float>, COF_SIMD_VARIANT(detail::sse42::sum), COF_SIMD_VARIANT(detail::avx2::sum), COF_SIMD_VARIANT(detail::avx512::sum) };
+			return variants.resolve()(data, count);
+		}
+
+		inline double sum(const double* data, std::size_t count)
+		{
+			static const KernelVariants<double(*)(const double*, std::size_t)> variants{
+				&sum_scalar<double>, COF_SIMD_VARIANT(detail::sse42::sum), COF_SIMD_VARIANT(detail::avx2::sum), nullptr };
+			return variants.resolve()(data, count);
+		}
+
+		inline std::int64_t sum(const std::int32_t* data, std::size_t count)
+		{
+			static const KernelVariants<std::int64_t(*)(const std::int32_t*, std::size_t)> variants{
+				&sum_scalar<std::int32_t>, COF_SIMD_VARIANT(detail::sse42::sum), COF_SIMD_VARIANT(detail::avx2::sum), COF_SIMD_VARIANT(detail::avx512::sum) };
+			return variants.resolve()(data, count);
+		}
+
+		template<typename T>
+		std::size_t min_index(const T* data, std::size_t count)
+		{
+			return min_index_scalar(data, count);
+		}
+
+		inline std::size_t min_index(const float* data, std::size_t count)
+		{
+			static const KernelVariants<std::size_t(*)(const float*, std::size_t)> variants{
+				&min_index_scalar<float>, COF_SIMD_VARIANT(detail::sse42::extremum_index<false>), COF_SIMD_VARIANT(detail::avx2::extremum_index<false>), COF_SIMD_VARIANT(detail::avx512::extremum_index<false>) };
+			return variants.resolve()(data, count);
+		}
+
+		inline std::size_t min_index(const double* data, std::size_t count)
+		{
+			static const KernelVariants<std::size_t(*)(const double*, std::size_t)> variants{
+				&min_index_scalar<double>, COF_SIMD_VARIANT(detail::sse42::extremum_index<false>), COF_SIMD_VARIANT(detail::avx2::extremum_index<false>), nullptr };
+			return variants.resolve()(data, count);
+		}
+
+		inline std::size_t min_index(const std::int32_t* data, std::size_t count)
+		{
+			static const KernelVariants<std::size_t(*)(const std::int32_t*, std::size_t)> variants{
+				&min_index_scalar<std::int32_t>, COF_SIMD_VARIANT(detail::sse42::extremum_index<false>), COF_SIMD_VARIANT(detail::avx2::extremum_index<false>), COF_SIMD_VARIANT(detail::avx512::extremum_index<false>) };
+			return variants.resolve()(data, count);
+		}
+
+		template<typename T>
+		std::size_t max_index(const T* data, std::size_t count)
+		{
+			return max_index_scalar(data, count);
+		}
+
+		inline std::size_t max_index(const float* data, std::size_t count)
+		{
+			static const KernelVariants<std::size_t(*)(const float*, std::size_t)> variants{
+				&max_index_scalar<float>, COF_SIMD_VARIANT(detail::sse42::extremum_index<true>), COF_SIMD_VARIANT(detail::avx2::extremum_index<true>), COF_SIMD_VARIANT(detail::avx512::extremum_index<true>) };
+			return variants.resolve()(data, count);
+		}
+
+		inline std::size_t max_index(const double* data, std::size_t count)
+		{
+			static const KernelVariants<std::size_t(*)(const double*, std::size_t)> variants{
+				&max_index_scalar<double>, COF_SIMD_VARIANT(detail::sse42::extremum_index<true>), COF_SIMD_VARIANT(detail::avx2::extremum_index<true>), nullptr };
+			return variants.resolve()(data, count);
+		}
+
+		inline std::size_t max_index(const std::int32_t* data, std::size_t count)
+		{
+			static const KernelVariants<std::size_t(*)(const std::int32_t*, std::size_t)> variants{
+				&max_index_scalar<std::int32_t>, COF_SIMD_VARIANT(detail::sse42::extremum_index<true>), COF_SIMD_VARIANT(detail::avx2::extremum_index<true>), COF_SIMD_VARIANT(detail::avx512::extremum_index<true>) };
+			return variants.resolve()(data, count);
+		}
+
+		template<typename T>
+		std::size_t count_in_range(const T* data, std::size_t count, T low, T high)
+		{
+			return count_in_range_scalar(data, count, low, high);
+		}
+
+		inline std::size_t count_in_range(const float* data, std::size_t count, float low, float high)
+		{
+			static const KernelVariants<std::size_t(*)(const float*, std::size_t, float, float)> variants{
+				&count_in_range_scalar<float>, COF_SIMD_VARIANT(detail::sse42::count_in_range), COF_SIMD_VARIANT(detail::avx2::count_in_range), COF_SIMD_VARIANT(detail::avx512::count_in_range) };
+			return variants.resolve()(data, count, low, high);
+		}
+
+		inline std::size_t count_in_range(const double* data, std::size_t count, double low, double high)
+		{
+			static const KernelVariants<std::size_t(*)(const double*, std::size_t, double, double)> variants{
+				&count_in_range_scalar<double>, COF_SIMD_VARIANT(detail::sse42::count_in_range), COF_SIMD_VARIANT(detail::avx2::count_in_range), nullptr };
+			return variants.resolve()(data, count, low, high);
+		}
+
+		inline std::size_t count_in_range(const std::int32_t* data, std::size_t count, std::int32_t low, std::int32_t high)
+		{
+			static const KernelVariants<std::size_t(*)(const std::int32_t*, std::size_t, std::int32_t, std::int32_t)> variants{
+				&count_in_range_scalar<std::int32_t>, COF_SIMD_VARIANT(detail::sse42::count_in_range), COF_SIMD_VARIANT(detail::avx2::count_in_range), COF_SIMD_VARIANT(detail::avx512::count_in_range) };
+			return variants.resolve()(data, count, low, high);
+		}
+
+		template<typename T, typename Handle>
+		std::size_t select_in_range(const T* data, const Handle* handles, std::size_t count, T low, T high, Handle* out)
+		{
+			return select_in_range_scalar(data, handles, count, low, high, out);
+		}
+
+		template<typename Handle>
+		std::size_t select_in_range(const float* data, const Handle* handles, std::size_t count, float low, float high, Handle* out)
+		{
+			static const KernelVariants<std::size_t(*)(const float*, const Handle*, std::size_t, float, float, Handle*)> variants{
+				&select_in_range_scalar<float, Handle>, COF_SIMD_VARIANT(detail::sse42::select_in_range<Handle>), COF_SIMD_VARIANT(detail::avx2::select_in_range<Handle>), COF_SIMD_VARIANT(detail::avx512::select_in_range<Handle>) };
+			return variants.resolve()(data, handles, count, low, high, out);
+		}
+
+		template<typename Handle>
+		std::size_t select_in_range(const double* data, const Handle* handles, std::size_t count, double low, double high, Handle* out)
+		{
+			static const KernelVariants<std::size_t(*)(const double*, const Handle*, std::size_t, double, double, Handle*)> variants{
+				&select_in_range_scalar<double, Handle>, COF_SIMD_VARIANT(detail::sse42::select_in_range<Handle>), COF_SIMD_VARIANT(detail::avx2::select_in_range<Handle>), nullptr };
+			return variants.resolve()(data, handles, count, low, high, out);
+		}
+
+		template<typename Handle>
+		std::size_t select_in_range(const std::int32_t* data, const Handle* handles, std::size_t count, std::int32_t low, std::int32_t high, Handle* out)
+		{
+			static const KernelVariants<std::size_t(*)(const std::int32_t*, const Handle*, std::size_t, std::int32_t, std::int32_t, Handle*)> variants{
+				&select_in_range_scalar<std::int32_t, Handle>, COF_SIMD_VARIANT(detail::sse42::select_in_range<Handle>), COF_SIMD_VARIANT(detail::avx2::select_in_range<Handle>), COF_SIMD_VARIANT(detail::avx512::select_in_range<Handle>) };
+			return variants.resolve()(data, handles, count, low, high, out);
+		}
+	}
+}
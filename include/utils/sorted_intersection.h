@@ -0,0 +1,302 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils/defines.h"
+#include "utils/cpu_dispatch.h"
+
+#if COF_SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+/* Intersection of two sorted arrays of unique 32 bit ids, used by flat_value_map_intersection.h
+ * For arrays of similar size the arrays are merged a block at a time, every id of a block from the first array is compared with every id of a block from the second array with SIMD compares.
+ * When one array is much smaller then the other, every id of the small array gallops (exponential search) through the big array instead.
+ * The AVX2 version of the galloping search ends with one SIMD compare of the last 8 candidates instead of the last 3 steps of the binary search.
+ */
+namespace cof
+{
+	namespace simd
+	{
+		// Intersect the sorted unique arrays `first` and `second`. For every id that is in both, the position in `first` is written to `first_positions` and the position in `second` to `second_positions`.
+		// Both output arrays need room for the size of the smallest input. The matches are written in ascending id order.
+		// \returns the amount of matches
+		std::size_t intersect_sorted(const std::uint32_t* first, std::size_t first_count, const std::uint32_t* second, std::size_t second_count,
+			std::uint32_t* first_positions, std::uint32_t* second_positions);
+
+		// The scalar merge, also used for the tails of the vectorized versions
+		std::size_t intersect_sorted_scalar(const std::uint32_t* first, std::size_t first_count, const std::uint32_t* second, std::size_t second_count,
+			std::uint32_t* first_positions, std::uint32_t* second_positions);
+		// Search every id of `small` in `big` with an exponential search. Positions are written like intersect_sorted(), dispatches to the best variant for the active SimdLevel
+		std::size_t intersect_sorted_galloping(const std::uint32_t* small, std::size_t small_count, const std::uint32_t* big, std::size_t big_count,
+			std::uint32_t* small_positions, std::uint32_t* big_positions);
+		// The scalar exponential search
+		std::size_t intersect_sorted_galloping_scalar(const std::uint32_t* small, std::size_t small_count, const std::uint32_t* big, std::size_t big_count,
+			std::uint32_t* small_positions, std::uint32_t* big_positions);
+	}
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	namespace simd
+	{
+		namespace detail
+		{
+			// Galloping pays off once one array is this many times bigger then the other
+			static const std::size_t galloping_ratio = 32;
+
+			inline unsigned intersection_trailing_zeros(unsigned bits)
+			{
+#if defined(_MSC_VER)
+				unsigned long index;
+				_BitScanForward(&index, bits);
+				return static_cast<unsigned>(index);
+#else
+				return static_cast<unsigned>(__builtin_ctz(bits));
+#endif
+			}
+
+			// Continue with the scalar merge after a vectorized kernel, offsetting the written positions
+			inline std::size_t intersect_tail(const std::uint32_t* first, std::size_t first_count, std::size_t i,
+				const std::uint32_t* second, std::size_t second_count, std::size_t j,
+				std::uint32_t* first_positions, std::uint32_t* second_positions, std::size_t written)
+			{
+				std::size_t tail_written = intersect_sorted_scalar(first + i, first_count - i, second + j, second_count - j, first_positions + written, second_positions + written);
+				for (std::size_t k = written; k < written + tail_written; ++k) {
+					first_positions[k] += static_cast<std::uint32_t>(i);
+					second_positions[k] += static_cast<std::uint32_t>(j);
+				}
+				return written + tail_written;
+			}
+
+#if COF_SIMD_X86
+			namespace sse42
+			{
+				// Compares a block of 4 with all 4 rotations of the other block
+				COF_TARGET_SSE42 inline std::size_t intersect_sorted(const std::uint32_t* first, std::size_t first_count, const std::uint32_t* second, std::size_t second_count,
+					std::uint32_t* first_positions, std::uint32_t* second_positions)
+				{
+					std::size_t i = 0, j = 0, written = 0;
+					while (i + 4 <= first_count && j + 4 <= second_count) {
+						const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+						const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + j));
+						// Lane k of rotation r holds second[j + (k + r) % 4]
+						const __m128i b1 = _mm_shuffle_epi32(b0, _MM_SHUFFLE(0, 3, 2, 1));
+						const __m128i b2 = _mm_shuffle_epi32(b0, _MM_SHUFFLE(1, 0, 3, 2));
+						const __m128i b3 = _mm_shuffle_epi32(b0, _MM_SHUFFLE(2, 1, 0, 3));
+						const unsigned masks[4] = {
+							static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b0)))),
+							static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b1)))),
+							static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b2)))),
+							static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b3)))),
+						};
+
+						unsigned matched = masks[0] | masks[1] | masks[2] | masks[3];
+						while (matched != 0) {
+							unsigned lane = intersection_trailing_zeros(matched);
+							unsigned rotation = 0;
+							while ((masks[rotation] & (1u << lane)) == 0) {
+								++rotation;
+							}
+							first_positions[written] = static_cast<std::uint32_t>(i + lane);
+							second_positions[written] = static_cast<std::uint32_t>(j + (lane + rotation) % 4);
+							++written;
+							matched &= matched - 1;
+						}
+
+						const std::uint32_t first_max = first[i + 3];
+						const std::uint32_t second_max = second[j + 3];
+						i += first_max <= second_max ? 4 : 0;
+						j += second_max <= first_max ? 4 : 0;
+					}
+					return intersect_tail(first, first_count, i, second, second_count, j, first_positions, second_positions, written);
+				}
+			}
+
+			namespace avx2
+			{
+				// Compares a block of 8 with all 8 rotations of the other block
+				COF_TARGET_AVX2 inline std::size_t intersect_sorted(const std::uint32_t* first, std::size_t first_count, const std::uint32_t* second, std::size_t second_count,
+					std::uint32_t* first_positions, std::uint32_t* second_positions)
+				{
+					const __m256i rotate_by_one = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+					std::size_t i = 0, j = 0, written = 0;
+					while (i + 8 <= first_count && j + 8 <= second_count) {
+						const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i));
+						__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + j));
+
+						// Lane k of rotation r holds second[j + (k + r) % 8]
+						unsigned masks[8];
+						unsigned matched = 0;
+						for (int rotation = 0; rotation < 8; ++rotation) {
+							masks[rotation] = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))));
+							matched |= masks[rotation];
+							b = _mm256_permutevar8x32_epi32(b, rotate_by_one);
+						}
+
+						while (matched != 0) {
+							unsigned lane = intersection_trailing_zeros(matched);
+							unsigned rotation = 0;
+							while ((masks[rotation] & (1u << lane)) == 0) {
+								++rotation;
+							}
+							first_positions[written] = static_cast<std::uint32_t>(i + lane);
+							second_positions[written] = static_cast<std::uint32_t>(j + (lane + rotation) % 8);
+							++written;
+							matched &= matched - 1;
+						}
+
+						const std::uint32_t first_max = first[i + 7];
+						const std::uint32_t second_max = second[j + 7];
+						i += first_max <= second_max ? 8 : 0;
+						j += second_max <= first_max ? 8 : 0;
+					}
+					return intersect_tail(first, first_count, i, second, second_count, j, first_positions, second_positions, written);
+				}
+
+				// Gallops like intersect_sorted_galloping_scalar(), and once at most 8 candidates are left counts the ones below the id with one compare
+				COF_TARGET_AVX2 inline std::size_t intersect_sorted_galloping(const std::uint32_t* small, std::size_t small_count, const std::uint32_t* big, std::size_t big_count,
+					std::uint32_t* small_positions, std::uint32_t* big_positions)
+				{
+					// The compare is signed, flipping the sign bit of both sides orders unsigned ids correctly
+					const __m256i sign_bit = _mm256_set1_epi32(static_cast<int>(0x80000000u));
+					std::size_t written = 0;
+					std::size_t low = 0;
+					for (std::size_t i = 0; i < small_count && low < big_count; ++i) {
+						const std::uint32_t id = small[i];
+
+						std::size_t step = 1;
+						std::size_t high = low;
+						while (high < big_count && big[high] < id) {
+							low = high;
+							high += step;
+							step *= 2;
+						}
+						if (high > big_count) {
+							high = big_count;
+						}
+						while (high - low > 8) {
+							std::size_t middle = low + (high - low) / 2;
+							if (big[middle] < id) {
+								low = middle + 1;
+							} else {
+								high = middle;
+							}
+						}
+						if (high - low == 8) {
+							const __m256i candidates = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(big + low)), sign_bit);
+							const __m256i needle = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(id)), sign_bit);
+							// The candidates are sorted, so the lanes below the id are the lowest lanes
+							unsigned below = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, candidates))));
+							low += intersection_trailing_zeros(~below);
+						} else {
+							while (low < high && big[low] < id) {
+								++low;
+							}
+						}
+
+						if (low < big_count && big[low] == id) {
+							small_positions[written] = static_cast<std::uint32_t>(i);
+							big_positions[written] = static_cast<std::uint32_t>(low);
+							++written;
+							++low;
+						}
+					}
+					return written;
+				}
+			}
+#endif // END: COF_SIMD_X86
+		}
+
+
+		inline std::size_t intersect_sorted_scalar(const std::uint32_t* first, std::size_t first_count, const std::uint32_t* second, std::size_t second_count,
+			std::uint32_t* first_positions, std::uint32_t* second_positions)
+		{
+			std::size_t i = 0, j = 0, written = 0;
+			while (i < first_count && j < second_count) {
+				if (first[i] < second[j]) {
+					++i;
+				} else if (second[j] < first[i]) {
+					++j;
+				} else {
+					first_positions[written] = static_cast<std::uint32_t>(i);
+					second_positions[written] = static_cast<std::uint32_t>(j);
+					++written;
+					++i;
+					++j;
+				}
+			}
+			return written;
+		}
+
+		inline std::size_t intersect_sorted_galloping_scalar(const std::uint32_t* small, std::size_t small_count, const std::uint32_t* big, std::size_t big_count,
+			std::uint32_t* small_positions, std::uint32_t* big_positions)
+		{
+			std::size_t written = 0;
+			std::size_t low = 0;
+			for (std::size_t i = 0; i < small_count && low < big_count; ++i) {
+				const std::uint32_t id = small[i];
+
+				// Gallop until big[high] >= id, then binary search in (low, high]
+				std::size_t step = 1;
+				std::size_t high = low;
+				while (high < big_count && big[high] < id) {
+					low = high;
+					high += step;
+					step *= 2;
+				}
+				if (high > big_count) {
+					high = big_count;
+				}
+				while (low < high) {
+					std::size_t middle = low + (high - low) / 2;
+					if (big[middle] < id) {
+						low = middle + 1;
+					} else {
+						high = middle;
+					}
+				}
+
+				if (low < big_count && big[low] == id) {
+					small_positions[written] = static_cast<std::uint32_t>(i);
+					big_positions[written] = static_cast<std::uint32_t>(low);
+					++written;
+					++low;
+				}
+			}
+			return written;
+		}
+
+		inline std::size_t intersect_sorted_galloping(const std::uint32_t* small, std::size_t small_count, const std::uint32_t* big, std::size_t big_count,
+			std::uint32_t* small_positions, std::uint32_t* big_positions)
+		{
+			using GallopFunction = std::size_t(*)(const std::uint32_t*, std::size_t, const std::uint32_t*, std::size_t, std::uint32_t*, std::uint32_t*);
+			static const KernelVariants<GallopFunction> variants{
+				&intersect_sorted_galloping_scalar, nullptr, COF_SIMD_VARIANT(detail::avx2::intersect_sorted_galloping), nullptr };
+			return variants.resolve()(small, small_count, big, big_count, small_positions, big_positions);
+		}
+
+		inline std::size_t intersect_sorted(const std::uint32_t* first, std::size_t first_count, const std::uint32_t* second, std::size_t second_count,
+			std::uint32_t* first_positions, std::uint32_t* second_positions)
+		{
+			if (first_count * detail::galloping_ratio < second_count) {
+				return intersect_sorted_galloping(first, first_count, second, second_count, first_positions, second_positions);
+			}
+			if (second_count * detail::galloping_ratio < first_count) {
+				return intersect_sorted_galloping(second, second_count, first, first_count, second_positions, first_positions);
+			}
+
+			using IntersectFunction = std::size_t(*)(const std::uint32_t*, std::size_t, const std::uint32_t*, std::size_t, std::uint32_t*, std::uint32_t*);
+			static const KernelVariants<IntersectFunction> variants{
+				&intersect_sorted_scalar, COF_SIMD_VARIANT(detail::sse42::intersect_sorted), COF_SIMD_VARIANT(detail::avx2::intersect_sorted), nullptr };
+			return variants.resolve()(first, first_count, second, second_count, first_positions, second_positions);
+		}
+	}
+}
@@ -0,0 +1,228 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+namespace cof
+{
+	/** \brief A fixed set of worker threads that split parallel loops in chunks and steal chunks from each other.
+	 *
+	 * \class WorkStealingPool
+	 *
+	 * parallel_for() deals the chunks of a loop out over one queue per thread. Every thread takes chunks from the back of it's own queue,
+	 * and when that is empty it steals from the front of the queue of a other thread, so a thread that got the slow chunks does not hold up the rest.
+	 * The calling thread works on the loop as well, and parallel_for() returns when every chunk is done.
+	 * A pool runs one loop at a time, parallel_for() must not be called from inside a loop body or from two threads at once.
+	 * When a chunk throws, the chunks that did not start yet are skipped, and parallel_for() rethrows the first exception after every chunk is done.
+	*/
+	class WorkStealingPool
+	{
+	public:
+		// Start `thread_count - 1` workers, the calling thread of parallel_for() is the last one. 0 uses std::thread::hardware_concurrency()
+		explicit WorkStealingPool(std::size_t thread_count = 0);
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+		~WorkStealingPool();
+
+		// The amount of threads that work on a loop, including the calling thread
+		std::size_t thread_count() const;
+
+		// Call `f(std::size_t begin, std::size_t end)` for the ranges [0, grain), [grain, 2 * grain), ... until `count`, on all threads of the pool
+		template<typename Func>
+		void parallel_for(std::size_t count, std::size_t grain, Func&& f);
+
+	private:
+		struct Job
+		{
+			void (*run)(void* body, std::size_t begin, std::size_t end);
+			void* body;
+			std::atomic<std::size_t> remaining_chunks;
+			// Set under `mutex` by the first chunk that throws
+			std::exception_ptr error;
+			std::atomic<bool> failed{ false };
+		};
+
+		struct Chunk
+		{
+			Job* job;
+			std::size_t begin;
+			std::size_t end;
+		};
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Chunk> chunks;
+		};
+
+		// One queue per worker, the last one is for the calling thread
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+
+		std::mutex mutex;
+		std::condition_variable work_available;
+		std::condition_variable job_done;
+		// The amount of chunks in all queues, the workers sleep while it is 0
+		std::atomic<std::size_t> queued_chunks{ 0 };
+		bool stopping = false;
+
+		void worker_loop(std::size_t queue_index);
+		// Take a chunk from the own queue, or steal one
+		bool take_chunk(std::size_t queue_index, Chunk& chunk);
+		void run_chunk(const Chunk& chunk);
+	};
+}
+
+
+//=============================================================================
+//                         IMPLEMENTATION:
+//=============================================================================
+
+namespace cof
+{
+	inline WorkStealingPool::WorkStealingPool(std::size_t thread_count)
+	{
+		if (thread_count == 0) {
+			thread_count = std::thread::hardware_concurrency();
+		}
+		if (thread_count == 0) {
+			thread_count = 1;
+		}
+		for (std::size_t i = 0; i < thread_count; ++i) {
+			queues.emplace_back(new Queue{});
+		}
+		for (std::size_t i = 0; i + 1 < thread_count; ++i) {
+			workers.emplace_back([this, i]() { worker_loop(i); });
+		}
+	}
+
+	inline WorkStealingPool::~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		work_available.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	inline std::size_t WorkStealingPool::thread_count() const
+	{
+		return queues.size();
+	}
+
+	template<typename Func>
+	void WorkStealingPool::parallel_for(std::size_t count, std::size_t grain, Func&& f)
+	{
+		if (count == 0) {
+			return;
+		}
+		if (grain == 0) {
+			grain = 1;
+		}
+		std::size_t chunk_count = (count + grain - 1) / grain;
+		Job job;
+		job.run = [](void* body, std::size_t begin, std::size_t end) { (*static_cast<typename std::remove_reference<Func>::type*>(body))(begin, end); };
+		job.body = const_cast<void*>(static_cast<const void*>(&f));
+		job.remaining_chunks = chunk_count;
+
+		// Counted before they are queued, so a worker that takes one right away never sees a count below 0
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			queued_chunks += chunk_count;
+		}
+		// Deal neighbouring chunks to the same queue, so a thread that does not steal walks through memory in order
+		std::size_t per_queue = (chunk_count + queues.size() - 1) / queues.size();
+		for (std::size_t q = 0; q < queues.size(); ++q) {
+			std::lock_guard<std::mutex> lock{ queues[q]->mutex };
+			for (std::size_t c = q * per_queue; c < (q + 1) * per_queue && c < chunk_count; ++c) {
+				std::size_t begin = c * grain;
+				queues[q]->chunks.push_front(Chunk{ &job, begin, begin + grain < count ? begin + grain : count });
+			}
+		}
+		work_available.notify_all();
+
+		Chunk chunk;
+		while (take_chunk(queues.size() - 1, chunk)) {
+			run_chunk(chunk);
+		}
+		std::unique_lock<std::mutex> lock{ mutex };
+		job_done.wait(lock, [&job]() { return job.remaining_chunks == 0; });
+		if (job.error) {
+			std::rethrow_exception(job.error);
+		}
+	}
+
+	inline void WorkStealingPool::worker_loop(std::size_t queue_index)
+	{
+		while (true) {
+			Chunk chunk;
+			if (take_chunk(queue_index, chunk)) {
+				run_chunk(chunk);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock{ mutex };
+			work_available.wait(lock, [this]() { return stopping || queued_chunks != 0; });
+			if (stopping) {
+				return;
+			}
+		}
+	}
+
+	inline bool WorkStealingPool::take_chunk(std::size_t queue_index, Chunk& chunk)
+	{
+		// The chunks were pushed to the front, so the back of the own queue is the first chunk
+		{
+			Queue& own = *queues[queue_index];
+			std::lock_guard<std::mutex> lock{ own.mutex };
+			if (!own.chunks.empty()) {
+				chunk = own.chunks.back();
+				own.chunks.pop_back();
+				--queued_chunks;
+				return true;
+			}
+		}
+		for (std::size_t i = 1; i < queues.size(); ++i) {
+			Queue& victim = *queues[(queue_index + i) % queues.size()];
+			std::lock_guard<std::mutex> lock{ victim.mutex };
+			if (!victim.chunks.empty()) {
+				chunk = victim.chunks.front();
+				victim.chunks.pop_front();
+				--queued_chunks;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline void WorkStealingPool::run_chunk(const Chunk& chunk)
+	{
+		Job& job = *chunk.job;
+		if (!job.failed) {
+			try {
+				job.run(job.body, chunk.begin, chunk.end);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock{ mutex };
+				if (!job.error) {
+					job.error = std::current_exception();
+				}
+				job.failed = true;
+			}
+		}
+		// The job lives on the stack of parallel_for(), it can be gone as soon as the last chunk is counted
+		if (--job.remaining_chunks == 0) {
+			std::lock_guard<std::mutex> lock{ mutex };
+			job_done.notify_all();
+		}
+	}
+}
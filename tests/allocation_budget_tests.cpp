@@ -0,0 +1,142 @@
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "light_flat_value_map.h"
+#include "utils/counting_allocator.h"
+
+
+using namespace cof;
+
+struct LedgerEntry { std::uint64_t id; double balance; };
+struct LedgerEntryTag;
+struct LightLedgerEntryTag;
+struct PooledLedgerEntryTag;
+struct ReservedLedgerEntryTag;
+struct CountedVectorTag;
+
+using LedgerMap = FlatValueMap<FvmHandle<LedgerEntryTag>, LedgerEntry, CountingAllocator<LedgerEntry, LedgerEntryTag>>;
+using LightLedgerMap = LightFlatValueMap<LfvmHandle<LightLedgerEntryTag>, LedgerEntry, CountingAllocator<LedgerEntry, LightLedgerEntryTag>>;
+using PooledLedgerMap = FlatValueMap<FvmHandle<PooledLedgerEntryTag>, LedgerEntry, CountingAllocator<LedgerEntry, PooledLedgerEntryTag>>;
+using ReservedLedgerMap = FlatValueMap<FvmHandle<ReservedLedgerEntryTag>, LedgerEntry, CountingAllocator<LedgerEntry, ReservedLedgerEntryTag>>;
+
+// Erase the oldest element and push a new one `operations` times, the size of the map stays the same
+// Adds the counts of the erases to `erases` and of the push_backs to `inserts`
+template<typename Tag, typename Map>
+static void churn(Map& map, std::vector<typename Map::HandleType>& handles, std::size_t operations, AllocationCounts& erases, AllocationCounts& inserts)
+{
+	for (std::size_t i = 0; i < operations; ++i) {
+		std::size_t oldest = i % handles.size();
+		AllocationCounts before = allocation_counts<Tag>();
+		map.erase(handles[oldest]);
+		AllocationCounts between = allocation_counts<Tag>();
+		handles[oldest] = map.push_back(LedgerEntry{ i, 0.0 });
+		AllocationCounts after = allocation_counts<Tag>();
+
+		AllocationCounts erase = between - before;
+		AllocationCounts insert = after - between;
+		erases.allocations += erase.allocations;
+		erases.allocated_bytes += erase.allocated_bytes;
+		inserts.allocations += insert.allocations;
+		inserts.allocated_bytes += insert.allocated_bytes;
+	}
+}
+
+
+TEST_CASE("CountingAllocator counts the allocations and bytes of it's Tag")
+{
+	AllocationCounts before = allocation_counts<CountedVectorTag>();
+	{
+		std::vector<std::uint32_t, CountingAllocator<std::uint32_t, CountedVectorTag>> numbers{};
+		numbers.reserve(100);
+		numbers.push_back(1);
+	}
+	AllocationCounts counted = allocation_counts<CountedVectorTag>() - before;
+	CHECK(counted.allocations == 1);
+	CHECK(counted.deallocations == 1);
+	CHECK(counted.allocated_bytes == 100 * sizeof(std::uint32_t));
+	CHECK(counted.deallocated_bytes == counted.allocated_bytes);
+
+	CountingAllocator<double, CountedVectorTag> rebound{ CountingAllocator<std::uint32_t, CountedVectorTag>{} };
+	CHECK(rebound == CountingAllocator<double, CountedVectorTag>{});
+}
+
+TEST_CASE("Steady state erase does not allocate and push_back only allocates the sparse_to_dense node")
+{
+	const std::size_t size = 1000;
+	const std::size_t operations = 20000;
+
+	SECTION("FlatValueMap")
+	{
+		LedgerMap ledger{};
+		std::vector<LedgerMap::HandleType> handles;
+		for (std::uint64_t i = 0; i < size; ++i) {
+			handles.push_back(ledger.push_back(LedgerEntry{ i, 0.0 }));
+		}
+		AllocationCounts erases{};
+		AllocationCounts inserts{};
+		churn<LedgerEntryTag>(ledger, handles, operations, erases, inserts);
+		CHECK(erases.allocations == 0);
+		CHECK(inserts.allocations == operations);
+		// One hash node: the handle, the index, the next pointer and maybe the cached hash
+		CHECK(inserts.allocated_bytes <= operations * 32);
+	}
+
+	SECTION("FlatValueMap with a value pool")
+	{
+		PooledLedgerMap ledger{};
+		ledger.enable_value_pool();
+		std::vector<PooledLedgerMap::HandleType> handles;
+		for (std::uint64_t i = 0; i < size; ++i) {
+			handles.push_back(ledger.push_back(LedgerEntry{ i, 0.0 }));
+		}
+		AllocationCounts erases{};
+		AllocationCounts inserts{};
+		churn<PooledLedgerEntryTag>(ledger, handles, operations, erases, inserts);
+		CHECK(erases.allocations == 0);
+		CHECK(inserts.allocations == operations);
+	}
+
+	SECTION("LightFlatValueMap")
+	{
+		LightLedgerMap ledger{};
+		std::vector<LightLedgerMap::HandleType> handles;
+		for (std::uint64_t i = 0; i < size; ++i) {
+			handles.push_back(ledger.push_back(LedgerEntry{ i, 0.0 }));
+		}
+		AllocationCounts erases{};
+		AllocationCounts inserts{};
+		churn<LightLedgerEntryTag>(ledger, handles, operations, erases, inserts);
+		CHECK(erases.allocations == 0);
+		CHECK(inserts.allocations == operations);
+	}
+}
+
+TEST_CASE("FlatValueMap::reserve() leaves only the node allocations to push_back")
+{
+	const std::size_t count = 50000;
+
+	AllocationCounts grown_before = allocation_counts<LedgerEntryTag>();
+	{
+		LedgerMap ledger{};
+		for (std::uint64_t i = 0; i < count; ++i) {
+			ledger.push_back(LedgerEntry{ i, 0.0 });
+		}
+	}
+	AllocationCounts grown = allocation_counts<LedgerEntryTag>() - grown_before;
+	// The nodes, and a logarithmic amount of reallocations and rehashes
+	CHECK(grown.allocations > count);
+	CHECK(grown.allocations <= count + 3 * 64);
+	CHECK(grown.deallocations == grown.allocations);
+
+	ReservedLedgerMap ledger{};
+	ledger.reserve(count);
+	AllocationCounts before = allocation_counts<ReservedLedgerEntryTag>();
+	for (std::uint64_t i = 0; i < count; ++i) {
+		ledger.push_back(LedgerEntry{ i, 0.0 });
+	}
+	AllocationCounts reserved = allocation_counts<ReservedLedgerEntryTag>() - before;
+	CHECK(reserved.allocations == count);
+	CHECK(reserved.deallocations == 0);
+}
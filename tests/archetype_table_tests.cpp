@@ -0,0 +1,174 @@
+#include <catch2/catch.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "archetype_table.h"
+
+
+using namespace cof;
+
+struct EntityTag;
+using EntityHandle = FvmHandle<EntityTag>;
+
+struct Position { float x, y; };
+struct Velocity { float x, y; };
+struct Name { std::string value; };
+
+
+TEST_CASE("ArchetypeTable stores entities with different component sets")
+{
+	ArchetypeTable<EntityHandle> table{};
+	EntityHandle moving = table.create(Position{ 0, 0 }, Velocity{ 1, 2 });
+	EntityHandle still = table.create(Position{ 5, 5 });
+	EntityHandle named = table.create(Name{ "Jhon" }, Position{ 1, 1 }, Velocity{ -1, 0 });
+
+	CHECK(table.size() == 3);
+	CHECK(table.archetype_count() == 4);
+	CHECK(table.has<Velocity>(moving));
+	CHECK_FALSE(table.has<Velocity>(still));
+	CHECK(table.get<Name>(named).value == "Jhon");
+	CHECK(table.try_get<Name>(moving) == nullptr);
+
+	int visited = 0;
+	table.for_each<Position, Velocity>([&](EntityHandle, Position& position, Velocity& velocity) {
+		position.x += velocity.x;
+		position.y += velocity.y;
+		++visited;
+	});
+	CHECK(visited == 2);
+	CHECK(table.get<Position>(moving).x == 1);
+	CHECK(table.get<Position>(moving).y == 2);
+	CHECK(table.get<Position>(named).x == 0);
+	CHECK(table.get<Position>(still).x == 5);
+
+	std::size_t chunks = 0;
+	std::size_t rows = 0;
+	table.for_each_chunk<Position>([&](std::size_t count, const EntityHandle*, Position*) {
+		++chunks;
+		rows += count;
+	});
+	CHECK(chunks == 3);
+	CHECK(rows == 3);
+}
+
+TEST_CASE("ArchetypeTable queries with const components visit the same entities")
+{
+	ArchetypeTable<EntityHandle> table{};
+	table.create(Position{ 1, 0 }, Velocity{ 1, 2 });
+	table.create(Position{ 2, 0 });
+	table.create(Name{ "Jhon" }, Position{ 3, 0 }, Velocity{ -1, 0 });
+
+	int visited = 0;
+	float velocity_sum = 0;
+	table.for_each<Position, const Velocity>([&](EntityHandle, Position& position, const Velocity& velocity) {
+		position.y = velocity.x;
+		velocity_sum += velocity.x;
+		++visited;
+	});
+	CHECK(visited == 2);
+	CHECK(velocity_sum == 0);
+
+	float position_sum = 0;
+	table.for_each_chunk<const Position>([&](std::size_t count, const EntityHandle*, const Position* positions) {
+		for (std::size_t i = 0; i < count; ++i) {
+			position_sum += positions[i].x;
+		}
+	});
+	CHECK(position_sum == 6);
+}
+
+TEST_CASE("ArchetypeTable moves rows when components are added and removed")
+{
+	ArchetypeTable<EntityHandle> table{};
+	std::vector<EntityHandle> handles;
+	for (int i = 0; i < 20; ++i) {
+		handles.push_back(table.create(Position{ static_cast<float>(i), 0 }));
+	}
+
+	// Every other entity starts moving, the rows left behind are filled with swap erase
+	for (int i = 0; i < 20; i += 2) {
+		table.add<Velocity>(handles[i], Velocity{ 1, 0 });
+	}
+	std::size_t archetypes_after_first_add = table.archetype_count();
+	for (int i = 0; i < 20; ++i) {
+		CHECK(table.get<Position>(handles[i]).x == static_cast<float>(i));
+		CHECK(table.has<Velocity>(handles[i]) == (i % 2 == 0));
+	}
+
+	// Adding a existing component assigns it
+	table.add<Velocity>(handles[0], Velocity{ 3, 0 });
+	CHECK(table.get<Velocity>(handles[0]).x == 3);
+
+	for (int i = 0; i < 20; i += 4) {
+		table.remove<Velocity>(handles[i]);
+	}
+	CHECK(table.archetype_count() == archetypes_after_first_add);
+	int moving = 0;
+	table.for_each<Velocity>([&](EntityHandle handle, Velocity&) {
+		CHECK(table.has<Position>(handle));
+		++moving;
+	});
+	CHECK(moving == 5);
+
+	table.destroy(handles[1]);
+	CHECK_FALSE(table.contains(handles[1]));
+	CHECK(table.size() == 19);
+	for (int i = 2; i < 20; ++i) {
+		CHECK(table.get<Position>(handles[i]).x == static_cast<float>(i));
+	}
+}
+
+TEST_CASE("ArchetypeTable destroys components with resources")
+{
+	auto shared = std::make_shared<int>(5);
+	{
+		ArchetypeTable<EntityHandle> table{};
+		EntityHandle first = table.create(shared);
+		EntityHandle second = table.create(shared, Name{ "Marie" });
+		CHECK(shared.use_count() == 3);
+
+		table.remove<std::shared_ptr<int>>(second);
+		CHECK(shared.use_count() == 2);
+		CHECK(table.get<Name>(second).value == "Marie");
+
+		table.add<std::shared_ptr<int>>(second, shared);
+		table.destroy(first);
+		CHECK(shared.use_count() == 2);
+	}
+	CHECK(shared.use_count() == 1);
+}
+
+TEST_CASE("ArchetypeTable keeps the entity in it's archetype when adding a component throws")
+{
+	struct Fragile
+	{
+		explicit Fragile(bool fail) { if (fail) { throw std::runtime_error{ "fragile" }; } }
+	};
+	static_assert(!detail::are_distinct<Position, Name, Position>::value, "create() rejects duplicate component types");
+	static_assert(detail::are_distinct<Position, Velocity, Name>::value, "create() accepts distinct component types");
+
+	ArchetypeTable<EntityHandle> table{};
+	EntityHandle first = table.create(Position{ 1, 2 }, Name{ "first" });
+	EntityHandle second = table.create(Position{ 3, 4 }, Name{ "second" });
+	table.add<Fragile>(second, false);
+
+	CHECK_THROWS_AS(table.add<Fragile>(first, true), std::runtime_error);
+	CHECK_FALSE(table.has<Fragile>(first));
+	CHECK(table.get<Position>(first).x == 1);
+	CHECK(table.get<Name>(first).value == "first");
+	CHECK(table.has<Fragile>(second));
+	CHECK(table.get<Name>(second).value == "second");
+
+	int fragile = 0;
+	table.for_each<Fragile, Name>([&](EntityHandle handle, Fragile&, Name& name) {
+		CHECK(handle == second);
+		CHECK(name.value == "second");
+		++fragile;
+	});
+	CHECK(fragile == 1);
+	table.add<Fragile>(first, false);
+	CHECK(table.get<Name>(first).value == "first");
+	CHECK(table.size() == 2);
+}
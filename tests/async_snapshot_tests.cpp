@@ -0,0 +1,87 @@
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "async_snapshot.h"
+
+
+using namespace cof;
+
+struct Position { float x, y, z; };
+struct PositionTag;
+
+using PositionHandle = FvmHandle<PositionTag>;
+using Positions = FlatValueMap<PositionHandle, Position>;
+
+static std::string async_snapshot_path(const char* name)
+{
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+
+TEST_CASE("async_snapshot saves the elements as they were when it was called")
+{
+	std::string path = async_snapshot_path("cof_async_snapshot.snapshot");
+	Positions positions{};
+	std::vector<PositionHandle> handles;
+	for (int i = 0; i < 20000; ++i) {
+		handles.push_back(positions.push_back(Position{ static_cast<float>(i), 0, 0 }));
+	}
+
+	auto saved = async_snapshot(path, positions, 1, SnapshotEncoding::compressed);
+
+	// The map can be changed right away, the snapshot has the old elements
+	for (PositionHandle handle : handles) {
+		positions[handle].y = 1;
+	}
+	positions.erase(handles[0]);
+	REQUIRE(saved.get());
+
+	Positions loaded{};
+	REQUIRE(load_snapshot(path, loaded));
+	CHECK(loaded.size() == handles.size());
+	CHECK(loaded.contains(handles[0]));
+	for (PositionHandle handle : handles) {
+		CHECK(loaded[handle].y == 0);
+	}
+
+	std::remove(path.c_str());
+}
+
+TEST_CASE("AsyncSnapshotWriter reuses it's buffers for every snapshot")
+{
+	std::string first_path = async_snapshot_path("cof_async_writer_1.snapshot");
+	std::string second_path = async_snapshot_path("cof_async_writer_2.snapshot");
+	Positions positions{};
+	for (int i = 0; i < 1000; ++i) {
+		positions.push_back(Position{ static_cast<float>(i), 1, 2 });
+	}
+
+	AsyncSnapshotWriter<PositionHandle, Position> writer{};
+	CHECK_FALSE(writer.wait());
+
+	writer.start(first_path, positions);
+	positions.push_back(Position{ -1, -1, -1 });
+	// Waits for the first snapshot before the buffers are overwritten
+	writer.start(second_path, positions, 2);
+	CHECK(writer.wait());
+	CHECK_FALSE(writer.busy());
+	// The result was returned, there is nothing left to wait for
+	CHECK_FALSE(writer.wait());
+
+	Positions first{};
+	Positions second{};
+	SnapshotInfo second_info{};
+	REQUIRE(load_snapshot(first_path, first));
+	REQUIRE(load_snapshot(second_path, second, &second_info));
+	CHECK(first.size() == 1000);
+	CHECK(second.size() == 1001);
+	CHECK(second_info.generation == 2);
+	CHECK(writer.last_capture_time().count() >= 0);
+
+	std::remove(first_path.c_str());
+	std::remove(second_path.c_str());
+}
@@ -0,0 +1,211 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "mapped_flat_value_map.h"
+#include "utils/open_addressing_index.h"
+#include "utils/work_stealing_pool.h"
+
+#if COF_POSIX_MAPPING
+#include <csignal>
+#include <sys/resource.h>
+#endif // END: COF_POSIX_MAPPING
+
+using namespace cof;
+
+// Unique ids that are not 0, in random order
+static std::vector<std::uint32_t> random_ids(std::size_t count, std::uint32_t seed)
+{
+	std::vector<std::uint32_t> ids(count);
+	std::iota(ids.begin(), ids.end(), 1u);
+	std::mt19937 rng{ seed };
+	std::shuffle(ids.begin(), ids.end(), rng);
+	// Spread them out, the ids of a real map have gaps
+	for (std::uint32_t& id : ids) {
+		id = id * 7 + 3;
+	}
+	return ids;
+}
+
+template<typename Pool>
+static void check_build(std::size_t count, Pool& pool)
+{
+	std::vector<std::uint32_t> ids = random_ids(count, static_cast<std::uint32_t>(count));
+	std::vector<IndexSlot> slots(OpenAddressingIndex::slot_count_for(count));
+	OpenAddressingIndex::clear(slots.data(), slots.size());
+	REQUIRE(OpenAddressingIndex::build(slots.data(), slots.size(), ids.data(), ids.size(), pool));
+
+	OpenAddressingIndex index{ slots.data(), slots.size() };
+	for (std::size_t i = 0; i < ids.size(); ++i) {
+		REQUIRE(index.find(ids[i]) == i);
+	}
+	CHECK(index.find(1) == OpenAddressingIndex::not_found);
+	CHECK(std::count_if(slots.begin(), slots.end(), [](IndexSlot slot) { return slot.id != 0; }) == static_cast<std::ptrdiff_t>(count));
+
+	// The built index works with the normal modifiers
+	REQUIRE(index.erase(ids[0]));
+	CHECK(index.find(ids[0]) == OpenAddressingIndex::not_found);
+	for (std::size_t i = 1; i < ids.size(); ++i) {
+		REQUIRE(index.find(ids[i]) == i);
+	}
+}
+
+
+TEST_CASE("OpenAddressingIndex::build finds every id, also when probes cross a partition")
+{
+	WorkStealingPool pool{ 4 };
+	detail::SequentialFor sequential{};
+
+	// One partition, the probes that wrap around the end are inserted after the partition is filled
+	check_build(7, sequential);
+	check_build(120, pool);
+	// Many partitions of 8192 slots
+	check_build(300000, sequential);
+	check_build(300000, pool);
+}
+
+TEST_CASE("FlatValueMap::reserve keeps the elements in place while the reserved elements are added")
+{
+	struct Sample { double value; };
+	FlatValueMap<FvmHandle<Sample>, Sample> samples{};
+	samples.reserve(10000);
+	samples.push_back(Sample{ 0 });
+	const Sample* data = samples.data();
+	for (int i = 1; i < 10000; ++i) {
+		samples.emplace_with_handle(FvmHandle<Sample>{ static_cast<std::uint32_t>(i * 2 + 100000) }, Sample{ static_cast<double>(i) });
+	}
+	CHECK(samples.data() == data);
+	CHECK(samples[FvmHandle<Sample>{ 2 * 9999 + 100000 }].value == 9999);
+}
+
+#if COF_POSIX_MAPPING
+TEST_CASE("MappedFlatValueMap::bulk_load builds the index for the loaded handles")
+{
+	struct Reading { std::uint64_t sensor; float value; };
+	using ReadingHandle = FvmHandle<Reading>;
+
+	std::string path = (std::filesystem::temp_directory_path() / "cof_bulk_load.fvm").string();
+	std::remove(path.c_str());
+	std::vector<ReadingHandle> handles;
+	std::vector<Reading> readings;
+	for (std::uint32_t id : random_ids(100000, 3)) {
+		handles.push_back(ReadingHandle{ id });
+		readings.push_back(Reading{ id * 2ull, 0.5f });
+	}
+
+	WorkStealingPool pool{ 3 };
+	{
+		MappedFlatValueMap<ReadingHandle, Reading> map{ path, 16 };
+		REQUIRE(map.is_open());
+		ReadingHandle existing = map.push_back(Reading{ 1, 1 });
+		REQUIRE(map.bulk_load(handles.data(), readings.data(), handles.size(), pool));
+		CHECK(map.size() == handles.size() + 1);
+		CHECK(map[existing].sensor == 1);
+		for (ReadingHandle handle : handles) {
+			REQUIRE(map.contains(handle));
+			CHECK(map[handle].sensor == handle.id * 2ull);
+		}
+		ReadingHandle next = map.push_back(Reading{ 2, 2 });
+		CHECK(next.id > 100000u * 7 + 3);
+	}
+	// Reopening rebuilds nothing, the index was saved in the file
+	MappedFlatValueMap<ReadingHandle, Reading> reopened{ path };
+	REQUIRE(reopened.is_open());
+	CHECK(reopened[handles[500]].sensor == handles[500].id * 2ull);
+	std::remove(path.c_str());
+}
+
+TEST_CASE("MappedFlatValueMap::bulk_load leaves the map as it was when it can not load")
+{
+	struct Meter { std::uint64_t serial; float reading; };
+	using MeterHandle = FvmHandle<Meter>;
+
+	std::string path = (std::filesystem::temp_directory_path() / "cof_bulk_load_rejected.fvm").string();
+	std::remove(path.c_str());
+	detail::SequentialFor sequential{};
+	MappedFlatValueMap<MeterHandle, Meter> map{ path, 64 };
+	REQUIRE(map.is_open());
+	std::vector<MeterHandle> existing;
+	for (std::uint64_t i = 0; i < 64; ++i) {
+		existing.push_back(map.push_back(Meter{ i, 1.0f }));
+	}
+
+	std::vector<MeterHandle> handles;
+	std::vector<Meter> meters;
+	for (std::uint32_t id : random_ids(1000, 5)) {
+		handles.push_back(MeterHandle{ id + 1000 });
+		meters.push_back(Meter{ id, 0.5f });
+	}
+	auto unchanged = [&]() {
+		CHECK(map.is_open());
+		CHECK(map.size() == existing.size());
+		for (std::size_t i = 0; i < existing.size(); ++i) {
+			REQUIRE(map.contains(existing[i]));
+			CHECK(map[existing[i]].serial == i);
+		}
+		CHECK_FALSE(map.contains(handles[1]));
+	};
+
+	SECTION("A handle with id 0")
+	{
+		handles[500] = MeterHandle{ 0 };
+		CHECK_FALSE(map.bulk_load(handles.data(), meters.data(), handles.size(), sequential));
+		unchanged();
+	}
+	SECTION("A handle that is loaded twice")
+	{
+		handles[500] = handles[20];
+		CHECK_FALSE(map.bulk_load(handles.data(), meters.data(), handles.size(), sequential));
+		unchanged();
+	}
+	SECTION("A handle that is already in the map")
+	{
+		handles[500] = existing[3];
+		CHECK_FALSE(map.bulk_load(handles.data(), meters.data(), handles.size(), sequential));
+		unchanged();
+	}
+	SECTION("A handle that is loaded twice, found by the threads of a pool")
+	{
+		WorkStealingPool pool{ 4 };
+		handles.clear();
+		meters.clear();
+		for (std::uint32_t id : random_ids(300000, 6)) {
+			handles.push_back(MeterHandle{ id + 1000 });
+			meters.push_back(Meter{ id, 0.5f });
+		}
+		handles[250000] = handles[17];
+		CHECK_FALSE(map.bulk_load(handles.data(), meters.data(), handles.size(), pool));
+		unchanged();
+
+		handles[250000] = MeterHandle{ 0 };
+		CHECK_FALSE(map.bulk_load(handles.data(), meters.data(), handles.size(), pool));
+		unchanged();
+	}
+	SECTION("A file that can not grow")
+	{
+		rlimit old_limit{};
+		REQUIRE(getrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+		rlimit limit = old_limit;
+		limit.rlim_cur = static_cast<rlim_t>(std::filesystem::file_size(path));
+		auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+		REQUIRE(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+		bool loaded = map.bulk_load(handles.data(), meters.data(), handles.size(), sequential);
+		setrlimit(RLIMIT_FSIZE, &old_limit);
+		std::signal(SIGXFSZ, old_handler);
+
+		CHECK_FALSE(loaded);
+		unchanged();
+		CHECK(map.capacity() == 64);
+		CHECK(map.bulk_load(handles.data(), meters.data(), handles.size(), sequential));
+		CHECK(map.size() == existing.size() + handles.size());
+		CHECK(map[handles[1]].serial == meters[1].serial);
+	}
+	std::remove(path.c_str());
+}
+#endif // END: COF_POSIX_MAPPING
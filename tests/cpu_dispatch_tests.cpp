@@ -0,0 +1,120 @@
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "utils/cpu_dispatch.h"
+#include "utils/simd_kernels.h"
+
+
+using namespace cof;
+
+
+TEST_CASE("SimdLevel names round trip")
+{
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 };
+	for (SimdLevel level : levels) {
+		SimdLevel parsed = SimdLevel::Scalar;
+		REQUIRE(parse_simd_level(simd_level_name(level), parsed));
+		CHECK(parsed == level);
+	}
+
+	SimdLevel parsed = SimdLevel::Scalar;
+	CHECK(parse_simd_level("AVX2", parsed));
+	CHECK(parsed == SimdLevel::AVX2);
+	CHECK_FALSE(parse_simd_level("neon", parsed));
+}
+
+TEST_CASE("Forcing a SimdLevel never goes above the supported level")
+{
+	CHECK(force_simd_level(SimdLevel::AVX512) == supported_simd_level());
+	CHECK(force_simd_level(SimdLevel::Scalar) == SimdLevel::Scalar);
+	CHECK(active_simd_level() == SimdLevel::Scalar);
+	reset_simd_level();
+}
+
+TEST_CASE("Every SimdLevel gives the same kernel results")
+{
+	std::vector<float> floats;
+	std::vector<double> doubles;
+	std::vector<std::int32_t> ints;
+	std::vector<std::uint32_t> ids;
+	for (std::int32_t i = 0; i < 203; ++i) {
+		std::int32_t value = (i * 7919) % 211 - 100;
+		floats.push_back(static_cast<float>(value) * 0.5f);
+		doubles.push_back(static_cast<double>(value) * 0.25);
+		ints.push_back(value);
+		ids.push_back(static_cast<std::uint32_t>(i));
+	}
+
+	force_simd_level(SimdLevel::Scalar);
+	const double float_sum = simd::sum(floats.data(), floats.size());
+	const double double_sum = simd::sum(doubles.data(), doubles.size());
+	const std::int64_t int_sum = simd::sum(ints.data(), ints.size());
+	const std::size_t float_min = simd::min_index(floats.data(), floats.size());
+	const std::size_t double_max = simd::max_index(doubles.data(), doubles.size());
+	const std::size_t int_max = simd::max_index(ints.data(), ints.size());
+	const std::size_t float_count = simd::count_in_range(floats.data(), floats.size(), -10.0f, 20.0f);
+	const std::size_t int_count = simd::count_in_range(ints.data(), ints.size(), -10, 20);
+	std::vector<std::uint32_t> expected_selection(ids.size());
+	expected_selection.resize(simd::select_in_range(ints.data(), ids.data(), ints.size(), -10, 20, expected_selection.data()));
+
+	const SimdLevel levels[] = { SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 };
+	for (SimdLevel level : levels) {
+		INFO("level: " << simd_level_name(force_simd_level(level)));
+
+		CHECK(simd::sum(floats.data(), floats.size()) == Approx(float_sum));
+		CHECK(simd::sum(doubles.data(), doubles.size()) == Approx(double_sum));
+		CHECK(simd::sum(ints.data(), ints.size()) == int_sum);
+		CHECK(simd::min_index(floats.data(), floats.size()) == float_min);
+		CHECK(simd::max_index(doubles.data(), doubles.size()) == double_max);
+		CHECK(simd::max_index(ints.data(), ints.size()) == int_max);
+		CHECK(simd::count_in_range(floats.data(), floats.size(), -10.0f, 20.0f) == float_count);
+		CHECK(simd::count_in_range(ints.data(), ints.size(), -10, 20) == int_count);
+
+		std::vector<std::uint32_t> selection(ids.size());
+		selection.resize(simd::select_in_range(ints.data(), ids.data(), ints.size(), -10, 20, selection.data()));
+		CHECK(selection == expected_selection);
+	}
+	reset_simd_level();
+}
+
+TEST_CASE("Every SimdLevel skips NaNs in min_index and max_index like the scalar versions")
+{
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	std::vector<float> floats;
+	std::vector<double> doubles;
+	for (int i = 0; i < 101; ++i) {
+		floats.push_back(static_cast<float>((i * 37) % 101));
+		doubles.push_back(static_cast<double>((i * 37) % 101));
+	}
+
+	// A NaN at the start of a lane does not hide the extremes that come later in that lane
+	auto check_levels = [&](std::size_t expected_min, std::size_t expected_max) {
+		const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 };
+		for (SimdLevel level : levels) {
+			INFO("level: " << simd_level_name(force_simd_level(level)));
+			CHECK(simd::min_index(floats.data(), floats.size()) == expected_min);
+			CHECK(simd::max_index(floats.data(), floats.size()) == expected_max);
+			CHECK(simd::min_index(doubles.data(), doubles.size()) == expected_min);
+			CHECK(simd::max_index(doubles.data(), doubles.size()) == expected_max);
+		}
+		reset_simd_level();
+	};
+	const std::size_t lowest = 34;
+	const std::size_t highest = 33;
+	floats[lowest] = -1.0f;
+	doubles[lowest] = -1.0;
+	floats[highest] = 200.0f;
+	doubles[highest] = 200.0;
+	for (std::size_t i : { 1, 2, 3, 5, 17, 100 }) {
+		floats[i] = nan;
+		doubles[i] = static_cast<double>(nan);
+	}
+	check_levels(lowest, highest);
+
+	// A NaN as the first element is the result of both, the same as the scalar versions
+	floats[0] = nan;
+	doubles[0] = static_cast<double>(nan);
+	check_levels(0, 0);
+}
@@ -0,0 +1,71 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "flat_value_map.h"
+
+
+using namespace cof;
+
+using NumberHandle = FvmHandle<int>;
+
+
+TEST_CASE("Cursor erases while iterating in a single pass")
+{
+	FlatValueMap<NumberHandle, int> fvm{};
+	for (int i = 0; i < 100; ++i) {
+		fvm.push_back(i);
+	}
+
+	int visited = 0;
+	for (auto c = fvm.cursor(); c; ) {
+		++visited;
+		CHECK(fvm[c.handle()] == *c);
+		if (*c % 3 == 0) {
+			c.erase();
+		} else {
+			++c;
+		}
+	}
+	CHECK(visited == 100);
+	REQUIRE(fvm.size() == 66);
+	for (int value : fvm) {
+		CHECK(value % 3 != 0);
+	}
+
+	std::vector<int> values(fvm.begin(), fvm.end());
+	std::sort(values.begin(), values.end());
+	CHECK(std::unique(values.begin(), values.end()) == values.end());
+}
+
+TEST_CASE("Cursor can erase every element, including the last")
+{
+	FlatValueMap<NumberHandle, int> fvm{};
+	for (int i = 0; i < 10; ++i) {
+		fvm.push_back(i);
+	}
+
+	for (auto c = fvm.cursor(); c; ) {
+		c.erase();
+	}
+	CHECK(fvm.empty());
+	CHECK_FALSE(fvm.cursor());
+}
+
+TEST_CASE("Cursor visits elements pushed back while iterating")
+{
+	FlatValueMap<NumberHandle, int> fvm{};
+	fvm.push_back(1);
+	fvm.push_back(2);
+
+	int sum = 0;
+	for (auto c = fvm.cursor(); c; ++c) {
+		sum += *c;
+		if (*c < 4) {
+			fvm.push_back(*c + 2);
+		}
+	}
+	// 1, 2, 3, 4, 5
+	CHECK(sum == 15);
+	CHECK(fvm.size() == 5);
+}
@@ -82,3 +82,19 @@ TEST_CASE("Custom allocator test")
 	CHECK(fvm.size() == 3);
 	CHECK(fvm.find(moveHandle) != fvm.end());
 }
+
+TEST_CASE("Custom allocator for the dense_to_sparse handles")
+{
+	using Handle = cof::FvmHandle<TestType>;
+	// The default DenseToSparseAllocator still is the one of the old dense_to_sparse unordered_map
+	static_assert(std::is_same<cof::FlatValueMap<Handle, TestType>,
+		cof::FlatValueMap<Handle, TestType, std::allocator<TestType>, std::allocator<std::pair<const Handle, std::size_t>>, std::allocator<std::pair<const std::size_t, Handle>>>>::value,
+		"The default allocators are part of the type of a FlatValueMap");
+
+	cof::FlatValueMap<Handle, TestType, std::allocator<TestType>, std::allocator<std::pair<const Handle, std::size_t>>, PassThroughAllocator<Handle>> fvm{};
+	auto first = fvm.emplace_back(1, std::string{ "first" });
+	auto second = fvm.emplace_back(2, std::string{ "second" });
+	fvm.erase(first);
+	CHECK(fvm.size() == 1);
+	CHECK(fvm[second].name == "second");
+}
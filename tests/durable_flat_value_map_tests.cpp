@@ -0,0 +1,205 @@
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "durable_flat_value_map.h"
+
+
+using namespace cof;
+
+struct Account { std::uint64_t id; double balance; };
+struct AccountTag;
+
+using AccountHandle = FvmHandle<AccountTag>;
+using Accounts = DurableFlatValueMap<AccountHandle, Account>;
+
+static std::string durable_test_path(const char* name)
+{
+	std::string path = (std::filesystem::temp_directory_path() / name).string();
+	std::remove((path + ".snapshot").c_str());
+	std::remove((path + ".wal").c_str());
+	return path;
+}
+
+static void remove_durable_files(const std::string& path)
+{
+	std::remove((path + ".snapshot").c_str());
+	std::remove((path + ".wal").c_str());
+}
+
+static bool same_contents(const Accounts& accounts, const std::unordered_map<std::uint32_t, Account>& model)
+{
+	if (accounts.size() != model.size()) {
+		return false;
+	}
+	for (auto& entry : model) {
+		auto it = accounts.find(AccountHandle{ entry.first });
+		if (it == accounts.end() || it->id != entry.second.id || it->balance != entry.second.balance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+TEST_CASE("DurableFlatValueMap recovers the changes from the log")
+{
+	std::string path = durable_test_path("cof_durable_recover");
+	std::unordered_map<std::uint32_t, Account> model;
+
+	DurabilityOptions options{};
+	options.checkpoint_log_bytes = 0;
+	{
+		Accounts accounts{ path, options };
+		REQUIRE(accounts.is_open());
+
+		std::mt19937 rng{ 7 };
+		std::vector<AccountHandle> handles;
+		for (std::uint64_t i = 0; i < 2000; ++i) {
+			int operation = static_cast<int>(rng() % 4);
+			if (handles.empty() || operation < 2) {
+				Account account{ i, static_cast<double>(i) };
+				handles.push_back(accounts.push_back(account));
+				model[handles.back().id] = account;
+			} else if (operation == 2) {
+				AccountHandle handle = handles[rng() % handles.size()];
+				accounts.update(handle, [](Account& account) { account.balance += 1.5; });
+				model[handle.id].balance += 1.5;
+			} else {
+				std::size_t index = rng() % handles.size();
+				accounts.erase(handles[index]);
+				model.erase(handles[index].id);
+				handles[index] = handles.back();
+				handles.pop_back();
+			}
+		}
+		CHECK(accounts.sync());
+		CHECK(accounts.log_size() > sizeof(Account) * 1000);
+	}
+
+	Accounts recovered{ path, options };
+	REQUIRE(recovered.is_open());
+	CHECK(same_contents(recovered, model));
+
+	// New handles never reuse a recovered id
+	AccountHandle new_handle = recovered.push_back(Account{ 0, 0 });
+	CHECK(model.count(new_handle.id) == 0);
+
+	remove_durable_files(path);
+}
+
+TEST_CASE("DurableFlatValueMap checkpoints truncate the log")
+{
+	std::string path = durable_test_path("cof_durable_checkpoint");
+	std::unordered_map<std::uint32_t, Account> model;
+
+	DurabilityOptions options{};
+	options.checkpoint_log_bytes = 4096;
+	options.group_commit_delay = std::chrono::microseconds{ 0 };
+	{
+		Accounts accounts{ path, options };
+		REQUIRE(accounts.is_open());
+		for (std::uint64_t i = 0; i < 1000; ++i) {
+			AccountHandle handle = accounts.push_back(Account{ i, 1.0 });
+			model[handle.id] = Account{ i, 1.0 };
+			CHECK(accounts.log_size() < 4096);
+		}
+		accounts.clear();
+		model.clear();
+		AccountHandle handle = accounts.push_back(Account{ 5, 5.0 });
+		model[handle.id] = Account{ 5, 5.0 };
+		CHECK(accounts.checkpoint());
+		CHECK(accounts.log_size() < 64);
+	}
+
+	Accounts recovered{ path, options };
+	REQUIRE(recovered.is_open());
+	CHECK(same_contents(recovered, model));
+
+	remove_durable_files(path);
+}
+
+TEST_CASE("DurableFlatValueMap ignores a torn record at the end of the log")
+{
+	std::string path = durable_test_path("cof_durable_torn");
+	std::unordered_map<std::uint32_t, Account> model;
+
+	DurabilityOptions options{};
+	options.checkpoint_log_bytes = 0;
+	{
+		Accounts accounts{ path, options };
+		REQUIRE(accounts.is_open());
+		for (std::uint64_t i = 0; i < 10; ++i) {
+			AccountHandle handle = accounts.push_back(Account{ i, 2.0 });
+			model[handle.id] = Account{ i, 2.0 };
+		}
+		CHECK(accounts.sync());
+	}
+
+	// Simulate a crash in the middle of writing a record
+	std::FILE* log = open_file(path + ".wal", "ab");
+	REQUIRE(log != nullptr);
+	unsigned char partial_record[7] = { 1, 0, 0, 0, 99, 0, 0 };
+	std::fwrite(partial_record, 1, sizeof(partial_record), log);
+	std::fclose(log);
+
+	{
+		Accounts recovered{ path, options };
+		REQUIRE(recovered.is_open());
+		CHECK(same_contents(recovered, model));
+		AccountHandle handle = recovered.push_back(Account{ 10, 3.0 });
+		model[handle.id] = Account{ 10, 3.0 };
+	}
+
+	// The recovery started a clean log, so the records after the torn one are found again
+	Accounts recovered_again{ path, options };
+	REQUIRE(recovered_again.is_open());
+	CHECK(same_contents(recovered_again, model));
+
+	remove_durable_files(path);
+}
+
+TEST_CASE("Snapshots keep the handles of a FlatValueMap")
+{
+	std::string path = (std::filesystem::temp_directory_path() / "cof_snapshot_roundtrip.snapshot").string();
+
+	FlatValueMap<AccountHandle, Account> accounts{};
+	std::vector<AccountHandle> handles;
+	for (std::uint64_t i = 0; i < 100; ++i) {
+		handles.push_back(accounts.push_back(Account{ i, i * 0.5 }));
+	}
+	for (std::size_t i = 0; i < handles.size(); i += 4) {
+		accounts.erase(handles[i]);
+	}
+	REQUIRE(save_snapshot(path, accounts, 42));
+
+	FlatValueMap<AccountHandle, Account> loaded{};
+	SnapshotInfo info{};
+	REQUIRE(load_snapshot(path, loaded, &info));
+	CHECK(info.generation == 42);
+	CHECK(loaded.size() == accounts.size());
+	for (std::size_t i = 0; i < handles.size(); ++i) {
+		CHECK(loaded.contains(handles[i]) == (i % 4 != 0));
+		if (i % 4 != 0) {
+			CHECK(loaded[handles[i]].id == i);
+		}
+	}
+
+	// A flipped byte is found by the checksum
+	std::FILE* file = open_file(path, "r+b");
+	REQUIRE(file != nullptr);
+	std::fseek(file, -10, SEEK_END);
+	int byte = std::fgetc(file);
+	std::fseek(file, -10, SEEK_END);
+	std::fputc(byte ^ 0x5A, file);
+	std::fclose(file);
+	FlatValueMap<AccountHandle, Account> corrupted{};
+	CHECK_FALSE(load_snapshot(path, corrupted));
+	CHECK(corrupted.empty());
+
+	std::remove(path.c_str());
+}
@@ -0,0 +1,95 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "expiring_flat_value_map.h"
+
+
+using namespace cof;
+
+using SessionHandle = FvmHandle<std::string>;
+using SessionMap = ExpiringFlatValueMap<SessionHandle, std::string>;
+
+
+TEST_CASE("ExpiringFlatValueMap removes only the expired elements")
+{
+	SessionMap sessions{ 10, 8 };
+	SessionHandle jhon = sessions.push_back("Jhon", 25);
+	SessionHandle marie = sessions.push_back("Marie", 100);
+	SessionHandle forever = sessions.push_back("Forever");
+	SessionHandle early = sessions.emplace_back(5, "Early");
+
+	CHECK(sessions.expire_until(4).empty());
+
+	std::vector<SessionHandle> expired = sessions.expire_until(30);
+	std::sort(expired.begin(), expired.end());
+	REQUIRE(expired.size() == 2);
+	CHECK(expired[0] == jhon);
+	CHECK(expired[1] == early);
+	CHECK(sessions.size() == 2);
+	CHECK(sessions[marie] == "Marie");
+	CHECK(sessions.expiry(marie) == 100);
+	CHECK(sessions.expiry(forever) == SessionMap::never);
+
+	expired = sessions.expire_until(100);
+	REQUIRE(expired.size() == 1);
+	CHECK(expired[0] == marie);
+
+	CHECK(sessions.expire_until(1000000).empty());
+	CHECK(sessions.contains(forever));
+}
+
+TEST_CASE("ExpiringFlatValueMap set_expiry moves the expiry")
+{
+	SessionMap sessions{ 1, 16 };
+	SessionHandle jhon = sessions.push_back("Jhon", 10);
+	SessionHandle marie = sessions.push_back("Marie", 10);
+
+	// Extend, then go back to the original expiry, the old wheel entries should not erase twice
+	sessions.set_expiry(jhon, 50);
+	sessions.set_expiry(jhon, 10);
+	sessions.set_expiry(marie, 40);
+
+	std::vector<SessionHandle> expired = sessions.expire_until(10);
+	REQUIRE(expired.size() == 1);
+	CHECK(expired[0] == jhon);
+
+	sessions.set_expiry(marie, SessionMap::never);
+	CHECK(sessions.expire_until(100).empty());
+
+	// A expiry in the past is picked up by the next sweep
+	sessions.set_expiry(marie, 3);
+	expired = sessions.expire_until(100);
+	REQUIRE(expired.size() == 1);
+	CHECK(expired[0] == marie);
+	CHECK(sessions.empty());
+}
+
+TEST_CASE("ExpiringFlatValueMap keeps the expiry column in dense order after erase")
+{
+	SessionMap sessions{ 4, 4 };
+	std::vector<SessionHandle> handles;
+	for (std::uint64_t i = 0; i < 64; ++i) {
+		handles.push_back(sessions.push_back(std::to_string(i), i * 3));
+	}
+	for (std::size_t i = 0; i < handles.size(); i += 5) {
+		sessions.erase(handles[i]);
+	}
+	for (std::size_t i = 0; i < sessions.size(); ++i) {
+		std::uint64_t id = std::stoull(sessions.begin()[i]);
+		CHECK(sessions.expiry_data()[i] == id * 3);
+	}
+
+	// The wheel turns more then once between these calls
+	std::vector<SessionHandle> expired;
+	for (std::uint64_t now = 0; now < 200; now += 7) {
+		sessions.expire_until(now, expired);
+		for (std::size_t i = 0; i < sessions.size(); ++i) {
+			CHECK(sessions.expiry_data()[i] > now);
+		}
+	}
+	CHECK(sessions.empty());
+	CHECK(expired.size() == 64 - 13);
+}
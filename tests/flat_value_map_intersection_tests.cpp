@@ -0,0 +1,168 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "light_flat_value_map.h"
+#include "flat_value_map_intersection.h"
+
+
+using namespace cof;
+
+using NameHandle = FvmHandle<std::string>;
+struct PersonTag;
+using PersonHandle = FvmHandle<PersonTag>;
+
+
+namespace
+{
+	// Brute force version of intersect(), matches ordered by handle id
+	template<typename FirstContainer, typename SecondContainer>
+	std::vector<MatchedIndices> intersect_brute_force(const FirstContainer& first, const SecondContainer& second)
+	{
+		std::map<std::uint32_t, std::size_t> first_indices;
+		for (auto it = first.handles_begin(); it != first.handles_end(); ++it) {
+			first_indices[it->first.id] = it->second;
+		}
+		std::map<std::uint32_t, std::size_t> second_indices;
+		for (auto it = second.handles_begin(); it != second.handles_end(); ++it) {
+			second_indices[it->first.id] = it->second;
+		}
+
+		std::vector<MatchedIndices> matches;
+		for (auto& pair : first_indices) {
+			auto found = second_indices.find(pair.first);
+			if (found != second_indices.end()) {
+				matches.push_back(MatchedIndices{ pair.second, found->second });
+			}
+		}
+		return matches;
+	}
+
+	void check_same_matches(const std::vector<MatchedIndices>& actual, const std::vector<MatchedIndices>& expected)
+	{
+		REQUIRE(actual.size() == expected.size());
+		for (std::size_t i = 0; i < actual.size(); ++i) {
+			CHECK(actual[i].first_index == expected[i].first_index);
+			CHECK(actual[i].second_index == expected[i].second_index);
+		}
+	}
+}
+
+
+TEST_CASE("Sorted intersection kernels agree with the scalar merge")
+{
+	std::vector<std::uint32_t> first;
+	std::vector<std::uint32_t> second;
+	for (std::uint32_t id = 0; id < 3000; ++id) {
+		if (id % 3 == 0) { first.push_back(id); }
+		if (id % 5 == 0 || id % 7 == 0) { second.push_back(id); }
+	}
+
+	std::vector<std::uint32_t> expected_first(first.size()), expected_second(first.size());
+	std::size_t expected_count = simd::intersect_sorted_scalar(first.data(), first.size(), second.data(), second.size(), expected_first.data(), expected_second.data());
+	REQUIRE(expected_count > 0);
+
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 };
+	for (SimdLevel level : levels) {
+		force_simd_level(level);
+		std::vector<std::uint32_t> first_positions(first.size()), second_positions(first.size());
+		std::size_t count = simd::intersect_sorted(first.data(), first.size(), second.data(), second.size(), first_positions.data(), second_positions.data());
+
+		REQUIRE(count == expected_count);
+		for (std::size_t i = 0; i < count; ++i) {
+			CHECK(first_positions[i] == expected_first[i]);
+			CHECK(second_positions[i] == expected_second[i]);
+		}
+	}
+	reset_simd_level();
+}
+
+TEST_CASE("Sorted intersection gallops when one side is much smaller")
+{
+	std::vector<std::uint32_t> small{ 3, 64, 65, 1000, 4095, 5000 };
+	std::vector<std::uint32_t> big;
+	for (std::uint32_t id = 0; id < 4096; ++id) {
+		big.push_back(id);
+	}
+	// Ids with the high bit set, the SIMD compare is signed
+	std::vector<std::uint32_t> high_small{ 0x7FFFFFF0u, 0x80000005u, 0xFFFFFFF0u };
+	std::vector<std::uint32_t> high_big;
+	for (std::uint32_t i = 0; i < 250; ++i) {
+		high_big.push_back(0x7FFFFF00u + i);
+		high_big.push_back(0x80000000u + i);
+		high_big.push_back(0xFFFFFE00u + i * 2);
+	}
+	std::sort(high_big.begin(), high_big.end());
+
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 };
+	for (SimdLevel level : levels) {
+		force_simd_level(level);
+		std::vector<std::uint32_t> small_positions(small.size()), big_positions(small.size());
+		REQUIRE(simd::intersect_sorted(big.data(), big.size(), small.data(), small.size(), big_positions.data(), small_positions.data()) == 5);
+		CHECK(small_positions == std::vector<std::uint32_t>{ 0, 1, 2, 3, 4, 0 });
+		CHECK(big_positions == std::vector<std::uint32_t>{ 3, 64, 65, 1000, 4095, 0 });
+
+		std::vector<std::uint32_t> high_small_positions(high_small.size()), high_big_positions(high_small.size());
+		std::vector<std::uint32_t> expected_small(high_small.size()), expected_big(high_small.size());
+		std::size_t expected_count = simd::intersect_sorted_scalar(high_small.data(), high_small.size(), high_big.data(), high_big.size(), expected_small.data(), expected_big.data());
+		CHECK(expected_count == 3);
+		REQUIRE(simd::intersect_sorted(high_small.data(), high_small.size(), high_big.data(), high_big.size(), high_small_positions.data(), high_big_positions.data()) == expected_count);
+		CHECK(high_small_positions == expected_small);
+		CHECK(high_big_positions == expected_big);
+	}
+	reset_simd_level();
+}
+
+TEST_CASE("Intersecting a FlatValueMap and a LightFlatValueMap")
+{
+	// The ages own the handles, the names are added with the handles of the ages
+	LightFlatValueMap<PersonHandle, int> ages;
+	FlatValueMap<PersonHandle, std::string> names;
+	std::vector<PersonHandle> handles;
+	for (int i = 0; i < 500; ++i) {
+		handles.push_back(ages.push_back(i));
+	}
+	// In reverse and not for every person, so the dense orders differ and only part of the handles match
+	for (std::size_t i = handles.size(); i-- > 0;) {
+		if (i % 3 != 0) {
+			names.emplace_with_handle(handles[i], std::to_string(ages[handles[i]]));
+		}
+	}
+	for (std::size_t i = 0; i < 500; i += 4) {
+		ages.erase(handles[i]);
+	}
+
+	std::vector<MatchedIndices> matches = intersect(names, ages);
+	check_same_matches(matches, intersect_brute_force(names, ages));
+	CHECK(matches.size() == 500 - 167 - 125 + 42);
+	for (const MatchedIndices& match : matches) {
+		CHECK(names.begin()[match.first_index] == std::to_string(ages.begin()[match.second_index]));
+	}
+
+	SortedHandleIndex names_index{ names };
+	SortedHandleIndex ages_index{ ages };
+	std::vector<MatchedIndices> indexed_matches;
+	intersect(names_index, ages_index, indexed_matches);
+	check_same_matches(indexed_matches, matches);
+
+	// Rebuilding after a change sees the change
+	names.erase(names.handle_at(0));
+	names_index.rebuild(names);
+	indexed_matches.clear();
+	intersect(names_index, ages_index, indexed_matches);
+	check_same_matches(indexed_matches, intersect_brute_force(names, ages));
+}
+
+TEST_CASE("Intersecting with an empty container")
+{
+	FlatValueMap<NameHandle, std::string> names;
+	FlatValueMap<NameHandle, std::string> empty;
+	names.push_back("Jhon");
+
+	CHECK(intersect(names, empty).empty());
+	CHECK(intersect(empty, names).empty());
+}
@@ -0,0 +1,82 @@
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "flat_value_map_kernels.h"
+
+
+using namespace cof;
+
+using MetricHandle = FvmHandle<float>;
+using CounterHandle = FvmHandle<std::int32_t>;
+
+
+TEST_CASE("FlatValueMap kernels on floats")
+{
+	FlatValueMap<MetricHandle, float> metrics{};
+	std::vector<MetricHandle> handles;
+	for (int i = 0; i < 100; ++i) {
+		handles.push_back(metrics.push_back(static_cast<float>(i % 37) - 10.0f));
+	}
+	// Put the extremes in the tail that the vector loops do not cover
+	auto lowest = metrics.push_back(-50.0f);
+	auto highest = metrics.push_back(80.0f);
+	metrics.erase(handles[3]);
+
+	double expected_sum = 0.0;
+	std::size_t expected_count = 0;
+	for (float value : metrics) {
+		expected_sum += value;
+		expected_count += (value >= 0.0f && value <= 10.0f) ? 1 : 0;
+	}
+
+	CHECK(sum(metrics) == Approx(expected_sum));
+	CHECK(find_min(metrics).handle == lowest);
+	CHECK(find_min(metrics).value == -50.0f);
+	CHECK(find_max(metrics).handle == highest);
+	CHECK(find_max(metrics).value == 80.0f);
+	CHECK(count_if(metrics, in_range(0.0f, 10.0f)) == expected_count);
+
+	std::vector<MetricHandle> selected(metrics.size());
+	std::size_t selected_count = select_if(metrics, in_range(0.0f, 10.0f), selected.data());
+	REQUIRE(selected_count == expected_count);
+	for (std::size_t i = 0; i < selected_count; ++i) {
+		CHECK(metrics[selected[i]] >= 0.0f);
+		CHECK(metrics[selected[i]] <= 10.0f);
+	}
+}
+
+TEST_CASE("FlatValueMap kernels on int32_t")
+{
+	FlatValueMap<CounterHandle, std::int32_t> counters{};
+	std::vector<CounterHandle> handles;
+	for (std::int32_t i = 0; i < 1000; ++i) {
+		handles.push_back(counters.push_back((i * 7919) % 1009 - 500));
+	}
+
+	std::int64_t expected_sum = 0;
+	for (std::int32_t value : counters) {
+		expected_sum += value;
+	}
+	CHECK(sum(counters) == expected_sum);
+
+	auto min = find_min(counters);
+	auto max = find_max(counters);
+	CHECK(counters[min.handle] == min.value);
+	CHECK(counters[max.handle] == max.value);
+	CHECK(min.value == -500);
+	CHECK(max.value == 508);
+
+	// The vectorized overload and the generic predicate overload have to agree
+	auto predicate = [](std::int32_t value) { return value >= -100 && value <= 100; };
+	std::size_t count = count_if(counters, in_range(-100, 100));
+	CHECK(count == count_if(counters, predicate));
+
+	std::vector<CounterHandle> simd_selected(counters.size());
+	std::vector<CounterHandle> scalar_selected(counters.size());
+	REQUIRE(select_if(counters, in_range(-100, 100), simd_selected.data()) == count);
+	REQUIRE(select_if(counters, predicate, scalar_selected.data()) == count);
+	for (std::size_t i = 0; i < count; ++i) {
+		CHECK(simd_selected[i] == scalar_selected[i]);
+	}
+}
@@ -0,0 +1,132 @@
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hierarchy_flat_value_map.h"
+
+
+using namespace cof;
+
+using NodeHandle = FvmHandle<std::string>;
+using Hierarchy = HierarchyFlatValueMap<NodeHandle, int>;
+
+
+namespace
+{
+	// Check that every element is stored directly in it's parent's subtree, and all indices agree with the handles
+	void check_depth_first_order(const Hierarchy& hierarchy)
+	{
+		const std::uint32_t* parents = hierarchy.parent_index_data();
+		std::vector<std::size_t> counted_sizes(hierarchy.size(), 1);
+		for (std::size_t i = hierarchy.size(); i-- > 0;) {
+			NodeHandle handle = hierarchy.handle_at(i);
+			REQUIRE(hierarchy.find(handle) - hierarchy.begin() == static_cast<std::ptrdiff_t>(i));
+			if (parents[i] != Hierarchy::no_parent) {
+				REQUIRE(parents[i] < i);
+				REQUIRE(i < parents[i] + hierarchy.subtree_size(hierarchy.handle_at(parents[i])));
+				REQUIRE(hierarchy.parent_of(handle) == hierarchy.handle_at(parents[i]));
+				counted_sizes[parents[i]] += counted_sizes[i];
+			}
+		}
+		for (std::size_t i = 0; i < hierarchy.size(); ++i) {
+			REQUIRE(hierarchy.subtree_size(hierarchy.handle_at(i)) == counted_sizes[i]);
+		}
+	}
+
+	bool is_in_subtree(const Hierarchy& hierarchy, NodeHandle root, NodeHandle node)
+	{
+		for (;;) {
+			if (node == root) {
+				return true;
+			}
+			if (!hierarchy.has_parent(node)) {
+				return false;
+			}
+			node = hierarchy.parent_of(node);
+		}
+	}
+}
+
+
+TEST_CASE("HierarchyFlatValueMap stores children after their parent")
+{
+	Hierarchy hierarchy{};
+	NodeHandle root = hierarchy.push_root(1);
+	NodeHandle second_root = hierarchy.push_root(100);
+	NodeHandle child = hierarchy.push_child(root, 10);
+	NodeHandle grandchild = hierarchy.emplace_child(child, 5);
+	NodeHandle second_child = hierarchy.push_child(root, 20);
+
+	CHECK(std::vector<int>(hierarchy.begin(), hierarchy.end()) == std::vector<int>{ 1, 10, 5, 20, 100 });
+	CHECK(hierarchy.subtree_size(root) == 4);
+	CHECK(hierarchy.parent_of(grandchild) == child);
+	CHECK_FALSE(hierarchy.has_parent(second_root));
+	check_depth_first_order(hierarchy);
+
+	// World value = parent world value + local value, in one forward pass
+	std::vector<int> world(hierarchy.size());
+	hierarchy.propagate([&](int& local, const int* parent) {
+		std::size_t index = &local - hierarchy.data();
+		world[index] = parent == nullptr ? local : world[parent - hierarchy.data()] + local;
+	});
+	CHECK(world == std::vector<int>{ 1, 11, 16, 21, 100 });
+
+	hierarchy.reparent(child, second_root);
+	CHECK(std::vector<int>(hierarchy.begin(), hierarchy.end()) == std::vector<int>{ 1, 20, 100, 10, 5 });
+	check_depth_first_order(hierarchy);
+
+	hierarchy.make_root(second_child);
+	CHECK(std::vector<int>(hierarchy.begin(), hierarchy.end()) == std::vector<int>{ 1, 100, 10, 5, 20 });
+	check_depth_first_order(hierarchy);
+
+	CHECK(hierarchy.erase(second_root) == 3);
+	CHECK(std::vector<int>(hierarchy.begin(), hierarchy.end()) == std::vector<int>{ 1, 20 });
+	CHECK_FALSE(hierarchy.contains(grandchild));
+	check_depth_first_order(hierarchy);
+}
+
+TEST_CASE("HierarchyFlatValueMap keeps depth first order under random changes")
+{
+	Hierarchy hierarchy{};
+	std::vector<NodeHandle> handles;
+	std::uint32_t state = 42;
+	auto random = [&state](std::uint32_t bound) {
+		state = state * 1103515245u + 12345u;
+		return (state >> 16) % bound;
+	};
+
+	for (int step = 0; step < 400; ++step) {
+		// Drop handles of erased elements
+		std::vector<NodeHandle> alive;
+		for (NodeHandle handle : handles) {
+			if (hierarchy.contains(handle)) {
+				alive.push_back(handle);
+			}
+		}
+		handles.swap(alive);
+
+		std::uint32_t operation = random(10);
+		if (handles.empty() || operation < 2) {
+			handles.push_back(hierarchy.push_root(step));
+		} else if (operation < 6) {
+			handles.push_back(hierarchy.push_child(handles[random(static_cast<std::uint32_t>(handles.size()))], step));
+		} else if (operation < 9) {
+			NodeHandle node = handles[random(static_cast<std::uint32_t>(handles.size()))];
+			NodeHandle new_parent = handles[random(static_cast<std::uint32_t>(handles.size()))];
+			if (!is_in_subtree(hierarchy, node, new_parent)) {
+				hierarchy.reparent(node, new_parent);
+			} else {
+				hierarchy.make_root(node);
+			}
+		} else {
+			std::size_t size_before = hierarchy.size();
+			NodeHandle node = handles[random(static_cast<std::uint32_t>(handles.size()))];
+			std::size_t subtree = hierarchy.subtree_size(node);
+			CHECK(hierarchy.erase(node) == subtree);
+			CHECK(hierarchy.size() == size_before - subtree);
+		}
+		check_depth_first_order(hierarchy);
+	}
+}
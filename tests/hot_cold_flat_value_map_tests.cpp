@@ -0,0 +1,113 @@
+#include <catch2/catch.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hot_cold_flat_value_map.h"
+#include "flat_value_map_kernels.h"
+
+
+using namespace cof;
+
+struct Particle { float x, y; };
+struct ParticleMeta { std::string name; std::vector<int> history; };
+
+using ParticleHandle = FvmHandle<Particle>;
+using Particles = HotColdFlatValueMap<ParticleHandle, Particle, ParticleMeta>;
+
+
+TEST_CASE("HotColdFlatValueMap keeps both parts in the same order")
+{
+	Particles particles{};
+	std::vector<ParticleHandle> handles;
+	for (int i = 0; i < 50; ++i) {
+		handles.push_back(particles.push_back(Particle{ static_cast<float>(i), 0 }, ParticleMeta{ std::to_string(i), { i } }));
+	}
+
+	for (std::size_t i = 0; i < handles.size(); i += 3) {
+		particles.erase(handles[i]);
+	}
+	CHECK(particles.size() == 33);
+	CHECK(particles.cold_end() - particles.cold_begin() == 33);
+
+	auto cold_it = particles.cold_begin();
+	for (auto hot_it = particles.begin(); hot_it != particles.end(); ++hot_it, ++cold_it) {
+		CHECK(std::to_string(static_cast<int>(hot_it->x)) == cold_it->name);
+	}
+	for (std::size_t i = 1; i < handles.size(); i += 3) {
+		CHECK(particles[handles[i]].x == static_cast<float>(i));
+		CHECK(particles.cold(handles[i]).history == std::vector<int>{ static_cast<int>(i) });
+	}
+
+	// The hot loop only touches the hot array
+	for (Particle& particle : particles) {
+		particle.y = particle.x * 2;
+	}
+	CHECK(particles[handles[1]].y == 2);
+
+	particles.clear();
+	CHECK(particles.empty());
+	CHECK(particles.cold_begin() == particles.cold_end());
+}
+
+TEST_CASE("HotColdFlatValueMap hot parts work with the numeric queries")
+{
+	HotColdFlatValueMap<FvmHandle<float>, float, std::string> scores{};
+	scores.push_back(1.0f, "one");
+	auto best = scores.push_back(5.0f, "five");
+	scores.push_back(2.0f, "two");
+
+	auto max = find_max(scores.hot_map());
+	CHECK(max.handle == best);
+	CHECK(scores.cold(max.handle) == "five");
+}
+
+// A part whose copy throws while `fail_copies` is set, Kind tells the hot and the cold part apart
+template<int Kind>
+struct FragilePart
+{
+	static bool fail_copies;
+	int id;
+
+	explicit FragilePart(int id) : id(id) {}
+	FragilePart(const FragilePart& other) : id(other.id)
+	{
+		if (fail_copies) {
+			throw std::runtime_error("copy failed");
+		}
+	}
+	FragilePart(FragilePart&&) = default;
+	FragilePart& operator=(const FragilePart&) = default;
+	FragilePart& operator=(FragilePart&&) = default;
+};
+template<int Kind>
+bool FragilePart<Kind>::fail_copies = false;
+
+using FragileHot = FragilePart<0>;
+using FragileCold = FragilePart<1>;
+
+TEST_CASE("HotColdFlatValueMap keeps the parts paired when a push_back throws")
+{
+	HotColdFlatValueMap<FvmHandle<FragileHot>, FragileHot, FragileCold> parts{};
+	std::vector<FvmHandle<FragileHot>> handles;
+	for (int i = 0; i < 4; ++i) {
+		handles.push_back(parts.push_back(FragileHot{ i }, FragileCold{ i }));
+	}
+
+	const FragileHot hot{ 99 };
+	const FragileCold cold{ 99 };
+	FragileHot::fail_copies = true;
+	CHECK_THROWS_AS(parts.push_back(hot, cold), std::runtime_error);
+	FragileHot::fail_copies = false;
+	FragileCold::fail_copies = true;
+	CHECK_THROWS_AS(parts.push_back(hot, cold), std::runtime_error);
+	FragileCold::fail_copies = false;
+
+	CHECK(parts.size() == 4);
+	CHECK(parts.cold_end() - parts.cold_begin() == 4);
+	parts.erase(handles[0]);
+	for (std::size_t i = 1; i < handles.size(); ++i) {
+		CHECK(parts[handles[i]].id == static_cast<int>(i));
+		CHECK(parts.cold(handles[i]).id == static_cast<int>(i));
+	}
+}
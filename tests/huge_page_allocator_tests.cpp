@@ -0,0 +1,68 @@
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "utils/huge_page_allocator.h"
+
+
+using namespace cof;
+
+struct Particle { double position[3]; double velocity[3]; };
+struct ParticleTag;
+
+using ParticleHandle = FvmHandle<ParticleTag>;
+
+static bool is_huge_page_aligned(const void* address)
+{
+	return reinterpret_cast<std::uintptr_t>(address) % detail::huge_page_size == 0;
+}
+
+
+TEST_CASE("HugePageAllocator maps large allocations and allocates small ones normally")
+{
+	HugePageAllocator<std::uint64_t> allocator{};
+	CHECK_FALSE(allocator.is_mapped(16));
+	CHECK(allocator.is_mapped(detail::huge_page_size / sizeof(std::uint64_t)) == (COF_POSIX_MAPPING != 0));
+
+	std::uint64_t* small = allocator.allocate(16);
+	small[15] = 1;
+	allocator.deallocate(small, 16);
+
+	// Not a multiple of the huge page size, the last huge page is only used partly
+	std::size_t large_count = detail::huge_page_size / sizeof(std::uint64_t) * 3 + 5;
+	std::uint64_t* large = allocator.allocate(large_count);
+	if (allocator.is_mapped(large_count)) {
+		CHECK(is_huge_page_aligned(large));
+	}
+	for (std::size_t i = 0; i < large_count; ++i) {
+		large[i] = i;
+	}
+	CHECK(large[large_count - 1] == large_count - 1);
+	allocator.deallocate(large, large_count);
+
+	HugePageAllocator<char> rebound{ allocator };
+	CHECK(rebound == HugePageAllocator<char>{});
+}
+
+TEST_CASE("FlatValueMap with a HugePageAllocator keeps it's elements when the dense vector grows")
+{
+	// A small threshold, so the test does not need hundreds of MB to go through the mapped path many times
+	FlatValueMap<ParticleHandle, Particle, HugePageAllocator<Particle, 4096>> particles{};
+	std::vector<ParticleHandle> handles;
+	for (int i = 0; i < 200000; ++i) {
+		handles.push_back(particles.push_back(Particle{ { static_cast<double>(i), 0, 0 }, { 0, 0, 0 } }));
+	}
+	if (COF_POSIX_MAPPING) {
+		CHECK(is_huge_page_aligned(particles.data()));
+	}
+
+	for (std::size_t i = 0; i < handles.size(); i += 2) {
+		particles.erase(handles[i]);
+	}
+	CHECK(particles.size() == handles.size() / 2);
+	for (std::size_t i = 1; i < handles.size(); i += 2) {
+		REQUIRE(particles.contains(handles[i]));
+		CHECK(particles[handles[i]].position[0] == static_cast<double>(i));
+	}
+}
@@ -0,0 +1,213 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <stdexcept>
+#include <string>
+
+#include "lru_flat_value_map.h"
+
+
+using namespace cof;
+
+using PageHandle = FvmHandle<std::string>;
+
+
+TEST_CASE("LruFlatValueMap evicts the least recently used element")
+{
+	LruFlatValueMap<PageHandle, std::string> cache{ 3 };
+	cache.put(PageHandle{ 1 }, "one");
+	cache.put(PageHandle{ 2 }, "two");
+	cache.put(PageHandle{ 3 }, "three");
+	REQUIRE(cache.size() == 3);
+	CHECK(cache.least_recent_handle() == PageHandle{ 1 });
+
+	// Using 1 makes 2 the least recent
+	REQUIRE(cache.get(PageHandle{ 1 }) != nullptr);
+	CHECK(*cache.get(PageHandle{ 1 }) == "one");
+	CHECK(cache.least_recent_handle() == PageHandle{ 2 });
+
+	cache.put(PageHandle{ 4 }, "four");
+	CHECK(cache.size() == 3);
+	CHECK_FALSE(cache.contains(PageHandle{ 2 }));
+	CHECK(cache.most_recent_handle() == PageHandle{ 4 });
+	CHECK(*cache.peek(PageHandle{ 4 }) == "four");
+
+	// Overwriting an existing handle does not evict
+	cache.put(PageHandle{ 3 }, "THREE");
+	CHECK(cache.size() == 3);
+	CHECK(*cache.peek(PageHandle{ 3 }) == "THREE");
+	CHECK(cache.least_recent_handle() == PageHandle{ 1 });
+
+	CHECK(cache.stats().evictions == 1);
+}
+
+TEST_CASE("LruFlatValueMap peek does not change the recency order or the stats")
+{
+	LruFlatValueMap<PageHandle, int> cache{ 2 };
+	cache.put(PageHandle{ 1 }, 1);
+	cache.put(PageHandle{ 2 }, 2);
+
+	CHECK(*cache.peek(PageHandle{ 1 }) == 1);
+	CHECK(cache.peek(PageHandle{ 3 }) == nullptr);
+	cache.put(PageHandle{ 3 }, 3);
+	CHECK_FALSE(cache.contains(PageHandle{ 1 }));
+	CHECK(cache.stats().hits == 0);
+	CHECK(cache.stats().misses == 0);
+}
+
+TEST_CASE("LruFlatValueMap counts hits and misses")
+{
+	LruFlatValueMap<PageHandle, int> cache{ 4 };
+	cache.put(PageHandle{ 1 }, 1);
+
+	CHECK(cache.get(PageHandle{ 1 }) != nullptr);
+	CHECK(cache.get(PageHandle{ 1 }) != nullptr);
+	CHECK(cache.get(PageHandle{ 1 }) != nullptr);
+	CHECK(cache.get(PageHandle{ 2 }) == nullptr);
+	CHECK(cache.stats().hits == 3);
+	CHECK(cache.stats().misses == 1);
+	CHECK(cache.stats().hit_rate() == Approx(0.75));
+
+	cache.reset_stats();
+	CHECK(cache.stats().hit_rate() == 0.0);
+}
+
+TEST_CASE("LruFlatValueMap erase keeps the recency order of the moved element")
+{
+	LruFlatValueMap<PageHandle, std::string> cache{ 4 };
+	cache.put(PageHandle{ 1 }, "one");
+	cache.put(PageHandle{ 2 }, "two");
+	cache.put(PageHandle{ 3 }, "three");
+	cache.put(PageHandle{ 4 }, "four");
+	cache.get(PageHandle{ 4 });
+	cache.get(PageHandle{ 1 });
+	// Recency from old to new: 2, 3, 4, 1
+
+	// Handle 4 is at the back of the dense_vector and gets moved into the hole of handle 2
+	REQUIRE(cache.erase(PageHandle{ 2 }));
+	CHECK_FALSE(cache.erase(PageHandle{ 2 }));
+	CHECK(cache.size() == 3);
+	CHECK(*cache.peek(PageHandle{ 4 }) == "four");
+	CHECK(cache.least_recent_handle() == PageHandle{ 3 });
+	CHECK(cache.most_recent_handle() == PageHandle{ 1 });
+
+	cache.put(PageHandle{ 5 }, "five");
+	cache.put(PageHandle{ 6 }, "six");
+	CHECK_FALSE(cache.contains(PageHandle{ 3 }));
+	CHECK(cache.contains(PageHandle{ 4 }));
+	cache.put(PageHandle{ 7 }, "seven");
+	CHECK_FALSE(cache.contains(PageHandle{ 4 }));
+
+	cache.clear();
+	CHECK(cache.empty());
+	cache.emplace(PageHandle{ 8 }, 3, 'x');
+	CHECK(*cache.peek(PageHandle{ 8 }) == "xxx");
+}
+
+TEST_CASE("LruFlatValueMap matches a std::list model")
+{
+	const std::size_t capacity = 16;
+	LruFlatValueMap<PageHandle, std::uint32_t> cache{ capacity };
+	// Front is the most recently used handle id
+	std::list<std::uint32_t> model;
+
+	std::uint32_t state = 12345;
+	for (int step = 0; step < 5000; ++step) {
+		state = state * 1103515245u + 12345u;
+		std::uint32_t id = (state >> 16) % 40;
+		std::uint32_t operation = (state >> 8) % 8;
+		auto model_it = std::find(model.begin(), model.end(), id);
+
+		if (operation < 4) {
+			std::uint32_t* value = cache.get(PageHandle{ id });
+			REQUIRE((value != nullptr) == (model_it != model.end()));
+			if (value != nullptr) {
+				CHECK(*value == id);
+				model.splice(model.begin(), model, model_it);
+			}
+		} else if (operation < 7) {
+			cache.put(PageHandle{ id }, id);
+			if (model_it != model.end()) {
+				model.erase(model_it);
+			} else if (model.size() == capacity) {
+				model.pop_back();
+			}
+			model.push_front(id);
+		} else {
+			CHECK(cache.erase(PageHandle{ id }) == (model_it != model.end()));
+			if (model_it != model.end()) {
+				model.erase(model_it);
+			}
+		}
+
+		REQUIRE(cache.size() == model.size());
+		if (!model.empty()) {
+			CHECK(cache.most_recent_handle().id == model.front());
+			CHECK(cache.least_recent_handle().id == model.back());
+		}
+	}
+}
+
+// A value whose copy throws while `fail_copies` is set
+struct FragilePage
+{
+	static bool fail_copies;
+	int id;
+
+	explicit FragilePage(int id) : id(id) {}
+	FragilePage(const FragilePage& other) : id(other.id)
+	{
+		if (fail_copies) {
+			throw std::runtime_error("copy failed");
+		}
+	}
+	FragilePage& operator=(const FragilePage& other)
+	{
+		if (fail_copies) {
+			throw std::runtime_error("copy failed");
+		}
+		id = other.id;
+		return *this;
+	}
+};
+bool FragilePage::fail_copies = false;
+
+TEST_CASE("LruFlatValueMap put keeps the cache unchanged when the copy throws")
+{
+	using FragileHandle = FvmHandle<FragilePage>;
+	LruFlatValueMap<FragileHandle, FragilePage> cache{ 2 };
+	FragilePage page{ 7 };
+	cache.put(FragileHandle{ 1 }, FragilePage{ 1 });
+
+	FragilePage::fail_copies = true;
+	// A new element in a cache that is not full
+	CHECK_THROWS_AS(cache.put(FragileHandle{ 2 }, page), std::runtime_error);
+	CHECK(cache.size() == 1);
+	CHECK_FALSE(cache.contains(FragileHandle{ 2 }));
+	FragilePage::fail_copies = false;
+
+	cache.put(FragileHandle{ 2 }, FragilePage{ 2 });
+	REQUIRE(cache.size() == 2);
+	CHECK(cache.least_recent_handle() == FragileHandle{ 1 });
+
+	FragilePage::fail_copies = true;
+	// A element that is already in the cache keeps it's place in the recency order
+	CHECK_THROWS_AS(cache.put(FragileHandle{ 1 }, page), std::runtime_error);
+	CHECK(cache.least_recent_handle() == FragileHandle{ 1 });
+	// A new element in a full cache does not evict anything
+	CHECK_THROWS_AS(cache.put(FragileHandle{ 3 }, page), std::runtime_error);
+	FragilePage::fail_copies = false;
+
+	CHECK(cache.size() == 2);
+	CHECK_FALSE(cache.contains(FragileHandle{ 3 }));
+	REQUIRE(cache.peek(FragileHandle{ 1 }) != nullptr);
+	CHECK(cache.peek(FragileHandle{ 1 })->id == 1);
+	CHECK(cache.peek(FragileHandle{ 2 })->id == 2);
+	CHECK(cache.least_recent_handle() == FragileHandle{ 1 });
+	CHECK(cache.stats().evictions == 0);
+
+	cache.put(FragileHandle{ 3 }, page);
+	CHECK_FALSE(cache.contains(FragileHandle{ 1 }));
+	CHECK(cache.peek(FragileHandle{ 3 })->id == 7);
+}
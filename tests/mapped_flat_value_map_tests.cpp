@@ -0,0 +1,255 @@
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_flat_value_map.h"
+#include "flat_value_map_handle.h"
+
+#if COF_POSIX_MAPPING
+#include <csignal>
+#include <sys/resource.h>
+
+using namespace cof;
+
+struct Record { std::uint64_t key; double amount; };
+
+using RecordHandle = FvmHandle<Record>;
+using Records = MappedFlatValueMap<RecordHandle, Record>;
+
+static std::string mapped_test_path(const char* name)
+{
+	std::string path = (std::filesystem::temp_directory_path() / name).string();
+	std::remove(path.c_str());
+	return path;
+}
+
+
+TEST_CASE("MappedFlatValueMap grows and matches a model")
+{
+	std::string path = mapped_test_path("cof_mapped_model.fvm");
+	Records records{ path, 4 };
+	REQUIRE(records.is_open());
+
+	std::unordered_map<std::uint32_t, std::uint64_t> model;
+	std::vector<RecordHandle> handles;
+	std::mt19937 rng{ 11 };
+	for (std::uint64_t i = 0; i < 5000; ++i) {
+		if (handles.empty() || rng() % 3 != 0) {
+			RecordHandle handle = records.push_back(Record{ i, 0.5 });
+			REQUIRE(handle.id != 0);
+			handles.push_back(handle);
+			model[handle.id] = i;
+		} else {
+			std::size_t index = rng() % handles.size();
+			records.erase(handles[index]);
+			model.erase(handles[index].id);
+			handles[index] = handles.back();
+			handles.pop_back();
+		}
+	}
+
+	CHECK(records.size() == model.size());
+	CHECK(records.capacity() >= records.size());
+	for (auto& entry : model) {
+		REQUIRE(records.contains(RecordHandle{ entry.first }));
+		CHECK(records[RecordHandle{ entry.first }].key == entry.second);
+	}
+	for (std::size_t i = 0; i < records.size(); ++i) {
+		CHECK(model.at(records.handle_at(i).id) == records.data()[i].key);
+	}
+	CHECK_FALSE(records.contains(RecordHandle{ 0 }));
+
+	std::remove(path.c_str());
+}
+
+TEST_CASE("MappedFlatValueMap is usable again after a restart without loading")
+{
+	std::string path = mapped_test_path("cof_mapped_restart.fvm");
+	std::vector<RecordHandle> handles;
+	{
+		Records records{ path };
+		REQUIRE(records.is_open());
+		for (std::uint64_t i = 0; i < 3000; ++i) {
+			handles.push_back(records.push_back(Record{ i, static_cast<double>(i) }));
+		}
+		records.erase(handles[10]);
+		CHECK(records.flush());
+	}
+
+	Records reopened{ path };
+	REQUIRE(reopened.is_open());
+	CHECK(reopened.size() == 2999);
+	CHECK_FALSE(reopened.contains(handles[10]));
+	CHECK(reopened[handles[2999]].key == 2999);
+
+	reopened.advise(AccessPattern::sequential);
+	double sum = 0;
+	for (const Record& record : reopened) {
+		sum += record.amount;
+	}
+	CHECK(sum == 2999.0 * 3000.0 / 2.0 - 10.0);
+
+	// The id counter is stored in the file, so handles from before the restart are never reused
+	RecordHandle new_handle = reopened.push_back(Record{ 0, 0 });
+	CHECK(new_handle.id > handles.back().id);
+
+	std::remove(path.c_str());
+}
+
+TEST_CASE("MappedFlatValueMap keeps it's elements when the file can not grow")
+{
+	std::string path = mapped_test_path("cof_mapped_full_disk.fvm");
+	std::vector<RecordHandle> handles;
+	{
+		Records records{ path };
+		REQUIRE(records.is_open());
+		while (records.size() < records.capacity()) {
+			handles.push_back(records.push_back(Record{ records.size(), 1.0 }));
+		}
+		std::size_t file_size = static_cast<std::size_t>(std::filesystem::file_size(path));
+
+		// A file size limit makes growing the file fail like a full disk does, without the signal that would end the process
+		rlimit old_limit{};
+		REQUIRE(getrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+		rlimit limit = old_limit;
+		limit.rlim_cur = static_cast<rlim_t>(file_size);
+		auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+		REQUIRE(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+		CHECK(records.push_back(Record{ 0, 0 }).id == 0);
+		CHECK_FALSE(records.reserve(records.capacity() * 4));
+		bool open_after_failure = records.is_open();
+		std::size_t capacity_after_failure = records.capacity();
+		// The map is still usable at it's old capacity
+		records.erase(handles[5]);
+		RecordHandle replacement = records.push_back(Record{ 5, 1.0 });
+
+		setrlimit(RLIMIT_FSIZE, &old_limit);
+		std::signal(SIGXFSZ, old_handler);
+
+		CHECK(open_after_failure);
+		CHECK(capacity_after_failure == handles.size());
+		CHECK(std::filesystem::file_size(path) == file_size);
+		REQUIRE(replacement.id != 0);
+		handles[5] = replacement;
+		CHECK(records.size() == handles.size());
+		for (std::size_t i = 0; i < handles.size(); ++i) {
+			REQUIRE(records.contains(handles[i]));
+			CHECK(records[handles[i]].key == i);
+		}
+
+		// Without the limit it grows again
+		handles.push_back(records.push_back(Record{ handles.size(), 1.0 }));
+		CHECK(handles.back().id != 0);
+		CHECK(records.capacity() > capacity_after_failure);
+	}
+
+	Records reopened{ path };
+	REQUIRE(reopened.is_open());
+	CHECK(reopened.size() == handles.size());
+	for (std::size_t i = 0; i < handles.size(); ++i) {
+		REQUIRE(reopened.contains(handles[i]));
+		CHECK(reopened[handles[i]].key == i);
+	}
+
+	std::remove(path.c_str());
+}
+
+TEST_CASE("MappedFlatValueMap stops making handles when the ids run out")
+{
+	std::string path = mapped_test_path("cof_mapped_last_id.fvm");
+	{
+		Records records{ path, 8 };
+		REQUIRE(records.is_open());
+		RecordHandle first = records.push_back(Record{ 1, 1.0 });
+
+		// A loaded handle with the highest id leaves no id for the next push_back()
+		detail::SequentialFor sequential{};
+		RecordHandle highest{ UINT32_MAX };
+		Record loaded{ 2, 2.0 };
+		REQUIRE(records.bulk_load(&highest, &loaded, 1, sequential));
+		CHECK(records.push_back(Record{ 3, 3.0 }).id == 0);
+		CHECK(records.emplace_back(Record{ 4, 4.0 }).id == 0);
+		CHECK(records.size() == 2);
+		CHECK(records[first].key == 1);
+		CHECK(records[highest].key == 2);
+	}
+	std::remove(path.c_str());
+}
+
+TEST_CASE("MappedFlatValueMap does not open files made for something else")
+{
+	std::string path = mapped_test_path("cof_mapped_other.fvm");
+	{
+		Records records{ path };
+		REQUIRE(records.is_open());
+		records.push_back(Record{ 1, 1 });
+	}
+	MappedFlatValueMap<FvmHandle<int>, int> wrong_value_type{ path };
+	CHECK_FALSE(wrong_value_type.is_open());
+	std::remove(path.c_str());
+
+	std::FILE* text = std::fopen(path.c_str(), "wb");
+	REQUIRE(text != nullptr);
+	std::fputs("not a map", text);
+	std::fclose(text);
+	Records not_a_map{ path };
+	CHECK_FALSE(not_a_map.is_open());
+	std::remove(path.c_str());
+}
+
+TEST_CASE("MappedFlatValueMap does not open a file with a damaged layout")
+{
+	std::string path = mapped_test_path("cof_mapped_damaged.fvm");
+	auto make_map = [&]() {
+		std::remove(path.c_str());
+		Records records{ path, 64 };
+		REQUIRE(records.is_open());
+		for (std::uint64_t i = 0; i < 10; ++i) {
+			records.push_back(Record{ i, 1.0 });
+		}
+	};
+	// Overwrite the 8 byte header field at `offset`
+	auto damage = [&](long offset, std::uint64_t value) {
+		std::FILE* file = std::fopen(path.c_str(), "r+b");
+		REQUIRE(file != nullptr);
+		std::fseek(file, offset, SEEK_SET);
+		std::fwrite(&value, sizeof(value), 1, file);
+		std::fclose(file);
+	};
+	const long capacity_field = 16;
+	const long handle_ids_offset_field = 40;
+	const long index_slots_offset_field = 48;
+	const long index_slot_count_field = 56;
+
+	make_map();
+	CHECK(Records{ path }.is_open());
+
+	make_map();
+	damage(handle_ids_offset_field, 1u << 30);
+	CHECK_FALSE(Records{ path }.is_open());
+
+	make_map();
+	damage(index_slots_offset_field, 64);
+	CHECK_FALSE(Records{ path }.is_open());
+
+	make_map();
+	damage(index_slot_count_field, 1u << 20);
+	CHECK_FALSE(Records{ path }.is_open());
+
+	make_map();
+	damage(capacity_field, ~0ull / 2);
+	CHECK_FALSE(Records{ path }.is_open());
+
+	make_map();
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+	CHECK_FALSE(Records{ path }.is_open());
+
+	std::remove(path.c_str());
+}
+
+#endif // END: COF_POSIX_MAPPING
@@ -0,0 +1,91 @@
+#define ENABLE_LIGHT_SPARSE_TO_DENSE_VECTOR_FIND
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "light_flat_value_map.h"
+#include "utils/membership_filter.h"
+
+
+using namespace cof;
+
+using NameHandle = FvmHandle<std::string>;
+
+
+TEST_CASE("CountingBloomFilter has no false negatives and supports erase")
+{
+	CountingBloomFilter filter{ 1000 };
+	REQUIRE(filter.enabled());
+
+	for (std::size_t key = 0; key < 1000; ++key) {
+		filter.insert(key);
+	}
+	for (std::size_t key = 0; key < 1000; ++key) {
+		CHECK(filter.may_contain(key));
+	}
+
+	std::size_t false_positives = 0;
+	for (std::size_t key = 1000; key < 11000; ++key) {
+		false_positives += filter.may_contain(key) ? 1 : 0;
+	}
+	CHECK(false_positives < 500);
+
+	for (std::size_t key = 0; key < 1000; key += 2) {
+		filter.erase(key);
+	}
+	for (std::size_t key = 1; key < 1000; key += 2) {
+		CHECK(filter.may_contain(key));
+	}
+	std::size_t erased_still_found = 0;
+	for (std::size_t key = 0; key < 1000; key += 2) {
+		erased_still_found += filter.may_contain(key) ? 1 : 0;
+	}
+	CHECK(erased_still_found < 50);
+}
+
+TEST_CASE("FlatValueMap with a membership filter")
+{
+	FlatValueMap<NameHandle, std::string> names{};
+	std::vector<NameHandle> handles;
+	handles.push_back(names.push_back("Before the filter"));
+	names.enable_membership_filter();
+	REQUIRE(names.membership_filter_enabled());
+
+	// Grow well past the initial capacity so the filter gets rebuilt
+	for (int i = 0; i < 500; ++i) {
+		handles.push_back(names.emplace_back(std::to_string(i)));
+	}
+	for (NameHandle handle : handles) {
+		CHECK(names.contains(handle));
+		CHECK(names.find(handle) != names.end());
+	}
+
+	names.erase(handles[10]);
+	CHECK_FALSE(names.contains(handles[10]));
+	CHECK(names.find(handles[10]) == names.end());
+	CHECK_FALSE(names.contains(NameHandle{ 0 }));
+
+	names.disable_membership_filter();
+	CHECK_FALSE(names.membership_filter_enabled());
+	CHECK(names.contains(handles[11]));
+}
+
+TEST_CASE("LightFlatValueMap with a membership filter")
+{
+	LightFlatValueMap<NameHandle, std::string> names{};
+	names.enable_membership_filter(16);
+
+	std::vector<NameHandle> handles;
+	for (int i = 0; i < 100; ++i) {
+		handles.push_back(names.push_back(std::to_string(i)));
+	}
+	names.erase(handles[0]);
+
+	CHECK_FALSE(names.contains(handles[0]));
+	CHECK(names.find(handles[0]) == names.end());
+	for (std::size_t i = 1; i < handles.size(); ++i) {
+		CHECK(names.contains(handles[i]));
+		CHECK(*names.find(handles[i]) == std::to_string(i));
+	}
+}
@@ -0,0 +1,169 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "numa_sharded_flat_value_map.h"
+
+
+using namespace cof;
+
+struct Account { std::uint64_t owner; std::int64_t balance; };
+struct AccountTag;
+
+using AccountHandle = FvmHandle<AccountTag>;
+using Accounts = NumaShardedFlatValueMap<AccountHandle, Account>;
+
+// Two nodes that both have CPU 0, so the threads can be pinned on any test machine
+static NumaTopology two_node_topology()
+{
+	return NumaTopology{ { { 0 }, { 0 } } };
+}
+
+
+TEST_CASE("parse_cpu_list reads the sysfs CPU list format")
+{
+	CHECK(detail::parse_cpu_list("0-3,8,10-11\n") == std::vector<int>{ 0, 1, 2, 3, 8, 10, 11 });
+	CHECK(detail::parse_cpu_list("5") == std::vector<int>{ 5 });
+	CHECK(detail::parse_cpu_list("\n").empty());
+
+	NumaTopology detected = NumaTopology::detect();
+	REQUIRE(detected.node_count() >= 1);
+	CHECK(detected.current_node() < detected.node_count());
+}
+
+TEST_CASE("NumaShardedFlatValueMap handles find the element in the shard it was added to")
+{
+	Accounts accounts{ 2, two_node_topology() };
+	REQUIRE(accounts.shard_count() == 4);
+	CHECK(accounts.node_of_shard(0) == 0);
+	CHECK(accounts.node_of_shard(1) == 1);
+	CHECK(accounts.node_of_shard(3) == 1);
+
+	std::unordered_map<std::uint32_t, std::uint64_t> model;
+	std::vector<AccountHandle> handles;
+	for (std::uint64_t i = 0; i < 4000; ++i) {
+		std::size_t shard = i % accounts.shard_count();
+		AccountHandle handle = accounts.push_back_to(shard, Account{ i, 0 });
+		CHECK(accounts.shard_of(handle) == shard);
+		handles.push_back(handle);
+		model[handle.id] = i;
+	}
+	AccountHandle local = accounts.emplace_back_to(accounts.local_shard(), Account{ 9999, 1 });
+	CHECK(accounts[local].owner == 9999);
+	accounts.erase(local);
+
+	for (std::size_t i = 0; i < handles.size(); i += 3) {
+		accounts.erase(handles[i]);
+		model.erase(handles[i].id);
+	}
+	CHECK(accounts.size() == model.size());
+	for (AccountHandle handle : handles) {
+		bool alive = model.count(handle.id) != 0;
+		REQUIRE(accounts.contains(handle) == alive);
+		if (alive) {
+			CHECK(accounts[handle].owner == model[handle.id]);
+			CHECK(accounts.find(handle) == &accounts[handle]);
+		} else {
+			CHECK(accounts.find(handle) == nullptr);
+		}
+	}
+
+	std::size_t visited = 0;
+	accounts.for_each([&](AccountHandle handle, Account& account) {
+		CHECK(model.at(handle.id) == account.owner);
+		++visited;
+	});
+	CHECK(visited == model.size());
+
+	accounts.clear();
+	CHECK(accounts.empty());
+}
+
+TEST_CASE("NumaShardedFlatValueMap::parallel_for_each visits every element once on the threads of it's node")
+{
+	Accounts accounts{ 3, two_node_topology() };
+	std::vector<AccountHandle> handles;
+	for (std::uint64_t i = 0; i < 30000; ++i) {
+		handles.push_back(accounts.push_back(Account{ i, 0 }));
+	}
+
+	accounts.parallel_for_each([](AccountHandle, Account& account) {
+		account.balance += 1;
+	}, 2);
+	for (AccountHandle handle : handles) {
+		REQUIRE(accounts[handle].balance == 1);
+	}
+
+	std::mutex visited_mutex;
+	std::set<std::size_t> visited_shards;
+	std::atomic<std::size_t> element_count{ 0 };
+	accounts.parallel_for_each_shard([&](std::size_t shard, Accounts::Shard& shard_map) {
+		element_count += shard_map.size();
+		std::lock_guard<std::mutex> lock{ visited_mutex };
+		CHECK(visited_shards.insert(shard).second);
+	});
+	CHECK(visited_shards.size() == accounts.shard_count());
+	CHECK(element_count == handles.size());
+}
+
+TEST_CASE("NumaShardedFlatValueMap returns a handle with id 0 instead of reusing ids when they run out")
+{
+	struct ExhaustedAccountTag;
+	using ExhaustedHandle = FvmHandle<ExhaustedAccountTag>;
+	using ExhaustedAccounts = NumaShardedFlatValueMap<ExhaustedHandle, Account>;
+
+	ExhaustedAccounts accounts{ 2, two_node_topology() };
+	REQUIRE(accounts.shard_count() == 4);
+	ExhaustedHandle first = accounts.push_back_to(1, Account{ 1, 0 });
+	REQUIRE(first.id != 0);
+
+	// 4 shards leave 30 bits for the ids
+	ExhaustedAccounts::Shard::reserve_handle_ids((1u << 30) - 2);
+	ExhaustedHandle last = accounts.push_back_to(2, Account{ 2, 0 });
+	REQUIRE(last.id != 0);
+	CHECK(accounts.shard_of(last) == 2);
+
+	CHECK(accounts.push_back_to(0, Account{ 3, 0 }).id == 0);
+	CHECK(accounts.emplace_back_to(1, Account{ 4, 0 }).id == 0);
+	CHECK(accounts.push_back(Account{ 5, 0 }).id == 0);
+	CHECK(accounts.size() == 2);
+	CHECK(accounts[first].owner == 1);
+	CHECK(accounts[last].owner == 2);
+}
+
+TEST_CASE("NumaShardedFlatValueMap puts no shards on nodes without CPUs")
+{
+	// Node 1 is memory-only
+	Accounts accounts{ 2, NumaTopology{ { { 0 }, {}, { 0 } } } };
+	REQUIRE(accounts.shard_count() == 4);
+	for (std::size_t shard = 0; shard < accounts.shard_count(); ++shard) {
+		CHECK(accounts.node_of_shard(shard) != 1);
+	}
+
+	std::vector<AccountHandle> handles;
+	for (std::uint64_t i = 0; i < 1000; ++i) {
+		handles.push_back(accounts.push_back(Account{ i, 0 }));
+	}
+	accounts.parallel_for_each([](AccountHandle, Account& account) { account.balance += 1; });
+	for (AccountHandle handle : handles) {
+		REQUIRE(accounts[handle].balance == 1);
+	}
+}
+
+TEST_CASE("NumaShardedFlatValueMap::parallel_for_each_shard rethrows the exception of a thread")
+{
+	Accounts accounts{ 2, two_node_topology() };
+	std::atomic<std::size_t> visited{ 0 };
+	CHECK_THROWS_AS(accounts.parallel_for_each_shard([&](std::size_t shard, Accounts::Shard&) {
+		++visited;
+		if (shard == 1) {
+			throw std::runtime_error("shard failed");
+		}
+	}), std::runtime_error);
+	CHECK(visited >= 1);
+}
@@ -0,0 +1,89 @@
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "ordered_flat_value_map.h"
+
+
+using namespace cof;
+
+using EventHandle = FvmHandle<std::string>;
+
+
+namespace
+{
+	std::vector<int> to_vector(const OrderedFlatValueMap<EventHandle, int>& map)
+	{
+		return std::vector<int>(map.begin(), map.end());
+	}
+}
+
+
+TEST_CASE("OrderedFlatValueMap keeps insertion order after erase")
+{
+	OrderedFlatValueMap<EventHandle, int> events{};
+	std::vector<EventHandle> handles;
+	for (int i = 0; i < 6; ++i) {
+		handles.push_back(events.push_back(i));
+	}
+
+	events.erase(handles[0]);
+	events.erase(handles[3]);
+	CHECK(events.size() == 4);
+	CHECK(events.tombstone_count() == 2);
+	CHECK(to_vector(events) == std::vector<int>{ 1, 2, 4, 5 });
+	CHECK_FALSE(events.contains(handles[3]));
+	CHECK(events.find(handles[3]) == events.end());
+	CHECK(*events.find(handles[4]) == 4);
+	CHECK(events.find(handles[4]).handle() == handles[4]);
+
+	events.push_back(6);
+	events.compact();
+	CHECK(events.tombstone_count() == 0);
+	CHECK(to_vector(events) == std::vector<int>{ 1, 2, 4, 5, 6 });
+	CHECK(events[handles[5]] == 5);
+}
+
+TEST_CASE("OrderedFlatValueMap compacts when most slots are tombstones")
+{
+	OrderedFlatValueMap<EventHandle, int> events{};
+	std::vector<EventHandle> handles;
+	for (int i = 0; i < 100; ++i) {
+		handles.push_back(events.emplace_back(i));
+	}
+
+	std::vector<int> expected;
+	for (int i = 0; i < 100; ++i) {
+		if (i % 4 != 0) {
+			events.erase(handles[i]);
+		} else {
+			expected.push_back(i);
+		}
+		// Never more tombstones then live elements after a erase
+		CHECK(events.tombstone_count() <= events.size());
+	}
+	CHECK(to_vector(events) == expected);
+	for (int i = 0; i < 100; i += 4) {
+		CHECK(events[handles[i]] == i);
+	}
+
+	for (int i = 0; i < 100; i += 4) {
+		events.erase(handles[i]);
+	}
+	CHECK(events.empty());
+	CHECK(events.begin() == events.end());
+}
+
+TEST_CASE("OrderedFlatValueMap const iteration")
+{
+	OrderedFlatValueMap<EventHandle, int> events{};
+	EventHandle first = events.push_back(1);
+	events.push_back(2);
+	events.erase(first);
+
+	const OrderedFlatValueMap<EventHandle, int>& const_events = events;
+	OrderedFlatValueMap<EventHandle, int>::const_iterator it = events.begin();
+	CHECK(it == const_events.begin());
+	CHECK(*it == 2);
+	CHECK(++it == const_events.end());
+}
@@ -0,0 +1,196 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "utils/work_stealing_pool.h"
+
+
+using namespace cof;
+
+struct Order { std::uint64_t id; std::string customer; };
+struct OrderTag;
+
+using OrderHandle = FvmHandle<OrderTag>;
+using Orders = FlatValueMap<OrderHandle, Order>;
+
+static std::vector<OrderHandle> fill_orders(Orders& orders, std::uint64_t count)
+{
+	std::vector<OrderHandle> handles;
+	for (std::uint64_t i = 0; i < count; ++i) {
+		handles.push_back(orders.push_back(Order{ i, "customer " + std::to_string(i % 97) }));
+	}
+	return handles;
+}
+
+static void check_consistent(const Orders& orders)
+{
+	for (std::size_t i = 0; i < orders.size(); ++i) {
+		REQUIRE(orders.contains(orders.handle_at(i)));
+		REQUIRE(&orders[orders.handle_at(i)] == &orders.data()[i]);
+	}
+}
+
+
+TEST_CASE("WorkStealingPool::parallel_for runs every chunk once")
+{
+	WorkStealingPool pool{ 4 };
+	CHECK(pool.thread_count() == 4);
+
+	std::vector<std::atomic<int>> visits(100003);
+	for (int round = 0; round < 20; ++round) {
+		pool.parallel_for(visits.size(), 1000, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) {
+				++visits[i];
+			}
+		});
+	}
+	for (std::atomic<int>& count : visits) {
+		REQUIRE(count == 20);
+	}
+
+	// Chunks that take very different times, the threads with the cheap chunks steal the rest
+	std::atomic<std::uint64_t> total{ 0 };
+	pool.parallel_for(64, 1, [&](std::size_t begin, std::size_t) {
+		std::uint64_t sum = 0;
+		for (std::uint64_t i = 0; i < (begin < 8 ? 200000u : 10u); ++i) {
+			sum += i;
+		}
+		total += sum;
+	});
+	CHECK(total == 8 * (200000ull * 199999ull / 2) + 56 * 45);
+	pool.parallel_for(0, 10, [](std::size_t, std::size_t) { FAIL("There are no chunks"); });
+}
+
+TEST_CASE("WorkStealingPool::parallel_for rethrows the exception of a chunk")
+{
+	WorkStealingPool pool{ 4 };
+	std::atomic<int> runs{ 0 };
+	CHECK_THROWS_AS(pool.parallel_for(1000, 1, [&](std::size_t begin, std::size_t) {
+		++runs;
+		if (begin % 100 == 42) {
+			throw std::runtime_error{ "chunk failed" };
+		}
+	}), std::runtime_error);
+	CHECK(runs <= 1000);
+
+	// The pool still works after a failed loop
+	std::atomic<std::size_t> total{ 0 };
+	pool.parallel_for(1000, 10, [&](std::size_t begin, std::size_t end) { total += end - begin; });
+	CHECK(total == 1000);
+}
+
+TEST_CASE("A grain of 0 runs chunks of one element")
+{
+	WorkStealingPool pool{ 2 };
+	detail::SequentialFor sequential{};
+	std::atomic<std::size_t> pool_chunks{ 0 };
+	std::atomic<std::size_t> pool_total{ 0 };
+	pool.parallel_for(10, 0, [&](std::size_t begin, std::size_t end) { ++pool_chunks; pool_total += end - begin; });
+	CHECK(pool_chunks == 10);
+	CHECK(pool_total == 10);
+
+	std::vector<std::size_t> chunk_ends;
+	sequential.parallel_for(10, 0, [&](std::size_t, std::size_t end) { chunk_ends.push_back(end); });
+	CHECK(chunk_ends == std::vector<std::size_t>{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 });
+
+	// A grain bigger then the rest of the range does not overflow
+	chunk_ends.clear();
+	sequential.parallel_for(10, SIZE_MAX, [&](std::size_t, std::size_t end) { chunk_ends.push_back(end); });
+	CHECK(chunk_ends == std::vector<std::size_t>{ 10 });
+}
+
+TEST_CASE("FlatValueMap::erase_if erases the matching elements and keeps the handles working")
+{
+	Orders orders{};
+	std::vector<OrderHandle> handles = fill_orders(orders, 50000);
+
+	CHECK(orders.erase_if([](const Order&) { return false; }) == 0);
+	std::size_t erased = orders.erase_if([](const Order& order) { return order.id % 3 == 0; });
+	CHECK(erased == 16667);
+	CHECK(orders.size() == 50000 - 16667);
+	for (std::size_t i = 0; i < handles.size(); ++i) {
+		REQUIRE(orders.contains(handles[i]) == (i % 3 != 0));
+	}
+	check_consistent(orders);
+
+	CHECK(orders.erase_if([](const Order&) { return true; }) == 50000 - 16667);
+	CHECK(orders.empty());
+}
+
+TEST_CASE("FlatValueMap::parallel_erase_if gives the same result as erase_if")
+{
+	WorkStealingPool pool{ 4 };
+	std::mt19937_64 rng{ 5 };
+	std::vector<std::uint8_t> erase_id(200000);
+	for (std::uint8_t& erase : erase_id) {
+		erase = rng() % 4 == 0 ? 1 : 0;
+	}
+	auto predicate = [&](const Order& order) { return erase_id[order.id] != 0; };
+
+	Orders sequential{};
+	Orders parallel{};
+	fill_orders(sequential, erase_id.size());
+	std::vector<OrderHandle> handles = fill_orders(parallel, erase_id.size());
+	parallel.erase(handles[7]);
+	sequential.erase(sequential.handle_at(7));
+
+	std::size_t sequential_erased = sequential.erase_if(predicate);
+	std::size_t parallel_erased = parallel.parallel_erase_if(predicate, pool, 1000);
+	CHECK(parallel_erased == sequential_erased);
+	REQUIRE(parallel.size() == sequential.size());
+	for (std::size_t i = 0; i < parallel.size(); ++i) {
+		REQUIRE(parallel.data()[i].id == sequential.data()[i].id);
+		REQUIRE(parallel.data()[i].customer == sequential.data()[i].customer);
+	}
+	check_consistent(parallel);
+	for (std::size_t i = 0; i < handles.size(); ++i) {
+		REQUIRE(parallel.contains(handles[i]) == (i != 7 && erase_id[i] == 0));
+	}
+}
+
+TEST_CASE("FlatValueMap::parallel_erase_if keeps the erased elements in the value pool")
+{
+	WorkStealingPool pool{ 3 };
+	Orders orders{};
+	orders.enable_value_pool();
+	orders.enable_membership_filter();
+	std::vector<OrderHandle> handles = fill_orders(orders, 10000);
+
+	std::size_t erased = orders.parallel_erase_if([](const Order& order) { return order.id >= 2500; }, pool, 100);
+	CHECK(erased == 7500);
+	CHECK(orders.size() == 2500);
+	CHECK(orders.pooled_count() == 7500);
+	CHECK_FALSE(orders.contains(handles[9999]));
+	check_consistent(orders);
+
+	OrderHandle reused = orders.push_back(Order{ 1, "new" });
+	CHECK(orders[reused].customer == "new");
+	CHECK(orders.pooled_count() == 7499);
+}
+
+TEST_CASE("FlatValueMap::parallel_erase_if leaves the map unchanged when the predicate throws")
+{
+	WorkStealingPool pool{ 4 };
+	Orders orders{};
+	std::vector<OrderHandle> handles = fill_orders(orders, 20000);
+
+	CHECK_THROWS_AS(orders.parallel_erase_if([](const Order& order) {
+		if (order.id == 12345) {
+			throw std::runtime_error{ "bad order" };
+		}
+		return order.id % 2 == 0;
+	}, pool, 100), std::runtime_error);
+	CHECK(orders.size() == 20000);
+	for (std::size_t i = 0; i < handles.size(); ++i) {
+		REQUIRE(orders[handles[i]].id == i);
+	}
+	check_consistent(orders);
+
+	CHECK(orders.parallel_erase_if([](const Order& order) { return order.id % 2 == 0; }, pool, 100) == 10000);
+	check_consistent(orders);
+}
@@ -0,0 +1,233 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "shared_flat_value_map.h"
+#include "flat_value_map_handle.h"
+
+#if COF_POSIX_MAPPING
+#include <unistd.h>
+
+using namespace cof;
+
+struct Entity { std::uint64_t a; std::uint64_t b; };
+
+using EntityHandle = FvmHandle<Entity>;
+using SharedEntities = SharedFlatValueMap<EntityHandle, Entity>;
+using EntityReader = SharedFlatValueMapReader<EntityHandle, Entity>;
+
+static std::string segment_name(const char* test_name)
+{
+	return std::string{ "/cof_" } + test_name + "_" + std::to_string(getpid());
+}
+
+
+TEST_CASE("OpenAddressingIndex erase keeps the other ids findable")
+{
+	std::vector<IndexSlot> slots(OpenAddressingIndex::slot_count_for(200));
+	OpenAddressingIndex::clear(slots.data(), slots.size());
+	OpenAddressingIndex index{ slots.data(), slots.size() };
+
+	std::unordered_map<std::uint32_t, std::uint32_t> model;
+	for (std::uint32_t id = 1; id <= 200; ++id) {
+		index.insert(id, id * 10);
+		model[id] = id * 10;
+	}
+	for (std::uint32_t id = 1; id <= 200; id += 3) {
+		CHECK(index.erase(id));
+		model.erase(id);
+	}
+	CHECK_FALSE(index.erase(1));
+
+	for (std::uint32_t id = 1; id <= 200; ++id) {
+		auto it = model.find(id);
+		CHECK(index.find(id) == (it == model.end() ? OpenAddressingIndex::not_found : it->second));
+	}
+}
+
+TEST_CASE("SharedFlatValueMap is readable through a second mapping")
+{
+	std::string name = segment_name("shared_read");
+	SharedEntities entities{ name.c_str(), 64 };
+	REQUIRE(entities.is_open());
+
+	auto first = entities.push_back(Entity{ 1, 2 });
+	auto second = entities.push_back(Entity{ 3, 6 });
+	auto third = entities.push_back(Entity{ 5, 10 });
+	entities.erase(first);
+	entities.assign(third, Entity{ 7, 14 });
+
+	EntityReader reader{ name.c_str() };
+	REQUIRE(reader.is_open());
+
+	Entity copy{};
+	CHECK(reader.get(second, copy));
+	CHECK(copy.a == 3);
+	CHECK(reader.get(third, copy));
+	CHECK(copy.a == 7);
+	CHECK_FALSE(reader.get(first, copy));
+
+	std::uint64_t sum = 0;
+	std::size_t count = 0;
+	reader.read([&](const EntityReader::View& view) {
+		sum = 0;
+		count = view.size();
+		for (const Entity& entity : view) {
+			sum += entity.a;
+		}
+	});
+	CHECK(count == 2);
+	CHECK(sum == 10);
+
+	// Both mappings point at the same memory, through offsets relative to their own address
+	std::uint64_t version = reader.version();
+	entities.update(second, [](Entity& entity) { entity.a = 100; });
+	CHECK(reader.version() == version + 2);
+	CHECK(reader.get(second, copy));
+	CHECK(copy.a == 100);
+
+	CHECK(SharedEntities::remove(name.c_str()));
+}
+
+TEST_CASE("SharedFlatValueMap reports a full segment and a wrong value type")
+{
+	std::string name = segment_name("shared_full");
+	SharedEntities entities{ name.c_str(), 2 };
+	REQUIRE(entities.is_open());
+	CHECK(entities.push_back(Entity{}).id != 0);
+	CHECK(entities.push_back(Entity{}).id != 0);
+	CHECK(entities.push_back(Entity{}).id == 0);
+	CHECK(entities.size() == 2);
+
+	SharedFlatValueMapReader<FvmHandle<int>, int> wrong_reader{ name.c_str() };
+	CHECK_FALSE(wrong_reader.is_open());
+	// Same size as Entity, but a other type
+	struct Pair { std::uint64_t first; std::uint64_t second; };
+	SharedFlatValueMapReader<FvmHandle<Pair>, Pair> same_size_reader{ name.c_str() };
+	CHECK_FALSE(same_size_reader.is_open());
+	SharedEntities::remove(name.c_str());
+
+	EntityReader missing_reader{ name.c_str() };
+	CHECK_FALSE(missing_reader.is_open());
+}
+
+TEST_CASE("SharedFlatValueMap publishes a change that throws")
+{
+	std::string name = segment_name("shared_throw");
+	SharedEntities entities{ name.c_str(), 8 };
+	REQUIRE(entities.is_open());
+	EntityHandle handle = entities.push_back(Entity{ 1, 1 });
+	EntityReader reader{ name.c_str() };
+	REQUIRE(reader.is_open());
+	std::uint64_t version = reader.version();
+
+	CHECK_THROWS_AS(entities.update(handle, [](Entity&) { throw std::runtime_error("update failed"); }), std::runtime_error);
+	CHECK_THROWS_AS(entities.batch([&](SharedEntities& map) {
+		map.push_back(Entity{ 2, 2 });
+		throw std::runtime_error("batch failed");
+	}), std::runtime_error);
+	CHECK(reader.version() % 2 == 0);
+	CHECK(reader.version() == version + 4);
+
+	std::size_t size = 0;
+	reader.read([&](const EntityReader::View& view) { size = view.size(); });
+	CHECK(size == 2);
+	SharedEntities::remove(name.c_str());
+}
+
+TEST_CASE("SharedFlatValueMap stays closed for a capacity that does not fit the dense indices")
+{
+	std::string name = segment_name("shared_capacity");
+	SharedEntities empty{ name.c_str(), 0 };
+	CHECK_FALSE(empty.is_open());
+	SharedEntities huge{ name.c_str(), std::size_t{ UINT32_MAX } };
+	CHECK_FALSE(huge.is_open());
+
+	EntityReader reader{ name.c_str() };
+	CHECK_FALSE(reader.is_open());
+}
+
+TEST_CASE("Replacing a SharedFlatValueMap segment leaves attached readers on the old one")
+{
+	std::string name = segment_name("shared_replace");
+	SharedEntities entities{ name.c_str(), 64 };
+	REQUIRE(entities.is_open());
+	EntityHandle handle = entities.push_back(Entity{ 7, 14 });
+	EntityReader reader{ name.c_str() };
+	REQUIRE(reader.is_open());
+
+	// A smaller segment under the same name, the old reader must neither see zeroes nor fault
+	SharedEntities replacement{ name.c_str(), 2 };
+	REQUIRE(replacement.is_open());
+	Entity copy{};
+	CHECK(reader.get(handle, copy));
+	CHECK(copy.a == 7);
+	EntityReader new_reader{ name.c_str() };
+	REQUIRE(new_reader.is_open());
+	CHECK_FALSE(new_reader.get(handle, copy));
+
+	SharedEntities moved{ std::move(replacement) };
+	CHECK(moved.is_open());
+	CHECK_FALSE(replacement.is_open());
+	EntityReader moved_reader{ std::move(new_reader) };
+	CHECK(moved_reader.is_open());
+	CHECK_FALSE(new_reader.is_open());
+	entities = std::move(moved);
+	CHECK(entities.is_open());
+	CHECK_FALSE(moved.is_open());
+	CHECK(entities.capacity() == 2);
+	SharedEntities::remove(name.c_str());
+}
+
+TEST_CASE("SharedFlatValueMap readers never see a half written change")
+{
+	std::string name = segment_name("shared_seqlock");
+	SharedEntities entities{ name.c_str(), 256 };
+	REQUIRE(entities.is_open());
+	EntityReader reader{ name.c_str() };
+	REQUIRE(reader.is_open());
+
+	std::atomic<bool> done{ false };
+	std::atomic<std::size_t> reads{ 0 };
+	std::thread writer{ [&]() {
+		std::vector<EntityHandle> handles;
+		// Keep writing until the reader read a few times, so the reads overlap the writes even on a machine with one CPU
+		for (std::uint64_t i = 0; i < 20000 || reads.load() < 100; ++i) {
+			if (handles.size() == 200) {
+				entities.erase(handles[i % handles.size()]);
+				handles[i % handles.size()] = handles.back();
+				handles.pop_back();
+			}
+			handles.push_back(entities.push_back(Entity{ i, i * 2 }));
+			entities.batch([&](SharedEntities& map) {
+				map.update(handles.front(), [i](Entity& entity) { entity.a = i; });
+				map.update(handles.front(), [i](Entity& entity) { entity.b = i * 2; });
+			});
+		}
+		done = true;
+	} };
+
+	std::size_t torn_reads = 0;
+	while (!done) {
+		reader.read([&](const EntityReader::View& view) {
+			torn_reads = 0;
+			for (const Entity& entity : view) {
+				if (entity.b != entity.a * 2) {
+					++torn_reads;
+				}
+			}
+		});
+		CHECK(torn_reads == 0);
+		++reads;
+	}
+	writer.join();
+	CHECK(reads >= 100);
+
+	SharedEntities::remove(name.c_str());
+}
+
+#endif // END: COF_POSIX_MAPPING
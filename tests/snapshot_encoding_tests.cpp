@@ -0,0 +1,227 @@
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "flat_value_map_snapshot.h"
+
+
+using namespace cof;
+
+struct Sample { std::uint32_t sensor; std::uint32_t flags; float value; std::int64_t timestamp; };
+struct SampleTag;
+
+using SampleHandle = FvmHandle<SampleTag>;
+using Samples = FlatValueMap<SampleHandle, Sample>;
+
+static Samples make_samples(std::size_t count)
+{
+	Samples samples{};
+	std::vector<SampleHandle> handles;
+	for (std::size_t i = 0; i < count; ++i) {
+		Sample sample{ static_cast<std::uint32_t>(i / 64), 1, 20.0f + static_cast<float>(i % 8) * 0.25f, 1700000000000 + static_cast<std::int64_t>(i) * 10 };
+		handles.push_back(samples.push_back(sample));
+	}
+	for (std::size_t i = 0; i < handles.size(); i += 7) {
+		samples.erase(handles[i]);
+	}
+	return samples;
+}
+
+static bool same_elements(const Samples& a, const Samples& b)
+{
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (std::size_t i = 0; i < a.size(); ++i) {
+		SampleHandle handle = a.handle_at(i);
+		if (!b.contains(handle) || std::memcmp(&a.data()[i], &b[handle], sizeof(Sample)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+TEST_CASE("Varints round trip")
+{
+	std::vector<std::uint32_t> numbers = { 0, 1, 127, 128, 16383, 16384, 0x0FFFFFFF, 0x10000000, UINT32_MAX };
+	std::vector<unsigned char> bytes;
+	for (std::uint32_t number : numbers) {
+		varint_encode(number, bytes);
+	}
+	CHECK(bytes.size() == 1 + 1 + 1 + 2 + 2 + 3 + 4 + 5 + 5);
+
+	const unsigned char* position = bytes.data();
+	for (std::uint32_t number : numbers) {
+		std::uint32_t decoded = 0;
+		REQUIRE(varint_decode(&position, bytes.data() + bytes.size(), decoded));
+		CHECK(decoded == number);
+	}
+	std::uint32_t decoded = 0;
+	CHECK_FALSE(varint_decode(&position, bytes.data() + bytes.size(), decoded));
+}
+
+TEST_CASE("Byte plane codec round trips and rejects bad input")
+{
+	std::mt19937 rng{ 3 };
+	for (std::size_t element_size : { 1, 3, 8, 24 }) {
+		for (std::size_t count : { 0, 1, 2, 5, 129, 1000 }) {
+			std::vector<unsigned char> elements(count * element_size);
+			for (std::size_t i = 0; i < elements.size(); ++i) {
+				// Half of the bytes are random, the other half form runs
+				elements[i] = (i / element_size) % 2 == 0 ? static_cast<unsigned char>(rng()) : static_cast<unsigned char>(i % element_size);
+			}
+			std::vector<unsigned char> encoded;
+			byte_plane_encode(elements.data(), count, element_size, encoded);
+			CHECK(encoded.size() <= byte_plane_max_size(count, element_size));
+
+			std::vector<unsigned char> decoded(elements.size());
+			REQUIRE(byte_plane_decode(encoded.data(), encoded.size(), count, element_size, decoded.data()));
+			CHECK(decoded == elements);
+
+			if (!encoded.empty()) {
+				CHECK_FALSE(byte_plane_decode(encoded.data(), encoded.size() - 1, count, element_size, decoded.data()));
+			}
+		}
+	}
+}
+
+TEST_CASE("Every snapshot encoding keeps the elements and handles")
+{
+	Samples samples = make_samples(10000);
+
+	std::vector<unsigned char> raw;
+	std::vector<unsigned char> delta;
+	std::vector<unsigned char> compressed;
+	encode_snapshot(samples, raw, SnapshotEncoding::raw);
+	encode_snapshot(samples, delta, SnapshotEncoding::delta_varint);
+	encode_snapshot(samples, compressed, SnapshotEncoding::compressed, 9);
+
+	for (auto* encoded : { &raw, &delta, &compressed }) {
+		Samples decoded{};
+		SnapshotInfo info{};
+		REQUIRE(decode_snapshot(encoded->data(), encoded->size(), decoded, &info));
+		CHECK(same_elements(samples, decoded));
+		CHECK(info.element_count == samples.size());
+	}
+
+	// The handles shrink from 4 bytes to 1 or 2 bytes, and the values compress well because most fields change slowly
+	CHECK(raw.size() - delta.size() >= samples.size() * 2);
+	CHECK(compressed.size() * 4 < raw.size());
+
+	// The raw encoding keeps the dense order
+	Samples raw_decoded{};
+	REQUIRE(decode_snapshot(raw.data(), raw.size(), raw_decoded));
+	for (std::size_t i = 0; i < samples.size(); ++i) {
+		CHECK(raw_decoded.handle_at(i) == samples.handle_at(i));
+	}
+}
+
+TEST_CASE("SnapshotDecoder streams one block at a time")
+{
+	Samples samples = make_samples(3 * snapshot_block_elements);
+	std::vector<unsigned char> encoded;
+	encode_snapshot(samples, encoded, SnapshotEncoding::compressed);
+
+	std::size_t offset = 0;
+	SnapshotDecoder<SampleHandle, Sample> decoder{ [&](void* out, std::size_t size) {
+		if (encoded.size() - offset < size) {
+			return false;
+		}
+		std::memcpy(out, encoded.data() + offset, size);
+		offset += size;
+		return true;
+	} };
+	REQUIRE(decoder.is_valid());
+
+	std::size_t block_count = 0;
+	std::size_t element_count = 0;
+	SampleHandle previous_handle{ 0 };
+	while (decoder.next_block()) {
+		++block_count;
+		for (std::size_t i = 0; i < decoder.block_size(); ++i) {
+			CHECK(previous_handle < decoder.block_handles()[i]);
+			previous_handle = decoder.block_handles()[i];
+			CHECK(std::memcmp(&decoder.block_values()[i], &samples[previous_handle], sizeof(Sample)) == 0);
+		}
+		element_count += decoder.block_size();
+	}
+	CHECK(decoder.finished());
+	CHECK(block_count == (samples.size() + snapshot_block_elements - 1) / snapshot_block_elements);
+	CHECK(element_count == samples.size());
+	CHECK(offset == encoded.size());
+}
+
+TEST_CASE("Corrupted or cut off snapshots are rejected")
+{
+	Samples samples = make_samples(5000);
+	std::vector<unsigned char> encoded;
+	encode_snapshot(samples, encoded, SnapshotEncoding::compressed);
+
+	Samples decoded{};
+	CHECK_FALSE(decode_snapshot(encoded.data(), encoded.size() - 1, decoded));
+	CHECK(decoded.empty());
+
+	encoded[encoded.size() / 2] ^= 0x40;
+	CHECK_FALSE(decode_snapshot(encoded.data(), encoded.size(), decoded));
+	CHECK(decoded.empty());
+
+	FlatValueMap<FvmHandle<SampleTag>, std::uint64_t> wrong_type{};
+	encode_snapshot(samples, encoded, SnapshotEncoding::raw);
+	CHECK_FALSE(decode_snapshot(encoded.data(), encoded.size(), wrong_type));
+}
+
+TEST_CASE("A block header with a impossible payload size is rejected before the payload is read")
+{
+	Samples samples = make_samples(100);
+	std::vector<unsigned char> encoded;
+	encode_snapshot(samples, encoded, SnapshotEncoding::raw);
+	// The first block header follows the snapshot header and it's checksum
+	const std::size_t payload_size_offset = sizeof(SnapshotInfo) + sizeof(std::uint32_t) + sizeof(std::uint32_t);
+	const std::uint32_t huge_payload = 0xFFFFFF00u;
+	std::memcpy(encoded.data() + payload_size_offset, &huge_payload, sizeof(huge_payload));
+
+	std::size_t offset = 0;
+	std::size_t largest_read = 0;
+	SnapshotDecoder<SampleHandle, Sample> decoder{ [&](void* out, std::size_t size) {
+		largest_read = size > largest_read ? size : largest_read;
+		if (size > encoded.size() - offset) {
+			return false;
+		}
+		std::memcpy(out, encoded.data() + offset, size);
+		offset += size;
+		return true;
+	} };
+	REQUIRE(decoder.is_valid());
+	CHECK_FALSE(decoder.next_block());
+	CHECK_FALSE(decoder.is_valid());
+	CHECK(largest_read < 1024);
+}
+
+TEST_CASE("Snapshots with a repeated handle are rejected")
+{
+	std::vector<SampleHandle> handles;
+	std::vector<Sample> values;
+	for (std::uint32_t i = 1; i <= 5000; ++i) {
+		handles.push_back(SampleHandle{ i * 3 });
+		values.push_back(Sample{ i, 0, 1.0f, 0 });
+	}
+	// In the second block, so the raw encoding repeats a handle of a earlier block
+	handles[4500] = handles[10];
+
+	for (SnapshotEncoding encoding : { SnapshotEncoding::raw, SnapshotEncoding::delta_varint, SnapshotEncoding::compressed }) {
+		INFO("encoding: " << static_cast<std::uint32_t>(encoding));
+		std::vector<unsigned char> encoded;
+		REQUIRE(encode_snapshot([&encoded](const void* data, std::size_t size) {
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			encoded.insert(encoded.end(), bytes, bytes + size);
+			return true;
+		}, handles.data(), values.data(), handles.size(), 15000, 0, encoding));
+
+		Samples decoded{};
+		CHECK_FALSE(decode_snapshot(encoded.data(), encoded.size(), decoded));
+		CHECK(decoded.empty());
+	}
+}
@@ -0,0 +1,206 @@
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "flat_value_map.h"
+#include "light_flat_value_map.h"
+#include "flat_value_map_trace.h"
+
+
+using namespace cof;
+
+struct TraceSample { std::uint32_t value; };
+struct TraceSampleTag;
+
+using TraceSampleHandle = FvmHandle<TraceSampleTag>;
+using TraceSampleMap = FlatValueMap<TraceSampleHandle, TraceSample>;
+using LightTraceSampleMap = LightFlatValueMap<LfvmHandle<TraceSampleTag>, TraceSample>;
+
+static std::string trace_test_path(const char* name)
+{
+	std::string path = (std::filesystem::temp_directory_path() / name).string();
+	std::remove(path.c_str());
+	return path;
+}
+
+
+TEST_CASE("TracedMap records every push_back, erase, lookup and iteration")
+{
+	std::string path = trace_test_path("cof_trace_record");
+	std::vector<TraceSampleHandle> handles;
+	{
+		TraceRecorder recorder{ path, sizeof(TraceSample) };
+		REQUIRE(recorder.is_open());
+		TracedMap<TraceSampleMap> map{ &recorder };
+		for (std::uint32_t i = 0; i < 300; ++i) {
+			handles.push_back(map.push_back(TraceSample{ i }));
+		}
+		CHECK(map[handles[200]].value == 200);
+		CHECK(map.contains(handles[3]));
+		map.erase(handles[3]);
+		CHECK(map.find(handles[3]) == map.end());
+		std::uint32_t sum = 0;
+		for (const TraceSample& sample : map) {
+			sum += sample.value;
+		}
+		CHECK(sum == 299 * 300 / 2 - 3);
+
+		// Not recorded
+		map.set_recorder(nullptr);
+		map.push_back(TraceSample{ 0 });
+		CHECK(map.inner().size() == 300);
+		CHECK(recorder.event_count() == 305);
+		CHECK(recorder.close());
+	}
+
+	std::vector<TraceEvent> events;
+	std::uint32_t value_size = 0;
+	REQUIRE(read_trace(path, events, &value_size));
+	CHECK(value_size == sizeof(TraceSample));
+	REQUIRE(events.size() == 305);
+	for (std::size_t i = 0; i < 300; ++i) {
+		CHECK(events[i].op == TraceOp::push_back);
+		CHECK(events[i].id == handles[i].id);
+	}
+	CHECK(events[300].op == TraceOp::access);
+	CHECK(events[300].id == handles[200].id);
+	CHECK(events[302].op == TraceOp::erase);
+	CHECK(events[302].id == handles[3].id);
+	CHECK(events[304].op == TraceOp::iterate);
+	CHECK(events[304].id == 299);
+	std::remove(path.c_str());
+}
+
+TEST_CASE("A trace replays to the same contents on FlatValueMap and LightFlatValueMap")
+{
+	std::string path = trace_test_path("cof_trace_replay");
+	std::size_t recorded_size = 0;
+	{
+		TraceRecorder recorder{ path };
+		TracedMap<TraceSampleMap> map{ &recorder };
+		std::vector<TraceSampleHandle> handles;
+		for (std::uint32_t i = 0; i < 2000; ++i) {
+			handles.push_back(map.push_back(TraceSample{ i }));
+			if (i % 3 == 0 && i != 0) {
+				map.erase(handles[i - 1]);
+			}
+			if (i % 7 == 0) {
+				map[handles[i]].value++;
+			}
+			if (i == 1000) {
+				map.clear();
+			}
+		}
+		recorded_size = map.size();
+	}
+
+	std::vector<TraceEvent> events;
+	REQUIRE(read_trace(path, events));
+
+	TraceSampleMap flat{};
+	TraceReplayer<TraceSampleMap> flat_replayer{ events };
+	flat_replayer.prepare(flat);
+	CHECK(flat.empty());
+	for (const TraceEvent& event : events) {
+		flat_replayer.replay(flat, event);
+	}
+	CHECK(flat.size() == recorded_size);
+
+	LightTraceSampleMap light{};
+	TraceReplayer<LightTraceSampleMap> light_replayer{ events };
+	light_replayer.prepare(light);
+	for (const TraceEvent& event : events) {
+		light_replayer.replay(light, event);
+	}
+	CHECK(light.size() == recorded_size);
+	std::remove(path.c_str());
+}
+
+TEST_CASE("TraceReplayer adds the elements a trace uses before it pushed them")
+{
+	std::vector<TraceEvent> events{
+		{ TraceOp::access, 7 },
+		{ TraceOp::push_back, 20 },
+		{ TraceOp::erase, 9 },
+		{ TraceOp::access, 20 },
+		{ TraceOp::access, 7 },
+	};
+	TraceSampleMap map{};
+	TraceReplayer<TraceSampleMap> replayer{ events };
+	replayer.prepare(map);
+	CHECK(map.size() == 2);
+	for (const TraceEvent& event : events) {
+		replayer.replay(map, event);
+	}
+	CHECK(map.size() == 2);
+}
+
+TEST_CASE("TraceReplayer handles traces with very large ids")
+{
+	// A trace of a long running process, a id array indexed by these ids would take gigabytes
+	std::vector<TraceEvent> events{
+		{ TraceOp::access, 4000000000u },
+		{ TraceOp::push_back, 4000000001u },
+		{ TraceOp::access, 4000000001u },
+		{ TraceOp::erase, 4000000000u },
+		{ TraceOp::push_back, 3999999999u },
+	};
+	TraceSampleMap map{};
+	TraceReplayer<TraceSampleMap> replayer{ events };
+	replayer.prepare(map);
+	CHECK(map.size() == 1);
+	for (const TraceEvent& event : events) {
+		replayer.replay(map, event);
+	}
+	CHECK(map.size() == 2);
+}
+
+TEST_CASE("read_trace reads events across the chunks it decodes")
+{
+	std::string path = trace_test_path("cof_trace_chunks");
+	std::vector<TraceEvent> recorded;
+	{
+		TraceRecorder recorder{ path };
+		for (std::uint32_t i = 0; i < 100000; ++i) {
+			TraceEvent event{ static_cast<TraceOp>(1 + i % 5), i * 2654435761u };
+			recorder.record(event.op, event.id);
+			recorded.push_back(event);
+		}
+	}
+
+	std::vector<TraceEvent> events;
+	REQUIRE(read_trace(path, events));
+	REQUIRE(events.size() == recorded.size());
+	for (std::size_t i = 0; i < events.size(); ++i) {
+		REQUIRE(events[i].op == recorded[i].op);
+		REQUIRE(events[i].id == recorded[i].id);
+	}
+	std::remove(path.c_str());
+}
+
+TEST_CASE("read_trace keeps the complete events of a cut off trace and rejects other files")
+{
+	std::string path = trace_test_path("cof_trace_truncated");
+	{
+		TraceRecorder recorder{ path };
+		recorder.record(TraceOp::push_back, 1);
+		recorder.record(TraceOp::access, 1u << 20);
+	}
+	std::uintmax_t size = std::filesystem::file_size(path);
+	CHECK(size == 16 + 2 + 4);
+	std::filesystem::resize_file(path, size - 1);
+
+	std::vector<TraceEvent> events;
+	REQUIRE(read_trace(path, events));
+	REQUIRE(events.size() == 1);
+	CHECK(events[0].op == TraceOp::push_back);
+	CHECK(events[0].id == 1);
+
+	std::filesystem::resize_file(path, 8);
+	CHECK_FALSE(read_trace(path, events));
+	std::remove(path.c_str());
+	CHECK_FALSE(read_trace(path, events));
+}
@@ -0,0 +1,163 @@
+#include <catch2/catch.hpp>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "flat_value_map.h"
+
+
+using namespace cof;
+
+struct PooledType
+{
+	std::string name;
+	std::vector<int> values;
+};
+
+using PooledHandle = FvmHandle<PooledType>;
+
+
+TEST_CASE("Value pool keeps erased elements after the live elements")
+{
+	FlatValueMap<PooledHandle, PooledType> fvm{};
+	fvm.enable_value_pool();
+	REQUIRE(fvm.value_pool_enabled());
+
+	std::vector<PooledHandle> handles;
+	for (int i = 0; i < 4; ++i) {
+		handles.push_back(fvm.push_back(PooledType{ std::string(100, 'a' + static_cast<char>(i)), std::vector<int>(100, i) }));
+	}
+
+	fvm.erase(handles[1]);
+	fvm.erase(handles[2]);
+	CHECK(fvm.size() == 2);
+	CHECK(fvm.pooled_count() == 2);
+	CHECK(fvm.end() - fvm.begin() == 2);
+	CHECK(fvm.find(handles[1]) == fvm.end());
+	CHECK(fvm.back().name[0] == fvm[fvm.handle_at(1)].name[0]);
+	for (const PooledType& element : fvm) {
+		CHECK(element.values.size() == 100);
+		CHECK((element.name[0] == 'a' || element.name[0] == 'd'));
+	}
+
+	// Pushing takes a pooled element, and the assign keeps the buffers of the erased element
+	PooledHandle recycled = fvm.recycle_back([](PooledType& element) {
+		CHECK(element.name.capacity() >= 100);
+		CHECK(element.values.capacity() >= 100);
+		element.name.assign("short");
+		element.values.assign(3, 7);
+	});
+	CHECK(fvm.pooled_count() == 1);
+	CHECK(fvm[recycled].name == "short");
+	CHECK(fvm[recycled].values == std::vector<int>{ 7, 7, 7 });
+	CHECK(fvm[recycled].name.capacity() >= 100);
+
+	PooledType copied{ "copied", { 1 } };
+	PooledHandle copy_handle = fvm.push_back(copied);
+	CHECK(fvm.pooled_count() == 0);
+	CHECK(fvm[copy_handle].values.capacity() >= 100);
+
+	// Growing past the pool appends like normal
+	PooledHandle appended = fvm.push_back(copied);
+	CHECK(fvm.size() == 5);
+	CHECK(fvm[appended].name == "copied");
+}
+
+TEST_CASE("Value pool keeps everything on clear and frees on release")
+{
+	FlatValueMap<PooledHandle, PooledType> fvm{};
+	fvm.enable_value_pool();
+	for (int i = 0; i < 10; ++i) {
+		fvm.emplace_back(PooledType{ std::to_string(i), {} });
+	}
+
+	fvm.clear();
+	CHECK(fvm.empty());
+	CHECK(fvm.begin() == fvm.end());
+	CHECK(fvm.pooled_count() == 10);
+
+	PooledHandle handle = fvm.emplace_back(PooledType{ "new", {} });
+	CHECK(fvm.size() == 1);
+	CHECK(fvm[handle].name == "new");
+	CHECK(fvm.pooled_count() == 9);
+
+	fvm.release_pool();
+	CHECK(fvm.pooled_count() == 0);
+	CHECK(fvm.size() == 1);
+
+	fvm.disable_value_pool();
+	fvm.erase(handle);
+	CHECK(fvm.pooled_count() == 0);
+	CHECK(fvm.empty());
+}
+
+TEST_CASE("Without the value pool erase destroys elements")
+{
+	FlatValueMap<PooledHandle, PooledType> fvm{};
+	PooledHandle handle = fvm.push_back(PooledType{ "name", {} });
+	fvm.erase(handle);
+	CHECK_FALSE(fvm.value_pool_enabled());
+	CHECK(fvm.pooled_count() == 0);
+}
+
+TEST_CASE("Value pool assigns the emplace_back argument straight into the pooled element")
+{
+	using NameHandle = FvmHandle<std::string>;
+	FlatValueMap<NameHandle, std::string> names{};
+	names.enable_value_pool();
+	NameHandle first = names.push_back(std::string(200, 'x'));
+	names.push_back("kept");
+	std::size_t pooled_capacity = names[first].capacity();
+	names.erase(first);
+	REQUIRE(names.pooled_count() == 1);
+
+	// A std::string temporary moved into the element would have replaced the 200 character buffer
+	NameHandle reused = names.emplace_back("short");
+	CHECK(names[reused] == "short");
+	CHECK(names[reused].capacity() == pooled_capacity);
+	CHECK(names.pooled_count() == 0);
+
+	// Two arguments go through a temporary
+	names.erase(reused);
+	NameHandle repeated = names.emplace_back(std::size_t{ 3 }, 'z');
+	CHECK(names[repeated] == "zzz");
+}
+
+// Can be constructed and moved into a vector, but not assigned to
+struct ConstantName
+{
+	const std::string name;
+	explicit ConstantName(std::string name) : name(std::move(name)) {}
+};
+
+TEST_CASE("Value pool compiles for elements that can not be assigned to")
+{
+	using ConstantHandle = FvmHandle<ConstantName>;
+	FlatValueMap<ConstantHandle, ConstantName> names{};
+	names.enable_value_pool();
+	ConstantHandle handle = names.emplace_back("constant");
+	CHECK(names[handle].name == "constant");
+	CHECK(names.emplace_with_handle(ConstantHandle{ handle.id + 10 }, "loaded").name == "loaded");
+}
+
+TEST_CASE("Value pool elements are not visited by reverse iteration")
+{
+	FlatValueMap<PooledHandle, PooledType> fvm{};
+	fvm.enable_value_pool();
+	std::vector<PooledHandle> handles;
+	for (int i = 0; i < 5; ++i) {
+		handles.push_back(fvm.push_back(PooledType{ std::string(1, 'a' + static_cast<char>(i)), {} }));
+	}
+	fvm.erase(handles[4]);
+	fvm.erase(handles[0]);
+	REQUIRE(fvm.pooled_count() == 2);
+
+	CHECK(std::distance(fvm.rbegin(), fvm.rend()) == 3);
+	CHECK(std::distance(fvm.crbegin(), fvm.crend()) == 3);
+	const auto& const_fvm = fvm;
+	std::string reversed;
+	for (auto it = const_fvm.rbegin(); it != const_fvm.rend(); ++it) {
+		reversed += it->name;
+	}
+	CHECK(reversed == "cbd");
+}